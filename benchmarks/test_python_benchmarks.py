@@ -0,0 +1,129 @@
+"""
+Throughput benchmarks of the Python entry points, for pytest-benchmark.
+
+Run them with
+
+    pytest benchmarks --benchmark-json=before.json
+
+and compare two runs, e.g. before and after an upgrade, with
+
+    pytest benchmarks --benchmark-compare=before.json \
+        --benchmark-compare-fail=mean:10%
+
+which fails if any benchmark got more than 10% slower. They live outside
+tests/ so that the regular test runs stay fast. The C++ stages are measured by
+the regression_benchmark target, see README.md.
+"""
+
+import numpy as np
+import pytest
+import zimtohrli_py as zimtohrli
+
+pytest.importorskip("pytest_benchmark")
+
+SAMPLE_RATE = 48000
+
+# Clip lengths in seconds. The unconstrained time alignment grows
+# quadratically, so the longest clips are only compared within a band.
+SECONDS = [1, 10, 60]
+BANDED_SECONDS = [1, 10, 60, 600]
+# The alignment drift the banded comparisons allow.
+MAX_DRIFT_SECONDS = 1.0
+
+
+def _signals(seconds, sample_rate=SAMPLE_RATE, num_channels=1):
+    """Returns a white noise clip and a slightly noisier copy of it."""
+    rng = np.random.default_rng(1)
+    shape = (int(seconds * sample_rate),) + (
+        (num_channels,) if num_channels > 1 else ())
+    reference = rng.uniform(-0.5, 0.5, shape).astype(np.float32)
+    degraded = (reference +
+                rng.uniform(-0.05, 0.05, shape)).astype(np.float32)
+    return reference, degraded
+
+
+def _run(benchmark, seconds, function, *args, **kwargs):
+    """Benchmarks function, with fewer rounds for longer clips."""
+    benchmark.extra_info["audio_seconds"] = seconds
+    return benchmark.pedantic(function, args=args, kwargs=kwargs,
+                              rounds=max(3, 30 // seconds), iterations=1,
+                              warmup_rounds=1 if seconds <= 10 else 0)
+
+
+@pytest.mark.parametrize("seconds", SECONDS)
+def test_compare_audio(benchmark, seconds):
+    reference, degraded = _signals(seconds)
+    distance = _run(benchmark, seconds, zimtohrli.compare_audio, reference,
+                    SAMPLE_RATE, degraded, SAMPLE_RATE, return_distance=True)
+    assert 0 <= distance <= 1
+
+
+@pytest.mark.parametrize("seconds", SECONDS)
+def test_compare_audio_resampled(benchmark, seconds):
+    reference, degraded = _signals(seconds, sample_rate=44100)
+    distance = _run(benchmark, seconds, zimtohrli.compare_audio, reference,
+                    44100, degraded, 44100, return_distance=True)
+    assert 0 <= distance <= 1
+
+
+@pytest.mark.parametrize("seconds", BANDED_SECONDS)
+def test_comparator_compare(benchmark, seconds):
+    comparator = zimtohrli.ZimtohrliComparator(
+        dtw_max_drift_seconds=MAX_DRIFT_SECONDS)
+    reference, degraded = _signals(seconds)
+    distance = _run(benchmark, seconds, comparator.compare, reference,
+                    degraded, return_distance=True)
+    assert 0 <= distance <= 1
+
+
+@pytest.mark.parametrize("seconds", BANDED_SECONDS)
+def test_comparator_analyze(benchmark, seconds):
+    comparator = zimtohrli.ZimtohrliComparator()
+    reference, _ = _signals(seconds)
+    spectrogram = _run(benchmark, seconds, comparator.analyze, reference)
+    assert spectrogram.num_steps > 0
+
+
+@pytest.mark.parametrize("num_threads", [1, 4])
+def test_compare_audio_batch(benchmark, num_threads):
+    pairs = [_signals(5) for _ in range(8)]
+    distances = _run(benchmark, 5 * len(pairs),
+                     zimtohrli.compare_audio_batch,
+                     [reference for reference, _ in pairs],
+                     [degraded for _, degraded in pairs], SAMPLE_RATE,
+                     num_threads=num_threads, return_distance=True)
+    assert len(distances) == len(pairs)
+
+
+@pytest.mark.parametrize("num_threads", [1, 4])
+def test_compare_audio_one_to_many(benchmark, num_threads):
+    reference, degraded = _signals(5)
+    degs = [degraded] * 8
+    distances = _run(benchmark, 5 * len(degs),
+                     zimtohrli.compare_audio_one_to_many, reference,
+                     SAMPLE_RATE, degs, num_threads=num_threads,
+                     return_distance=True)
+    assert len(distances) == len(degs)
+
+
+@pytest.mark.parametrize("seconds", SECONDS)
+def test_compare_audio_channels(benchmark, seconds):
+    reference, degraded = _signals(seconds, num_channels=2)
+    comparison = _run(benchmark, 2 * seconds,
+                      zimtohrli.compare_audio_channels, reference,
+                      SAMPLE_RATE, degraded, SAMPLE_RATE, channel_axis=1)
+    assert len(comparison.channel_distances) == 2
+
+
+@pytest.mark.parametrize("seconds", SECONDS)
+def test_streaming_analyzer(benchmark, seconds):
+    reference, _ = _signals(seconds)
+    chunks = np.array_split(reference, max(1, len(reference) // 4800))
+
+    def analyze():
+        analyzer = zimtohrli.StreamingAnalyzer()
+        for chunk in chunks:
+            analyzer.push(chunk)
+        return analyzer.finish()
+
+    _run(benchmark, seconds, analyze)
@@ -2,6 +2,11 @@
 Test suite for Zimtohrli Python package core functionality.
 """
 
+import asyncio
+import os
+import time
+from concurrent.futures import ThreadPoolExecutor
+
 import numpy as np
 import pytest
 import zimtohrli_py as zimtohrli
@@ -114,9 +119,492 @@ class TestZimtohrliComparator:
     
     def test_comparator_analyze(self):
         """Test spectrogram analysis."""
-        spec_data = self.comparator.analyze(self.sine_1khz)
-        assert isinstance(spec_data, bytes)
-        assert len(spec_data) > 0
+        spec = self.comparator.analyze(self.sine_1khz)
+        assert isinstance(spec, zimtohrli.Spectrogram)
+        assert spec.num_steps > 0
+        assert spec.num_dims == self.comparator.num_rotators
+        
+        values = np.asarray(spec)
+        assert values.shape == (spec.num_steps, spec.num_dims)
+        assert values.dtype == np.float32
+        assert not values.flags['WRITEABLE']
+        assert np.all(np.isfinite(values))
+    
+    def test_comparator_analyze_zero_copy(self):
+        """Test that spectrogram views share memory with the spectrogram."""
+        spec = self.comparator.analyze(self.sine_1khz)
+        values = np.asarray(spec)
+        assert np.shares_memory(values, np.asarray(spec))
+        assert np.shares_memory(values, np.asarray(spec.values))
+        del spec
+        # The view keeps the spectrogram alive.
+        assert np.all(np.isfinite(values))
+    
+    def test_comparator_compare_spectrograms(self):
+        """Test comparing precomputed spectrograms."""
+        expected = self.comparator.compare(
+            self.sine_1khz, self.sine_440hz, return_distance=True)
+        spec_a = self.comparator.analyze(self.sine_1khz)
+        spec_b = self.comparator.analyze(self.sine_440hz)
+        assert self.comparator.compare(
+            spec_a, spec_b, return_distance=True) == expected
+        assert self.comparator.compare(
+            spec_a, self.sine_440hz, return_distance=True) == expected
+        assert self.comparator.compare(
+            self.sine_1khz, spec_b, return_distance=True) == expected
+    
+    def test_spectrogram_from_array(self):
+        """Test creating a spectrogram from a numpy array."""
+        spec = self.comparator.analyze(self.sine_1khz)
+        copy = zimtohrli.Spectrogram(np.asarray(spec))
+        np.testing.assert_array_equal(np.asarray(copy), np.asarray(spec))
+        assert self.comparator.compare(copy, spec, return_distance=True) == 0
+        
+        with pytest.raises(TypeError):
+            zimtohrli.Spectrogram(np.zeros(10, dtype=np.float32))
+        with pytest.raises(TypeError):
+            copy.__init__(np.asarray(spec))
+        with pytest.raises(TypeError):
+            self.comparator.compare(
+                zimtohrli.Spectrogram(np.ones((4, 3), dtype=np.float32)), spec)
+    
+    def test_distance_map(self):
+        """Test that the distance map explains the distance of compare()."""
+        expected = self.comparator.compare(
+            self.sine_1khz, self.sine_440hz, return_distance=True)
+        dmap = self.comparator.distance_map(self.sine_1khz, self.sine_440hz)
+        assert dmap.distance == expected
+        assert dmap.mos == zimtohrli.zimtohrli_distance_to_mos(expected)
+        
+        num_pairs = len(dmap.time_pairs)
+        assert dmap.time_pairs.shape == (num_pairs, 2)
+        assert dmap.time_pairs.dtype == np.int64
+        assert dmap.scores.shape == (num_pairs, self.comparator.num_rotators)
+        assert dmap.scores.dtype == np.float32
+        assert not dmap.scores.flags['WRITEABLE']
+        np.testing.assert_array_equal(dmap.time_pairs[0], [0, 0])
+        assert np.all(np.diff(dmap.time_pairs, axis=0) >= 0)
+        np.testing.assert_allclose(1 - dmap.scores.mean(), expected, atol=1e-4)
+        
+        # Precomputed spectrograms give the same map.
+        spec_a = self.comparator.analyze(self.sine_1khz)
+        same = self.comparator.distance_map(spec_a, self.sine_440hz)
+        np.testing.assert_array_equal(same.time_pairs, dmap.time_pairs)
+        np.testing.assert_array_equal(same.scores, dmap.scores)
+    
+    def test_distance_map_locates_differences(self):
+        """Test that the distance map is worst where the signals differ."""
+        rng = np.random.default_rng(4)
+        t = np.arange(3 * self.sample_rate, dtype=np.float32) / self.sample_rate
+        ref = (np.sin(2 * np.pi * 440 * t) * 0.3).astype(np.float32)
+        deg = ref.copy()
+        deg[self.sample_rate:self.sample_rate + 9600] += rng.normal(
+            0, 0.1, 9600).astype(np.float32)
+        dmap = self.comparator.distance_map(ref, deg)
+        per_step = 1 - dmap.scores.mean(axis=1)
+        worst_seconds = dmap.time_pairs[np.argmax(per_step), 0] * 571 / 48000
+        assert 1.0 <= worst_seconds <= 1.4
+
+
+def _delayed_noise():
+    """Return 48 kHz enveloped noise and a slightly noisy copy delayed 50 ms."""
+    rng = np.random.default_rng(0)
+    sample_rate = 48000
+    envelope = np.repeat(rng.uniform(0.1, 1.0, 40), sample_rate // 10)
+    noise = rng.uniform(-0.3, 0.3, len(envelope)) * envelope
+    delay = sample_rate // 20  # 50 ms
+    reference = noise[delay:].astype(np.float32)
+    delayed = (noise[:-delay] +
+               rng.uniform(-0.01, 0.01, len(noise) - delay)).astype(np.float32)
+    return reference, delayed
+
+
+class TestBandedDTW:
+    """Test the banded time warp of ZimtohrliComparator."""
+    
+    def setup_method(self):
+        """Set up test fixtures."""
+        self.reference, self.delayed = _delayed_noise()
+    
+    def test_default_is_unconstrained(self):
+        """Test that the comparator doesn't limit the time warp by default."""
+        comparator = zimtohrli.ZimtohrliComparator()
+        assert comparator.dtw_band_radius == 0
+        assert comparator.dtw_max_drift_seconds == 0
+    
+    def test_wide_band_matches_full(self):
+        """Test that a band covering the drift gives the unconstrained result."""
+        full = zimtohrli.ZimtohrliComparator().compare(
+            self.reference, self.delayed, return_distance=True)
+        for comparator in [
+                zimtohrli.ZimtohrliComparator(dtw_band_radius=100),
+                zimtohrli.ZimtohrliComparator(dtw_max_drift_seconds=1.0)]:
+            banded = comparator.compare(
+                self.reference, self.delayed, return_distance=True)
+            assert banded == full
+    
+    def test_narrow_band(self):
+        """Test that a band narrower than the drift still gives a valid result."""
+        comparator = zimtohrli.ZimtohrliComparator(dtw_band_radius=1)
+        distance = comparator.compare(
+            self.reference, self.delayed, return_distance=True)
+        assert 0 <= distance <= 1
+    
+    def test_invalid_band(self):
+        """Test that negative band parameters are rejected."""
+        with pytest.raises(ValueError):
+            zimtohrli.ZimtohrliComparator(dtw_band_radius=-1)
+        with pytest.raises(ValueError):
+            zimtohrli.ZimtohrliComparator(dtw_max_drift_seconds=-0.5)
+        with pytest.raises(ValueError):
+            zimtohrli.ZimtohrliComparator(dtw_multiresolution_radius=-1)
+        with pytest.raises(ValueError):
+            zimtohrli.ZimtohrliComparator(dtw_precision="float64")
+
+    def test_multiresolution(self):
+        """Test that the multiresolution time warp is close to the full one."""
+        full = zimtohrli.ZimtohrliComparator()
+        assert full.dtw_multiresolution_radius == 0
+        multiresolution = zimtohrli.ZimtohrliComparator(
+            dtw_multiresolution_radius=4)
+        assert multiresolution.dtw_multiresolution_radius == 4
+        for reference, degraded in [(self.reference, self.delayed),
+                                    (self.reference, self.reference)]:
+            full_distance = full.compare(
+                reference, degraded, return_distance=True)
+            multiresolution_distance = multiresolution.compare(
+                reference, degraded, return_distance=True)
+            assert abs(multiresolution_distance - full_distance) < 5e-3
+
+    def test_dtw_precision(self):
+        """Test that half precision time warps are close to the exact one."""
+        exact = zimtohrli.ZimtohrliComparator()
+        assert exact.dtw_precision == "float32"
+        for precision in ["float16", "bfloat16"]:
+            compact = zimtohrli.ZimtohrliComparator(dtw_precision=precision)
+            assert compact.dtw_precision == precision
+            for reference, degraded in [(self.reference, self.delayed),
+                                        (self.reference, self.reference)]:
+                exact_distance = exact.compare(
+                    reference, degraded, return_distance=True)
+                compact_distance = compact.compare(
+                    reference, degraded, return_distance=True)
+                assert abs(compact_distance - exact_distance) < 1e-3
+
+    def test_fast_math(self):
+        """Test that fast math gives about the same result as exact math."""
+        exact = zimtohrli.ZimtohrliComparator()
+        assert not exact.fast_math
+        fast = zimtohrli.ZimtohrliComparator(fast_math=True)
+        assert fast.fast_math
+        for reference, degraded in [(self.reference, self.delayed),
+                                    (self.reference, self.reference)]:
+            exact_distance = exact.compare(
+                reference, degraded, return_distance=True)
+            fast_distance = fast.compare(
+                reference, degraded, return_distance=True)
+            assert abs(fast_distance - exact_distance) < 1e-3
+
+    def test_parallel_dtw(self):
+        """Test that the parallel time warp gives exactly the serial result."""
+        serial = zimtohrli.ZimtohrliComparator()
+        assert serial.dtw_num_threads == 1
+        expected = serial.compare(
+            self.reference, self.delayed, return_distance=True)
+        for num_threads in [0, 2, 3]:
+            comparator = zimtohrli.ZimtohrliComparator(
+                dtw_num_threads=num_threads)
+            assert comparator.dtw_num_threads == num_threads
+            for _ in range(3):
+                assert comparator.compare(
+                    self.reference, self.delayed,
+                    return_distance=True) == expected
+        with pytest.raises(ValueError):
+            zimtohrli.ZimtohrliComparator(dtw_num_threads=-1)
+
+
+class TestSegmentedMode:
+    """Test the segmented mode of ZimtohrliComparator."""
+
+    def setup_method(self):
+        """Set up test fixtures."""
+        self.reference, self.delayed = _delayed_noise()
+        self.whole = zimtohrli.ZimtohrliComparator()
+
+    def test_default_is_whole(self):
+        """Test that the comparator doesn't segment signals by default."""
+        assert self.whole.segment_seconds == 0
+
+    def test_matches_whole(self):
+        """Test that segments give about the whole-signal result."""
+        comparator = zimtohrli.ZimtohrliComparator(
+            segment_seconds=1.0, segment_overlap_seconds=0.5)
+        assert comparator.segment_seconds == 1.0
+        assert comparator.segment_overlap_seconds == 0.5
+        np.testing.assert_allclose(
+            np.asarray(comparator.analyze(self.reference)),
+            np.asarray(self.whole.analyze(self.reference)), rtol=1e-4)
+        expected = self.whole.compare(
+            self.reference, self.delayed, return_distance=True)
+        distance = comparator.compare(
+            self.reference, self.delayed, return_distance=True)
+        assert distance == pytest.approx(expected, rel=1e-2)
+
+    def test_threads_do_not_matter(self):
+        """Test that the result doesn't depend on the number of threads."""
+        results = []
+        for num_threads in [1, 2, 0]:
+            comparator = zimtohrli.ZimtohrliComparator(
+                segment_seconds=1.0, segment_num_threads=num_threads)
+            assert comparator.segment_num_threads == num_threads
+            results.append(comparator.compare(
+                self.reference, self.delayed, return_distance=True))
+        assert results[0] == results[1] == results[2]
+
+    def test_short_signals_are_whole(self):
+        """Test that signals shorter than a segment are processed whole."""
+        comparator = zimtohrli.ZimtohrliComparator(segment_seconds=10.0)
+        assert comparator.compare(
+            self.reference, self.delayed, return_distance=True) == \
+            self.whole.compare(
+                self.reference, self.delayed, return_distance=True)
+
+    def test_invalid_segments(self):
+        """Test that negative segment parameters are rejected."""
+        with pytest.raises(ValueError):
+            zimtohrli.ZimtohrliComparator(segment_seconds=-1.0)
+        with pytest.raises(ValueError):
+            zimtohrli.ZimtohrliComparator(segment_overlap_seconds=-1.0)
+        with pytest.raises(ValueError):
+            zimtohrli.ZimtohrliComparator(segment_num_threads=-1)
+
+
+class TestResampleQuality:
+    """Test the selectable resampling quality."""
+
+    def setup_method(self):
+        """Set up test fixtures."""
+        rng = np.random.default_rng(0)
+        self.sample_rate = 44100
+        t = np.arange(self.sample_rate // 2) / self.sample_rate
+        self.reference = (0.5 * np.sin(2 * np.pi * 440 * t)).astype(np.float32)
+        self.degraded = (self.reference + rng.uniform(
+            -0.01, 0.01, len(t))).astype(np.float32)
+
+    def distance(self, **kwargs):
+        return zimtohrli.compare_audio(
+            self.reference, self.sample_rate, self.degraded, self.sample_rate,
+            return_distance=True, **kwargs)
+
+    def test_default_is_very_high(self):
+        """Test that the default quality is the most accurate one."""
+        assert zimtohrli.ZimtohrliComparator().resample_quality == "very_high"
+        assert self.distance() == self.distance(resample_quality="very_high")
+
+    def test_qualities_are_close(self):
+        """Test that all qualities give about the same distance."""
+        expected = self.distance()
+        for quality in zimtohrli.RESAMPLE_QUALITIES:
+            distance = self.distance(resample_quality=quality)
+            assert distance == pytest.approx(expected, rel=0.1, abs=1e-4)
+
+    def test_threads_do_not_matter(self):
+        """Test that the number of soxr threads doesn't change results."""
+        assert self.distance(resample_num_threads=4) == self.distance()
+        assert self.distance(resample_num_threads=0) == self.distance()
+
+    def test_apis_agree(self):
+        """Test that all APIs resample with the requested quality."""
+        options = {"resample_quality": "quick", "resample_num_threads": 2}
+        expected = self.distance(**options)
+        batch = zimtohrli.compare_audio_batch(
+            [self.reference], [self.degraded], self.sample_rate,
+            return_distance=True, **options)
+        one_to_many = zimtohrli.compare_audio_one_to_many(
+            self.reference, self.sample_rate, [self.degraded],
+            return_distance=True, **options)
+        comparator = zimtohrli.ZimtohrliComparator(**options)
+        assert comparator.resample_quality == "quick"
+        assert comparator.resample_num_threads == 2
+        assert batch[0] == pytest.approx(expected, rel=1e-6)
+        assert one_to_many[0] == pytest.approx(expected, rel=1e-6)
+        assert comparator.compare(
+            self.reference, self.degraded, return_distance=True,
+            sample_rate_a=self.sample_rate,
+            sample_rate_b=self.sample_rate) == pytest.approx(expected, rel=1e-6)
+        spectrogram = comparator.analyze(self.reference, self.sample_rate)
+        assert comparator.compare(
+            spectrogram, self.degraded, return_distance=True,
+            sample_rate_b=self.sample_rate) == pytest.approx(expected, rel=1e-6)
+
+    def test_invalid_options(self):
+        """Test that unknown qualities and negative threads are rejected."""
+        with pytest.raises(ValueError):
+            self.distance(resample_quality="best")
+        with pytest.raises(ValueError):
+            self.distance(resample_num_threads=-1)
+        with pytest.raises(ValueError):
+            zimtohrli.ZimtohrliComparator(resample_quality="best")
+        with pytest.raises(ValueError):
+            zimtohrli.compare_audio_batch(
+                [self.reference], [self.degraded], self.sample_rate,
+                resample_quality="best")
+
+
+class TestSpectrogramCache:
+    """Test the on-disk spectrogram cache of ZimtohrliComparator."""
+
+    def setup_method(self):
+        """Set up test fixtures."""
+        rng = np.random.default_rng(0)
+        self.reference = rng.uniform(-0.3, 0.3, 48000).astype(np.float32)
+        self.degraded = (self.reference + rng.uniform(
+            -0.01, 0.01, 48000)).astype(np.float32)
+        self.expected = zimtohrli.ZimtohrliComparator().compare(
+            self.reference, self.degraded, return_distance=True)
+
+    def test_hits_match_analysis(self, tmp_path):
+        """Test that cached spectrograms give the same distance."""
+        comparator = zimtohrli.ZimtohrliComparator(cache_dir=tmp_path)
+        assert comparator.cache_dir == str(tmp_path)
+        assert comparator.cache_stats() == zimtohrli.CacheStats(0, 0)
+        for _ in range(3):
+            assert comparator.compare(
+                self.reference, self.degraded,
+                return_distance=True) == self.expected
+        assert comparator.cache_stats() == zimtohrli.CacheStats(4, 2)
+        # Other comparators with the same parameters share the entries.
+        other = zimtohrli.ZimtohrliComparator(cache_dir=tmp_path)
+        spectrogram = other.analyze(self.reference)
+        assert other.cache_stats() == zimtohrli.CacheStats(1, 0)
+        assert np.array_equal(
+            np.asarray(spectrogram),
+            np.asarray(zimtohrli.ZimtohrliComparator().analyze(
+                self.reference)))
+
+    def test_parameters_key_entries(self, tmp_path):
+        """Test that other analysis or resampling parameters miss."""
+        zimtohrli.ZimtohrliComparator(cache_dir=tmp_path).analyze(
+            self.reference, 44100)
+        for comparator in [
+                zimtohrli.ZimtohrliComparator(cache_dir=tmp_path,
+                                              segment_seconds=0.5),
+                zimtohrli.ZimtohrliComparator(cache_dir=tmp_path,
+                                              resample_quality="quick"),
+                zimtohrli.ZimtohrliComparator(cache_dir=tmp_path,
+                                              perceptual_sample_rate=50)]:
+            comparator.analyze(self.reference, 44100)
+            assert comparator.cache_stats() == zimtohrli.CacheStats(0, 1)
+        # The NSIM windows don't change the spectrograms.
+        comparator = zimtohrli.ZimtohrliComparator(cache_dir=tmp_path,
+                                                   nsim_step_window=3)
+        comparator.analyze(self.reference, 44100)
+        assert comparator.cache_stats() == zimtohrli.CacheStats(1, 0)
+
+    @pytest.mark.parametrize("dtype", ["float16", "bfloat16"])
+    def test_half_precision(self, tmp_path, dtype):
+        """Test that half precision entries give about the same distance."""
+        comparator = zimtohrli.ZimtohrliComparator(cache_dir=tmp_path,
+                                                   cache_dtype=dtype)
+        first = comparator.compare(self.reference, self.degraded,
+                                   return_distance=True)
+        second = comparator.compare(self.reference, self.degraded,
+                                    return_distance=True)
+        assert comparator.cache_stats() == zimtohrli.CacheStats(2, 2)
+        assert first == second
+        assert first == pytest.approx(self.expected, rel=0.1, abs=1e-5)
+
+    def test_damaged_entries_are_misses(self, tmp_path):
+        """Test that truncated entries are analyzed again."""
+        comparator = zimtohrli.ZimtohrliComparator(cache_dir=tmp_path)
+        comparator.analyze(self.reference)
+        for entry in tmp_path.glob("*/*.zspec"):
+            entry.write_bytes(entry.read_bytes()[:100])
+        spectrogram = comparator.analyze(self.reference)
+        assert comparator.cache_stats() == zimtohrli.CacheStats(0, 2)
+        assert spectrogram.num_steps > 0
+
+    def test_invalid_dtype(self, tmp_path):
+        """Test that unknown cache dtypes are rejected."""
+        with pytest.raises(ValueError):
+            zimtohrli.ZimtohrliComparator(cache_dir=tmp_path,
+                                          cache_dtype="int8")
+
+
+class TestMultichannel:
+    """Test comparing multichannel signals channel by channel."""
+
+    def setup_method(self):
+        """Set up test fixtures."""
+        rng = np.random.default_rng(0)
+        t = np.arange(24000) / 48000
+        self.reference = np.stack([
+            0.5 * np.sin(2 * np.pi * 440 * t),
+            rng.uniform(-0.3, 0.3, len(t)),
+        ]).astype(np.float32)
+        self.degraded = (self.reference + rng.uniform(
+            -0.05, 0.05, self.reference.shape) * [[0.2], [1.0]]
+        ).astype(np.float32)
+        self.comparator = zimtohrli.ZimtohrliComparator()
+
+    def channel_distances(self, sample_rate):
+        return [self.comparator.compare(
+            self.reference[channel].copy(), self.degraded[channel].copy(),
+            return_distance=True, sample_rate_a=sample_rate,
+            sample_rate_b=sample_rate) for channel in range(2)]
+
+    def test_matches_single_channels(self):
+        """Test that each channel scores like comparing it on its own."""
+        for sample_rate in [48000, 44100]:
+            expected = self.channel_distances(sample_rate)
+            planar = self.comparator.compare_channels(
+                self.reference, self.degraded,
+                sample_rate_a=sample_rate, sample_rate_b=sample_rate)
+            interleaved = self.comparator.compare_channels(
+                self.reference.T.copy(), self.degraded.T.copy(),
+                channel_axis=-1, sample_rate_a=sample_rate,
+                sample_rate_b=sample_rate)
+            np.testing.assert_allclose(planar.channel_distances, expected,
+                                       rtol=1e-6)
+            np.testing.assert_allclose(interleaved.channel_distances,
+                                       expected, rtol=1e-5)
+            assert planar.channel_distances[0] < planar.channel_distances[1]
+
+    def test_aggregation(self):
+        """Test that the channel distances are aggregated as requested."""
+        for aggregation, function in [("mean", np.mean), ("min", np.min),
+                                      ("max", np.max)]:
+            result = zimtohrli.compare_audio_channels(
+                self.reference, 48000, self.degraded, 48000,
+                aggregation=aggregation, num_threads=2)
+            assert result.distance == pytest.approx(
+                function(result.channel_distances))
+            assert result.mos == pytest.approx(
+                zimtohrli.zimtohrli_distance_to_mos(result.distance))
+            assert len(result.channel_mos) == 2
+
+    def test_mono(self):
+        """Test that 1-dimensional arrays are compared as one channel."""
+        result = self.comparator.compare_channels(
+            self.reference[0], self.degraded[0])
+        assert result.channel_distances.shape == (1,)
+        assert result.distance == self.comparator.compare(
+            self.reference[0], self.degraded[0], return_distance=True)
+
+    def test_input_validation(self):
+        """Test that mismatched and invalid inputs are rejected."""
+        with pytest.raises(ValueError):
+            self.comparator.compare_channels(self.reference,
+                                             self.degraded[:1])
+        with pytest.raises(ValueError):
+            self.comparator.compare_channels(self.reference, self.degraded,
+                                             aggregation="median")
+        with pytest.raises(ValueError):
+            self.comparator.compare_channels(self.reference, self.degraded,
+                                             channel_axis=2)
+        with pytest.raises(ValueError):
+            self.comparator.compare_channels(
+                self.reference[np.newaxis], self.degraded[np.newaxis])
 
 
 class TestUtilityFunctions:
@@ -187,6 +675,565 @@ class TestEdgeCases:
         mos = zimtohrli.compare_audio(audio_orig, sample_rate, audio_non_contig, sample_rate)
         assert mos > 4.5, "Same signal should have high MOS regardless of contiguity"
 
+    def test_pcm_arrays(self):
+        """Test that int16 and int32 arrays are read as PCM."""
+        rng = np.random.default_rng(0)
+        t = np.arange(24000) / 48000
+        reference = 0.5 * np.sin(2 * np.pi * 440 * t)
+        degraded = reference + rng.uniform(-0.01, 0.01, len(t))
+        for dtype, full_scale in [(np.int16, 2**15), (np.int32, 2**31)]:
+            pcm_a = np.round(reference * (full_scale - 1)).astype(dtype)
+            pcm_b = np.round(degraded * (full_scale - 1)).astype(dtype)
+            float_a = (pcm_a / full_scale).astype(np.float32)
+            float_b = (pcm_b / full_scale).astype(np.float32)
+            for sample_rate in [48000, 44100]:
+                expected = zimtohrli.compare_audio(
+                    float_a, sample_rate, float_b, sample_rate,
+                    return_distance=True)
+                distance = zimtohrli.compare_audio(
+                    pcm_a, sample_rate, pcm_b, sample_rate,
+                    return_distance=True)
+                assert distance == pytest.approx(expected, rel=1e-5)
+                batch = zimtohrli.compare_audio_batch(
+                    [pcm_a], [pcm_b], sample_rate, return_distance=True)
+                assert batch[0] == pytest.approx(expected, rel=1e-5)
+
+    def test_strided_arrays(self):
+        """Test that strided arrays give the same results as contiguous ones."""
+        rng = np.random.default_rng(0)
+        stereo = rng.uniform(-0.5, 0.5, (24000, 2)).astype(np.float32)
+        left, right = stereo[:, 0], stereo[:, 1]
+        assert not left.flags['C_CONTIGUOUS']
+        for sample_rate in [48000, 44100]:
+            expected = zimtohrli.compare_audio(
+                left.copy(), sample_rate, right.copy(), sample_rate,
+                return_distance=True)
+            assert zimtohrli.compare_audio(
+                left, sample_rate, right, sample_rate,
+                return_distance=True) == expected
+            assert zimtohrli.compare_audio_batch(
+                [left], [right], sample_rate,
+                return_distance=True)[0] == pytest.approx(expected, rel=1e-6)
+        comparator = zimtohrli.ZimtohrliComparator()
+        np.testing.assert_array_equal(
+            np.asarray(comparator.analyze(left[::-1])),
+            np.asarray(comparator.analyze(left[::-1].copy())))
+
+    def test_unsupported_dtypes(self):
+        """Test that integer arrays that aren't PCM are rejected."""
+        audio = np.zeros(4800, dtype=np.uint8)
+        with pytest.raises(ValueError):
+            zimtohrli.compare_audio(audio, 48000, audio, 48000)
+        with pytest.raises(ValueError):
+            zimtohrli.compare_audio_batch([audio], [audio], 48000)
+
+
+
+class TestBatchAPI:
+    """Test compare_audio_batch."""
+    
+    def setup_method(self):
+        """Set up test fixtures."""
+        self.sample_rate = 48000
+        t = np.arange(self.sample_rate // 2, dtype=np.float32) / self.sample_rate
+        self.refs = [(np.sin(2 * np.pi * f * t) * 0.5).astype(np.float32) for f in (440, 1000, 2000)]
+        self.degs = [np.roll(ref, 7) for ref in self.refs[1:]] + [self.refs[0] * 0.5]
+    
+    def test_batch_matches_single_comparisons(self):
+        """Test that batch results equal individual compare_audio calls."""
+        expected = [zimtohrli.compare_audio(ref, self.sample_rate, deg, self.sample_rate)
+                    for ref, deg in zip(self.refs, self.degs)]
+        scores = zimtohrli.compare_audio_batch(self.refs, self.degs, self.sample_rate, num_threads=2)
+        assert isinstance(scores, np.ndarray)
+        assert scores.dtype == np.float32
+        assert scores.shape == (len(self.refs),)
+        np.testing.assert_allclose(scores, expected, rtol=1e-6)
+        
+        distances = zimtohrli.compare_audio_batch(self.refs, self.degs, self.sample_rate,
+                                                  return_distance=True)
+        expected = [zimtohrli.compare_audio(ref, self.sample_rate, deg, self.sample_rate,
+                                            return_distance=True)
+                    for ref, deg in zip(self.refs, self.degs)]
+        np.testing.assert_allclose(distances, expected, rtol=1e-6)
+    
+    def test_batch_per_pair_sample_rates(self):
+        """Test per-pair sample rates with resampling."""
+        ref_16k = self.refs[0][::3].copy()
+        scores = zimtohrli.compare_audio_batch([ref_16k, self.refs[1]], [ref_16k, self.degs[0]],
+                                               [16000, self.sample_rate])
+        expected = zimtohrli.compare_audio(ref_16k, 16000, ref_16k, 16000)
+        np.testing.assert_allclose(scores[0], expected, rtol=1e-6)
+    
+    def test_batch_input_validation(self):
+        """Test batch input validation."""
+        with pytest.raises(ValueError):
+            zimtohrli.compare_audio_batch(self.refs, self.degs[:1], self.sample_rate)
+        with pytest.raises(ValueError):
+            zimtohrli.compare_audio_batch(self.refs, self.degs, [self.sample_rate])
+        with pytest.raises(ValueError):
+            zimtohrli.compare_audio_batch(self.refs, self.degs, -1)
+        with pytest.raises(ValueError):
+            zimtohrli.compare_audio_batch(self.refs, self.degs, self.sample_rate, num_threads=0)
+        assert len(zimtohrli.compare_audio_batch([], [], self.sample_rate)) == 0
+    
+    def test_identical_pairs_skip_time_warp(self):
+        """Test that identical pairs are counted and keep their distance."""
+        zimtohrli.get_distance_stats(reset=True)
+        refs = self.refs + self.refs
+        degs = [ref.copy() for ref in self.refs] + self.degs
+        distances = zimtohrli.compare_audio_batch(refs, degs, self.sample_rate,
+                                                  return_distance=True)
+        stats = zimtohrli.get_distance_stats()
+        assert stats == zimtohrli.DistanceStats(time_warps=6, identical=3)
+        np.testing.assert_array_equal(distances[:3], 0)
+        assert np.all(distances[3:] > 0)
+        assert zimtohrli.get_distance_stats(reset=True) == stats
+        assert zimtohrli.get_distance_stats() == (0, 0)
+
+    def test_profile(self):
+        """Test that the batch profile sums the profiles of the pairs."""
+        distance, profile = zimtohrli.compare_audio(
+            self.refs[1], self.sample_rate, self.degs[0], self.sample_rate,
+            return_distance=True, profile=True)
+        assert distance == zimtohrli.compare_audio(
+            self.refs[1], self.sample_rate, self.degs[0], self.sample_rate,
+            return_distance=True)
+        assert profile["num_comparisons"] == 1
+        assert profile["analyze_calls"] == 2
+        assert profile["dtw_calls"] == profile["nsim_calls"] == 1
+        assert profile["resample_calls"] == profile["resampled_samples"] == 0
+        assert profile["analyzed_samples"] == 2 * len(self.refs[1])
+        assert profile["dtw_cells"] > 0 and profile["dtw_cost_bytes"] > 0
+        assert profile["nsim_cells"] > 0
+        assert 0 < profile["analyze_seconds"] <= profile["wall_seconds"]
+
+        refs = [self.refs[1]] * 4
+        degs = [self.degs[0]] * 4
+        distances, batch_profile = zimtohrli.compare_audio_batch(
+            refs, degs, self.sample_rate, num_threads=2,
+            return_distance=True, profile=True)
+        np.testing.assert_array_equal(distances, np.float32(distance))
+        assert batch_profile["num_comparisons"] == 4
+        for key in ("analyze_calls", "dtw_calls", "nsim_calls",
+                    "analyzed_samples", "dtw_cells", "dtw_cost_bytes",
+                    "nsim_cells"):
+            assert batch_profile[key] == 4 * profile[key], key
+
+        _, resampled = zimtohrli.compare_audio(
+            self.refs[0][::3].copy(), 16000, self.refs[0][::3].copy(), 16000,
+            profile=True)
+        assert resampled["resample_calls"] == 2
+        assert resampled["resampled_samples"] == 2 * len(self.refs[0][::3])
+
+class TestOneToManyAPI:
+    """Test compare_audio_one_to_many."""
+    
+    def setup_method(self):
+        """Set up test fixtures."""
+        self.sample_rate = 48000
+        rng = np.random.default_rng(1)
+        t = np.arange(self.sample_rate // 2, dtype=np.float32) / self.sample_rate
+        self.reference = (np.sin(2 * np.pi * 440 * t) * 0.5).astype(np.float32)
+        self.degs = [
+            (self.reference + rng.normal(0, level, self.reference.shape)).astype(np.float32)
+            for level in (0.001, 0.01, 0.1)
+        ] + [self.reference * 0.25]
+    
+    def test_matches_pairwise_comparisons(self):
+        """Test that sharing the reference analysis doesn't change results."""
+        expected = [zimtohrli.compare_audio(self.reference, self.sample_rate, deg, self.sample_rate,
+                                            return_distance=True)
+                    for deg in self.degs]
+        distances = zimtohrli.compare_audio_one_to_many(self.reference, self.sample_rate, self.degs,
+                                                        return_distance=True, num_threads=2)
+        assert distances.dtype == np.float32
+        assert distances.shape == (len(self.degs),)
+        np.testing.assert_array_equal(distances, np.float32(expected))
+        
+        scores = zimtohrli.compare_audio_one_to_many(self.reference, self.sample_rate, self.degs)
+        assert scores[0] > scores[2], "More noise should give a lower MOS"
+    
+    def test_reference_not_modified(self):
+        """Test that the reference array is left untouched."""
+        reference = self.reference.copy()
+        zimtohrli.compare_audio_one_to_many(reference, self.sample_rate, self.degs)
+        np.testing.assert_array_equal(reference, self.reference)
+    
+    def test_mixed_sample_rates(self):
+        """Test degraded signals at other sample rates."""
+        deg_16k = self.reference[::3].copy()
+        scores = zimtohrli.compare_audio_one_to_many(self.reference, self.sample_rate,
+                                                     [self.reference, deg_16k],
+                                                     [self.sample_rate, 16000])
+        expected = zimtohrli.compare_audio(self.reference, self.sample_rate, deg_16k, 16000)
+        np.testing.assert_allclose(scores[1], expected, rtol=1e-6)
+        assert scores[0] > 4.5
+
+    def test_profile(self):
+        """Test that the reference is analyzed once in the profile."""
+        scores, profile = zimtohrli.compare_audio_one_to_many(
+            self.reference, self.sample_rate, self.degs, profile=True)
+        np.testing.assert_array_equal(
+            scores, zimtohrli.compare_audio_one_to_many(
+                self.reference, self.sample_rate, self.degs))
+        assert profile["num_comparisons"] == len(self.degs)
+        assert profile["analyze_calls"] == len(self.degs) + 1
+        assert profile["nsim_calls"] == len(self.degs)
+
+class TestPerceptualParameters:
+    """Test the NSIM windows and the analysis step length."""
+
+    def setup_method(self):
+        """Set up test fixtures."""
+        rng = np.random.default_rng(2)
+        self.reference = rng.uniform(-0.3, 0.3, 48000).astype(np.float32)
+        self.degraded = (self.reference + rng.uniform(
+            -0.02, 0.02, 48000)).astype(np.float32)
+
+    def test_defaults(self):
+        """Test that the default parameters are those of the library."""
+        comparator = zimtohrli.ZimtohrliComparator()
+        assert comparator.nsim_step_window == 6
+        assert comparator.nsim_channel_window == 5
+        assert comparator.high_gamma_band == 84.0
+        assert comparator.perceptual_sample_rate == pytest.approx(48000 / 571)
+        assert zimtohrli.ZimtohrliComparator(
+            high_gamma_band=84.0).compare(
+                self.reference, self.degraded) == comparator.compare(
+                    self.reference, self.degraded)
+
+    def test_perceptual_sample_rate(self):
+        """Test that a lower rate makes fewer steps, in every API."""
+        comparator = zimtohrli.ZimtohrliComparator(perceptual_sample_rate=40,
+                                                   nsim_step_window=3)
+        assert comparator.perceptual_sample_rate == 40
+        assert comparator.high_gamma_band == 40
+        assert comparator.analyze(self.reference).num_steps == 40
+        parameters = {"perceptual_sample_rate": 40, "nsim_step_window": 3}
+        distance = comparator.compare(self.reference, self.degraded,
+                                      return_distance=True)
+        assert distance != zimtohrli.ZimtohrliComparator().compare(
+            self.reference, self.degraded, return_distance=True)
+        assert zimtohrli.compare_audio(
+            self.reference, 48000, self.degraded, 48000,
+            return_distance=True, **parameters) == distance
+        np.testing.assert_array_equal(
+            zimtohrli.compare_audio_batch(
+                [self.reference], [self.degraded], 48000,
+                return_distance=True, **parameters), np.float32(distance))
+        np.testing.assert_array_equal(
+            zimtohrli.compare_audio_one_to_many(
+                self.reference, 48000, [self.degraded],
+                return_distance=True, **parameters), np.float32(distance))
+        analyzer = zimtohrli.StreamingAnalyzer(perceptual_sample_rate=40)
+        analyzer.push(self.reference)
+        assert analyzer.num_steps + analyzer.finish().num_steps == 40
+
+    def test_validation(self):
+        """Test that out of range parameters raise ValueError."""
+        for parameters in [{"nsim_step_window": 0},
+                           {"nsim_channel_window": 0},
+                           {"nsim_channel_window": 129},
+                           {"high_gamma_band": 0},
+                           {"perceptual_sample_rate": 0.5},
+                           {"perceptual_sample_rate": 96000}]:
+            with pytest.raises(ValueError):
+                zimtohrli.ZimtohrliComparator(**parameters)
+            with pytest.raises(ValueError):
+                zimtohrli.compare_audio(self.reference, 48000, self.degraded,
+                                        48000, **parameters)
+            with pytest.raises(ValueError):
+                zimtohrli.compare_audio_batch([self.reference],
+                                              [self.degraded], 48000,
+                                              **parameters)
+            with pytest.raises(ValueError):
+                zimtohrli.StreamingDistance(**parameters)
+
+class TestStreamingAnalyzer:
+    """Test the incremental StreamingAnalyzer."""
+    
+    def setup_method(self):
+        """Set up test fixtures."""
+        rng = np.random.default_rng(2)
+        self.step = 571  # samples_per_perceptual_block
+        self.signal = rng.uniform(-0.5, 0.5, 40 * self.step).astype(np.float32)
+    
+    def test_matches_analyze(self):
+        """Test that streaming in chunks gives exactly the batch spectrogram."""
+        expected = np.asarray(zimtohrli.ZimtohrliComparator().analyze(self.signal))
+        analyzer = zimtohrli.StreamingAnalyzer()
+        rows = []
+        bounds = [0, 1, 100, 100, 700, 3000, 9000, len(self.signal)]
+        for begin, end in zip(bounds[:-1], bounds[1:]):
+            rows.append(np.asarray(analyzer.push(self.signal[begin:end])))
+            assert analyzer.num_samples == end
+            assert analyzer.num_steps == sum(len(r) for r in rows)
+        rows.append(np.asarray(analyzer.finish()))
+        streamed = np.concatenate(rows)
+        assert streamed.shape == expected.shape
+        np.testing.assert_array_equal(streamed, expected)
+        assert analyzer.num_samples == 0
+        assert analyzer.num_steps == 0
+    
+    def test_emits_completed_rows(self):
+        """Test that rows are returned as soon as their samples arrived."""
+        analyzer = zimtohrli.StreamingAnalyzer()
+        assert analyzer.push(self.signal[:self.step]).num_steps == 0
+        assert analyzer.push(self.signal[self.step:self.step + 32]).num_steps == 1
+        assert analyzer.finish().num_steps == 1
+    
+    def test_reset_and_reuse(self):
+        """Test that an analyzer gives the same rows for a new stream."""
+        analyzer = zimtohrli.StreamingAnalyzer()
+        first = np.asarray(analyzer.push(self.signal)).copy()
+        analyzer.reset()
+        np.testing.assert_array_equal(np.asarray(analyzer.push(self.signal)), first)
+    
+    def test_resamples(self):
+        """Test that streams at other sample rates are resampled to 48kHz."""
+        def sine(sample_rate):
+            t = np.arange(2 * sample_rate, dtype=np.float32) / sample_rate
+            return (0.3 * np.sin(2 * np.pi * 440 * t)).astype(np.float32)
+        streams = []
+        for chunk_size in [1000, 4410]:
+            analyzer = zimtohrli.StreamingAnalyzer(sample_rate=44100)
+            signal = sine(44100)
+            rows = [np.asarray(analyzer.push(signal[begin:begin + chunk_size]))
+                    for begin in range(0, len(signal), chunk_size)]
+            rows.append(np.asarray(analyzer.finish()))
+            streams.append(np.concatenate(rows))
+        np.testing.assert_array_equal(streams[0], streams[1])
+        assert len(streams[0]) == int(np.ceil(2 * 48000 / self.step))
+        distance = zimtohrli.ZimtohrliComparator().compare(
+            zimtohrli.Spectrogram(streams[0]), sine(48000), return_distance=True)
+        assert distance < 0.01
+
+    def test_input_validation(self):
+        """Test that invalid chunks are rejected."""
+        with pytest.raises(ValueError):
+            zimtohrli.StreamingAnalyzer(sample_rate=0)
+        analyzer = zimtohrli.StreamingAnalyzer()
+        with pytest.raises(ValueError):
+            analyzer.push([0.0, 1.0])
+        with pytest.raises(ValueError):
+            analyzer.push(np.zeros((2, 2), dtype=np.float32))
+        assert analyzer.push(np.zeros(0, dtype=np.float32)).num_steps == 0
+        assert analyzer.finish().num_steps == 0
+
+
+class TestStreamingDistance:
+    """Test the StreamingDistance of two live streams."""
+    
+    def setup_method(self):
+        """Set up test fixtures."""
+        rng = np.random.default_rng(3)
+        self.step = 571  # samples_per_perceptual_block
+        t = np.arange(600 * self.step, dtype=np.float32) / 48000
+        self.ref = (np.sin(2 * np.pi * 440 * t) * 0.3).astype(np.float32)
+        self.deg = (self.ref + rng.normal(0, 0.01, self.ref.shape)).astype(np.float32)
+    
+    def _stream(self, streaming, bounds_a, bounds_b):
+        reports = []
+        for (begin_a, end_a), (begin_b, end_b) in zip(
+                zip(bounds_a[:-1], bounds_a[1:]), zip(bounds_b[:-1], bounds_b[1:])):
+            reports += streaming.push(self.ref[begin_a:end_a], self.deg[begin_b:end_b])
+        return reports + streaming.finish()
+    
+    def test_matches_comparator(self):
+        """Test that the overall distance is close to the batch distance."""
+        streaming = zimtohrli.StreamingDistance(max_drift_seconds=0.5)
+        assert streaming.distance is None
+        bounds = list(range(0, len(self.ref), 4800)) + [len(self.ref)]
+        self._stream(streaming, bounds, bounds)
+        expected = zimtohrli.ZimtohrliComparator(dtw_max_drift_seconds=0.5).compare(
+            self.ref, self.deg, return_distance=True)
+        assert streaming.distance == pytest.approx(expected, rel=0.05)
+        assert streaming.mos == pytest.approx(zimtohrli.zimtohrli_distance_to_mos(streaming.distance))
+    
+    def test_chunking_does_not_matter(self):
+        """Test that the reports don't depend on how the streams are chunked."""
+        n = len(self.ref)
+        even = self._stream(zimtohrli.StreamingDistance(), [0, n], [0, n])
+        streaming = zimtohrli.StreamingDistance()
+        uneven = self._stream(streaming, [0, 1, 5000, 5000, 90000, n],
+                              [0, 40000, 40001, 200000, n, n])
+        assert uneven == even
+        assert even[-1].distance > 0
+    
+    def test_reports(self):
+        """Test that reports follow report_seconds and window_seconds."""
+        streaming = zimtohrli.StreamingDistance(report_seconds=1.0, window_seconds=2.5)
+        reports = []
+        for begin in range(0, len(self.ref), 4800):
+            reports += streaming.push(self.ref[begin:begin + 4800],
+                                      self.deg[begin:begin + 4800])
+            # Reports arrive within report_seconds and the drift delay of
+            # the audio they cover.
+            if reports:
+                assert reports[-1].end_seconds > begin / 48000 - 2.1
+        reports += streaming.finish()
+        duration = len(self.ref) / 48000
+        assert len(reports) == int(np.ceil(duration))
+        for index, report in enumerate(reports[:-1]):
+            assert report.end_seconds == pytest.approx(index + 1, abs=0.02)
+            assert report.end_seconds - report.start_seconds <= 2.5 + 0.02
+        assert reports[-1].end_seconds == pytest.approx(duration, abs=0.02)
+        for report in reports:
+            assert 0 < report.distance < 0.1
+            assert report.mos == pytest.approx(zimtohrli.zimtohrli_distance_to_mos(report.distance))
+    
+    def test_finish_and_reset(self):
+        """Test that finished streams must be reset before reuse."""
+        streaming = zimtohrli.StreamingDistance()
+        first = self._stream(streaming, [0, len(self.ref)], [0, len(self.deg)])
+        assert streaming.finished
+        with pytest.raises(RuntimeError):
+            streaming.push(self.ref, self.deg)
+        with pytest.raises(RuntimeError):
+            streaming.finish()
+        streaming.reset()
+        assert not streaming.finished
+        assert streaming.distance is None
+        assert self._stream(streaming, [0, len(self.ref)], [0, len(self.deg)]) == first
+    
+    def test_input_validation(self):
+        """Test that invalid arguments are rejected."""
+        with pytest.raises(ValueError):
+            zimtohrli.StreamingDistance(report_seconds=0)
+        with pytest.raises(ValueError):
+            zimtohrli.StreamingDistance(window_seconds=-1)
+        with pytest.raises(ValueError):
+            zimtohrli.StreamingDistance(max_drift_seconds=0)
+        streaming = zimtohrli.StreamingDistance()
+        with pytest.raises(ValueError):
+            streaming.push([0.0, 1.0], self.deg)
+        with pytest.raises(ValueError):
+            streaming.push(self.ref, np.zeros((2, 2), dtype=np.float32))
+        assert streaming.push(np.zeros(0, dtype=np.float32),
+                              np.zeros(0, dtype=np.float32)) == []
+        assert streaming.finish() == []
+
+class TestConcurrency:
+    """Test that comparisons release the GIL and run concurrently."""
+    
+    def setup_method(self):
+        """Set up test fixtures."""
+        self.sample_rate = 48000
+        rng = np.random.default_rng(0)
+        t = np.arange(self.sample_rate * 2, dtype=np.float32) / self.sample_rate
+        self.pairs = []
+        for i in range(8):
+            ref = (np.sin(2 * np.pi * (300 + 50 * i) * t) * 0.5).astype(np.float32)
+            deg = (ref + rng.normal(0, 0.02, ref.shape)).astype(np.float32)
+            self.pairs.append((ref, deg))
+    
+    def _compare(self, pair):
+        ref, deg = pair
+        return zimtohrli.compare_audio(ref, self.sample_rate, deg, self.sample_rate, return_distance=True)
+    
+    def test_concurrent_results_match_serial(self):
+        """Test that concurrent calls give the same results as serial calls."""
+        serial = [self._compare(pair) for pair in self.pairs]
+        with ThreadPoolExecutor(max_workers=4) as executor:
+            concurrent = list(executor.map(self._compare, self.pairs))
+        assert concurrent == serial
+        
+        comparator = zimtohrli.ZimtohrliComparator()
+        serial = [comparator.compare(ref, deg) for ref, deg in self.pairs]
+        with ThreadPoolExecutor(max_workers=4) as executor:
+            concurrent = list(executor.map(lambda pair: comparator.compare(*pair), self.pairs))
+        assert concurrent == serial
+    
+    @pytest.mark.skipif((os.cpu_count() or 1) < 2, reason="needs at least 2 cores")
+    def test_concurrent_calls_scale_with_cores(self):
+        """Test that a thread pool runs comparisons in parallel."""
+        num_workers = min(os.cpu_count(), 4)
+        pairs = self.pairs[:num_workers] * 2
+        
+        start = time.perf_counter()
+        for pair in pairs:
+            self._compare(pair)
+        serial_time = time.perf_counter() - start
+        
+        start = time.perf_counter()
+        with ThreadPoolExecutor(max_workers=num_workers) as executor:
+            list(executor.map(self._compare, pairs))
+        concurrent_time = time.perf_counter() - start
+        
+        # Perfect scaling would give serial_time / num_workers; require at
+        # least half of the ideal speedup to leave room for noisy CI machines.
+        speedup = serial_time / concurrent_time
+        assert speedup > num_workers / 2, (
+            f"Expected concurrent speedup with {num_workers} workers, got {speedup:.2f}x"
+        )
+
+class TestAsyncAPI:
+    """Test compare_audio_async."""
+    
+    def setup_method(self):
+        """Set up test fixtures."""
+        self.sample_rate = 48000
+        rng = np.random.default_rng(2)
+        t = np.arange(self.sample_rate, dtype=np.float32) / self.sample_rate
+        self.reference = (np.sin(2 * np.pi * 440 * t) * 0.5).astype(np.float32)
+        self.degraded = (self.reference + rng.normal(0, 0.02, t.shape)).astype(np.float32)
+    
+    def test_matches_compare_audio(self):
+        """Test that the futures complete with the blocking results."""
+        async def compare():
+            return await asyncio.gather(
+                zimtohrli.compare_audio_async(self.reference, self.sample_rate,
+                                              self.degraded, self.sample_rate),
+                zimtohrli.compare_audio_async(self.reference, self.sample_rate,
+                                              self.degraded, self.sample_rate,
+                                              return_distance=True,
+                                              nsim_step_window=3))
+        score, distance = asyncio.run(compare())
+        assert score == zimtohrli.compare_audio(
+            self.reference, self.sample_rate, self.degraded, self.sample_rate)
+        assert distance == zimtohrli.compare_audio(
+            self.reference, self.sample_rate, self.degraded, self.sample_rate,
+            return_distance=True, nsim_step_window=3)
+    
+    def test_cancel_stops_comparison(self):
+        """Test that cancelling a long comparison frees the worker threads."""
+        long_reference = np.tile(self.reference, 60)
+        long_degraded = np.tile(self.degraded, 60)
+        start = time.perf_counter()
+        zimtohrli.compare_audio(long_reference, self.sample_rate,
+                                long_degraded, self.sample_rate)
+        blocking_time = time.perf_counter() - start
+        
+        async def cancel_and_compare():
+            futures = [zimtohrli.compare_audio_async(long_reference, self.sample_rate,
+                                                     long_degraded, self.sample_rate)
+                       for _ in range(2 * (os.cpu_count() or 1))]
+            await asyncio.sleep(0.05)
+            for future in futures:
+                future.cancel()
+            start = time.perf_counter()
+            await zimtohrli.compare_audio_async(self.reference, self.sample_rate,
+                                                self.degraded, self.sample_rate)
+            return time.perf_counter() - start, futures
+        
+        elapsed, futures = asyncio.run(cancel_and_compare())
+        assert all(future.cancelled() for future in futures)
+        assert elapsed < blocking_time, (
+            "The cancelled comparisons should not have run to completion")
+    
+    def test_invalid_inputs(self):
+        """Test that invalid inputs raise before any work is submitted."""
+        async def compare(**kwargs):
+            return await zimtohrli.compare_audio_async(
+                self.reference, self.sample_rate, self.degraded,
+                self.sample_rate, **kwargs)
+        with pytest.raises(ValueError):
+            asyncio.run(compare(resample_quality="best"))
+        with pytest.raises(ValueError):
+            asyncio.run(compare(nsim_channel_window=0))
+        with pytest.raises(RuntimeError):
+            zimtohrli.compare_audio_async(self.reference, self.sample_rate,
+                                          self.degraded, self.sample_rate)
 
 if __name__ == "__main__":
     pytest.main([__file__])
\ No newline at end of file
@@ -22,9 +22,25 @@ Basic usage:
 
 from .core import (
     compare_audio,
+    compare_audio_batch,
+    compare_audio_one_to_many,
+    compare_audio_async,
+    compare_audio_channels,
     zimtohrli_distance_to_mos,
     get_expected_sample_rate,
+    get_distance_stats,
+    DistanceStats,
+    CACHE_DTYPES,
+    DTW_PRECISIONS,
+    CacheStats,
+    RESAMPLE_QUALITIES,
     ZimtohrliComparator,
+    ChannelComparison,
+    DistanceMap,
+    Spectrogram,
+    StreamingAnalyzer,
+    StreamingDistance,
+    StreamingDistanceReport,
 )
 
 try:
@@ -43,9 +59,25 @@ __license__ = "Apache-2.0"
 
 __all__ = [
     "compare_audio",
+    "compare_audio_batch",
+    "compare_audio_one_to_many",
+    "compare_audio_async",
+    "compare_audio_channels",
     "zimtohrli_distance_to_mos", 
     "get_expected_sample_rate",
+    "get_distance_stats",
+    "DistanceStats",
+    "CACHE_DTYPES",
+    "DTW_PRECISIONS",
+    "CacheStats",
+    "RESAMPLE_QUALITIES",
     "ZimtohrliComparator",
+    "ChannelComparison",
+    "DistanceMap",
+    "Spectrogram",
+    "StreamingAnalyzer",
+    "StreamingDistance",
+    "StreamingDistanceReport",
     "load_and_compare_audio_files",
     "assess_audio_quality",
     "batch_compare_audio",
@@ -111,13 +111,7 @@ def batch_compare_audio(reference_audio: "np.ndarray", test_audios: list,
         >>> scores = batch_compare_audio(reference, test_audios, 48000)
         >>> print(f"Average MOS: {np.mean(scores):.3f}")
     """
-    from .core import ZimtohrliComparator
+    from .core import compare_audio_one_to_many
     
-    # Use comparator for efficiency if all at 48kHz
-    if sample_rate == 48000:
-        comparator = ZimtohrliComparator()
-        return [comparator.compare(reference_audio, test_audio) for test_audio in test_audios]
-    else:
-        # Use high-level function with resampling
-        return [compare_audio(reference_audio, sample_rate, test_audio, sample_rate) 
-                for test_audio in test_audios]
\ No newline at end of file
+    # The reference is analyzed only once and shared by all comparisons
+    return compare_audio_one_to_many(reference_audio, sample_rate, test_audios).tolist()
\ No newline at end of file
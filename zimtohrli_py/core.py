@@ -4,15 +4,25 @@ Core functionality for Zimtohrli Python binding.
 This module provides the main interface to the Zimtohrli C++ library.
 """
 
+import asyncio
+import os
+
 import numpy as np
-from typing import Union
+from typing import Dict, List, NamedTuple, Optional, Sequence, Tuple, Union
 
 try:
     from ._zimtohrli import (
         Pyohrli as _ZimtohrliCore,
+        Spectrogram,
+        StreamingAnalyzer as _StreamingAnalyzerCore,
+        StreamingDistance as _StreamingDistanceCore,
         compare_audio_arrays as _compare_audio_arrays,
         compare_audio_arrays_distance as _compare_audio_arrays_distance,
+        compare_audio_batch as _compare_audio_batch,
+        compare_audio_one_to_many as _compare_audio_one_to_many,
+        compare_audio_async as _compare_audio_async,
         MOSFromZimtohrli as _mos_from_zimtohrli,
+        distance_stats as _distance_stats,
     )
 except ImportError as e:
     raise ImportError(
@@ -21,29 +31,86 @@ except ImportError as e:
     ) from e
 
 
+RESAMPLE_QUALITIES = ("quick", "low", "medium", "high", "very_high")
+"""The soxr resampling qualities, from fastest to most accurate."""
+
+
+def _check_resample_options(resample_quality: str,
+                            resample_num_threads: int) -> None:
+    """Raises ValueError if the resampling options are invalid."""
+    if resample_quality not in RESAMPLE_QUALITIES:
+        raise ValueError(
+            f"resample_quality must be one of {RESAMPLE_QUALITIES}")
+    if resample_num_threads < 0:
+        raise ValueError("resample_num_threads must be non-negative")
+
+
+def _perceptual_parameters(nsim_step_window: int, nsim_channel_window: int,
+                           high_gamma_band: float,
+                           perceptual_sample_rate: Optional[float]) -> dict:
+    """Returns the keyword arguments of the native perceptual parameters.
+
+    They are validated by the native code, which raises ValueError.
+    """
+    return {
+        "nsim_step_window": int(nsim_step_window),
+        "nsim_channel_window": int(nsim_channel_window),
+        "high_gamma_band": float(high_gamma_band),
+        "perceptual_sample_rate": (None if perceptual_sample_rate is None
+                                   else float(perceptual_sample_rate)),
+    }
+
+
 def compare_audio(
     audio_a: np.ndarray, 
     sample_rate_a: float, 
     audio_b: np.ndarray, 
     sample_rate_b: float,
-    return_distance: bool = False
-) -> float:
+    return_distance: bool = False,
+    resample_quality: str = "very_high",
+    resample_num_threads: int = 1,
+    profile: bool = False,
+    nsim_step_window: int = 6,
+    nsim_channel_window: int = 5,
+    high_gamma_band: float = 84.0,
+    perceptual_sample_rate: Optional[float] = None
+) -> Union[float, Tuple[float, Dict[str, Union[int, float]]]]:
     """
     Compare two audio arrays using the Zimtohrli perceptual similarity metric.
     
     Args:
-        audio_a: First audio array (1D numpy array of float32)
+        audio_a: First audio array (1D numpy array of float32, float64, or int16/int32 PCM)
         sample_rate_a: Sample rate of first audio in Hz
-        audio_b: Second audio array (1D numpy array of float32)  
+        audio_b: Second audio array (1D numpy array of float32, float64, or int16/int32 PCM)  
         sample_rate_b: Sample rate of second audio in Hz
         return_distance: If True, return raw Zimtohrli distance (0-1).
                         If False, return MOS score (1-5).
+        resample_quality: The soxr quality audio at other sample rates than
+                          48kHz is resampled with, one of RESAMPLE_QUALITIES.
+                          Lower qualities resample faster and change the
+                          distance slightly (see the README).
+        resample_num_threads: Number of threads soxr resamples with, or 0 to
+                              let soxr decide
+        profile: If True, also return a dict with the time spent in each stage
+                 of the comparison and counters of the work done: for each
+                 stage of "resample", "analyze", "dtw" and "nsim" the keys
+                 "<stage>_seconds" and "<stage>_calls", and
+                 "resampled_samples", "analyzed_samples", "dtw_cells"
+                 (cells of the time warp cost matrix evaluated),
+                 "dtw_cost_bytes" (cost matrix memory), "nsim_cells"
+                 (aligned steps times channels scored),
+                 "spectrogram_allocations", "spectrogram_allocated_bytes",
+                 "wall_seconds" and "num_comparisons".
+        nsim_step_window, nsim_channel_window, high_gamma_band,
+        perceptual_sample_rate: The perceptual parameters, see
+                                ZimtohrliComparator
     
     Returns:
-        float: Either MOS score (1-5, higher is better) or Zimtohrli distance (0-1, lower is better)
+        float: Either MOS score (1-5, higher is better) or Zimtohrli distance (0-1, lower is better),
+        or a (score, profile dict) tuple if profile is True
         
     Raises:
-        ValueError: If inputs are invalid
+        ValueError: If inputs or perceptual parameters are invalid
         RuntimeError: If comparison fails
         
     Example:
@@ -64,29 +131,374 @@ def compare_audio(
     if len(audio_a) == 0 or len(audio_b) == 0:
         raise ValueError("Audio arrays cannot be empty")
     
-    # Convert to float32 if needed
-    if audio_a.dtype != np.float32:
-        audio_a = audio_a.astype(np.float32)
-    if audio_b.dtype != np.float32:
-        audio_b = audio_b.astype(np.float32)
-    
-    # Ensure arrays are contiguous
-    if not audio_a.flags['C_CONTIGUOUS']:
-        audio_a = np.ascontiguousarray(audio_a)
-    if not audio_b.flags['C_CONTIGUOUS']:
-        audio_b = np.ascontiguousarray(audio_b)
+    # int16, int32, float32 and float64 arrays are converted natively
+    audio_a = _as_signal(audio_a)
+    audio_b = _as_signal(audio_b)
     
     # Validate sample rates
     if sample_rate_a <= 0 or sample_rate_b <= 0:
         raise ValueError("Sample rates must be positive")
+    _check_resample_options(resample_quality, resample_num_threads)
     
     # Call the appropriate C++ function
+    perceptual = _perceptual_parameters(
+        nsim_step_window, nsim_channel_window, high_gamma_band,
+        perceptual_sample_rate)
     if return_distance:
         return _compare_audio_arrays_distance(audio_a, float(sample_rate_a), 
-                                             audio_b, float(sample_rate_b))
+                                             audio_b, float(sample_rate_b),
+                                             resample_quality,
+                                             int(resample_num_threads),
+                                             bool(profile), **perceptual)
     else:
         return _compare_audio_arrays(audio_a, float(sample_rate_a), 
-                                    audio_b, float(sample_rate_b))
+                                    audio_b, float(sample_rate_b),
+                                    resample_quality,
+                                    int(resample_num_threads),
+                                    bool(profile), **perceptual)
+
+
+_NATIVE_DTYPES = (np.dtype(np.int16), np.dtype(np.int32),
+                  np.dtype(np.float32), np.dtype(np.float64))
+
+
+def _as_signal(audio: np.ndarray) -> np.ndarray:
+    """Return audio as an array the native code reads, copying only if needed.
+
+    int16, int32, float32 and float64 arrays with any strides are passed
+    through, and converted to float32 by the native code in the same pass that
+    copies or resamples them. Integer samples are PCM, so full scale maps to
+    [-1, 1). Other floating point arrays are converted to float32 here.
+    """
+    if not isinstance(audio, np.ndarray):
+        raise ValueError("Audio inputs must be numpy arrays")
+    if audio.dtype in _NATIVE_DTYPES:
+        return audio
+    if audio.dtype.newbyteorder("=") in _NATIVE_DTYPES:
+        return audio.astype(audio.dtype.newbyteorder("="))
+    if audio.dtype.kind == "f":
+        return audio.astype(np.float32)
+    raise ValueError(
+        "Audio arrays must contain int16 or int32 PCM, or floating point samples")
+
+
+def compare_audio_batch(
+    refs: Sequence[np.ndarray],
+    degs: Sequence[np.ndarray],
+    sample_rates: Union[float, Sequence[float]],
+    num_threads: Optional[int] = None,
+    return_distance: bool = False,
+    resample_quality: str = "very_high",
+    resample_num_threads: int = 1,
+    profile: bool = False,
+    nsim_step_window: int = 6,
+    nsim_channel_window: int = 5,
+    high_gamma_band: float = 84.0,
+    perceptual_sample_rate: Optional[float] = None
+) -> Union[np.ndarray, Tuple[np.ndarray, Dict[str, Union[int, float]]]]:
+    """
+    Compare many pairs of audio arrays in a single call.
+    
+    The pairs are distributed over a pool of native worker threads, which avoids
+    the per-call overhead of compare_audio() and uses all available cores.
+    
+    Args:
+        refs: Reference audio arrays (1D numpy arrays)
+        degs: Degraded audio arrays, degs[i] is compared with refs[i]
+        sample_rates: Sample rate in Hz shared by all pairs, or one sample rate
+                      per pair (shared by refs[i] and degs[i])
+        num_threads: Number of worker threads, defaults to one per core
+        return_distance: If True, return raw Zimtohrli distances (0-1).
+                        If False, return MOS scores (1-5).
+        resample_quality: The soxr resampling quality, see compare_audio()
+        resample_num_threads: Number of threads soxr resamples each array
+                              with, or 0 to let soxr decide
+        profile: If True, also return the profile dict of compare_audio(),
+                 summed over all pairs. The stage seconds of pairs compared
+                 in parallel add up, so they can exceed wall_seconds.
+        nsim_step_window, nsim_channel_window, high_gamma_band,
+        perceptual_sample_rate: The perceptual parameters, see
+                                ZimtohrliComparator
+    
+    Returns:
+        np.ndarray: float32 array with one score per pair, or a (scores,
+        profile dict) tuple if profile is True
+        
+    Raises:
+        ValueError: If inputs are invalid
+        RuntimeError: If comparison fails
+        
+    Example:
+        >>> scores = zimtohrli.compare_audio_batch(refs, degs, 48000, num_threads=8)
+        >>> print(f"Average MOS: {scores.mean():.3f}")
+    """
+    if len(refs) != len(degs):
+        raise ValueError("refs and degs must have the same length")
+    if num_threads is not None and num_threads <= 0:
+        raise ValueError("num_threads must be positive")
+    _check_resample_options(resample_quality, resample_num_threads)
+    refs = [_as_signal(audio) for audio in refs]
+    degs = [_as_signal(audio) for audio in degs]
+    for audio in refs + degs:
+        if audio.ndim != 1:
+            raise ValueError("Audio arrays must be 1-dimensional")
+        if len(audio) == 0:
+            raise ValueError("Audio arrays cannot be empty")
+    if np.ndim(sample_rates) == 0:
+        sample_rates = float(sample_rates)
+    else:
+        sample_rates = [float(sample_rate) for sample_rate in sample_rates]
+    if np.any(np.asarray(sample_rates) <= 0):
+        raise ValueError("Sample rates must be positive")
+    
+    result = _compare_audio_batch(
+        refs, degs, sample_rates,
+        num_threads=num_threads or 0,
+        return_distance=return_distance,
+        resample_quality=resample_quality,
+        resample_num_threads=int(resample_num_threads),
+        profile=bool(profile),
+        **_perceptual_parameters(nsim_step_window, nsim_channel_window,
+                                 high_gamma_band, perceptual_sample_rate),
+    )
+    if profile:
+        return np.asarray(result[0]), result[1]
+    return np.asarray(result)
+
+
+def compare_audio_one_to_many(
+    reference: np.ndarray,
+    sample_rate: float,
+    degs: Sequence[np.ndarray],
+    sample_rates: Optional[Union[float, Sequence[float]]] = None,
+    num_threads: Optional[int] = None,
+    return_distance: bool = False,
+    resample_quality: str = "very_high",
+    resample_num_threads: int = 1,
+    profile: bool = False,
+    nsim_step_window: int = 6,
+    nsim_channel_window: int = 5,
+    high_gamma_band: float = 84.0,
+    perceptual_sample_rate: Optional[float] = None
+) -> Union[np.ndarray, Tuple[np.ndarray, Dict[str, Union[int, float]]]]:
+    """
+    Compare one reference audio array with many degraded versions of it.
+    
+    The reference is resampled and analyzed only once, and its spectrogram is
+    shared by all comparisons, which run on a pool of native worker threads.
+    
+    Args:
+        reference: Reference audio array (1D numpy array)
+        sample_rate: Sample rate of the reference in Hz
+        degs: Degraded audio arrays (1D numpy arrays)
+        sample_rates: Sample rate shared by all degraded arrays, or one per
+                      degraded array. Defaults to the reference sample rate.
+        num_threads: Number of worker threads, defaults to one per core
+        return_distance: If True, return raw Zimtohrli distances (0-1).
+                        If False, return MOS scores (1-5).
+        resample_quality: The soxr resampling quality, see compare_audio()
+        resample_num_threads: Number of threads soxr resamples each array
+                              with, or 0 to let soxr decide
+        profile: If True, also return the profile dict of compare_audio(),
+                 summed over the analysis of the reference and all
+                 comparisons, see compare_audio_batch()
+        nsim_step_window, nsim_channel_window, high_gamma_band,
+        perceptual_sample_rate: The perceptual parameters, see
+                                ZimtohrliComparator
+    
+    Returns:
+        np.ndarray: float32 array with one score per degraded array, or a
+        (scores, profile dict) tuple if profile is True
+        
+    Raises:
+        ValueError: If inputs are invalid
+        RuntimeError: If comparison fails
+        
+    Example:
+        >>> encodes = [encode(reference, bitrate) for bitrate in bitrates]
+        >>> scores = zimtohrli.compare_audio_one_to_many(reference, 48000, encodes)
+    """
+    if num_threads is not None and num_threads <= 0:
+        raise ValueError("num_threads must be positive")
+    _check_resample_options(resample_quality, resample_num_threads)
+    reference = _as_signal(reference)
+    degs = [_as_signal(audio) for audio in degs]
+    for audio in [reference] + degs:
+        if audio.ndim != 1:
+            raise ValueError("Audio arrays must be 1-dimensional")
+        if len(audio) == 0:
+            raise ValueError("Audio arrays cannot be empty")
+    if sample_rates is None:
+        sample_rates = sample_rate
+    if np.ndim(sample_rates) == 0:
+        sample_rates = float(sample_rates)
+    else:
+        sample_rates = [float(rate) for rate in sample_rates]
+    if sample_rate <= 0 or np.any(np.asarray(sample_rates) <= 0):
+        raise ValueError("Sample rates must be positive")
+    
+    result = _compare_audio_one_to_many(
+        reference, float(sample_rate), degs, sample_rates,
+        num_threads=num_threads or 0,
+        return_distance=return_distance,
+        resample_quality=resample_quality,
+        resample_num_threads=int(resample_num_threads),
+        profile=bool(profile),
+        **_perceptual_parameters(nsim_step_window, nsim_channel_window,
+                                 high_gamma_band, perceptual_sample_rate),
+    )
+    if profile:
+        return np.asarray(result[0]), result[1]
+    return np.asarray(result)
+
+
+def compare_audio_async(
+    audio_a: np.ndarray,
+    sample_rate_a: float,
+    audio_b: np.ndarray,
+    sample_rate_b: float,
+    return_distance: bool = False,
+    resample_quality: str = "very_high",
+    resample_num_threads: int = 1,
+    nsim_step_window: int = 6,
+    nsim_channel_window: int = 5,
+    high_gamma_band: float = 84.0,
+    perceptual_sample_rate: Optional[float] = None,
+    loop: Optional[asyncio.AbstractEventLoop] = None
+) -> "asyncio.Future[float]":
+    """
+    Start comparing two audio arrays without blocking the event loop.
+
+    The arrays are copied, and the comparison runs on a pool of native worker
+    threads shared by all asynchronous comparisons, with one thread per core.
+    The returned future completes on the event loop with the result of
+    compare_audio(). Cancelling it, e.g. because the client that asked for the
+    score disconnected, stops the time alignment within a block of cost
+    matrix rows and skips the stages that haven't started. Resampling, and the
+    filterbank pass of an analysis (or segment) that is already running, are
+    not interrupted and finish first.
+
+    Args:
+        audio_a, sample_rate_a, audio_b, sample_rate_b, return_distance,
+        resample_quality, resample_num_threads: See compare_audio()
+        nsim_step_window, nsim_channel_window, high_gamma_band,
+        perceptual_sample_rate: The perceptual parameters, see
+                                ZimtohrliComparator
+        loop: The event loop the future belongs to, defaults to the running
+              loop
+
+    Returns:
+        asyncio.Future: The MOS score (1-5), or the Zimtohrli distance (0-1)
+        if return_distance is True
+
+    Raises:
+        ValueError: If inputs or perceptual parameters are invalid
+        RuntimeError: If called without a loop outside of a running loop
+
+    Example:
+        >>> async def score(reference, degraded):
+        ...     return await zimtohrli.compare_audio_async(
+        ...         reference, 48000, degraded, 48000)
+    """
+    if not isinstance(audio_a, np.ndarray) or not isinstance(audio_b, np.ndarray):
+        raise ValueError("Audio inputs must be numpy arrays")
+    if audio_a.ndim != 1 or audio_b.ndim != 1:
+        raise ValueError("Audio arrays must be 1-dimensional")
+    if len(audio_a) == 0 or len(audio_b) == 0:
+        raise ValueError("Audio arrays cannot be empty")
+    if sample_rate_a <= 0 or sample_rate_b <= 0:
+        raise ValueError("Sample rates must be positive")
+    _check_resample_options(resample_quality, resample_num_threads)
+    if loop is None:
+        loop = asyncio.get_running_loop()
+    future = loop.create_future()
+
+    def resolve(result, error):
+        if future.done():
+            return
+        if error is not None:
+            future.set_exception(error)
+        else:
+            future.set_result(result)
+
+    def callback(result, error):
+        # Called on a native worker thread.
+        try:
+            loop.call_soon_threadsafe(resolve, result, error)
+        except RuntimeError:
+            # The loop is closed, so nobody can await the result anymore.
+            pass
+
+    comparison = _compare_audio_async(
+        _as_signal(audio_a), float(sample_rate_a),
+        _as_signal(audio_b), float(sample_rate_b), callback,
+        return_distance=bool(return_distance),
+        resample_quality=resample_quality,
+        resample_num_threads=int(resample_num_threads),
+        **_perceptual_parameters(nsim_step_window, nsim_channel_window,
+                                 high_gamma_band, perceptual_sample_rate),
+    )
+
+    def cancel(done_future):
+        if done_future.cancelled():
+            comparison.cancel()
+
+    future.add_done_callback(cancel)
+    return future
+
+
+def compare_audio_channels(
+    audio_a: np.ndarray,
+    sample_rate_a: float,
+    audio_b: np.ndarray,
+    sample_rate_b: float,
+    channel_axis: int = 0,
+    aggregation: str = "mean",
+    num_threads: Optional[int] = None,
+    resample_quality: str = "very_high",
+    resample_num_threads: int = 1
+) -> "ChannelComparison":
+    """
+    Compare two multichannel audio arrays channel by channel.
+    
+    Same as ZimtohrliComparator.compare_channels(), with automatic
+    resampling of both arrays.
+    
+    Args:
+        audio_a: First audio array, 1D for mono or 2D with channels along
+                 channel_axis
+        sample_rate_a: Sample rate of first audio in Hz
+        audio_b: Second audio array, with as many channels as audio_a
+        sample_rate_b: Sample rate of second audio in Hz
+        channel_axis: 0 for planar [channels, samples] arrays, 1 or -1 for
+                      interleaved [samples, channels] arrays
+        aggregation: How the channel distances are combined: "mean", "min"
+                     or "max" (the worst channel)
+        num_threads: Number of threads the channels are analyzed on, defaults
+                     to one per core
+        resample_quality: The soxr resampling quality, see compare_audio()
+        resample_num_threads: Number of threads soxr spreads the channels of
+                              interleaved arrays over, or 0 to let soxr decide
+    
+    Returns:
+        ChannelComparison: The aggregated and the per-channel scores
+        
+    Raises:
+        ValueError: If inputs are invalid
+        
+    Example:
+        >>> stereo_a, sr = soundfile.read("a.wav", dtype="int16")
+        >>> stereo_b, _ = soundfile.read("b.wav", dtype="int16")
+        >>> result = zimtohrli.compare_audio_channels(
+        ...     stereo_a, sr, stereo_b, sr, channel_axis=1, aggregation="max")
+        >>> print(f"Worst channel MOS: {result.mos:.3f}")
+    """
+    comparator = ZimtohrliComparator(resample_quality=resample_quality,
+                                     resample_num_threads=resample_num_threads)
+    return comparator.compare_channels(
+        audio_a, audio_b, channel_axis=channel_axis, aggregation=aggregation,
+        num_threads=num_threads, sample_rate_a=sample_rate_a,
+        sample_rate_b=sample_rate_b)
 
 
 def zimtohrli_distance_to_mos(distance: float) -> float:
@@ -121,6 +533,114 @@ def get_expected_sample_rate() -> int:
     return 48000
 
 
+class DistanceStats(NamedTuple):
+    """
+    Counts of the time alignments computed by all comparisons in the process.
+    
+    Comparisons of signals whose spectrograms are identical after the energy
+    rescaling, e.g. bit-exact passthroughs, skip the time warp search, since
+    its result is known to be the diagonal. Their distance is then computed
+    along the diagonal, and is the same as without the shortcut.
+    
+    Attributes:
+        time_warps: The number of time alignments computed
+        identical: The number of them that took the identical shortcut
+    """
+    
+    time_warps: int
+    identical: int
+
+
+def get_distance_stats(reset: bool = False) -> DistanceStats:
+    """
+    Get the counts of the time alignments computed by all comparisons.
+    
+    Args:
+        reset: Whether to reset the counts to 0 after reading them
+        
+    Returns:
+        DistanceStats: The counts since the start or the last reset
+        
+    Example:
+        >>> zimtohrli.get_distance_stats(reset=True)
+        >>> zimtohrli.compare_audio_batch(refs, degs, 48000)
+        >>> stats = zimtohrli.get_distance_stats()
+        >>> print(f"{stats.identical} of {stats.time_warps} were identical")
+    """
+    return DistanceStats(*_distance_stats(bool(reset)))
+
+
+CACHE_DTYPES = ("float32", "float16", "bfloat16")
+"""The value types spectrogram cache entries can be stored in."""
+
+DTW_PRECISIONS = ("float32", "float16", "bfloat16")
+"""The value types the time alignment can read spectrograms in."""
+
+
+class CacheStats(NamedTuple):
+    """
+    Counts of the spectrogram cache lookups of a ZimtohrliComparator.
+    
+    Attributes:
+        hits: The number of signals whose spectrogram was loaded from the cache
+        misses: The number of signals that were analyzed and then stored
+    """
+    
+    hits: int
+    misses: int
+
+
+class DistanceMap(NamedTuple):
+    """
+    Where a distance between two signals comes from.
+    
+    The rows of time_pairs and scores correspond to each other: row i says
+    that step time_pairs[i, 0] of the first signal was aligned with step
+    time_pairs[i, 1] of the second, and how well each of the num_rotators
+    frequency channels matched there. Each step covers 571 samples (about
+    12 ms) at 48kHz.
+    
+    Examples:
+        >>> per_step = 1 - dmap.scores.mean(axis=1)  # Distance per aligned step
+        >>> seconds = dmap.time_pairs[:, 0] * 571 / 48000
+        >>> worst = seconds[np.argmax(per_step)]
+        >>> per_channel = 1 - dmap.scores.mean(axis=0)  # Distance per channel
+    
+    Attributes:
+        distance: The Zimtohrli distance, as returned by compare()
+        mos: The MOS score of distance
+        time_pairs: Read-only (num_pairs, 2) int64 array of the aligned steps
+        scores: Read-only (num_pairs, num_rotators) float32 array of NSIM
+            scores. distance is 1 minus their mean clamped to [0, 1], up to
+            the rounding error of the native float sum (see fast_math).
+    """
+    
+    distance: float
+    mos: float
+    time_pairs: np.ndarray
+    scores: np.ndarray
+
+
+_CHANNEL_AGGREGATIONS = {"mean": np.mean, "min": np.min, "max": np.max}
+
+
+class ChannelComparison(NamedTuple):
+    """
+    The result of comparing two multichannel signals channel by channel.
+    
+    Attributes:
+        distance: The aggregation of the channel distances
+        mos: The MOS score of distance
+        channel_distances: float32 array with the distance of each channel
+        channel_mos: float32 array with the MOS score of each channel
+    """
+    
+    distance: float
+    mos: float
+    channel_distances: np.ndarray
+    channel_mos: np.ndarray
+
+
 class ZimtohrliComparator:
     """
     A class for performing multiple audio comparisons with the same configuration.
@@ -140,22 +660,175 @@ class ZimtohrliComparator:
         ...     print(f"MOS: {mos:.3f}")
     """
     
-    def __init__(self):
-        """Initialize the Zimtohrli comparator."""
-        self._zimtohrli = _ZimtohrliCore()
+    def __init__(self, dtw_band_radius: int = 0,
+                 dtw_max_drift_seconds: float = 0.0,
+                 dtw_multiresolution_radius: int = 0,
+                 dtw_precision: str = "float32",
+                 fast_math: bool = False,
+                 dtw_num_threads: int = 1,
+                 segment_seconds: float = 0.0,
+                 segment_overlap_seconds: float = 2.0,
+                 segment_num_threads: int = 1,
+                 resample_quality: str = "very_high",
+                 resample_num_threads: int = 1,
+                 cache_dir: Optional[Union[str, os.PathLike]] = None,
+                 cache_dtype: str = "float32",
+                 nsim_step_window: int = 6,
+                 nsim_channel_window: int = 5,
+                 high_gamma_band: float = 84.0,
+                 perceptual_sample_rate: Optional[float] = None):
+        """
+        Initialize the Zimtohrli comparator.
+        
+        Args:
+            dtw_band_radius: If not 0, the max number of spectrogram time steps
+                (about 12 ms each) the time alignment may deviate from the
+                diagonal. Makes comparing long recordings feasible, since time
+                grows linearly instead of quadratically with length.
+            dtw_max_drift_seconds: If not 0, the max time alignment drift in
+                seconds between the signals. Same as dtw_band_radius but in
+                seconds. If both are set, the narrower band is used. The
+                result of a band equals the unconstrained comparison as long
+                as the signals don't drift apart more than it allows.
+            dtw_multiresolution_radius: If not 0, the time alignment is first
+                computed between spectrograms pooled to 1/2, 1/4, 1/8, ... of
+                their time steps, and each finer alignment only within this
+                many time steps of the coarser one. Time and memory grow
+                linearly with length, and unlike a band this follows drifts
+                of any size. Distances stay within a few 1e-3 of the full
+                alignment, and are often lower since it finds cheaper
+                alignments around gaps. Takes precedence over the band
+                parameters, but not over segment_seconds.
+            dtw_precision: The value type the time alignment reads the
+                second spectrogram in, one of DTW_PRECISIONS. "float16" and
+                "bfloat16" halve the memory it reads and use the fast math
+                frame distances, which makes it about twice as fast. On
+                noisy, stretched and gapped test clips, distances stayed
+                within 2e-6 and MOS within 1e-4 ("float16") or 3e-4
+                ("bfloat16") of the exact ones, which suits screening runs.
+            fast_math: If True, the frame distances of the time alignment and
+                the NSIM scores are computed with vectorized approximations of
+                the power function (relative error below 1e-5). This makes
+                both two to three times faster. The alignment may differ where
+                alternative alignments cost almost the same, and distances
+                differ by a few 1e-4 from the exact ones. Keep it False where
+                bit-exact reproducibility matters.
+            dtw_num_threads: The number of threads the time alignment of a
+                single comparison uses, or 0 for one per CPU. Reduces the
+                latency of comparing long recordings, with identical results.
+                To compare many signals, prefer compare_audio_batch().
+            segment_seconds: If not 0, signals longer than this many seconds
+                are analyzed and time aligned in segments of this length, on
+                segment_num_threads threads. This can use several cores and
+                bounds the memory of the time alignment of multi-hour
+                recordings, at the cost of a small deviation from processing
+                the signals whole (typically below 1e-3 relative).
+            segment_overlap_seconds: The context in seconds processed with
+                each segment on both sides. Should exceed the alignment drift
+                between the signals.
+            segment_num_threads: The number of threads the segments of one
+                comparison are processed on, or 0 for one per CPU. The
+                comparators asking for the same number share one pool of
+                native threads. Keep the default of 1 when comparisons already
+                run in parallel, e.g. on several Python threads.
+            resample_quality: The soxr quality audio at other sample rates
+                than 48kHz is resampled with, one of RESAMPLE_QUALITIES.
+            resample_num_threads: The number of threads soxr resamples with,
+                or 0 to let soxr decide.
+            cache_dir: If not None, a directory that compare(),
+                distance_map() and analyze() store the spectrograms of audio
+                arrays in, and load them from when the same audio is passed
+                again with the same analysis and resampling parameters,
+                skipping its resampling and analysis. Entries are named by a
+                hash of the audio, can be shared by processes, and are memory
+                mapped without copying.
+            cache_dtype: The value type cache entries are stored in, one of
+                CACHE_DTYPES. "float16" and "bfloat16" halve their size, with
+                relative errors below 5e-4 and 2e-3 in the spectrogram values,
+                but entries are then copied into float32 when loaded.
+                Spectrograms analyzed with such a cache are rounded the same
+                way, so that results don't depend on whether the cache had
+                them.
+            nsim_step_window: The number of time steps the NSIM statistics
+                are windowed over.
+            nsim_channel_window: The number of channels (at most 128) the
+                NSIM statistics are windowed over.
+            high_gamma_band: The frequency in Hz the analysis time steps
+                derive from: each step is int(48000 / high_gamma_band)
+                samples at 48kHz.
+            perceptual_sample_rate: If not None, the rate of the analysis
+                time steps in Hz, between 1 and 48000, which takes precedence
+                over high_gamma_band. It is rounded to a whole number of
+                samples per step. Lower rates make fewer, longer steps, which
+                makes the time alignment much cheaper (quadratically without
+                a band), e.g. for coarse screening runs. The MOS mapping is
+                fitted to the default parameters, so distances and MOS of
+                other parameters are only comparable among themselves.
+                Spectrogram caches are keyed on the step length.
+        
+        Raises:
+            ValueError: If a band, segment or thread parameter is negative,
+                resample_quality, dtw_precision or cache_dtype is unknown,
+                or a perceptual parameter is out of range
+        """
+        if dtw_band_radius < 0:
+            raise ValueError("dtw_band_radius must be non-negative")
+        if dtw_max_drift_seconds < 0:
+            raise ValueError("dtw_max_drift_seconds must be non-negative")
+        if dtw_multiresolution_radius < 0:
+            raise ValueError("dtw_multiresolution_radius must be non-negative")
+        if dtw_num_threads < 0:
+            raise ValueError("dtw_num_threads must be non-negative")
+        if segment_seconds < 0:
+            raise ValueError("segment_seconds must be non-negative")
+        if segment_overlap_seconds < 0:
+            raise ValueError("segment_overlap_seconds must be non-negative")
+        if segment_num_threads < 0:
+            raise ValueError("segment_num_threads must be non-negative")
+        _check_resample_options(resample_quality, resample_num_threads)
+        if dtw_precision not in DTW_PRECISIONS:
+            raise ValueError(f"dtw_precision must be one of {DTW_PRECISIONS}")
+        if cache_dtype not in CACHE_DTYPES:
+            raise ValueError(f"cache_dtype must be one of {CACHE_DTYPES}")
+        self._zimtohrli = _ZimtohrliCore(**_perceptual_parameters(
+            nsim_step_window, nsim_channel_window, high_gamma_band,
+            perceptual_sample_rate))
+        self._zimtohrli.dtw_band_radius = int(dtw_band_radius)
+        self._zimtohrli.dtw_max_drift_seconds = float(dtw_max_drift_seconds)
+        self._zimtohrli.dtw_multiresolution_radius = int(
+            dtw_multiresolution_radius)
+        self._zimtohrli.dtw_precision = dtw_precision
+        self._zimtohrli.fast_math = bool(fast_math)
+        self._zimtohrli.dtw_num_threads = int(dtw_num_threads)
+        self._zimtohrli.segment_seconds = float(segment_seconds)
+        self._zimtohrli.segment_overlap_seconds = float(segment_overlap_seconds)
+        self._zimtohrli.segment_num_threads = int(segment_num_threads)
+        self._zimtohrli.resample_quality = resample_quality
+        self._zimtohrli.resample_num_threads = int(resample_num_threads)
+        if cache_dir is not None:
+            self._zimtohrli.set_cache(os.fspath(cache_dir), cache_dtype)
     
-    def compare(self, audio_a: np.ndarray, audio_b: np.ndarray, 
-                return_distance: bool = False) -> float:
+    def compare(self, audio_a: Union[np.ndarray, Spectrogram],
+                audio_b: Union[np.ndarray, Spectrogram],
+                return_distance: bool = False,
+                sample_rate_a: float = 48000,
+                sample_rate_b: float = 48000) -> float:
         """
-        Compare two audio arrays at 48kHz sample rate.
+        Compare two audio arrays.
+        
+        Audio arrays at other sample rates than 48kHz are resampled with the
+        resample_quality of the comparator.
         
-        Note: Both arrays must already be at 48kHz sample rate.
-        Use compare_audio() for automatic resampling.
+        Either argument can also be a Spectrogram returned by analyze(),
+        which skips analyzing that signal again. This is useful when the
+        same reference is compared against many signals.
         
         Args:
-            audio_a: First audio array (1D numpy array of float32)
-            audio_b: Second audio array (1D numpy array of float32)
+            audio_a: First audio array (1D numpy array of float32, float64, or int16/int32 PCM) or Spectrogram
+            audio_b: Second audio array (1D numpy array of float32, float64, or int16/int32 PCM) or Spectrogram
             return_distance: If True, return raw distance. If False, return MOS.
+            sample_rate_a: Sample rate of audio_a in Hz, ignored for a Spectrogram
+            sample_rate_b: Sample rate of audio_b in Hz, ignored for a Spectrogram
             
         Returns:
             float: Either MOS score or raw distance
@@ -163,54 +836,144 @@ class ZimtohrliComparator:
         Raises:
             ValueError: If inputs are invalid
         """
-        # Validate and prepare arrays
-        if not isinstance(audio_a, np.ndarray) or not isinstance(audio_b, np.ndarray):
-            raise ValueError("Audio inputs must be numpy arrays")
-        
-        if audio_a.ndim != 1 or audio_b.ndim != 1:
-            raise ValueError("Audio arrays must be 1-dimensional")
-            
-        if audio_a.dtype != np.float32:
-            audio_a = audio_a.astype(np.float32)
-        if audio_b.dtype != np.float32:
-            audio_b = audio_b.astype(np.float32)
-        
-        if not audio_a.flags['C_CONTIGUOUS']:
-            audio_a = np.ascontiguousarray(audio_a)
-        if not audio_b.flags['C_CONTIGUOUS']:
-            audio_b = np.ascontiguousarray(audio_b)
+        audio_a = self._prepare_operand(audio_a)
+        audio_b = self._prepare_operand(audio_b)
         
         # Get raw distance
-        distance = self._zimtohrli.distance(audio_a, audio_b)
+        distance = self._zimtohrli.distance(audio_a, audio_b,
+                                            float(sample_rate_a),
+                                            float(sample_rate_b))
         
         if return_distance:
             return distance
         else:
             return zimtohrli_distance_to_mos(distance)
     
-    def analyze(self, audio: np.ndarray) -> bytes:
+    def distance_map(self, audio_a: Union[np.ndarray, Spectrogram],
+                     audio_b: Union[np.ndarray, Spectrogram],
+                     sample_rate_a: float = 48000,
+                     sample_rate_b: float = 48000) -> DistanceMap:
+        """
+        Compare two audio arrays, and return where differences are.
+        
+        Computes the same distance as compare() in one pass, and also returns
+        the time alignment and the score of each frequency channel in each
+        aligned step, which locates the differences without comparing slices
+        of the signals again. The arrays are views of the native results,
+        without copies.
+        
+        Args:
+            audio_a: First audio array (1D numpy array of float32, float64, or int16/int32 PCM) or Spectrogram
+            audio_b: Second audio array (1D numpy array of float32, float64, or int16/int32 PCM) or Spectrogram
+            sample_rate_a: Sample rate of audio_a in Hz, ignored for a Spectrogram
+            sample_rate_b: Sample rate of audio_b in Hz, ignored for a Spectrogram
+            
+        Returns:
+            DistanceMap: The distance, its MOS, the aligned steps and scores
+            
+        Raises:
+            ValueError: If inputs are invalid
+        """
+        audio_a = self._prepare_operand(audio_a)
+        audio_b = self._prepare_operand(audio_b)
+        distance, time_pairs, scores = self._zimtohrli.distance_map(
+            audio_a, audio_b, float(sample_rate_a), float(sample_rate_b))
+        return DistanceMap(distance, zimtohrli_distance_to_mos(distance),
+                           np.asarray(time_pairs), np.asarray(scores))
+    
+    def compare_channels(self, audio_a: np.ndarray, audio_b: np.ndarray,
+                         channel_axis: int = 0, aggregation: str = "mean",
+                         num_threads: Optional[int] = None,
+                         sample_rate_a: float = 48000,
+                         sample_rate_b: float = 48000) -> ChannelComparison:
+        """
+        Compare two multichannel audio arrays channel by channel.
+        
+        Channel i of audio_a is compared with channel i of audio_b. All
+        channels of both arrays are analyzed in parallel on native threads,
+        each into one contiguous spectrogram, and read in place from planar
+        arrays without copies. Interleaved arrays at other sample rates than
+        48kHz are resampled with all channels in one soxr call.
+        
+        The arrays mustn't be modified by other threads during the call.
+        
+        Args:
+            audio_a: First audio array, 1D for mono or 2D with channels along
+                channel_axis, of the dtypes compare() accepts
+            audio_b: Second audio array, with as many channels as audio_a
+            channel_axis: 0 for planar [channels, samples] arrays, 1 or -1
+                for interleaved [samples, channels] arrays
+            aggregation: How the channel distances are combined: "mean",
+                "min" or "max" (the worst channel)
+            num_threads: Number of threads, defaults to one per core
+            sample_rate_a: Sample rate of audio_a in Hz
+            sample_rate_b: Sample rate of audio_b in Hz
+            
+        Returns:
+            ChannelComparison: The aggregated and the per-channel scores
+            
+        Raises:
+            ValueError: If inputs are invalid
+        """
+        if aggregation not in _CHANNEL_AGGREGATIONS:
+            raise ValueError(
+                f"aggregation must be one of {tuple(_CHANNEL_AGGREGATIONS)}")
+        if channel_axis not in (0, 1, -1):
+            raise ValueError("channel_axis must be 0, 1 or -1")
+        if num_threads is not None and num_threads <= 0:
+            raise ValueError("num_threads must be positive")
+        if sample_rate_a <= 0 or sample_rate_b <= 0:
+            raise ValueError("Sample rates must be positive")
+        audio_a = _as_signal(audio_a)
+        audio_b = _as_signal(audio_b)
+        for audio in (audio_a, audio_b):
+            if audio.ndim not in (1, 2):
+                raise ValueError("Audio arrays must be 1- or 2-dimensional")
+            if audio.size == 0:
+                raise ValueError("Audio arrays cannot be empty")
+        distances = np.asarray(self._zimtohrli.distance_channels(
+            audio_a, audio_b, float(sample_rate_a), float(sample_rate_b),
+            channel_axis % 2, num_threads or 0))
+        distance = float(_CHANNEL_AGGREGATIONS[aggregation](distances))
+        channel_mos = np.array(
+            [zimtohrli_distance_to_mos(value) for value in distances],
+            dtype=np.float32)
+        return ChannelComparison(distance, zimtohrli_distance_to_mos(distance),
+                                 distances, channel_mos)
+    
+    def analyze(self, audio: np.ndarray,
+                sample_rate: float = 48000) -> Spectrogram:
         """
-        Analyze audio and return spectrogram data.
+        Analyze audio and return its spectrogram.
         
         Args:
-            audio: Audio array (1D numpy array of float32) at 48kHz
+            audio: Audio array (1D numpy array of float32, float64, or int16/int32 PCM)
+            sample_rate: Sample rate of audio in Hz
             
         Returns:
-            bytes: Spectrogram data
+            Spectrogram: Spectrogram of the audio. np.asarray(spectrogram)
+            returns a read-only (num_steps, num_rotators) float32 view of
+            its values without copying them.
         """
+        return self._zimtohrli.analyze(self._prepare_operand(audio),
+                                       float(sample_rate))
+    
+    @staticmethod
+    def _prepare_operand(audio):
+        """Validates audio and converts it to an array the native code reads."""
+        if isinstance(audio, Spectrogram):
+            return audio
+        
         if not isinstance(audio, np.ndarray):
             raise ValueError("Audio input must be numpy array")
         
         if audio.ndim != 1:
             raise ValueError("Audio array must be 1-dimensional")
-            
-        if audio.dtype != np.float32:
-            audio = audio.astype(np.float32)
         
-        if not audio.flags['C_CONTIGUOUS']:
-            audio = np.ascontiguousarray(audio)
-            
-        return self._zimtohrli.analyze(audio)
+        if len(audio) == 0:
+            raise ValueError("Audio array cannot be empty")
+        
+        return _as_signal(audio)
     
     @property
     def sample_rate(self) -> int:
@@ -221,6 +984,342 @@ class ZimtohrliComparator:
     def num_rotators(self) -> int:
         """Get the number of rotators (spectrogram dimensions)."""
         return self._zimtohrli.num_rotators()
+    
+    @property
+    def dtw_band_radius(self) -> int:
+        """Get the DTW band radius in time steps, 0 if unconstrained."""
+        return self._zimtohrli.dtw_band_radius
+    
+    @property
+    def dtw_max_drift_seconds(self) -> float:
+        """Get the max DTW alignment drift in seconds, 0 if unconstrained."""
+        return self._zimtohrli.dtw_max_drift_seconds
+
+    @property
+    def dtw_multiresolution_radius(self) -> int:
+        """Get the multiresolution DTW radius in time steps, 0 if disabled."""
+        return self._zimtohrli.dtw_multiresolution_radius
+
+    @property
+    def dtw_precision(self) -> str:
+        """Get the value type the time alignment reads spectrograms in."""
+        return self._zimtohrli.dtw_precision
+
+    @property
+    def fast_math(self) -> bool:
+        """Get whether the approximate fast math path is used."""
+        return self._zimtohrli.fast_math
+
+    @property
+    def dtw_num_threads(self) -> int:
+        """Get the number of threads of the time alignment, 0 for one per CPU."""
+        return self._zimtohrli.dtw_num_threads
+
+    @property
+    def segment_seconds(self) -> float:
+        """Get the segment length in seconds, 0 if signals are processed whole."""
+        return self._zimtohrli.segment_seconds
+
+    @property
+    def segment_overlap_seconds(self) -> float:
+        """Get the context in seconds processed with each segment."""
+        return self._zimtohrli.segment_overlap_seconds
+
+    @property
+    def segment_num_threads(self) -> int:
+        """Get the number of threads of the segments, 0 for one per CPU."""
+        return self._zimtohrli.segment_num_threads
+
+    @property
+    def nsim_step_window(self) -> int:
+        """Get the number of time steps the NSIM is windowed over."""
+        return self._zimtohrli.nsim_step_window
+
+    @property
+    def nsim_channel_window(self) -> int:
+        """Get the number of channels the NSIM is windowed over."""
+        return self._zimtohrli.nsim_channel_window
+
+    @property
+    def high_gamma_band(self) -> float:
+        """Get the frequency in Hz the analysis time steps derive from."""
+        return self._zimtohrli.high_gamma_band
+
+    @property
+    def perceptual_sample_rate(self) -> float:
+        """Get the rate of the analysis time steps in Hz."""
+        return self._zimtohrli.perceptual_sample_rate
+
+    @property
+    def resample_quality(self) -> str:
+        """Get the soxr quality audio at other sample rates is resampled with."""
+        return self._zimtohrli.resample_quality
+
+    @property
+    def resample_num_threads(self) -> int:
+        """Get the number of soxr threads, 0 if soxr decides."""
+        return self._zimtohrli.resample_num_threads
+
+    @property
+    def cache_dir(self) -> Optional[str]:
+        """Get the spectrogram cache directory, None if nothing is cached."""
+        info = self._zimtohrli.cache_info()
+        return None if info is None else info[0]
+
+    def cache_stats(self) -> CacheStats:
+        """
+        Get the counts of the spectrogram cache lookups of this comparator.
+        
+        Returns:
+            CacheStats: The counts of hits and misses, 0 without a cache
+        """
+        info = self._zimtohrli.cache_info()
+        return CacheStats(0, 0) if info is None else CacheStats(*info[2:])
+
+
+class StreamingAnalyzer:
+    """
+    Analyzes a live audio stream chunk by chunk.
+    
+    Keeps the filterbank state between calls, so audio can be analyzed while
+    it arrives instead of buffering the whole signal. Each spectrogram row
+    covers one step of 571 samples at 48 kHz (about 12 ms), and is returned
+    once the samples of its step and 32 samples of lookahead have been pushed.
+    Streams at other sample rates are resampled to 48 kHz on the fly, which
+    delays the rows by the resampling filter.
+    
+    For a 48 kHz stream whose length is a multiple of 571 samples, the
+    concatenated rows equal ZimtohrliComparator().analyze() of the whole
+    signal. Other high_gamma_band and perceptual_sample_rate values change
+    the step length.
+    
+    Example:
+        >>> analyzer = StreamingAnalyzer()
+        >>> for chunk in stream:
+        ...     rows = np.asarray(analyzer.push(chunk))
+        ...     print(f"{rows.shape[0]} new rows")
+        >>> last_rows = analyzer.finish()
+    """
+    
+    def __init__(self, sample_rate: float = 48000,
+                 high_gamma_band: float = 84.0,
+                 perceptual_sample_rate: Optional[float] = None):
+        """
+        Initialize an analyzer for a new stream.
+        
+        Args:
+            sample_rate: Sample rate of the stream in Hz
+            high_gamma_band, perceptual_sample_rate: The length of the
+                steps, see ZimtohrliComparator
+            
+        Raises:
+            ValueError: If sample_rate isn't positive, or the step length is
+                out of range
+        """
+        if sample_rate <= 0:
+            raise ValueError("sample_rate must be positive")
+        self._analyzer = _StreamingAnalyzerCore(
+            float(sample_rate), high_gamma_band=float(high_gamma_band),
+            perceptual_sample_rate=(None if perceptual_sample_rate is None
+                                    else float(perceptual_sample_rate)))
+    
+    def push(self, chunk: np.ndarray) -> Spectrogram:
+        """
+        Add a chunk of samples to the stream.
+        
+        Args:
+            chunk: Audio samples (1D numpy array of int16 or int32 PCM, or
+                floating point) at the sample rate of the stream, of any
+                length including 0
+            
+        Returns:
+            Spectrogram: The rows completed by the chunk, possibly with 0
+            steps
+            
+        Raises:
+            ValueError: If the chunk is not a 1-dimensional array
+        """
+        if not isinstance(chunk, np.ndarray):
+            raise ValueError("Audio chunk must be numpy array")
+        if chunk.ndim != 1:
+            raise ValueError("Audio chunk must be 1-dimensional")
+        return self._analyzer.push(_as_signal(chunk))
+    
+    def finish(self) -> Spectrogram:
+        """
+        End the stream and return its remaining rows.
+        
+        The last row covers the samples of the partial last step. The
+        analyzer is reset afterwards and can analyze a new stream.
+        
+        Returns:
+            Spectrogram: The remaining rows, possibly with 0 steps
+        """
+        return self._analyzer.finish()
+    
+    def reset(self) -> None:
+        """Discard the stream analyzed so far."""
+        self._analyzer.reset()
+    
+    @property
+    def num_samples(self) -> int:
+        """Get the number of 48kHz samples analyzed since the stream started."""
+        return self._analyzer.num_samples
+    
+    @property
+    def num_steps(self) -> int:
+        """Get the number of rows returned since the stream started."""
+        return self._analyzer.num_steps
+
+
+class StreamingDistanceReport(NamedTuple):
+    """
+    The distance between two streams over a window of time.
+    
+    Attributes:
+        start_seconds: Start of the window in the first stream
+        end_seconds: End of the window in the first stream
+        distance: Zimtohrli distance over the window (0-1, lower is better)
+        mos: MOS score over the window (1-5, higher is better)
+    """
+    
+    start_seconds: float
+    end_seconds: float
+    distance: float
+    mos: float
+
+
+class StreamingDistance:
+    """
+    Compares two live 48kHz audio streams, e.g. the input and the output of an
+    encoder, while their samples arrive.
+    
+    Both streams are analyzed incrementally and time aligned over a band of
+    max_drift_seconds, so memory and latency stay bounded for streams of any
+    length. Every report_seconds of aligned audio, a StreamingDistanceReport
+    over the last window_seconds is returned.
+    
+    Compared to ZimtohrliComparator.compare() of the whole signals, the
+    alignment assumes both streams run at the same rate, and energy levels
+    are matched with the loudest parts heard so far. For streams of equal
+    length whose energy levels match, the distance is that of a comparator
+    with the same dtw_max_drift_seconds, up to rounding.
+    
+    Example:
+        >>> streaming = StreamingDistance(report_seconds=1.0, window_seconds=3.0)
+        >>> for chunk_a, chunk_b in streams:
+        ...     for report in streaming.push(chunk_a, chunk_b):
+        ...         print(f"{report.end_seconds:.1f}s: MOS {report.mos:.3f}")
+        >>> streaming.finish()
+        >>> print(f"Overall distance: {streaming.distance:.5f}")
+    """
+    
+    def __init__(self, report_seconds: float = 1.0,
+                 window_seconds: float = 3.0,
+                 max_drift_seconds: float = 1.0,
+                 fast_math: bool = False,
+                 nsim_step_window: int = 6,
+                 nsim_channel_window: int = 5,
+                 high_gamma_band: float = 84.0,
+                 perceptual_sample_rate: Optional[float] = None):
+        """
+        Initialize the comparison of two new streams.
+        
+        Args:
+            report_seconds: The aligned time between two reports.
+            window_seconds: The time each report covers, which may be longer
+                (overlapping windows) or shorter than report_seconds.
+            max_drift_seconds: The max time alignment drift between the
+                streams. Also the delay after which the second stream's audio
+                is reported on.
+            fast_math: If True, uses the vectorized approximations described
+                in ZimtohrliComparator.
+            nsim_step_window, nsim_channel_window, high_gamma_band,
+            perceptual_sample_rate: The perceptual parameters, see
+                ZimtohrliComparator
+        
+        Raises:
+            ValueError: If report_seconds, window_seconds or max_drift_seconds
+                isn't positive, or a perceptual parameter is out of range
+        """
+        if report_seconds <= 0:
+            raise ValueError("report_seconds must be positive")
+        if window_seconds <= 0:
+            raise ValueError("window_seconds must be positive")
+        if max_drift_seconds <= 0:
+            raise ValueError("max_drift_seconds must be positive")
+        self._distance = _StreamingDistanceCore(
+            float(report_seconds), float(window_seconds),
+            float(max_drift_seconds), bool(fast_math),
+            **_perceptual_parameters(nsim_step_window, nsim_channel_window,
+                                     high_gamma_band, perceptual_sample_rate))
+    
+    @staticmethod
+    def _prepare_chunk(chunk: np.ndarray) -> np.ndarray:
+        if not isinstance(chunk, np.ndarray):
+            raise ValueError("Audio chunk must be numpy array")
+        if chunk.ndim != 1:
+            raise ValueError("Audio chunk must be 1-dimensional")
+        return _as_signal(chunk)
+    
+    def push(self, chunk_a: np.ndarray,
+             chunk_b: np.ndarray) -> List[StreamingDistanceReport]:
+        """
+        Add the next chunks of both streams.
+        
+        Args:
+            chunk_a: Samples of the first stream (1D numpy array of float32, float64, or int16/int32 PCM)
+                at 48kHz, of any length including 0
+            chunk_b: Samples of the second stream, of any length including 0
+            
+        Returns:
+            list: The StreamingDistanceReports completed by the chunks
+            
+        Raises:
+            ValueError: If a chunk is not a 1-dimensional array
+            RuntimeError: If finish() was called since the streams started
+        """
+        chunk_a = self._prepare_chunk(chunk_a)
+        chunk_b = self._prepare_chunk(chunk_b)
+        return [StreamingDistanceReport(*report)
+                for report in self._distance.push(chunk_a, chunk_b)]
+    
+    def finish(self) -> List[StreamingDistanceReport]:
+        """
+        End both streams and return the remaining reports.
+        
+        The last report covers the aligned audio after the previous report,
+        which may be shorter than report_seconds. Call reset() before
+        pushing new streams.
+        
+        Returns:
+            list: The remaining StreamingDistanceReports
+            
+        Raises:
+            RuntimeError: If finish() was already called
+        """
+        return [StreamingDistanceReport(*report)
+                for report in self._distance.finish()]
+    
+    def reset(self) -> None:
+        """Discard the streams compared so far."""
+        self._distance.reset()
+    
+    @property
+    def distance(self) -> Optional[float]:
+        """Get the distance over everything aligned so far, None before."""
+        return self._distance.distance
+    
+    @property
+    def mos(self) -> Optional[float]:
+        """Get the MOS score over everything aligned so far, None before."""
+        distance = self._distance.distance
+        return None if distance is None else _mos_from_zimtohrli(distance)
+    
+    @property
+    def finished(self) -> bool:
+        """Get whether finish() was called since the streams started."""
+        return self._distance.finished
 
 
 # Module-level convenience instance
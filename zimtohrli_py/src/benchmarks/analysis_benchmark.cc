@@ -0,0 +1,278 @@
+// Copyright 2025 The Zimtohrli Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Microbenchmarks of the Analyze stages.
+//
+// BM_DualFIR and BM_IncrementRotators measure the prefilter and filterbank
+// kernels per simd::Target, and BM_LoopDualFIR and BM_LoopIncrementRotators
+// the scalar loops they replace. All report samples per second on one core,
+// and the kernels report whether their output is bit-identical to the scalar
+// loop. BM_Analyze measures the end-to-end Analyze, and BM_ComputeRotatorTables
+// and BM_GetRotatorTables the filterbank setup it saves by sharing
+// RotatorTables. BM_CachedAnalyze measures loading the spectrogram from a
+// SpectrogramCache instead.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "zimt/simd.h"
+#include "zimt/spectrogram_cache.h"
+#include "zimt/zimtohrli.h"
+
+namespace zimtohrli {
+
+namespace {
+
+// One output step at the default 48 kHz sample rate and 84 Hz frame rate.
+constexpr size_t kStepSamples = 571;
+
+std::vector<float> RandomSignal(size_t num_samples, unsigned seed) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> distribution(-0.5f, 0.5f);
+  std::vector<float> result(num_samples);
+  for (float& value : result) {
+    value = distribution(rng);
+  }
+  return result;
+}
+
+// The state of a filterbank with kNumRotators rotators, laid out like in
+// Rotators.
+struct RotatorBank {
+  RotatorBank()
+      : rot(4 * kNumRotators),
+        accu(6 * kNumRotators),
+        window(kNumRotators),
+        weights(kStepSamples),
+        current(kNumRotators),
+        next(kNumRotators) {
+    for (size_t i = 0; i < kNumRotators; ++i) {
+      const float f = 2.0f * M_PI * Freq(i) / kSampleRate;
+      window[i] = 0.9996f - 0.0004f * i / kNumRotators;
+      rot[i] = std::cos(f);
+      rot[kNumRotators + i] = -std::sin(f);
+      rot[2 * kNumRotators + i] = 1.0f;
+    }
+    for (size_t i = 0; i < kStepSamples; ++i) {
+      weights[i] = 1.0f - (i + 0.5f) / kStepSamples;
+    }
+  }
+
+  std::vector<float> rot;
+  std::vector<float> accu;
+  std::vector<float> window;
+  std::vector<float> weights;
+  std::vector<float> current;
+  std::vector<float> next;
+};
+
+void BM_LoopIncrementRotators(benchmark::State& state) {
+  const std::vector<float> signal = RandomSignal(kStepSamples, 1);
+  RotatorBank bank;
+  for (auto _ : state) {
+    simd::LoopIncrementRotators(bank.rot.data(), bank.accu.data(),
+                                bank.window.data(), kNumRotators,
+                                signal.data(), kStepSamples,
+                                bank.weights.data(), bank.current.data(),
+                                bank.next.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * kStepSamples);
+}
+BENCHMARK(BM_LoopIncrementRotators);
+
+// State.range(0) is the simd::Target.
+void BM_IncrementRotators(benchmark::State& state) {
+  const simd::Target target = static_cast<simd::Target>(state.range(0));
+  const std::vector<simd::Target> targets = simd::SupportedTargets();
+  if (std::find(targets.begin(), targets.end(), target) == targets.end()) {
+    state.SkipWithError("target not supported by this CPU");
+    return;
+  }
+  state.SetLabel(simd::TargetName(target));
+  const std::vector<float> signal = RandomSignal(kStepSamples, 1);
+  RotatorBank bank;
+  for (auto _ : state) {
+    simd::IncrementRotators(target, bank.rot.data(), bank.accu.data(),
+                            bank.window.data(), kNumRotators, signal.data(),
+                            kStepSamples, bank.weights.data(),
+                            bank.current.data(), bank.next.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * kStepSamples);
+
+  // Runs a few steps from a fresh state through both implementations.
+  RotatorBank expected;
+  RotatorBank actual;
+  for (int step = 0; step < 16; ++step) {
+    simd::LoopIncrementRotators(
+        expected.rot.data(), expected.accu.data(), expected.window.data(),
+        kNumRotators, signal.data(), kStepSamples, expected.weights.data(),
+        expected.current.data(), step % 2 ? expected.next.data() : nullptr);
+    simd::IncrementRotators(
+        target, actual.rot.data(), actual.accu.data(), actual.window.data(),
+        kNumRotators, signal.data(), kStepSamples, actual.weights.data(),
+        actual.current.data(), step % 2 ? actual.next.data() : nullptr);
+  }
+  const auto same = [](const std::vector<float>& a,
+                       const std::vector<float>& b) {
+    return std::memcmp(a.data(), b.data(), a.size() * sizeof(float)) == 0;
+  };
+  state.counters["identical"] = same(expected.rot, actual.rot) &&
+                                same(expected.accu, actual.accu) &&
+                                same(expected.current, actual.current) &&
+                                same(expected.next, actual.next);
+}
+BENCHMARK(BM_IncrementRotators)
+    ->DenseRange(static_cast<int>(simd::Target::kScalar),
+                 static_cast<int>(simd::Target::kAVX512));
+
+// The prefilter kernels of FilterAndDownsample.
+constexpr size_t kKernelSize = 32;
+
+void BM_LoopDualFIR(benchmark::State& state) {
+  const std::vector<float> signal = RandomSignal(kStepSamples + kKernelSize, 1);
+  const std::vector<float> kernel_a = RandomSignal(kKernelSize, 2);
+  const std::vector<float> kernel_b = RandomSignal(kKernelSize, 3);
+  std::vector<float> out_a(kStepSamples);
+  std::vector<float> out_b(kStepSamples);
+  for (auto _ : state) {
+    simd::LoopDualFIR(signal.data(), kStepSamples, kernel_a.data(),
+                      kernel_b.data(), kKernelSize, out_a.data(),
+                      out_b.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * kStepSamples);
+}
+BENCHMARK(BM_LoopDualFIR);
+
+// State.range(0) is the simd::Target.
+void BM_DualFIR(benchmark::State& state) {
+  const simd::Target target = static_cast<simd::Target>(state.range(0));
+  const std::vector<simd::Target> targets = simd::SupportedTargets();
+  if (std::find(targets.begin(), targets.end(), target) == targets.end()) {
+    state.SkipWithError("target not supported by this CPU");
+    return;
+  }
+  state.SetLabel(simd::TargetName(target));
+  const std::vector<float> signal = RandomSignal(kStepSamples + kKernelSize, 1);
+  const std::vector<float> kernel_a = RandomSignal(kKernelSize, 2);
+  const std::vector<float> kernel_b = RandomSignal(kKernelSize, 3);
+  std::vector<float> out_a(kStepSamples);
+  std::vector<float> out_b(kStepSamples);
+  for (auto _ : state) {
+    simd::DualFIR(target, signal.data(), kStepSamples, kernel_a.data(),
+                  kernel_b.data(), kKernelSize, out_a.data(), out_b.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * kStepSamples);
+
+  std::vector<float> expected_a(kStepSamples);
+  std::vector<float> expected_b(kStepSamples);
+  simd::LoopDualFIR(signal.data(), kStepSamples, kernel_a.data(),
+                    kernel_b.data(), kKernelSize, expected_a.data(),
+                    expected_b.data());
+  state.counters["identical"] =
+      std::memcmp(out_a.data(), expected_a.data(),
+                  kStepSamples * sizeof(float)) == 0 &&
+      std::memcmp(out_b.data(), expected_b.data(),
+                  kStepSamples * sizeof(float)) == 0;
+}
+BENCHMARK(BM_DualFIR)
+    ->DenseRange(static_cast<int>(simd::Target::kScalar),
+                 static_cast<int>(simd::Target::kAVX512));
+
+// State.range(0) is the clip length in seconds.
+void BM_Analyze(benchmark::State& state) {
+  const size_t num_samples =
+      state.range(0) * static_cast<size_t>(kSampleRate);
+  const std::vector<float> signal = RandomSignal(num_samples, 1);
+  const Zimtohrli zimtohrli;
+  for (auto _ : state) {
+    const Spectrogram spectrogram =
+        zimtohrli.Analyze(Span<const float>(signal));
+    benchmark::DoNotOptimize(spectrogram.values.get());
+  }
+  state.SetItemsProcessed(state.iterations() * num_samples);
+}
+BENCHMARK(BM_Analyze)
+    ->Arg(1)
+    ->Arg(3)
+    ->Arg(5)
+    ->Unit(benchmark::kMillisecond);
+
+// State.range(0) is the clip length in seconds, state.range(1) the
+// SpectrogramEncoding. Includes hashing the signal for the key and reading
+// all values, from the page cache after the first iteration.
+void BM_CachedAnalyze(benchmark::State& state) {
+  const size_t num_samples =
+      state.range(0) * static_cast<size_t>(kSampleRate);
+  const std::vector<float> signal = RandomSignal(num_samples, 1);
+  const Zimtohrli zimtohrli;
+  const std::filesystem::path directory =
+      std::filesystem::temp_directory_path() / "zimtohrli_analysis_benchmark";
+  const SpectrogramCache cache(
+      directory.string(), static_cast<SpectrogramEncoding>(state.range(1)));
+  const uint64_t config_hash = AnalysisHash(zimtohrli);
+  cache.Store(
+      SpectrogramCache::Key(Span<const float>(signal), kSampleRate,
+                            config_hash),
+      zimtohrli.Analyze(Span<const float>(signal)), config_hash);
+  for (auto _ : state) {
+    const std::optional<Spectrogram> spectrogram = cache.Load(
+        SpectrogramCache::Key(Span<const float>(signal), kSampleRate,
+                              config_hash),
+        config_hash);
+    benchmark::DoNotOptimize(spectrogram->max());
+  }
+  state.counters["misses"] = cache.num_misses();
+  state.SetItemsProcessed(state.iterations() * num_samples);
+  std::filesystem::remove_all(directory);
+}
+BENCHMARK(BM_CachedAnalyze)
+    ->ArgsProduct({{1, 5},
+                   {static_cast<int>(SpectrogramEncoding::kFloat32),
+                    static_cast<int>(SpectrogramEncoding::kFloat16)}})
+    ->Unit(benchmark::kMillisecond);
+
+// Computing the filterbank coefficients, which every Analyze did before they
+// were shared.
+void BM_ComputeRotatorTables(benchmark::State& state) {
+  for (auto _ : state) {
+    RotatorTables tables(RotatorTables::kDefaultDownsample);
+    benchmark::DoNotOptimize(tables.window);
+  }
+}
+BENCHMARK(BM_ComputeRotatorTables);
+
+// Looking up the shared filterbank coefficients, which every Analyze does.
+// State.range(0) is the downsample.
+void BM_GetRotatorTables(benchmark::State& state) {
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(&RotatorTables::Get(state.range(0)));
+  }
+}
+BENCHMARK(BM_GetRotatorTables)->Arg(RotatorTables::kDefaultDownsample)->Arg(500);
+
+}  // namespace
+
+}  // namespace zimtohrli
+
+BENCHMARK_MAIN();
@@ -0,0 +1,476 @@
+// Copyright 2025 The Zimtohrli Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Microbenchmarks of the Distance stages.
+//
+// BM_SquaredDistances measures the DTW frame distance kernels per
+// simd::Target, and BM_DeltaNorms compares them with the scalar delta_norm
+// they replace. BM_ParallelDTW measures the DTW per Zimtohrli::dtw_num_threads.
+// BM_NSIM and BM_Distance measure NSIM and the end-to-end Distance, exact and
+// with Zimtohrli::fast_math. BM_SegmentedDistance measures Analyze and
+// Distance of long clips in segments (Zimtohrli::segment_seconds) per thread
+// count. BM_IdenticalDistance measures Distance of a clip with a copy of
+// itself, which skips the DTW. BM_WorkspaceDistance measures Analyze and
+// Distance with and without a reused Workspace, and counts the heap
+// allocations per iteration.
+// BM_MultiresolutionDistance measures Distance with
+// Zimtohrli::dtw_multiresolution_radius of noisy, stretched and gapped clips.
+// The counters report the max deviation from the exact reference.
+// BM_CompactDistance measures Distance with Zimtohrli::dtw_panel_type of the
+// same clips, and reports the deviation of distance and MOS.
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "zimt/mos.h"
+#include "zimt/simd.h"
+#include "zimt/zimtohrli.h"
+
+// The number of calls to operator new and operator new[], for
+// BM_WorkspaceDistance.
+static std::atomic<size_t> num_allocations{0};
+
+static void* CountedAllocate(size_t size) {
+  num_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* result = std::malloc(size == 0 ? 1 : size)) {
+    return result;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new(size_t size) { return CountedAllocate(size); }
+void* operator new[](size_t size) { return CountedAllocate(size); }
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+void operator delete(void* pointer, size_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { std::free(pointer); }
+
+namespace zimtohrli {
+
+namespace {
+
+Spectrogram RandomSpectrogram(size_t num_steps, unsigned seed) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> distribution(0.0f, 80.0f);
+  Spectrogram result(num_steps, kNumRotators);
+  for (size_t index = 0; index < result.size(); ++index) {
+    result.values[index] = distribution(rng);
+  }
+  return result;
+}
+
+std::vector<float> RandomSignal(size_t num_samples, unsigned seed) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> distribution(-0.5f, 0.5f);
+  std::vector<float> result(num_samples);
+  for (float& value : result) {
+    value = distribution(rng);
+  }
+  return result;
+}
+
+// State.range(0) is the simd::Target, state.range(1) is 1 for fast math.
+void BM_SquaredDistances(benchmark::State& state) {
+  const simd::Target target = static_cast<simd::Target>(state.range(0));
+  const bool fast_math = state.range(1);
+  const std::vector<simd::Target> targets = simd::SupportedTargets();
+  if (std::find(targets.begin(), targets.end(), target) == targets.end()) {
+    state.SkipWithError("target not supported by this CPU");
+    return;
+  }
+  state.SetLabel(simd::TargetName(target));
+  constexpr size_t kNumPanels = 64;
+  constexpr size_t kNumColumns = kNumPanels * simd::kPanelWidth;
+  const Spectrogram a = RandomSpectrogram(simd::kRows, 1);
+  const Spectrogram b = RandomSpectrogram(kNumColumns, 2);
+  std::vector<float> panels(b.size());
+  for (size_t step = 0; step < b.num_steps; ++step) {
+    for (size_t dim = 0; dim < b.num_dims; ++dim) {
+      panels[simd::PanelIndex(step, dim, b.num_dims)] = b[step][dim];
+    }
+  }
+  std::vector<double> out(simd::kRows * kNumColumns);
+  for (auto _ : state) {
+    if (fast_math) {
+      simd::FastPowSquaredDistances(target, a.values.get(), a.num_dims,
+                                    simd::kRows, panels.data(), b.num_dims,
+                                    kNumPanels, kDeltaNormPower, out.data(),
+                                    kNumColumns);
+    } else {
+      simd::SquaredDistances(target, a.values.get(), a.num_dims, simd::kRows,
+                             panels.data(), b.num_dims, kNumPanels,
+                             out.data(), kNumColumns);
+    }
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  double max_deviation = 0;
+  for (size_t row = 0; row < simd::kRows; ++row) {
+    for (size_t step = 0; step < kNumColumns; ++step) {
+      const double expected = delta_norm(a[row], b[step]);
+      double actual = out[row * kNumColumns + step];
+      if (!fast_math) {
+        actual = std::pow(actual, kDeltaNormPower);
+      }
+      max_deviation =
+          std::max(max_deviation, std::abs(actual - expected) / expected);
+    }
+  }
+  state.counters["max_rel_deviation"] = max_deviation;
+  state.SetItemsProcessed(state.iterations() * simd::kRows * kNumColumns);
+}
+BENCHMARK(BM_SquaredDistances)
+    ->ArgsProduct({{static_cast<int>(simd::Target::kScalar),
+                    static_cast<int>(simd::Target::kNEON),
+                    static_cast<int>(simd::Target::kAVX2),
+                    static_cast<int>(simd::Target::kAVX512)},
+                   {0, 1}});
+
+// The scalar delta_norm loop the DTW used before DeltaNorms.
+void BM_DeltaNormScalar(benchmark::State& state) {
+  const size_t num_steps = state.range(0);
+  const Spectrogram a = RandomSpectrogram(1, 1);
+  const Spectrogram b = RandomSpectrogram(num_steps, 2);
+  std::vector<double> out(num_steps);
+  for (auto _ : state) {
+    for (size_t step = 0; step < num_steps; ++step) {
+      out[step] = delta_norm(a[0], b[step]);
+    }
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * num_steps);
+}
+BENCHMARK(BM_DeltaNormScalar)->Arg(1024);
+
+// State.range(0) is the number of steps of b, state.range(1) is 1 for fast
+// math, state.range(2) the simd::PanelType.
+void BM_DeltaNorms(benchmark::State& state) {
+  const size_t num_steps = state.range(0);
+  const bool fast_math = state.range(1);
+  const auto panel_type = static_cast<simd::PanelType>(state.range(2));
+  state.SetLabel(simd::TargetName(simd::BestTarget()));
+  const Spectrogram a = RandomSpectrogram(simd::kRows, 1);
+  const Spectrogram b = RandomSpectrogram(num_steps, 2);
+  const DeltaNorms delta_norms(b, 1.0f, 1.0f, fast_math, panel_type);
+  DeltaNorms::Block block;
+  for (auto _ : state) {
+    delta_norms.Compute(a, 0, simd::kRows, 0, num_steps, block);
+    benchmark::DoNotOptimize(block.Row(0));
+    benchmark::ClobberMemory();
+  }
+  double max_deviation = 0;
+  for (size_t row = 0; row < simd::kRows; ++row) {
+    for (size_t step = 0; step < num_steps; ++step) {
+      const double expected = delta_norm(a[row], b[step]);
+      max_deviation = std::max(
+          max_deviation,
+          std::abs(block.Row(row)[step - block.first_step_b()] - expected) /
+              expected);
+    }
+  }
+  state.counters["max_rel_deviation"] = max_deviation;
+  state.SetItemsProcessed(state.iterations() * simd::kRows * num_steps);
+}
+BENCHMARK(BM_DeltaNorms)
+    ->ArgsProduct({{1024, 16384}, {0, 1}, {0}})
+    ->ArgsProduct({{1024, 16384},
+                   {1},
+                   {static_cast<int>(simd::PanelType::kFloat16),
+                    static_cast<int>(simd::PanelType::kBFloat16)}});
+
+// State.range(0) is the number of steps of both spectrograms, state.range(1)
+// the number of threads.
+void BM_ParallelDTW(benchmark::State& state) {
+  const size_t num_steps = state.range(0);
+  const size_t num_threads = state.range(1);
+  const Spectrogram a = RandomSpectrogram(num_steps, 1);
+  const Spectrogram b = RandomSpectrogram(num_steps, 2);
+  Zimtohrli zimtohrli;
+  zimtohrli.dtw_num_threads = num_threads;
+  ThreadPool* const pool = zimtohrli.DTWThreadPool();
+  const std::vector<std::pair<size_t, size_t>> serial = DTW(a, b);
+  std::vector<std::pair<size_t, size_t>> path;
+  for (auto _ : state) {
+    path = DTW(a, b, 1.0f, 1.0f, 0, false, pool);
+    benchmark::DoNotOptimize(path.data());
+  }
+  if (path != serial) {
+    state.SkipWithError("path differs from the serial DTW");
+  }
+  state.SetItemsProcessed(state.iterations() * num_steps * num_steps);
+}
+BENCHMARK(BM_ParallelDTW)
+    ->ArgsProduct({{1000, 4000}, {1, 2, 4, 8}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// State.range(0) is the number of aligned steps, state.range(1) is 1 for fast
+// math.
+void BM_NSIM(benchmark::State& state) {
+  const size_t num_steps = state.range(0);
+  const bool fast_math = state.range(1);
+  const Spectrogram a = RandomSpectrogram(num_steps, 1);
+  const Spectrogram b = RandomSpectrogram(num_steps, 2);
+  std::vector<std::pair<size_t, size_t>> time_pairs;
+  for (size_t step = 0; step < num_steps; ++step) {
+    time_pairs.push_back({step, step});
+  }
+  float nsim = 0;
+  for (auto _ : state) {
+    nsim = NSIM(a, b, time_pairs, 6, 5, 1.0f, 1.0f, fast_math);
+    benchmark::DoNotOptimize(nsim);
+  }
+  state.counters["nsim_deviation"] =
+      std::abs(nsim - NSIM(a, b, time_pairs, 6, 5));
+  state.SetItemsProcessed(state.iterations() * num_steps * a.num_dims);
+}
+BENCHMARK(BM_NSIM)
+    ->ArgsProduct({{500, 5000}, {0, 1}})
+    ->Unit(benchmark::kMillisecond);
+
+// State.range(0) is the clip length in seconds, state.range(1) is 1 for fast
+// math.
+void BM_Distance(benchmark::State& state) {
+  const size_t num_samples =
+      state.range(0) * static_cast<size_t>(kSampleRate);
+  const std::vector<float> signal_a = RandomSignal(num_samples, 1);
+  std::vector<float> signal_b = signal_a;
+  std::mt19937 rng(2);
+  std::uniform_real_distribution<float> noise(-0.05f, 0.05f);
+  for (float& value : signal_b) {
+    value += noise(rng);
+  }
+  Zimtohrli exact;
+  Zimtohrli fast;
+  fast.fast_math = true;
+  const Zimtohrli& zimtohrli = state.range(1) ? fast : exact;
+  const Spectrogram a = exact.Analyze(Span<const float>(signal_a));
+  const Spectrogram b = exact.Analyze(Span<const float>(signal_b));
+  float distance = 0;
+  for (auto _ : state) {
+    distance = zimtohrli.Distance(a, a.max(), b, b.max());
+    benchmark::DoNotOptimize(distance);
+  }
+  const float exact_distance = exact.Distance(a, a.max(), b, b.max());
+  state.counters["distance_deviation"] = std::abs(distance - exact_distance);
+  state.SetItemsProcessed(state.iterations() * a.num_steps * b.num_steps);
+}
+BENCHMARK(BM_Distance)
+    ->ArgsProduct({{5, 20}, {0, 1}})
+    ->Unit(benchmark::kMillisecond);
+
+// State.range(0) is the clip length in seconds, state.range(1) the number of
+// threads. Analyzes and compares the clips in 10 second segments.
+void BM_SegmentedDistance(benchmark::State& state) {
+  const size_t num_samples =
+      state.range(0) * static_cast<size_t>(kSampleRate);
+  const std::vector<float> signal_a = RandomSignal(num_samples, 1);
+  std::vector<float> signal_b = signal_a;
+  std::mt19937 rng(2);
+  std::uniform_real_distribution<float> noise(-0.05f, 0.05f);
+  for (float& value : signal_b) {
+    value += noise(rng);
+  }
+  Zimtohrli segmented;
+  segmented.segment_seconds = 10;
+  segmented.segment_num_threads = state.range(1);
+  float distance = 0;
+  for (auto _ : state) {
+    const Spectrogram a = segmented.Analyze(Span<const float>(signal_a));
+    const Spectrogram b = segmented.Analyze(Span<const float>(signal_b));
+    distance = segmented.Distance(a, a.max(), b, b.max());
+    benchmark::DoNotOptimize(distance);
+  }
+  const Zimtohrli whole;
+  const Spectrogram a = whole.Analyze(Span<const float>(signal_a));
+  const Spectrogram b = whole.Analyze(Span<const float>(signal_b));
+  state.counters["distance_deviation"] =
+      std::abs(distance - whole.Distance(a, a.max(), b, b.max()));
+  state.SetItemsProcessed(state.iterations() * 2 * num_samples);
+}
+BENCHMARK(BM_SegmentedDistance)
+    ->ArgsProduct({{60, 180}, {1, 2, 4, 8}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// State.range(0) is the clip length in seconds.
+void BM_IdenticalDistance(benchmark::State& state) {
+  const size_t num_samples =
+      state.range(0) * static_cast<size_t>(kSampleRate);
+  const std::vector<float> signal = RandomSignal(num_samples, 1);
+  const Zimtohrli zimtohrli;
+  const Spectrogram a = zimtohrli.Analyze(Span<const float>(signal));
+  const Spectrogram b = zimtohrli.Analyze(Span<const float>(signal));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(zimtohrli.Distance(a, a.max(), b, b.max()));
+  }
+  state.SetItemsProcessed(state.iterations() * a.num_steps * b.num_steps);
+}
+BENCHMARK(BM_IdenticalDistance)->Arg(5)->Arg(20)->Unit(benchmark::kMillisecond);
+
+// State.range(0) is the clip length in seconds, state.range(1) is 1 to reuse
+// a Workspace.
+void BM_WorkspaceDistance(benchmark::State& state) {
+  const size_t num_samples =
+      state.range(0) * static_cast<size_t>(kSampleRate);
+  const std::vector<float> signal_a = RandomSignal(num_samples, 1);
+  const std::vector<float> signal_b = RandomSignal(num_samples, 2);
+  const Zimtohrli zimtohrli;
+  Workspace workspace;
+  Spectrogram& a = workspace.spectrogram_a;
+  Spectrogram& b = workspace.spectrogram_b;
+  const auto distance = [&] {
+    if (!state.range(1)) {
+      const Spectrogram new_a = zimtohrli.Analyze(Span<const float>(signal_a));
+      const Spectrogram new_b = zimtohrli.Analyze(Span<const float>(signal_b));
+      return zimtohrli.Distance(new_a, new_a.max(), new_b, new_b.max());
+    }
+    zimtohrli.Analyze(Span<const float>(signal_a), a, workspace);
+    zimtohrli.Analyze(Span<const float>(signal_b), b, workspace);
+    return zimtohrli.Distance(a, a.max(), b, b.max(), workspace);
+  };
+  // Grows the buffers of the workspace.
+  distance();
+  const size_t allocations_before = num_allocations.load();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(distance());
+  }
+  state.counters["allocations"] = benchmark::Counter(
+      num_allocations.load() - allocations_before,
+      benchmark::Counter::kAvgIterations);
+  state.SetItemsProcessed(state.iterations() * 2 * num_samples);
+}
+BENCHMARK(BM_WorkspaceDistance)
+    ->ArgsProduct({{1, 5}, {0, 1}})
+    ->Unit(benchmark::kMillisecond);
+
+// The degradations of BM_MultiresolutionDistance.
+enum Degradation { kNoise, kStretch, kGap };
+
+// Returns signal with degradation applied.
+std::vector<float> Degrade(const std::vector<float>& signal,
+                           Degradation degradation) {
+  std::vector<float> result;
+  switch (degradation) {
+    case kNoise: {
+      result = signal;
+      std::mt19937 rng(2);
+      std::uniform_real_distribution<float> noise(-0.05f, 0.05f);
+      for (float& value : result) {
+        value += noise(rng);
+      }
+      break;
+    }
+    case kStretch:
+      // Plays signal 5% slower.
+      result.resize(signal.size() * 105 / 100);
+      for (size_t index = 0; index < result.size(); ++index) {
+        result[index] = signal[index * 100 / 105];
+      }
+      break;
+    case kGap:
+      // Inserts 2 seconds of silence after the first third.
+      result = signal;
+      result.insert(result.begin() + result.size() / 3,
+                    2 * static_cast<size_t>(kSampleRate), 0.0f);
+      break;
+  }
+  return result;
+}
+
+// State.range(0) is the clip length in seconds, state.range(1) the
+// Degradation, state.range(2) the radius. distance_deviation is the
+// deviation from the DTW distance, and optimal_deviation from the distance
+// along the cheapest path of BacktrackedDTW, which DTW doesn't always find.
+void BM_MultiresolutionDistance(benchmark::State& state) {
+  const size_t num_samples =
+      state.range(0) * static_cast<size_t>(kSampleRate);
+  const std::vector<float> signal_a = RandomSignal(num_samples, 1);
+  const std::vector<float> signal_b =
+      Degrade(signal_a, static_cast<Degradation>(state.range(1)));
+  Zimtohrli zimtohrli;
+  const Spectrogram a = zimtohrli.Analyze(Span<const float>(signal_a));
+  const Spectrogram b = zimtohrli.Analyze(Span<const float>(signal_b));
+  const float exact_distance = zimtohrli.Distance(a, a.max(), b, b.max());
+  const auto [scale_a, scale_b] = Zimtohrli::RescaleFactors(a.max(), b.max());
+  const float optimal_distance =
+      1 - NSIM(a, b,
+               BacktrackedDTW(a, b, scale_a, scale_b,
+                              DTWBand(a.num_steps, b.num_steps, 0)),
+               zimtohrli.nsim_step_window, zimtohrli.nsim_channel_window,
+               scale_a, scale_b);
+  zimtohrli.dtw_multiresolution_radius = state.range(2);
+  float distance = 0;
+  for (auto _ : state) {
+    distance = zimtohrli.Distance(a, a.max(), b, b.max());
+    benchmark::DoNotOptimize(distance);
+  }
+  state.counters["distance_deviation"] = distance - exact_distance;
+  state.counters["optimal_deviation"] = distance - optimal_distance;
+  state.SetItemsProcessed(state.iterations() * a.num_steps);
+}
+BENCHMARK(BM_MultiresolutionDistance)
+    ->ArgsProduct({{10, 60}, {kNoise, kStretch, kGap}, {1, 4, 16}})
+    ->Unit(benchmark::kMillisecond);
+
+// State.range(0) is the clip length in seconds, state.range(1) the
+// Degradation, state.range(2) the simd::PanelType. The deviations are from the
+// exact float32 Distance, and from the fast math one it otherwise matches.
+void BM_CompactDistance(benchmark::State& state) {
+  const size_t num_samples =
+      state.range(0) * static_cast<size_t>(kSampleRate);
+  const std::vector<float> signal_a = RandomSignal(num_samples, 1);
+  const std::vector<float> signal_b =
+      Degrade(signal_a, static_cast<Degradation>(state.range(1)));
+  Zimtohrli zimtohrli;
+  const Spectrogram a = zimtohrli.Analyze(Span<const float>(signal_a));
+  const Spectrogram b = zimtohrli.Analyze(Span<const float>(signal_b));
+  const float exact_distance = zimtohrli.Distance(a, a.max(), b, b.max());
+  zimtohrli.fast_math = true;
+  const float fast_distance = zimtohrli.Distance(a, a.max(), b, b.max());
+  zimtohrli.fast_math = false;
+  zimtohrli.dtw_panel_type = static_cast<simd::PanelType>(state.range(2));
+  float distance = 0;
+  for (auto _ : state) {
+    distance = zimtohrli.Distance(a, a.max(), b, b.max());
+    benchmark::DoNotOptimize(distance);
+  }
+  state.counters["distance_deviation"] = distance - exact_distance;
+  state.counters["fast_math_deviation"] = distance - fast_distance;
+  state.counters["mos_deviation"] =
+      MOSFromZimtohrli(distance) - MOSFromZimtohrli(exact_distance);
+  state.SetItemsProcessed(state.iterations() * a.num_steps * b.num_steps);
+}
+BENCHMARK(BM_CompactDistance)
+    ->ArgsProduct({{10, 60},
+                   {kNoise, kStretch, kGap},
+                   {static_cast<int>(simd::PanelType::kFloat32),
+                    static_cast<int>(simd::PanelType::kFloat16),
+                    static_cast<int>(simd::PanelType::kBFloat16)}})
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace
+
+}  // namespace zimtohrli
+
+BENCHMARK_MAIN();
@@ -0,0 +1,229 @@
+// Copyright 2025 The Zimtohrli Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Throughput benchmarks of every stage of a comparison over clip lengths
+// from 1 s to 10 min, to catch performance regressions between versions.
+//
+// All benchmarks take the clip length in seconds as state.range(0), and
+// report realtime_factor, the seconds of audio processed per second, next to
+// the time. BM_FilterAndDownsample measures Rotators::FilterAndDownsample,
+// BM_WindowMean and BM_NSIM the NSIM statistics and scores along the
+// diagonal, and BM_DTW the time warp within a band of kMaxDriftSeconds per
+// thread count. BM_Resample measures resampling a stereo clip from 44.1 kHz
+// per soxr thread count, and BM_Distance analyzing and comparing two clips
+// end to end per Zimtohrli::dtw_num_threads.
+//
+// The run_benchmarks target (or --benchmark_out=<file>
+// --benchmark_out_format=json) writes the results as JSON, which
+// Google Benchmark's tools/compare.py compares between two builds.
+
+#include <cstddef>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "zimt/resample.h"
+#include "zimt/zimtohrli.h"
+
+namespace zimtohrli {
+
+namespace {
+
+// The clip lengths in seconds.
+const std::vector<int64_t> kSeconds = {1, 10, 60, 600};
+// The thread counts of the benchmarks that can use several threads.
+const std::vector<int64_t> kThreads = {1, 4};
+// The time warp drift the DTW benchmarks allow, which keeps them linear in
+// the clip length. Unconstrained time warps of long clips are measured by
+// distance_benchmark.
+constexpr float kMaxDriftSeconds = 1.0f;
+
+// White noise, which exercises every channel of the filterbank.
+std::vector<float> RandomSignal(size_t num_samples, unsigned seed) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> distribution(-0.5f, 0.5f);
+  std::vector<float> result(num_samples);
+  for (float& value : result) {
+    value = distribution(rng);
+  }
+  return result;
+}
+
+// Returns signal with a little noise added.
+std::vector<float> Degrade(const std::vector<float>& signal, unsigned seed) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> noise(-0.05f, 0.05f);
+  std::vector<float> result = signal;
+  for (float& value : result) {
+    value += noise(rng);
+  }
+  return result;
+}
+
+size_t NumSamples(const benchmark::State& state) {
+  return state.range(0) * static_cast<size_t>(kSampleRate);
+}
+
+void SetRealtimeFactor(benchmark::State& state) {
+  state.counters["realtime_factor"] = benchmark::Counter(
+      static_cast<double>(state.range(0)) * state.iterations(),
+      benchmark::Counter::kIsRate);
+}
+
+// The diagonal time pairs of num_steps steps.
+std::vector<std::pair<size_t, size_t>> Diagonal(size_t num_steps) {
+  std::vector<std::pair<size_t, size_t>> result(num_steps);
+  for (size_t step = 0; step < num_steps; ++step) {
+    result[step] = {step, step};
+  }
+  return result;
+}
+
+void BM_FilterAndDownsample(benchmark::State& state) {
+  const std::vector<float> signal = RandomSignal(NumSamples(state), 1);
+  const Zimtohrli zimtohrli;
+  Spectrogram spectrogram(zimtohrli.SpectrogramSteps(signal.size()),
+                          kNumRotators);
+  const size_t downsample = signal.size() / spectrogram.num_steps;
+  Rotators rotators;
+  for (auto _ : state) {
+    rotators.FilterAndDownsample(signal.data(), signal.size(),
+                                 spectrogram.values.get(),
+                                 spectrogram.num_steps, spectrogram.num_dims,
+                                 downsample);
+    benchmark::DoNotOptimize(spectrogram.values.get());
+    benchmark::ClobberMemory();
+  }
+  SetRealtimeFactor(state);
+  state.SetItemsProcessed(state.iterations() * signal.size());
+}
+BENCHMARK(BM_FilterAndDownsample)
+    ->ArgsProduct({kSeconds})
+    ->Unit(benchmark::kMillisecond);
+
+void BM_WindowMean(benchmark::State& state) {
+  const Zimtohrli zimtohrli;
+  const Spectrogram a = zimtohrli.Analyze(
+      Span<const float>(RandomSignal(NumSamples(state), 1)));
+  for (auto _ : state) {
+    const Spectrogram mean = WindowMean(
+        a.num_steps, a.num_dims, zimtohrli.nsim_step_window,
+        zimtohrli.nsim_channel_window,
+        [&](size_t step, size_t dim) { return a[step][dim]; });
+    benchmark::DoNotOptimize(mean.values.get());
+  }
+  SetRealtimeFactor(state);
+  state.SetItemsProcessed(state.iterations() * a.size());
+}
+BENCHMARK(BM_WindowMean)
+    ->ArgsProduct({kSeconds})
+    ->Unit(benchmark::kMillisecond);
+
+void BM_NSIM(benchmark::State& state) {
+  const std::vector<float> signal_a = RandomSignal(NumSamples(state), 1);
+  const std::vector<float> signal_b = Degrade(signal_a, 2);
+  const Zimtohrli zimtohrli;
+  const Spectrogram a = zimtohrli.Analyze(Span<const float>(signal_a));
+  const Spectrogram b = zimtohrli.Analyze(Span<const float>(signal_b));
+  const std::vector<std::pair<size_t, size_t>> time_pairs =
+      Diagonal(a.num_steps);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(NSIM(a, b, time_pairs,
+                                  zimtohrli.nsim_step_window,
+                                  zimtohrli.nsim_channel_window));
+  }
+  SetRealtimeFactor(state);
+  state.SetItemsProcessed(state.iterations() * a.size());
+}
+BENCHMARK(BM_NSIM)->ArgsProduct({kSeconds})->Unit(benchmark::kMillisecond);
+
+// State.range(1) is the number of threads.
+void BM_DTW(benchmark::State& state) {
+  const std::vector<float> signal_a = RandomSignal(NumSamples(state), 1);
+  const std::vector<float> signal_b = Degrade(signal_a, 2);
+  Zimtohrli zimtohrli;
+  zimtohrli.dtw_max_drift_seconds = kMaxDriftSeconds;
+  zimtohrli.dtw_num_threads = state.range(1);
+  const Spectrogram a = zimtohrli.Analyze(Span<const float>(signal_a));
+  const Spectrogram b = zimtohrli.Analyze(Span<const float>(signal_b));
+  ThreadPool* const pool = zimtohrli.DTWThreadPool();
+  DTWBuffers buffers;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(DTW(a, b, 1.0f, 1.0f, zimtohrli.DTWBandRadius(),
+                                 false, pool, buffers)
+                                 .data());
+  }
+  SetRealtimeFactor(state);
+  state.SetItemsProcessed(state.iterations() * a.num_steps);
+}
+BENCHMARK(BM_DTW)
+    ->ArgsProduct({kSeconds, kThreads})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// State.range(1) is the number of soxr threads, which resample the channels
+// in parallel.
+void BM_Resample(benchmark::State& state) {
+  constexpr float kInSampleRate = 44100;
+  constexpr size_t kNumChannels = 2;
+  const std::vector<float> signal = RandomSignal(
+      state.range(0) * static_cast<size_t>(kInSampleRate) * kNumChannels, 1);
+  ResampleOptions options;
+  options.num_threads = state.range(1);
+  for (auto _ : state) {
+    std::vector<float> resampled =
+        ResampleInterleaved<float>(Span<const float>(signal), kNumChannels,
+                                   kInSampleRate, kSampleRate, options);
+    benchmark::DoNotOptimize(resampled.data());
+  }
+  SetRealtimeFactor(state);
+  state.SetItemsProcessed(state.iterations() * signal.size());
+}
+BENCHMARK(BM_Resample)
+    ->ArgsProduct({kSeconds, {1, 2}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// State.range(1) is Zimtohrli::dtw_num_threads. Measures Analyze of both
+// clips and Distance, like a comparison of two signals at kSampleRate.
+void BM_Distance(benchmark::State& state) {
+  const std::vector<float> signal_a = RandomSignal(NumSamples(state), 1);
+  const std::vector<float> signal_b = Degrade(signal_a, 2);
+  Zimtohrli zimtohrli;
+  zimtohrli.dtw_max_drift_seconds = kMaxDriftSeconds;
+  zimtohrli.dtw_num_threads = state.range(1);
+  Workspace workspace;
+  for (auto _ : state) {
+    zimtohrli.Analyze(Span<const float>(signal_a), workspace.spectrogram_a,
+                      workspace);
+    zimtohrli.Analyze(Span<const float>(signal_b), workspace.spectrogram_b,
+                      workspace);
+    benchmark::DoNotOptimize(zimtohrli.Distance(
+        workspace.spectrogram_a, workspace.spectrogram_a.max(),
+        workspace.spectrogram_b, workspace.spectrogram_b.max(), workspace));
+  }
+  SetRealtimeFactor(state);
+  state.SetItemsProcessed(state.iterations() * signal_a.size());
+}
+BENCHMARK(BM_Distance)
+    ->ArgsProduct({kSeconds, kThreads})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+}  // namespace
+
+}  // namespace zimtohrli
+
+BENCHMARK_MAIN();
@@ -0,0 +1,112 @@
+// Copyright 2025 The Zimtohrli Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Microbenchmarks of resampling to kSampleRate per soxr quality.
+//
+// BM_Resample measures Resample per ResampleOptions::quality_recipe and input
+// sample rate, and reports input samples per second. BM_ResampledDistance
+// measures resampling and comparing two clips end to end, and its counters
+// report the deviation of the distance and MOS from resampling with SOXR_VHQ.
+
+#include <cmath>
+#include <cstddef>
+#include <random>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "zimt/mos.h"
+#include "zimt/resample.h"
+#include "zimt/zimtohrli.h"
+
+namespace zimtohrli {
+
+namespace {
+
+constexpr unsigned long kQualities[] = {SOXR_QQ, SOXR_LQ, SOXR_MQ, SOXR_HQ,
+                                        SOXR_VHQ};
+
+ResampleOptions OptionsFor(size_t quality_index) {
+  ResampleOptions options;
+  options.quality_recipe = kQualities[quality_index] | SOXR_LINEAR_PHASE;
+  return options;
+}
+
+// A chord of tones with a little noise, which exercises the whole band.
+std::vector<float> TestSignal(size_t num_samples, float sample_rate,
+                              unsigned seed) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> noise(-0.01f, 0.01f);
+  std::vector<float> result(num_samples);
+  for (size_t index = 0; index < num_samples; ++index) {
+    const float t = index / sample_rate;
+    result[index] = 0.2f * std::sin(2 * M_PI * 220 * t) +
+                    0.1f * std::sin(2 * M_PI * 1760 * t) +
+                    0.05f * std::sin(2 * M_PI * 7040 * t) + noise(rng);
+  }
+  return result;
+}
+
+// State.range(0) indexes kQualities, state.range(1) is the input sample rate.
+void BM_Resample(benchmark::State& state) {
+  const ResampleOptions options = OptionsFor(state.range(0));
+  const float sample_rate = state.range(1);
+  const std::vector<float> signal =
+      TestSignal(10 * static_cast<size_t>(sample_rate), sample_rate, 1);
+  for (auto _ : state) {
+    std::vector<float> resampled = Resample<float>(
+        Span<const float>(signal), sample_rate, kSampleRate, options);
+    benchmark::DoNotOptimize(resampled.data());
+  }
+  state.SetItemsProcessed(state.iterations() * signal.size());
+}
+BENCHMARK(BM_Resample)
+    ->ArgsProduct({{0, 1, 2, 3, 4}, {16000, 44100}})
+    ->Unit(benchmark::kMillisecond);
+
+// State.range(0) indexes kQualities, state.range(1) is the input sample rate.
+// Resamples and compares two 5 second clips.
+void BM_ResampledDistance(benchmark::State& state) {
+  const ResampleOptions options = OptionsFor(state.range(0));
+  const float sample_rate = state.range(1);
+  const size_t num_samples = 5 * static_cast<size_t>(sample_rate);
+  const std::vector<float> signal_a = TestSignal(num_samples, sample_rate, 1);
+  const std::vector<float> signal_b = TestSignal(num_samples, sample_rate, 2);
+  const Zimtohrli zimtohrli;
+  const auto distance_with = [&](const ResampleOptions& resample) {
+    const Spectrogram a = zimtohrli.Analyze(Span<const float>(Resample<float>(
+        Span<const float>(signal_a), sample_rate, kSampleRate, resample)));
+    const Spectrogram b = zimtohrli.Analyze(Span<const float>(Resample<float>(
+        Span<const float>(signal_b), sample_rate, kSampleRate, resample)));
+    return zimtohrli.Distance(a, a.max(), b, b.max());
+  };
+  float distance = 0;
+  for (auto _ : state) {
+    distance = distance_with(options);
+    benchmark::DoNotOptimize(distance);
+  }
+  const float reference = distance_with(OptionsFor(4));
+  state.counters["distance_deviation"] = std::abs(distance - reference);
+  state.counters["mos_deviation"] =
+      std::abs(MOSFromZimtohrli(distance) - MOSFromZimtohrli(reference));
+  state.SetItemsProcessed(state.iterations() * 2 * num_samples);
+}
+BENCHMARK(BM_ResampledDistance)
+    ->ArgsProduct({{0, 1, 2, 3, 4}, {16000, 44100}})
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace
+
+}  // namespace zimtohrli
+
+BENCHMARK_MAIN();
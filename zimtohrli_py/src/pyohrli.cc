@@ -16,21 +16,50 @@
 #define PY_SSIZE_T_CLEAN
 #include <Python.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <new>
 #include <optional>
+#include <string>
+#include <type_traits>
+#include <vector>
 
 #include "absl/log/check.h"
 #include "structmember.h"  // NOLINT // For PyMemberDef
+#include "zimt/cancellation.h"
 #include "zimt/mos.h"
+#include "zimt/profile.h"
 #include "zimt/zimtohrli.h"
 #include "zimt/resample.h"
+#include "zimt/spectrogram_cache.h"
+#include "zimt/thread_pool.h"
 
 namespace {
 
+struct BufferDeleter {
+  void operator()(Py_buffer* buffer) const { PyBuffer_Release(buffer); }
+};
+
+struct PyObjectDeleter {
+  void operator()(PyObject* object) const { Py_DECREF(object); }
+};
+
 struct SpectrogramObject {
   // clang-format off
   PyObject_HEAD
   void *spectrogram;
   // clang-format on
+  // Shape and strides of the exported values buffer, i.e.
+  // [num_steps, num_dims].
+  Py_ssize_t shape[2];
+  Py_ssize_t strides[2];
 };
 
 void Spectrogram_dealloc(SpectrogramObject* self) {
@@ -43,6 +72,132 @@ void Spectrogram_dealloc(SpectrogramObject* self) {
   }
 }
 
+// Sets the C++ spectrogram wrapped by self, which must not wrap one yet.
+//
+// Spectrograms are immutable once set: exported buffers and computations
+// running without the GIL borrow the wrapped values.
+void Spectrogram_set(SpectrogramObject* self,
+                     zimtohrli::Spectrogram spectrogram) {
+  self->shape[0] = spectrogram.num_steps;
+  self->shape[1] = spectrogram.num_dims;
+  self->strides[0] = spectrogram.num_dims * sizeof(float);
+  self->strides[1] = sizeof(float);
+  self->spectrogram = new zimtohrli::Spectrogram(std::move(spectrogram));
+}
+
+// Initializes a spectrogram with a copy of a 2-dimensional float32 buffer of
+// shape [num_steps, num_dims]. Raises TypeError if the spectrogram is already
+// initialized.
+int Spectrogram_init(SpectrogramObject* self, PyObject* args, PyObject* kwds) {
+  static const char* keywords[] = {"values", nullptr};
+  PyObject* values_obj;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O",
+                                   const_cast<char**>(keywords), &values_obj)) {
+    return -1;
+  }
+  if (self->spectrogram != nullptr) {
+    PyErr_SetString(PyExc_TypeError, "Spectrogram is already initialized");
+    return -1;
+  }
+  Py_buffer view;
+  if (PyObject_GetBuffer(values_obj, &view,
+                         PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0) {
+    return -1;
+  }
+  std::unique_ptr<Py_buffer, BufferDeleter> view_deleter(&view);
+  if (view.ndim != 2 || view.itemsize != sizeof(float) ||
+      (view.format != nullptr && std::string(view.format) != "f")) {
+    PyErr_SetString(PyExc_TypeError,
+                    "values must be a 2-dimensional float32 array");
+    return -1;
+  }
+  if (view.shape[0] == 0 || view.shape[1] == 0) {
+    PyErr_SetString(PyExc_ValueError, "values cannot be empty");
+    return -1;
+  }
+  try {
+    zimtohrli::Spectrogram spectrogram(view.shape[0], view.shape[1]);
+    std::memcpy(spectrogram.values.get(), view.buf, view.len);
+    Spectrogram_set(self, std::move(spectrogram));
+  } catch (const std::bad_alloc&) {
+    PyErr_SetNone(PyExc_MemoryError);
+    return -1;
+  }
+  return 0;
+}
+
+// Exports the spectrogram values as a read-only [num_steps, num_dims] float32
+// buffer, without copying them.
+int Spectrogram_getbuffer(SpectrogramObject* self, Py_buffer* view,
+                          int flags) {
+  if (self->spectrogram == nullptr) {
+    PyErr_SetString(PyExc_BufferError, "spectrogram is not initialized");
+    view->obj = nullptr;
+    return -1;
+  }
+  if (flags & PyBUF_WRITABLE) {
+    PyErr_SetString(PyExc_BufferError, "spectrogram values are read-only");
+    view->obj = nullptr;
+    return -1;
+  }
+  const zimtohrli::Spectrogram& spectrogram =
+      *static_cast<zimtohrli::Spectrogram*>(self->spectrogram);
+  view->buf = spectrogram.values.get();
+  view->obj = (PyObject*)self;
+  Py_INCREF(self);
+  view->len = spectrogram.size() * sizeof(float);
+  view->readonly = 1;
+  view->itemsize = sizeof(float);
+  view->format = (flags & PyBUF_FORMAT) ? const_cast<char*>("f") : nullptr;
+  view->ndim = 2;
+  view->shape = (flags & PyBUF_ND) == PyBUF_ND ? self->shape : nullptr;
+  view->strides =
+      (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides : nullptr;
+  view->suboffsets = nullptr;
+  view->internal = nullptr;
+  return 0;
+}
+
+PyBufferProcs Spectrogram_as_buffer = {
+    .bf_getbuffer = (getbufferproc)Spectrogram_getbuffer,
+    .bf_releasebuffer = nullptr,
+};
+
+// Returns the wrapped C++ spectrogram, or nullptr with a Python error set if
+// the object was never initialized.
+const zimtohrli::Spectrogram* Spectrogram_get(SpectrogramObject* self) {
+  if (self->spectrogram == nullptr) {
+    PyErr_SetString(PyExc_ValueError, "spectrogram is not initialized");
+  }
+  return static_cast<const zimtohrli::Spectrogram*>(self->spectrogram);
+}
+
+PyObject* Spectrogram_num_steps(SpectrogramObject* self, void* closure) {
+  const zimtohrli::Spectrogram* spectrogram = Spectrogram_get(self);
+  return spectrogram ? PyLong_FromSize_t(spectrogram->num_steps) : nullptr;
+}
+
+PyObject* Spectrogram_num_dims(SpectrogramObject* self, void* closure) {
+  const zimtohrli::Spectrogram* spectrogram = Spectrogram_get(self);
+  return spectrogram ? PyLong_FromSize_t(spectrogram->num_dims) : nullptr;
+}
+
+PyObject* Spectrogram_values(SpectrogramObject* self, void* closure) {
+  return PyMemoryView_FromObject((PyObject*)self);
+}
+
+PyGetSetDef Spectrogram_getset[] = {
+    {"num_steps", (getter)Spectrogram_num_steps, nullptr,
+     "Number of time steps in the spectrogram.", nullptr},
+    {"num_dims", (getter)Spectrogram_num_dims, nullptr,
+     "Number of frequency dimensions in the spectrogram.", nullptr},
+    {"values", (getter)Spectrogram_values, nullptr,
+     "Read-only [num_steps, num_dims] float32 memoryview of the spectrogram "
+     "values, shared with the spectrogram without copying.",
+     nullptr},
+    {nullptr} /* Sentinel */
+};
+
 PyTypeObject SpectrogramType = {
     // clang-format off
     .ob_base = PyVarObject_HEAD_INIT(nullptr, 0)
@@ -51,21 +206,327 @@ PyTypeObject SpectrogramType = {
     .tp_basicsize = sizeof(SpectrogramObject),
     .tp_itemsize = 0,
     .tp_dealloc = (destructor)Spectrogram_dealloc,
+    .tp_as_buffer = &Spectrogram_as_buffer,
     .tp_flags = Py_TPFLAGS_DEFAULT,
-    .tp_doc = PyDoc_STR("Python wrapper around C++ zimtohrli::Spectrogram."),
+    .tp_doc = PyDoc_STR(
+        "Python wrapper around C++ zimtohrli::Spectrogram.\n\n"
+        "Exports its values through the buffer protocol as a read-only "
+        "[num_steps, num_dims] float32 array, so numpy.asarray(spectrogram) "
+        "doesn't copy them. Spectrogram(values) creates a spectrogram from a "
+        "copy of a 2-dimensional float32 array."),
+    .tp_getset = Spectrogram_getset,
+    .tp_init = (initproc)Spectrogram_init,
     .tp_new = PyType_GenericNew,
 };
 
+// Returns a new Spectrogram object taking ownership of spectrogram.
+PyObject* NewSpectrogram(zimtohrli::Spectrogram spectrogram) {
+  SpectrogramObject* result = (SpectrogramObject*)SpectrogramType.tp_alloc(
+      &SpectrogramType, 0);
+  if (result == nullptr) {
+    return nullptr;
+  }
+  try {
+    Spectrogram_set(result, std::move(spectrogram));
+  } catch (const std::bad_alloc&) {
+    Py_DECREF(result);
+    PyErr_SetNone(PyExc_MemoryError);
+    return nullptr;
+  }
+  return (PyObject*)result;
+}
+
+// Typed, immutable storage exported by an ArrayObject.
+struct NativeArray {
+  // Keeps the memory behind data alive.
+  std::shared_ptr<void> owner;
+  void* data;
+  Py_ssize_t itemsize;
+  const char* format;
+  std::vector<Py_ssize_t> shape;
+  std::vector<Py_ssize_t> strides;
+};
+
+struct ArrayObject {
+  // clang-format off
+  PyObject_HEAD
+  void *array;
+  // clang-format on
+};
+
+void Array_dealloc(ArrayObject* self) {
+  if (self) {
+    if (self->array) {
+      delete static_cast<NativeArray*>(self->array);
+      self->array = nullptr;
+    }
+    Py_TYPE(self)->tp_free((PyObject*)self);
+  }
+}
+
+int Array_getbuffer(ArrayObject* self, Py_buffer* view, int flags) {
+  if (flags & PyBUF_WRITABLE) {
+    PyErr_SetString(PyExc_BufferError, "array is read-only");
+    view->obj = nullptr;
+    return -1;
+  }
+  const NativeArray* array = static_cast<NativeArray*>(self->array);
+  Py_ssize_t len = array->itemsize;
+  for (const Py_ssize_t dim : array->shape) {
+    len *= dim;
+  }
+  view->buf = array->data;
+  view->obj = (PyObject*)self;
+  Py_INCREF(self);
+  view->len = len;
+  view->readonly = 1;
+  view->itemsize = array->itemsize;
+  view->format = (flags & PyBUF_FORMAT) ? const_cast<char*>(array->format)
+                                        : nullptr;
+  view->ndim = static_cast<int>(array->shape.size());
+  view->shape = (flags & PyBUF_ND) == PyBUF_ND
+                    ? const_cast<Py_ssize_t*>(array->shape.data())
+                    : nullptr;
+  view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES
+                      ? const_cast<Py_ssize_t*>(array->strides.data())
+                      : nullptr;
+  view->suboffsets = nullptr;
+  view->internal = nullptr;
+  return 0;
+}
+
+PyBufferProcs Array_as_buffer = {
+    .bf_getbuffer = (getbufferproc)Array_getbuffer,
+    .bf_releasebuffer = nullptr,
+};
+
+PyTypeObject ArrayType = {
+    // clang-format off
+    .ob_base = PyVarObject_HEAD_INIT(nullptr, 0)
+    .tp_name = "pyohrli.Array",
+    // clang-format on
+    .tp_basicsize = sizeof(ArrayObject),
+    .tp_itemsize = 0,
+    .tp_dealloc = (destructor)Array_dealloc,
+    .tp_as_buffer = &Array_as_buffer,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = PyDoc_STR(
+        "Read-only array exported through the buffer protocol, wrap with "
+        "numpy.asarray to get an ndarray without copying."),
+};
+
+template <typename T>
+constexpr const char* BufferFormat() {
+  if constexpr (std::is_same_v<T, float>) {
+    return "f";
+  } else if constexpr (std::is_same_v<T, double>) {
+    return "d";
+  } else if constexpr (std::is_same_v<T, int64_t>) {
+    return "q";
+  } else {
+    static_assert(sizeof(T) == 0, "Unsupported array element type");
+  }
+}
+
+// Returns a new C-contiguous ArrayObject with the given shape, taking
+// ownership of values.
+template <typename T>
+PyObject* NewArray(std::vector<T> values, std::vector<Py_ssize_t> shape) {
+  ArrayObject* result = (ArrayObject*)ArrayType.tp_alloc(&ArrayType, 0);
+  if (result == nullptr) {
+    return nullptr;
+  }
+  try {
+    auto storage = std::make_shared<std::vector<T>>(std::move(values));
+    auto array = std::make_unique<NativeArray>();
+    array->data = storage->data();
+    array->owner = std::move(storage);
+    array->itemsize = sizeof(T);
+    array->format = BufferFormat<T>();
+    array->strides.resize(shape.size());
+    Py_ssize_t stride = sizeof(T);
+    for (size_t dim = shape.size(); dim > 0; --dim) {
+      array->strides[dim - 1] = stride;
+      stride *= shape[dim - 1];
+    }
+    array->shape = std::move(shape);
+    result->array = array.release();
+  } catch (const std::bad_alloc&) {
+    Py_DECREF(result);
+    PyErr_SetNone(PyExc_MemoryError);
+    return nullptr;
+  }
+  return (PyObject*)result;
+}
+
+// The soxr quality recipes by their names in the Python API.
+constexpr std::pair<const char*, unsigned long> kResampleQualities[] = {
+    {"quick", SOXR_QQ}, {"low", SOXR_LQ},        {"medium", SOXR_MQ},
+    {"high", SOXR_HQ},  {"very_high", SOXR_VHQ},
+};
+
+// Sets options.quality_recipe to the linear phase recipe of the named
+// quality. Returns false with a Python error set if there is no such quality.
+bool ParseResampleQuality(const char* name,
+                          zimtohrli::ResampleOptions& options) {
+  for (const auto& [quality_name, quality] : kResampleQualities) {
+    if (std::strcmp(name, quality_name) == 0) {
+      options.quality_recipe = quality | SOXR_LINEAR_PHASE;
+      return true;
+    }
+  }
+  PyErr_Format(PyExc_ValueError,
+               "resample quality must be one of 'quick', 'low', 'medium', "
+               "'high' and 'very_high', not '%s'",
+               name);
+  return false;
+}
+
+// Returns the name of the quality of options.quality_recipe.
+const char* ResampleQualityName(const zimtohrli::ResampleOptions& options) {
+  for (const auto& [quality_name, quality] : kResampleQualities) {
+    if (options.quality_recipe == (quality | SOXR_LINEAR_PHASE)) {
+      return quality_name;
+    }
+  }
+  return "custom";
+}
+
+// The value types of the time warp and the spectrogram cache by their names
+// in the Python API.
+constexpr std::pair<const char*, zimtohrli::simd::PanelType> kPrecisions[] = {
+    {"float32", zimtohrli::simd::PanelType::kFloat32},
+    {"float16", zimtohrli::simd::PanelType::kFloat16},
+    {"bfloat16", zimtohrli::simd::PanelType::kBFloat16},
+};
+
+// Sets panel_type to the named value type. Returns false with a Python error
+// set if there is no such type.
+bool ParsePrecision(const char* name, zimtohrli::simd::PanelType& panel_type) {
+  for (const auto& [precision_name, precision] : kPrecisions) {
+    if (std::strcmp(name, precision_name) == 0) {
+      panel_type = precision;
+      return true;
+    }
+  }
+  PyErr_Format(PyExc_ValueError,
+               "precision must be one of 'float32', 'float16' and 'bfloat16', "
+               "not '%s'",
+               name);
+  return false;
+}
+
+// Returns the name of panel_type.
+const char* PrecisionName(zimtohrli::simd::PanelType panel_type) {
+  for (const auto& [precision_name, precision] : kPrecisions) {
+    if (panel_type == precision) {
+      return precision_name;
+    }
+  }
+  return "float32";
+}
+
+// The keywords of the perceptual parameters of zimtohrli::Zimtohrli that
+// Pyohrli, the module functions and the streaming types take, in the order
+// of the values of ApplyPerceptualParameters.
+constexpr const char* kPerceptualKeywords[] = {
+    "nsim_step_window", "nsim_channel_window", "high_gamma_band",
+    "perceptual_sample_rate"};
+constexpr size_t kNumPerceptualParameters = std::size(kPerceptualKeywords);
+
+// Sets the parameters of zimtohrli whose values aren't null or None, from
+// the ints nsim_step_window and nsim_channel_window and the floats
+// high_gamma_band and perceptual_sample_rate, see
+// Zimtohrli::SetHighGammaBand and Zimtohrli::SetPerceptualSampleRate. A
+// perceptual_sample_rate takes precedence over a high_gamma_band. Returns
+// false with a Python error set if a value isn't a number, or the resulting
+// parameters fail Zimtohrli::CheckParameters, in which case zimtohrli is left
+// unchanged.
+bool ApplyPerceptualParameters(
+    PyObject* const (&values)[kNumPerceptualParameters],
+    zimtohrli::Zimtohrli& zimtohrli) {
+  zimtohrli::Zimtohrli result = zimtohrli;
+  // Sets window to values[index] if it is set.
+  const auto parse_window = [&](size_t index, size_t& window) {
+    PyObject* const value = values[index];
+    if (value == nullptr || value == Py_None) {
+      return true;
+    }
+    const long parsed = PyLong_AsLong(value);
+    if (parsed == -1 && PyErr_Occurred()) {
+      return false;
+    }
+    if (parsed < 1) {
+      PyErr_Format(PyExc_ValueError, "%s must be positive",
+                   kPerceptualKeywords[index]);
+      return false;
+    }
+    window = parsed;
+    return true;
+  };
+  // Calls set with values[index] if it is set.
+  const auto parse_rate = [&](size_t index, void (zimtohrli::Zimtohrli::*set)(
+                                                float)) {
+    PyObject* const value = values[index];
+    if (value == nullptr || value == Py_None) {
+      return true;
+    }
+    const double rate = PyFloat_AsDouble(value);
+    if (rate == -1.0 && PyErr_Occurred()) {
+      return false;
+    }
+    (result.*set)(rate);
+    return true;
+  };
+  if (!parse_window(0, result.nsim_step_window) ||
+      !parse_window(1, result.nsim_channel_window) ||
+      !parse_rate(2, &zimtohrli::Zimtohrli::SetHighGammaBand) ||
+      !parse_rate(3, &zimtohrli::Zimtohrli::SetPerceptualSampleRate)) {
+    return false;
+  }
+  if (const char* problem = result.CheckParameters()) {
+    PyErr_SetString(PyExc_ValueError, problem);
+    return false;
+  }
+  zimtohrli = result;
+  return true;
+}
+
 struct PyohrliObject {
   // clang-format off
   PyObject_HEAD
   void *zimtohrli;
   // clang-format on
+  // How signals at other sample rates are resampled to kSampleRate.
+  zimtohrli::ResampleOptions resample;
+  // The cache signals are analyzed through, or null. Shared with the calls
+  // using it without the GIL, so that set_cache can replace it meanwhile.
+  std::shared_ptr<const zimtohrli::SpectrogramCache>* cache;
 };
 
+// Takes the perceptual parameters as optional keyword arguments, see
+// ApplyPerceptualParameters.
 int Pyohrli_init(PyohrliObject* self, PyObject* args, PyObject* kwds) {
+  static const char* keywords[] = {
+      kPerceptualKeywords[0], kPerceptualKeywords[1], kPerceptualKeywords[2],
+      kPerceptualKeywords[3], nullptr};
+  PyObject* perceptual[kNumPerceptualParameters] = {};
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|$OOOO",
+                                   const_cast<char**>(keywords),
+                                   &perceptual[0], &perceptual[1],
+                                   &perceptual[2], &perceptual[3])) {
+    return -1;
+  }
+  zimtohrli::Zimtohrli zimtohrli;
+  if (!ApplyPerceptualParameters(perceptual, zimtohrli)) {
+    return -1;
+  }
+  self->resample = zimtohrli::ResampleOptions();
   try {
-    self->zimtohrli = new zimtohrli::Zimtohrli{};
+    delete static_cast<zimtohrli::Zimtohrli*>(self->zimtohrli);
+    self->zimtohrli = new zimtohrli::Zimtohrli(zimtohrli);
+    delete self->cache;
+    self->cache = new std::shared_ptr<const zimtohrli::SpectrogramCache>();
   } catch (const std::bad_alloc&) {
     PyErr_SetNone(PyExc_MemoryError);
     return -1;
@@ -79,40 +540,288 @@ void Pyohrli_dealloc(PyohrliObject* self) {
       delete static_cast<zimtohrli::Zimtohrli*>(self->zimtohrli);
       self->zimtohrli = nullptr;
     }
+    delete self->cache;
+    self->cache = nullptr;
     Py_TYPE(self)->tp_free((PyObject*)self);
   }
 }
 
-struct BufferDeleter {
-  void operator()(Py_buffer* buffer) const { PyBuffer_Release(buffer); }
+// Releases the GIL for the lifetime of the object, so that the expensive C++
+// parts of a call (resampling, Analyze, DTW and NSIM) can run concurrently with
+// other Python threads.
+//
+// Nothing that touches Python objects may run while a GilRelease is alive.
+class GilRelease {
+ public:
+  GilRelease() : state_(PyEval_SaveThread()) {}
+  ~GilRelease() { PyEval_RestoreThread(state_); }
+  GilRelease(const GilRelease&) = delete;
+  GilRelease& operator=(const GilRelease&) = delete;
+
+ private:
+  PyThreadState* state_;
+};
+
+// The samples of a 1-dimensional Python buffer of int16, int32, float32 or
+// float64 samples, with any stride. Integer samples are PCM, i.e. fixed point
+// fractions of full scale.
+struct SignalView {
+  enum class Type { kInt16, kInt32, kFloat32, kFloat64 };
+
+  // Returns the samples if they are contiguous float32 ones, which can be
+  // analyzed in place.
+  std::optional<zimtohrli::Span<const float>> FloatSpan() const {
+    if (type != Type::kFloat32 || stride != sizeof(float)) {
+      return std::nullopt;
+    }
+    return zimtohrli::Span<const float>(reinterpret_cast<const float*>(data),
+                                        size);
+  }
+
+  // Returns the size of one sample in bytes.
+  Py_ssize_t sample_size() const {
+    switch (type) {
+      case Type::kInt16:
+        return sizeof(int16_t);
+      case Type::kInt32:
+        return sizeof(int32_t);
+      case Type::kFloat32:
+        return sizeof(float);
+      case Type::kFloat64:
+        return sizeof(double);
+    }
+    return 0;
+  }
+
+  const char* data;
+  size_t size;
+  Py_ssize_t stride;
+  Type type;
 };
 
-// Plain C++ function to analyze a Python buffer object using Zimtohrli.
+// The buffer flags to acquire views of signals with.
+constexpr int kSignalBufferFlags = PyBUF_RECORDS_RO;
+
+// Sets type to the sample type of view, which must be acquired with
+// kSignalBufferFlags. Returns a description of the problem if view doesn't
+// contain native int16, int32, float32 or float64 samples.
+const char* ParseSampleType(const Py_buffer& view, SignalView::Type& type) {
+  const char* format = view.format == nullptr ? "B" : view.format;
+  if (*format == '@' || *format == '=') {
+    ++format;
+  }
+  if (format[0] == '\0' || format[1] != '\0') {
+    return "must contain int16, int32, float32 or float64 samples";
+  }
+  // Integer formats are told apart by their size, since e.g. 'i' and 'l' are
+  // both int32 on some platforms.
+  const char kind = *format;
+  if ((kind == 'h' || kind == 'i' || kind == 'l' || kind == 'q') &&
+      view.itemsize == sizeof(int16_t)) {
+    type = SignalView::Type::kInt16;
+  } else if ((kind == 'h' || kind == 'i' || kind == 'l' || kind == 'q') &&
+             view.itemsize == sizeof(int32_t)) {
+    type = SignalView::Type::kInt32;
+  } else if (kind == 'f' && view.itemsize == sizeof(float)) {
+    type = SignalView::Type::kFloat32;
+  } else if (kind == 'd' && view.itemsize == sizeof(double)) {
+    type = SignalView::Type::kFloat64;
+  } else {
+    return "must contain int16, int32, float32 or float64 samples";
+  }
+  return nullptr;
+}
+
+// Fills signal with the samples of view, which must be acquired with
+// kSignalBufferFlags. Returns a description of the problem if view isn't a
+// 1-dimensional buffer of native int16, int32, float32 or float64 samples.
+const char* ParseSignalView(const Py_buffer& view, SignalView& signal) {
+  if (view.ndim != 1) {
+    return "must be 1-dimensional";
+  }
+  if (const char* problem = ParseSampleType(view, signal.type)) {
+    return problem;
+  }
+  signal.data = static_cast<const char*>(view.buf);
+  signal.size = view.shape[0];
+  signal.stride = view.strides[0];
+  return nullptr;
+}
+
+// Fills channels with one view per channel of view, which must be acquired
+// with kSignalBufferFlags. A 1-dimensional view has one channel, and a
+// 2-dimensional one has its channels along channel_axis: 0 if it is planar,
+// i.e. [channels, samples], and 1 if it is interleaved, i.e. [samples,
+// channels]. Returns a description of the problem if view isn't such a buffer
+// of native int16, int32, float32 or float64 samples.
+const char* ParseChannelViews(const Py_buffer& view, int channel_axis,
+                              std::vector<SignalView>& channels) {
+  if (view.ndim == 1) {
+    channels.resize(1);
+    return ParseSignalView(view, channels[0]);
+  }
+  if (view.ndim != 2) {
+    return "must be 1- or 2-dimensional";
+  }
+  SignalView::Type type;
+  if (const char* problem = ParseSampleType(view, type)) {
+    return problem;
+  }
+  const int sample_axis = 1 - channel_axis;
+  channels.resize(view.shape[channel_axis]);
+  for (size_t channel = 0; channel < channels.size(); ++channel) {
+    channels[channel].data =
+        static_cast<const char*>(view.buf) +
+        static_cast<Py_ssize_t>(channel) * view.strides[channel_axis];
+    channels[channel].size = view.shape[sample_axis];
+    channels[channel].stride = view.strides[sample_axis];
+    channels[channel].type = type;
+  }
+  return nullptr;
+}
+
+template <typename T>
+std::vector<float> ConvertSignalAs(const SignalView& signal, float sample_rate,
+                                   const zimtohrli::ResampleOptions& resample) {
+  if (signal.stride == sizeof(T)) {
+    return zimtohrli::Resample<float>(
+        zimtohrli::Span<const T>(reinterpret_cast<const T*>(signal.data),
+                                 signal.size),
+        sample_rate, zimtohrli::kSampleRate, resample);
+  }
+  // soxr only reads contiguous samples, so strided ones are converted first.
+  constexpr double kScale = zimtohrli::SampleScale<float, T>();
+  std::vector<float> converted(signal.size);
+  for (size_t index = 0; index < signal.size; ++index) {
+    T sample;
+    std::memcpy(&sample,
+                signal.data + static_cast<Py_ssize_t>(index) * signal.stride,
+                sizeof(T));
+    converted[index] = static_cast<float>(sample * kScale);
+  }
+  if (sample_rate == zimtohrli::kSampleRate) {
+    return converted;
+  }
+  return zimtohrli::Resample<float>(zimtohrli::Span<const float>(converted),
+                                    sample_rate, zimtohrli::kSampleRate,
+                                    resample);
+}
+
+// Returns the samples of signal, at sample_rate, as float32 samples at
+// kSampleRate. Converts and resamples them in one pass, unless they are
+// strided and need resampling.
+//
+// Doesn't touch any Python objects and is safe to call without the GIL, as
+// long as the buffer of signal is held.
+std::vector<float> ConvertSignal(const SignalView& signal, float sample_rate,
+                                 const zimtohrli::ResampleOptions& resample =
+                                     zimtohrli::ResampleOptions()) {
+  switch (signal.type) {
+    case SignalView::Type::kInt16:
+      return ConvertSignalAs<int16_t>(signal, sample_rate, resample);
+    case SignalView::Type::kInt32:
+      return ConvertSignalAs<int32_t>(signal, sample_rate, resample);
+    case SignalView::Type::kFloat32:
+      return ConvertSignalAs<float>(signal, sample_rate, resample);
+    case SignalView::Type::kFloat64:
+      return ConvertSignalAs<double>(signal, sample_rate, resample);
+  }
+  return {};
+}
+
+// Returns whether the channels are the interleaved channels of one
+// contiguous buffer, which soxr can resample together.
+bool AreInterleaved(const std::vector<SignalView>& channels) {
+  if (channels.size() < 2) {
+    return false;
+  }
+  const Py_ssize_t sample_size = channels[0].sample_size();
+  for (size_t channel = 0; channel < channels.size(); ++channel) {
+    if (channels[channel].data !=
+            channels[0].data +
+                static_cast<Py_ssize_t>(channel) * sample_size ||
+        channels[channel].stride !=
+            static_cast<Py_ssize_t>(channels.size()) * sample_size) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename T>
+std::vector<std::vector<float>> ResampleInterleavedAs(
+    const std::vector<SignalView>& channels, float sample_rate,
+    const zimtohrli::ResampleOptions& resample) {
+  const size_t num_channels = channels.size();
+  const std::vector<float> interleaved = zimtohrli::ResampleInterleaved<float>(
+      zimtohrli::Span<const T>(reinterpret_cast<const T*>(channels[0].data),
+                               channels[0].size * num_channels),
+      num_channels, sample_rate, zimtohrli::kSampleRate, resample);
+  const size_t num_frames = interleaved.size() / num_channels;
+  std::vector<std::vector<float>> result(num_channels,
+                                         std::vector<float>(num_frames));
+  for (size_t frame = 0; frame < num_frames; ++frame) {
+    for (size_t channel = 0; channel < num_channels; ++channel) {
+      result[channel][frame] = interleaved[frame * num_channels + channel];
+    }
+  }
+  return result;
+}
+
+// Returns the channels, which must be interleaved, at sample_rate, as planar
+// float32 channels at kSampleRate. Resamples all channels in one soxr call,
+// which spreads them over ResampleOptions::num_threads threads.
 //
-// Calls to Analyze never need to be cleaned up (with e.g. delete or DECREF)
-// afterwards.
+// Doesn't touch any Python objects and is safe to call without the GIL, as
+// long as the buffer of the channels is held.
+std::vector<std::vector<float>> ResampleInterleaved(
+    const std::vector<SignalView>& channels, float sample_rate,
+    const zimtohrli::ResampleOptions& resample) {
+  switch (channels[0].type) {
+    case SignalView::Type::kInt16:
+      return ResampleInterleavedAs<int16_t>(channels, sample_rate, resample);
+    case SignalView::Type::kInt32:
+      return ResampleInterleavedAs<int32_t>(channels, sample_rate, resample);
+    case SignalView::Type::kFloat32:
+      return ResampleInterleavedAs<float>(channels, sample_rate, resample);
+    case SignalView::Type::kFloat64:
+      return ResampleInterleavedAs<double>(channels, sample_rate, resample);
+  }
+  return {};
+}
+
+// Plain C++ function to copy the samples of a Python buffer object, as
+// float32 samples.
+//
+// The copy is what allows the rest of the computation to run without the GIL:
+// once it is made, other Python threads are free to mutate or release the
+// original buffer. Samples of other types are converted while copying them.
 //
 // If the return value is std::nullopt that means a Python error is set and the
 // current operation should be terminated ASAP.
-std::optional<zimtohrli::Spectrogram> Analyze(
-    const zimtohrli::Zimtohrli& zimtohrli, PyObject* buffer_object) {
+std::optional<std::vector<float>> CopySignal(PyObject* buffer_object,
+                                             bool allow_empty = false) {
   Py_buffer buffer_view;
-  if (PyObject_GetBuffer(buffer_object, &buffer_view, PyBUF_C_CONTIGUOUS)) {
+  if (PyObject_GetBuffer(buffer_object, &buffer_view, kSignalBufferFlags)) {
     PyErr_SetString(PyExc_TypeError, "object is not buffer");
     return std::nullopt;
   }
   std::unique_ptr<Py_buffer, BufferDeleter> buffer_view_deleter(&buffer_view);
-  if (buffer_view.itemsize != sizeof(float)) {
-    PyErr_SetString(PyExc_TypeError, "buffer does not contain floats");
+  SignalView signal;
+  if (const char* problem = ParseSignalView(buffer_view, signal)) {
+    PyErr_Format(PyExc_TypeError, "buffer %s", problem);
     return std::nullopt;
   }
-  if (buffer_view.ndim != 1) {
-    PyErr_SetString(PyExc_TypeError, "buffer has more than 1 axis");
+  if (signal.size == 0 && !allow_empty) {
+    PyErr_SetString(PyExc_ValueError, "buffer is empty");
+    return std::nullopt;
+  }
+  try {
+    return ConvertSignal(signal, zimtohrli::kSampleRate);
+  } catch (const std::bad_alloc&) {
+    PyErr_NoMemory();
     return std::nullopt;
   }
-  return std::optional<zimtohrli::Spectrogram>(zimtohrli.Analyze(
-      zimtohrli::Span<const float>(static_cast<float*>(buffer_view.buf),
-                                   buffer_view.len / sizeof(float))));
 }
 
 PyObject* BadArgument(const std::string& message) {
@@ -120,86 +829,1356 @@ PyObject* BadArgument(const std::string& message) {
   return nullptr;
 }
 
-PyObject* Pyohrli_distance(PyohrliObject* self, PyObject* const* args,
-                           Py_ssize_t nargs) {
-  if (nargs != 2) {
-    return BadArgument("not exactly 2 arguments provided");
+// Translates a C++ exception escaping from the computation into a Python error.
+PyObject* SetErrorFromException(const std::exception& e) {
+  if (dynamic_cast<const std::bad_alloc*>(&e)) {
+    PyErr_SetNone(PyExc_MemoryError);
+  } else {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
   }
-  const zimtohrli::Zimtohrli zimtohrli =
-      *static_cast<zimtohrli::Zimtohrli*>(self->zimtohrli);
-  std::optional<zimtohrli::Spectrogram> spectrogram_a =
-      Analyze(zimtohrli, args[0]);
-  if (!spectrogram_a.has_value()) {
-    return nullptr;
+  return nullptr;
+}
+
+// Resamples the signal to kSampleRate if needed, and returns its spectrogram.
+//
+// Doesn't touch any Python objects and is safe to call without the GIL.
+zimtohrli::Spectrogram AnalyzeSignal(const zimtohrli::Zimtohrli& zimtohrli,
+                                     zimtohrli::Span<const float> signal,
+                                     float sample_rate,
+                                     const zimtohrli::ResampleOptions& resample =
+                                         zimtohrli::ResampleOptions()) {
+  if (sample_rate == zimtohrli::kSampleRate) {
+    return zimtohrli.Analyze(signal);
   }
-  std::optional<zimtohrli::Spectrogram> spectrogram_b =
-      Analyze(zimtohrli, args[1]);
-  if (!spectrogram_b.has_value()) {
-    return nullptr;
+  const std::vector<float> resampled = zimtohrli::Resample<float>(
+      signal, sample_rate, zimtohrli::kSampleRate, resample);
+  return zimtohrli.Analyze(zimtohrli::Span<const float>(resampled));
+}
+
+// Returns the configuration hash the spectrograms of signals at sample_rate
+// are cached under: the AnalysisHash of zimtohrli, and how they are resampled
+// if they are.
+uint64_t CacheConfigHash(const zimtohrli::Zimtohrli& zimtohrli,
+                         float sample_rate,
+                         const zimtohrli::ResampleOptions& resample) {
+  const uint64_t hash = zimtohrli::AnalysisHash(zimtohrli);
+  return sample_rate == zimtohrli::kSampleRate
+             ? hash
+             : zimtohrli::MixBits(hash ^ resample.quality_recipe);
+}
+
+// Returns the panel type with the values of encoding.
+zimtohrli::simd::PanelType EncodingPanelType(
+    zimtohrli::SpectrogramEncoding encoding) {
+  switch (encoding) {
+    case zimtohrli::SpectrogramEncoding::kFloat16:
+      return zimtohrli::simd::PanelType::kFloat16;
+    case zimtohrli::SpectrogramEncoding::kBFloat16:
+      return zimtohrli::simd::PanelType::kBFloat16;
+    default:
+      return zimtohrli::simd::PanelType::kFloat32;
   }
-  return PyFloat_FromDouble(
-      zimtohrli.Distance(spectrogram_a.value(), spectrogram_b.value()));
 }
 
-PyObject* Pyohrli_analyze(PyohrliObject* self, PyObject* const* args,
-                          Py_ssize_t nargs) {
-  if (nargs != 1) {
-    return BadArgument("not exactly 1 argument provided");
+// Rounds the values of spectrogram like storing them in encoding does, so
+// that spectrograms are the same whether they were just analyzed or loaded
+// from a file.
+void RoundToEncoding(zimtohrli::Spectrogram& spectrogram,
+                     zimtohrli::SpectrogramEncoding encoding) {
+  const zimtohrli::simd::PanelType panel_type = EncodingPanelType(encoding);
+  if (panel_type == zimtohrli::simd::PanelType::kFloat32) {
+    return;
   }
-  const zimtohrli::Zimtohrli zimtohrli =
-      *static_cast<zimtohrli::Zimtohrli*>(self->zimtohrli);
-  const std::optional<zimtohrli::Spectrogram> spectrogram =
-      Analyze(zimtohrli, args[0]);
-  if (!spectrogram.has_value()) {
-    return nullptr;
+  for (size_t index = 0; index < spectrogram.size(); ++index) {
+    spectrogram.values[index] = zimtohrli::simd::RoundToPanelType(
+        spectrogram.values[index], panel_type);
   }
-  return PyBytes_FromStringAndSize(
-      reinterpret_cast<const char*>(spectrogram->values.get()),
-      spectrogram->size() * sizeof(float));
 }
 
-PyObject* Pyohrli_num_rotators(PyohrliObject* self, PyObject* const* args,
-                               Py_ssize_t nargs) {
-  if (nargs != 0) {
-    return BadArgument("not exactly 0 arguments provided");
+// Like AnalyzeSignal, but returns the spectrogram stored in cache for the
+// signal if there is one, skipping the resampling and analysis, and stores the
+// spectrogram otherwise. A null cache analyzes the signal.
+//
+// Doesn't touch any Python objects and is safe to call without the GIL.
+zimtohrli::Spectrogram AnalyzeSignal(const zimtohrli::Zimtohrli& zimtohrli,
+                                     zimtohrli::Span<const float> signal,
+                                     float sample_rate,
+                                     const zimtohrli::ResampleOptions& resample,
+                                     const zimtohrli::SpectrogramCache* cache) {
+  if (cache == nullptr) {
+    return AnalyzeSignal(zimtohrli, signal, sample_rate, resample);
   }
-  return PyLong_FromLong(zimtohrli::kNumRotators);
+  const uint64_t config_hash =
+      CacheConfigHash(zimtohrli, sample_rate, resample);
+  const zimtohrli::Hash128 key =
+      zimtohrli::SpectrogramCache::Key(signal, sample_rate, config_hash);
+  std::optional<zimtohrli::Spectrogram> cached = cache->Load(key, config_hash);
+  if (cached.has_value()) {
+    return std::move(cached.value());
+  }
+  zimtohrli::Spectrogram spectrogram =
+      AnalyzeSignal(zimtohrli, signal, sample_rate, resample);
+  RoundToEncoding(spectrogram, cache->encoding());
+  // A cache that can't be written only costs the analysis of the next call.
+  cache->Store(key, spectrogram, config_hash);
+  return spectrogram;
 }
 
-PyObject* Pyohrli_sample_rate(PyohrliObject* self, PyObject* const* args,
-                              Py_ssize_t nargs) {
-  if (nargs != 0) {
-    return BadArgument("not exactly 0 arguments provided");
+// Converts and resamples the signal to float32 samples at kSampleRate if
+// needed, and returns its spectrogram. Contiguous float32 samples at
+// kSampleRate are analyzed in place.
+//
+// Doesn't touch any Python objects and is safe to call without the GIL, as
+// long as the buffer of signal is held.
+zimtohrli::Spectrogram AnalyzeSignal(const zimtohrli::Zimtohrli& zimtohrli,
+                                     const SignalView& signal,
+                                     float sample_rate,
+                                     const zimtohrli::ResampleOptions& resample) {
+  const std::optional<zimtohrli::Span<const float>> samples =
+      signal.FloatSpan();
+  if (samples.has_value() && sample_rate == zimtohrli::kSampleRate) {
+    return zimtohrli.Analyze(samples.value());
   }
-  return PyLong_FromLong(zimtohrli::kSampleRate);
+  const std::vector<float> converted =
+      ConvertSignal(signal, sample_rate, resample);
+  return zimtohrli.Analyze(zimtohrli::Span<const float>(converted));
 }
 
-PyMethodDef Pyohrli_methods[] = {
-    {"num_rotators", (PyCFunction)Pyohrli_num_rotators, METH_FASTCALL,
-     "Returns the number of rotators, i.e. the number of dimensions in a "
-     "spectrogram."},
-    {"analyze", (PyCFunction)Pyohrli_analyze, METH_FASTCALL,
-     "Returns a spectrogram of the provided signal."},
-    {"distance", (PyCFunction)Pyohrli_distance, METH_FASTCALL,
-     "Returns the distance between the two provided signals."},
-    {"sample_rate", (PyCFunction)Pyohrli_sample_rate, METH_FASTCALL,
-     "Returns the expected sample rate for analyzed audio."},
-    {nullptr} /* Sentinel */
+// Converts and resamples the signal like AnalyzeSignal, and analyzes it into
+// spectrogram with the buffers of workspace. Contiguous float32 samples at
+// kSampleRate are analyzed in place without allocating.
+//
+// Doesn't touch any Python objects and is safe to call without the GIL, as
+// long as the buffer of signal is held.
+void AnalyzeSignal(const zimtohrli::Zimtohrli& zimtohrli,
+                   const SignalView& signal, float sample_rate,
+                   const zimtohrli::ResampleOptions& resample,
+                   zimtohrli::Workspace& workspace,
+                   zimtohrli::Spectrogram& spectrogram) {
+  const std::optional<zimtohrli::Span<const float>> samples =
+      signal.FloatSpan();
+  if (samples.has_value() && sample_rate == zimtohrli::kSampleRate) {
+    zimtohrli.Analyze(samples.value(), spectrogram, workspace);
+    return;
+  }
+  const std::vector<float> converted =
+      ConvertSignal(signal, sample_rate, resample);
+  zimtohrli.Analyze(zimtohrli::Span<const float>(converted), spectrogram,
+                    workspace);
+}
+
+// An argument of Pyohrli.distance: either a precomputed spectrogram, or a
+// copy of a signal that still has to be analyzed.
+struct DistanceOperand {
+  // Borrowed from the Spectrogram object passed as argument, which is kept
+  // alive by the caller for the duration of the call.
+  const zimtohrli::Spectrogram* spectrogram = nullptr;
+  std::vector<float> signal;
 };
 
-PyTypeObject PyohrliType = {
-    // clang-format off
-    .ob_base = PyVarObject_HEAD_INIT(nullptr, 0)
-    .tp_name = "pyohrli.Pyohrli",
-    // clang-format on
-    .tp_basicsize = sizeof(PyohrliObject),
-    .tp_itemsize = 0,
-    .tp_dealloc = (destructor)Pyohrli_dealloc,
-    .tp_flags = Py_TPFLAGS_DEFAULT,
-    .tp_doc =
-        PyDoc_STR("Python wrapper around the C++ zimtohrli::Zimtohrli type."),
-    .tp_methods = Pyohrli_methods,
-    .tp_init = (initproc)Pyohrli_init,
+// If the return value is std::nullopt that means a Python error is set and the
+// current operation should be terminated ASAP.
+std::optional<DistanceOperand> ParseDistanceOperand(PyObject* object) {
+  DistanceOperand operand;
+  if (PyObject_TypeCheck(object, &SpectrogramType)) {
+    operand.spectrogram = Spectrogram_get((SpectrogramObject*)object);
+    if (operand.spectrogram == nullptr) {
+      return std::nullopt;
+    }
+    return operand;
+  }
+  std::optional<std::vector<float>> signal = CopySignal(object);
+  if (!signal.has_value()) {
+    return std::nullopt;
+  }
+  operand.signal = std::move(signal.value());
+  return operand;
+}
+
+// Parses the sample rate argument at args[index] if index < nargs, into
+// sample_rate, which is left at kSampleRate otherwise. Returns false with a
+// Python error set if it isn't a positive number.
+bool ParseOptionalSampleRate(PyObject* const* args, Py_ssize_t nargs,
+                             Py_ssize_t index, float& sample_rate) {
+  sample_rate = zimtohrli::kSampleRate;
+  if (index >= nargs) {
+    return true;
+  }
+  const double value = PyFloat_AsDouble(args[index]);
+  if (value == -1.0 && PyErr_Occurred()) {
+    return false;
+  }
+  if (!(value > 0)) {
+    PyErr_SetString(PyExc_ValueError, "sample rates must be positive");
+    return false;
+  }
+  sample_rate = value;
+  return true;
+}
+
+// Parses the two DistanceOperand arguments of a Pyohrli method, optionally
+// followed by the sample rates of the operands that are signals, and calls
+// compute(zimtohrli, spectrogram_a, spectrogram_b) without the GIL, after
+// resampling and analyzing the operands that are signals, through the cache
+// of self if it has one.
+//
+// Returns false if a Python error is set.
+template <typename Compute>
+bool ComputeWithOperands(PyohrliObject* self, PyObject* const* args,
+                         Py_ssize_t nargs, const Compute& compute) {
+  if (nargs != 2 && nargs != 4) {
+    BadArgument("not exactly 2 or 4 arguments provided");
+    return false;
+  }
+  const zimtohrli::Zimtohrli zimtohrli =
+      *static_cast<zimtohrli::Zimtohrli*>(self->zimtohrli);
+  const zimtohrli::ResampleOptions resample = self->resample;
+  const std::shared_ptr<const zimtohrli::SpectrogramCache> cache = *self->cache;
+  float sample_rate_a, sample_rate_b;
+  if (!ParseOptionalSampleRate(args, nargs, 2, sample_rate_a) ||
+      !ParseOptionalSampleRate(args, nargs, 3, sample_rate_b)) {
+    return false;
+  }
+  std::optional<DistanceOperand> operand_a = ParseDistanceOperand(args[0]);
+  if (!operand_a.has_value()) {
+    return false;
+  }
+  std::optional<DistanceOperand> operand_b = ParseDistanceOperand(args[1]);
+  if (!operand_b.has_value()) {
+    return false;
+  }
+  for (const DistanceOperand* operand : {&*operand_a, &*operand_b}) {
+    if (operand->spectrogram &&
+        operand->spectrogram->num_dims != zimtohrli::kNumRotators) {
+      BadArgument("spectrograms must have num_rotators() dimensions");
+      return false;
+    }
+  }
+  try {
+    GilRelease gil_release;
+    std::optional<zimtohrli::Spectrogram> analyzed_a, analyzed_b;
+    if (!operand_a->spectrogram) {
+      analyzed_a = AnalyzeSignal(zimtohrli,
+                                 zimtohrli::Span<const float>(operand_a->signal),
+                                 sample_rate_a, resample, cache.get());
+    }
+    if (!operand_b->spectrogram) {
+      analyzed_b = AnalyzeSignal(zimtohrli,
+                                 zimtohrli::Span<const float>(operand_b->signal),
+                                 sample_rate_b, resample, cache.get());
+    }
+    const zimtohrli::Spectrogram& spectrogram_a =
+        operand_a->spectrogram ? *operand_a->spectrogram : *analyzed_a;
+    const zimtohrli::Spectrogram& spectrogram_b =
+        operand_b->spectrogram ? *operand_b->spectrogram : *analyzed_b;
+    compute(zimtohrli, spectrogram_a, spectrogram_b);
+  } catch (const std::exception& e) {
+    SetErrorFromException(e);
+    return false;
+  }
+  return true;
+}
+
+PyObject* Pyohrli_distance(PyohrliObject* self, PyObject* const* args,
+                           Py_ssize_t nargs) {
+  float distance;
+  if (!ComputeWithOperands(
+          self, args, nargs,
+          [&](const zimtohrli::Zimtohrli& zimtohrli,
+              const zimtohrli::Spectrogram& spectrogram_a,
+              const zimtohrli::Spectrogram& spectrogram_b) {
+            distance = zimtohrli.Distance(spectrogram_a, spectrogram_a.max(),
+                                          spectrogram_b, spectrogram_b.max());
+          })) {
+    return nullptr;
+  }
+  return PyFloat_FromDouble(distance);
+}
+
+// Returns a float32 Array with the distance between each pair of channels of
+// two 1- or 2-dimensional signals, see ParseChannelViews. The arguments are
+// audio_a, audio_b, sample_rate_a, sample_rate_b, channel_axis and
+// num_threads.
+//
+// The channels of both signals are analyzed in parallel on num_threads
+// threads, and each channel is analyzed into one contiguous Spectrogram.
+// Valid buffer views of both signals are held for the duration of the call,
+// so contiguous channels are read in place without copies. The signals
+// mustn't be mutated by other threads until the call returns.
+PyObject* Pyohrli_distance_channels(PyohrliObject* self, PyObject* const* args,
+                                    Py_ssize_t nargs) {
+  if (nargs != 6) {
+    return BadArgument("not exactly 6 arguments provided");
+  }
+  const zimtohrli::Zimtohrli zimtohrli =
+      *static_cast<zimtohrli::Zimtohrli*>(self->zimtohrli);
+  const zimtohrli::ResampleOptions resample = self->resample;
+  float sample_rates[2];
+  if (!ParseOptionalSampleRate(args, nargs, 2, sample_rates[0]) ||
+      !ParseOptionalSampleRate(args, nargs, 3, sample_rates[1])) {
+    return nullptr;
+  }
+  const long channel_axis = PyLong_AsLong(args[4]);
+  if (channel_axis == -1 && PyErr_Occurred()) {
+    return nullptr;
+  }
+  if (channel_axis != 0 && channel_axis != 1) {
+    PyErr_SetString(PyExc_ValueError, "channel_axis must be 0 or 1");
+    return nullptr;
+  }
+  const Py_ssize_t num_threads = PyLong_AsSsize_t(args[5]);
+  if (num_threads == -1 && PyErr_Occurred()) {
+    return nullptr;
+  }
+  if (num_threads < 0) {
+    PyErr_SetString(PyExc_ValueError, "num_threads must be non-negative");
+    return nullptr;
+  }
+
+  Py_buffer buffers[2];
+  std::unique_ptr<Py_buffer, BufferDeleter> buffer_deleters[2];
+  std::vector<SignalView> channels[2];
+  for (size_t signal = 0; signal < 2; ++signal) {
+    if (PyObject_GetBuffer(args[signal], &buffers[signal],
+                           kSignalBufferFlags) != 0) {
+      PyErr_SetString(PyExc_TypeError, "object is not buffer");
+      return nullptr;
+    }
+    buffer_deleters[signal].reset(&buffers[signal]);
+    if (const char* problem = ParseChannelViews(
+            buffers[signal], channel_axis, channels[signal])) {
+      PyErr_Format(PyExc_TypeError, "buffer %s", problem);
+      return nullptr;
+    }
+    if (channels[signal].empty() || channels[signal][0].size == 0) {
+      PyErr_SetString(PyExc_ValueError, "buffer is empty");
+      return nullptr;
+    }
+  }
+  const size_t num_channels = channels[0].size();
+  if (channels[1].size() != num_channels) {
+    PyErr_SetString(PyExc_ValueError,
+                    "signals must have the same number of channels");
+    return nullptr;
+  }
+
+  try {
+    std::vector<float> distances(num_channels);
+    {
+      GilRelease gil_release;
+      zimtohrli::ThreadPool pool(num_threads);
+      std::vector<std::vector<float>> resampled[2];
+      pool.ParallelFor(2, [&](size_t signal) {
+        if (sample_rates[signal] != zimtohrli::kSampleRate &&
+            AreInterleaved(channels[signal])) {
+          resampled[signal] = ResampleInterleaved(
+              channels[signal], sample_rates[signal], resample);
+        }
+      });
+      std::vector<std::optional<zimtohrli::Spectrogram>> spectrograms(
+          2 * num_channels);
+      pool.ParallelFor(2 * num_channels, [&](size_t index) {
+        const size_t signal = index / num_channels;
+        const size_t channel = index % num_channels;
+        if (resampled[signal].empty()) {
+          spectrograms[index] =
+              AnalyzeSignal(zimtohrli, channels[signal][channel],
+                            sample_rates[signal], resample);
+        } else {
+          spectrograms[index] = zimtohrli.Analyze(
+              zimtohrli::Span<const float>(resampled[signal][channel]));
+        }
+      });
+      pool.ParallelFor(num_channels, [&](size_t channel) {
+        const zimtohrli::Spectrogram& spectrogram_a = *spectrograms[channel];
+        const zimtohrli::Spectrogram& spectrogram_b =
+            *spectrograms[num_channels + channel];
+        distances[channel] =
+            zimtohrli.Distance(spectrogram_a, spectrogram_a.max(),
+                               spectrogram_b, spectrogram_b.max());
+      });
+    }
+    return NewArray(std::move(distances),
+                    {static_cast<Py_ssize_t>(num_channels)});
+  } catch (const std::exception& e) {
+    return SetErrorFromException(e);
+  }
+}
+
+// Returns a (distance, time_pairs, scores) tuple, where time_pairs is an int64
+// Array of shape [num_pairs, 2] and scores a float32 Array of shape
+// [num_pairs, num_rotators].
+PyObject* Pyohrli_distance_map(PyohrliObject* self, PyObject* const* args,
+                               Py_ssize_t nargs) {
+  std::optional<zimtohrli::DistanceMap> map;
+  if (!ComputeWithOperands(
+          self, args, nargs,
+          [&](const zimtohrli::Zimtohrli& zimtohrli,
+              const zimtohrli::Spectrogram& spectrogram_a,
+              const zimtohrli::Spectrogram& spectrogram_b) {
+            map = zimtohrli.DistanceWithMap(spectrogram_a, spectrogram_a.max(),
+                                            spectrogram_b, spectrogram_b.max());
+          })) {
+    return nullptr;
+  }
+  const Py_ssize_t num_pairs = map->time_pairs.size();
+  std::vector<int64_t> time_pairs;
+  try {
+    time_pairs.reserve(2 * num_pairs);
+    for (const auto& [step_a, step_b] : map->time_pairs) {
+      time_pairs.push_back(step_a);
+      time_pairs.push_back(step_b);
+    }
+  } catch (const std::bad_alloc&) {
+    PyErr_SetNone(PyExc_MemoryError);
+    return nullptr;
+  }
+  map->time_pairs = {};
+  PyObject* time_pairs_array = NewArray(std::move(time_pairs), {num_pairs, 2});
+  if (time_pairs_array == nullptr) {
+    return nullptr;
+  }
+  PyObject* scores_array = NewArray(std::move(map->scores),
+                                    {num_pairs, zimtohrli::kNumRotators});
+  if (scores_array == nullptr) {
+    Py_DECREF(time_pairs_array);
+    return nullptr;
+  }
+  return Py_BuildValue("(dNN)", static_cast<double>(map->distance),
+                       time_pairs_array, scores_array);
+}
+
+PyObject* Pyohrli_analyze(PyohrliObject* self, PyObject* const* args,
+                          Py_ssize_t nargs) {
+  if (nargs != 1 && nargs != 2) {
+    return BadArgument("not exactly 1 or 2 arguments provided");
+  }
+  const zimtohrli::Zimtohrli zimtohrli =
+      *static_cast<zimtohrli::Zimtohrli*>(self->zimtohrli);
+  const zimtohrli::ResampleOptions resample = self->resample;
+  const std::shared_ptr<const zimtohrli::SpectrogramCache> cache = *self->cache;
+  float sample_rate;
+  if (!ParseOptionalSampleRate(args, nargs, 1, sample_rate)) {
+    return nullptr;
+  }
+  const std::optional<std::vector<float>> signal = CopySignal(args[0]);
+  if (!signal.has_value()) {
+    return nullptr;
+  }
+  std::optional<zimtohrli::Spectrogram> spectrogram;
+  try {
+    GilRelease gil_release;
+    spectrogram = AnalyzeSignal(
+        zimtohrli, zimtohrli::Span<const float>(signal.value()), sample_rate,
+        resample, cache.get());
+  } catch (const std::exception& e) {
+    return SetErrorFromException(e);
+  }
+  return NewSpectrogram(std::move(spectrogram.value()));
+}
+
+PyObject* Pyohrli_num_rotators(PyohrliObject* self, PyObject* const* args,
+                               Py_ssize_t nargs) {
+  if (nargs != 0) {
+    return BadArgument("not exactly 0 arguments provided");
+  }
+  return PyLong_FromLong(zimtohrli::kNumRotators);
+}
+
+PyObject* Pyohrli_sample_rate(PyohrliObject* self, PyObject* const* args,
+                              Py_ssize_t nargs) {
+  if (nargs != 0) {
+    return BadArgument("not exactly 0 arguments provided");
+  }
+  return PyLong_FromLong(zimtohrli::kSampleRate);
+}
+
+// Sets the cache that analyze(), distance() and distance_map() analyze
+// signals through. The arguments are the cache directory, or None to stop
+// caching, and the name of the value type to store, see kPrecisions.
+PyObject* Pyohrli_set_cache(PyohrliObject* self, PyObject* const* args,
+                            Py_ssize_t nargs) {
+  if (nargs != 2) {
+    return BadArgument("not exactly 2 arguments provided");
+  }
+  const char* dtype = PyUnicode_AsUTF8(args[1]);
+  if (dtype == nullptr) {
+    return nullptr;
+  }
+  zimtohrli::simd::PanelType panel_type;
+  if (!ParsePrecision(dtype, panel_type)) {
+    return nullptr;
+  }
+  if (args[0] == Py_None) {
+    self->cache->reset();
+    Py_RETURN_NONE;
+  }
+  const char* directory = PyUnicode_AsUTF8(args[0]);
+  if (directory == nullptr) {
+    return nullptr;
+  }
+  try {
+    *self->cache = std::make_shared<const zimtohrli::SpectrogramCache>(
+        directory, panel_type == zimtohrli::simd::PanelType::kFloat16
+                       ? zimtohrli::SpectrogramEncoding::kFloat16
+                   : panel_type == zimtohrli::simd::PanelType::kBFloat16
+                       ? zimtohrli::SpectrogramEncoding::kBFloat16
+                       : zimtohrli::SpectrogramEncoding::kFloat32);
+  } catch (const std::bad_alloc&) {
+    PyErr_SetNone(PyExc_MemoryError);
+    return nullptr;
+  }
+  Py_RETURN_NONE;
+}
+
+// Returns a (directory, dtype, hits, misses) tuple describing the cache of
+// self, or None if it has none.
+PyObject* Pyohrli_cache_info(PyohrliObject* self, PyObject* const* args,
+                             Py_ssize_t nargs) {
+  if (nargs != 0) {
+    return BadArgument("not exactly 0 arguments provided");
+  }
+  const zimtohrli::SpectrogramCache* cache = self->cache->get();
+  if (cache == nullptr) {
+    Py_RETURN_NONE;
+  }
+  return Py_BuildValue(
+      "(ssnn)", cache->directory().c_str(),
+      PrecisionName(EncodingPanelType(cache->encoding())),
+      static_cast<Py_ssize_t>(cache->num_hits()),
+      static_cast<Py_ssize_t>(cache->num_misses()));
+}
+
+PyMethodDef Pyohrli_methods[] = {
+    {"num_rotators", (PyCFunction)Pyohrli_num_rotators, METH_FASTCALL,
+     "Returns the number of rotators, i.e. the number of dimensions in a "
+     "spectrogram."},
+    {"analyze", (PyCFunction)Pyohrli_analyze, METH_FASTCALL,
+     "Returns a Spectrogram of the provided signal, optionally followed by "
+     "its sample rate if that isn't sample_rate()."},
+    {"distance", (PyCFunction)Pyohrli_distance, METH_FASTCALL,
+     "Returns the distance between the two provided signals, optionally "
+     "followed by their sample rates if they aren't sample_rate(). Each "
+     "signal can also be a Spectrogram returned by analyze(), which skips "
+     "re-analyzing it, and whose sample rate is then ignored."},
+    {"distance_map", (PyCFunction)Pyohrli_distance_map, METH_FASTCALL,
+     "Returns a (distance, time_pairs, scores) tuple for the same arguments "
+     "as distance(), where time_pairs is an int64 Array of the [num_pairs, 2] "
+     "aligned time steps, and scores a float32 Array of the [num_pairs, "
+     "num_rotators] NSIM scores that distance is 1 minus the mean of."},
+    {"distance_channels", (PyCFunction)Pyohrli_distance_channels,
+     METH_FASTCALL,
+     "Returns a float32 Array of the distances between the channels of two "
+     "1- or 2-dimensional signals. Args: audio_a, audio_b, sample_rate_a, "
+     "sample_rate_b, channel_axis (0 for [channels, samples], 1 for "
+     "[samples, channels]) and num_threads (0 means one per core)."},
+    {"sample_rate", (PyCFunction)Pyohrli_sample_rate, METH_FASTCALL,
+     "Returns the expected sample rate for analyzed audio."},
+    {"set_cache", (PyCFunction)Pyohrli_set_cache, METH_FASTCALL,
+     "Makes analyze(), distance() and distance_map() look up and store the "
+     "spectrograms of signals in a cache directory. Args: directory, or None "
+     "to stop caching, and the stored value type: 'float32', 'float16' or "
+     "'bfloat16'."},
+    {"cache_info", (PyCFunction)Pyohrli_cache_info, METH_FASTCALL,
+     "Returns a (directory, dtype, hits, misses) tuple describing the "
+     "cache, or None if signals aren't cached."},
+    {nullptr} /* Sentinel */
+};
+
+PyObject* Pyohrli_get_dtw_band_radius(PyohrliObject* self, void* closure) {
+  return PyLong_FromSize_t(
+      static_cast<zimtohrli::Zimtohrli*>(self->zimtohrli)->dtw_band_radius);
+}
+
+int Pyohrli_set_dtw_band_radius(PyohrliObject* self, PyObject* value,
+                                void* closure) {
+  if (value == nullptr) {
+    PyErr_SetString(PyExc_TypeError, "cannot delete dtw_band_radius");
+    return -1;
+  }
+  const size_t radius = PyLong_AsSize_t(value);
+  if (radius == static_cast<size_t>(-1) && PyErr_Occurred()) {
+    return -1;
+  }
+  static_cast<zimtohrli::Zimtohrli*>(self->zimtohrli)->dtw_band_radius =
+      radius;
+  return 0;
+}
+
+PyObject* Pyohrli_get_dtw_multiresolution_radius(PyohrliObject* self,
+                                                 void* closure) {
+  return PyLong_FromSize_t(static_cast<zimtohrli::Zimtohrli*>(self->zimtohrli)
+                               ->dtw_multiresolution_radius);
+}
+
+int Pyohrli_set_dtw_multiresolution_radius(PyohrliObject* self,
+                                           PyObject* value, void* closure) {
+  if (value == nullptr) {
+    PyErr_SetString(PyExc_TypeError,
+                    "cannot delete dtw_multiresolution_radius");
+    return -1;
+  }
+  const size_t radius = PyLong_AsSize_t(value);
+  if (radius == static_cast<size_t>(-1) && PyErr_Occurred()) {
+    return -1;
+  }
+  static_cast<zimtohrli::Zimtohrli*>(self->zimtohrli)
+      ->dtw_multiresolution_radius = radius;
+  return 0;
+}
+
+PyObject* Pyohrli_get_dtw_max_drift_seconds(PyohrliObject* self,
+                                            void* closure) {
+  return PyFloat_FromDouble(static_cast<zimtohrli::Zimtohrli*>(self->zimtohrli)
+                                ->dtw_max_drift_seconds);
+}
+
+int Pyohrli_set_dtw_max_drift_seconds(PyohrliObject* self, PyObject* value,
+                                      void* closure) {
+  if (value == nullptr) {
+    PyErr_SetString(PyExc_TypeError, "cannot delete dtw_max_drift_seconds");
+    return -1;
+  }
+  const double seconds = PyFloat_AsDouble(value);
+  if (seconds == -1.0 && PyErr_Occurred()) {
+    return -1;
+  }
+  if (!(seconds >= 0)) {
+    PyErr_SetString(PyExc_ValueError,
+                    "dtw_max_drift_seconds must be non-negative");
+    return -1;
+  }
+  static_cast<zimtohrli::Zimtohrli*>(self->zimtohrli)->dtw_max_drift_seconds =
+      seconds;
+  return 0;
+}
+
+PyObject* Pyohrli_get_fast_math(PyohrliObject* self, void* closure) {
+  return PyBool_FromLong(
+      static_cast<zimtohrli::Zimtohrli*>(self->zimtohrli)->fast_math);
+}
+
+int Pyohrli_set_fast_math(PyohrliObject* self, PyObject* value,
+                          void* closure) {
+  if (value == nullptr) {
+    PyErr_SetString(PyExc_TypeError, "cannot delete fast_math");
+    return -1;
+  }
+  const int fast_math = PyObject_IsTrue(value);
+  if (fast_math == -1) {
+    return -1;
+  }
+  static_cast<zimtohrli::Zimtohrli*>(self->zimtohrli)->fast_math = fast_math;
+  return 0;
+}
+
+PyObject* Pyohrli_get_dtw_num_threads(PyohrliObject* self, void* closure) {
+  return PyLong_FromSize_t(
+      static_cast<zimtohrli::Zimtohrli*>(self->zimtohrli)->dtw_num_threads);
+}
+
+int Pyohrli_set_dtw_num_threads(PyohrliObject* self, PyObject* value,
+                                void* closure) {
+  if (value == nullptr) {
+    PyErr_SetString(PyExc_TypeError, "cannot delete dtw_num_threads");
+    return -1;
+  }
+  const size_t num_threads = PyLong_AsSize_t(value);
+  if (num_threads == static_cast<size_t>(-1) && PyErr_Occurred()) {
+    return -1;
+  }
+  static_cast<zimtohrli::Zimtohrli*>(self->zimtohrli)->dtw_num_threads =
+      num_threads;
+  return 0;
+}
+
+PyObject* Pyohrli_get_segment_seconds(PyohrliObject* self, void* closure) {
+  return PyFloat_FromDouble(
+      static_cast<zimtohrli::Zimtohrli*>(self->zimtohrli)->segment_seconds);
+}
+
+int Pyohrli_set_segment_seconds(PyohrliObject* self, PyObject* value,
+                                void* closure) {
+  if (value == nullptr) {
+    PyErr_SetString(PyExc_TypeError, "cannot delete segment_seconds");
+    return -1;
+  }
+  const double seconds = PyFloat_AsDouble(value);
+  if (seconds == -1.0 && PyErr_Occurred()) {
+    return -1;
+  }
+  if (!(seconds >= 0)) {
+    PyErr_SetString(PyExc_ValueError, "segment_seconds must be non-negative");
+    return -1;
+  }
+  static_cast<zimtohrli::Zimtohrli*>(self->zimtohrli)->segment_seconds =
+      seconds;
+  return 0;
+}
+
+PyObject* Pyohrli_get_segment_overlap_seconds(PyohrliObject* self,
+                                              void* closure) {
+  return PyFloat_FromDouble(static_cast<zimtohrli::Zimtohrli*>(self->zimtohrli)
+                                ->segment_overlap_seconds);
+}
+
+int Pyohrli_set_segment_overlap_seconds(PyohrliObject* self, PyObject* value,
+                                        void* closure) {
+  if (value == nullptr) {
+    PyErr_SetString(PyExc_TypeError, "cannot delete segment_overlap_seconds");
+    return -1;
+  }
+  const double seconds = PyFloat_AsDouble(value);
+  if (seconds == -1.0 && PyErr_Occurred()) {
+    return -1;
+  }
+  if (!(seconds >= 0)) {
+    PyErr_SetString(PyExc_ValueError,
+                    "segment_overlap_seconds must be non-negative");
+    return -1;
+  }
+  static_cast<zimtohrli::Zimtohrli*>(self->zimtohrli)->segment_overlap_seconds =
+      seconds;
+  return 0;
+}
+
+PyObject* Pyohrli_get_segment_num_threads(PyohrliObject* self, void* closure) {
+  return PyLong_FromSize_t(
+      static_cast<zimtohrli::Zimtohrli*>(self->zimtohrli)->segment_num_threads);
+}
+
+int Pyohrli_set_segment_num_threads(PyohrliObject* self, PyObject* value,
+                                    void* closure) {
+  if (value == nullptr) {
+    PyErr_SetString(PyExc_TypeError, "cannot delete segment_num_threads");
+    return -1;
+  }
+  const size_t num_threads = PyLong_AsSize_t(value);
+  if (num_threads == static_cast<size_t>(-1) && PyErr_Occurred()) {
+    return -1;
+  }
+  static_cast<zimtohrli::Zimtohrli*>(self->zimtohrli)->segment_num_threads =
+      num_threads;
+  return 0;
+}
+
+PyObject* Pyohrli_get_dtw_precision(PyohrliObject* self, void* closure) {
+  return PyUnicode_FromString(PrecisionName(
+      static_cast<zimtohrli::Zimtohrli*>(self->zimtohrli)->dtw_panel_type));
+}
+
+int Pyohrli_set_dtw_precision(PyohrliObject* self, PyObject* value,
+                              void* closure) {
+  if (value == nullptr) {
+    PyErr_SetString(PyExc_TypeError, "cannot delete dtw_precision");
+    return -1;
+  }
+  const char* name = PyUnicode_AsUTF8(value);
+  if (name == nullptr) {
+    return -1;
+  }
+  return ParsePrecision(
+             name,
+             static_cast<zimtohrli::Zimtohrli*>(self->zimtohrli)->dtw_panel_type)
+             ? 0
+             : -1;
+}
+
+PyObject* Pyohrli_get_resample_quality(PyohrliObject* self, void* closure) {
+  return PyUnicode_FromString(ResampleQualityName(self->resample));
+}
+
+int Pyohrli_set_resample_quality(PyohrliObject* self, PyObject* value,
+                                 void* closure) {
+  if (value == nullptr) {
+    PyErr_SetString(PyExc_TypeError, "cannot delete resample_quality");
+    return -1;
+  }
+  const char* name = PyUnicode_AsUTF8(value);
+  if (name == nullptr) {
+    return -1;
+  }
+  return ParseResampleQuality(name, self->resample) ? 0 : -1;
+}
+
+PyObject* Pyohrli_get_resample_num_threads(PyohrliObject* self,
+                                           void* closure) {
+  return PyLong_FromUnsignedLong(self->resample.num_threads);
+}
+
+int Pyohrli_set_resample_num_threads(PyohrliObject* self, PyObject* value,
+                                     void* closure) {
+  if (value == nullptr) {
+    PyErr_SetString(PyExc_TypeError, "cannot delete resample_num_threads");
+    return -1;
+  }
+  const unsigned long num_threads = PyLong_AsUnsignedLong(value);
+  if (num_threads == static_cast<unsigned long>(-1) && PyErr_Occurred()) {
+    return -1;
+  }
+  self->resample.num_threads = num_threads;
+  return 0;
+}
+
+// The closure of the perceptual parameters is their index in
+// kPerceptualKeywords.
+PyObject* Pyohrli_get_perceptual(PyohrliObject* self, void* closure) {
+  const zimtohrli::Zimtohrli& zimtohrli =
+      *static_cast<zimtohrli::Zimtohrli*>(self->zimtohrli);
+  switch (reinterpret_cast<intptr_t>(closure)) {
+    case 0:
+      return PyLong_FromSize_t(zimtohrli.nsim_step_window);
+    case 1:
+      return PyLong_FromSize_t(zimtohrli.nsim_channel_window);
+    case 2:
+      return PyFloat_FromDouble(zimtohrli.high_gamma_band);
+    default:
+      return PyFloat_FromDouble(zimtohrli.perceptual_sample_rate);
+  }
+}
+
+int Pyohrli_set_perceptual(PyohrliObject* self, PyObject* value,
+                           void* closure) {
+  const intptr_t index = reinterpret_cast<intptr_t>(closure);
+  if (value == nullptr || value == Py_None) {
+    PyErr_Format(PyExc_TypeError, "cannot delete %s",
+                 kPerceptualKeywords[index]);
+    return -1;
+  }
+  PyObject* values[kNumPerceptualParameters] = {};
+  values[index] = value;
+  return ApplyPerceptualParameters(
+             values, *static_cast<zimtohrli::Zimtohrli*>(self->zimtohrli))
+             ? 0
+             : -1;
+}
+
+PyGetSetDef Pyohrli_getset[] = {
+    {"nsim_step_window", (getter)Pyohrli_get_perceptual,
+     (setter)Pyohrli_set_perceptual,
+     "The number of time steps the NSIM statistics are windowed over.",
+     reinterpret_cast<void*>(0)},
+    {"nsim_channel_window", (getter)Pyohrli_get_perceptual,
+     (setter)Pyohrli_set_perceptual,
+     "The number of channels the NSIM statistics are windowed over.",
+     reinterpret_cast<void*>(1)},
+    {"high_gamma_band", (getter)Pyohrli_get_perceptual,
+     (setter)Pyohrli_set_perceptual,
+     "The frequency in Hz the time steps of the analysis derive from. "
+     "Setting it sets perceptual_sample_rate to 48000 / int(48000 / band).",
+     reinterpret_cast<void*>(2)},
+    {"perceptual_sample_rate", (getter)Pyohrli_get_perceptual,
+     (setter)Pyohrli_set_perceptual,
+     "The rate of the time steps of the analysis in Hz, rounded to a whole "
+     "number of samples per step at 48 kHz. Lower rates make the time warp "
+     "cheaper.",
+     reinterpret_cast<void*>(3)},
+    {"dtw_band_radius", (getter)Pyohrli_get_dtw_band_radius,
+     (setter)Pyohrli_set_dtw_band_radius,
+     "Max number of time steps the time warp may deviate from the diagonal, "
+     "or 0 for an unconstrained time warp.",
+     nullptr},
+    {"dtw_max_drift_seconds", (getter)Pyohrli_get_dtw_max_drift_seconds,
+     (setter)Pyohrli_set_dtw_max_drift_seconds,
+     "Max alignment drift in seconds the time warp may find, or 0 for an "
+     "unconstrained time warp.",
+     nullptr},
+    {"dtw_multiresolution_radius",
+     (getter)Pyohrli_get_dtw_multiresolution_radius,
+     (setter)Pyohrli_set_dtw_multiresolution_radius,
+     "Number of time steps around the projected coarser alignment the "
+     "multiresolution time warp refines, or 0 for the full time warp.",
+     nullptr},
+    {"fast_math", (getter)Pyohrli_get_fast_math,
+     (setter)Pyohrli_set_fast_math,
+     "Whether the time warp and NSIM use faster, approximate math instead "
+     "of bit-exact results. The warp may then differ where alternative "
+     "alignments cost almost the same.",
+     nullptr},
+    {"dtw_precision", (getter)Pyohrli_get_dtw_precision,
+     (setter)Pyohrli_set_dtw_precision,
+     "The value type the time warp reads the second spectrogram in: "
+     "'float32', or 'float16' or 'bfloat16' to halve the memory it reads "
+     "at the cost of a small deviation of the distance.",
+     nullptr},
+    {"dtw_num_threads", (getter)Pyohrli_get_dtw_num_threads,
+     (setter)Pyohrli_set_dtw_num_threads,
+     "Number of threads the time warp of one comparison uses, or 0 for one "
+     "per CPU. The result doesn't depend on it.",
+     nullptr},
+    {"segment_seconds", (getter)Pyohrli_get_segment_seconds,
+     (setter)Pyohrli_set_segment_seconds,
+     "Length in seconds of the segments long signals are analyzed and "
+     "aligned in, or 0 to process them whole.",
+     nullptr},
+    {"segment_overlap_seconds", (getter)Pyohrli_get_segment_overlap_seconds,
+     (setter)Pyohrli_set_segment_overlap_seconds,
+     "Seconds of context processed with each segment. Should exceed the "
+     "alignment drift between the signals.",
+     nullptr},
+    {"segment_num_threads", (getter)Pyohrli_get_segment_num_threads,
+     (setter)Pyohrli_set_segment_num_threads,
+     "Number of threads the segments of one call are processed on, or 0 for "
+     "one per CPU. Defaults to 1.",
+     nullptr},
+    {"resample_quality", (getter)Pyohrli_get_resample_quality,
+     (setter)Pyohrli_set_resample_quality,
+     "The soxr quality signals at other sample rates are resampled with: "
+     "'quick', 'low', 'medium', 'high' or 'very_high'.",
+     nullptr},
+    {"resample_num_threads", (getter)Pyohrli_get_resample_num_threads,
+     (setter)Pyohrli_set_resample_num_threads,
+     "Number of threads soxr resamples with, or 0 to let soxr decide.",
+     nullptr},
+    {nullptr} /* Sentinel */
+};
+
+PyTypeObject PyohrliType = {
+    // clang-format off
+    .ob_base = PyVarObject_HEAD_INIT(nullptr, 0)
+    .tp_name = "pyohrli.Pyohrli",
+    // clang-format on
+    .tp_basicsize = sizeof(PyohrliObject),
+    .tp_itemsize = 0,
+    .tp_dealloc = (destructor)Pyohrli_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc =
+        PyDoc_STR("Python wrapper around the C++ zimtohrli::Zimtohrli type. "
+                  "Takes the keyword-only arguments nsim_step_window, "
+                  "nsim_channel_window, high_gamma_band and "
+                  "perceptual_sample_rate."),
+    .tp_methods = Pyohrli_methods,
+    .tp_getset = Pyohrli_getset,
+    .tp_init = (initproc)Pyohrli_init,
+    .tp_new = PyType_GenericNew,
+};
+
+// A zimtohrli::StreamingAnalyzer with the resampler from the stream's sample
+// rate to kSampleRate, and the mutex that serializes the calls from different
+// Python threads while they run without the GIL.
+struct StreamingState {
+  StreamingState(float sample_rate, const zimtohrli::Zimtohrli& zimtohrli)
+      : resampler(sample_rate, zimtohrli::kSampleRate), analyzer(zimtohrli) {}
+
+  std::mutex mutex;
+  zimtohrli::StreamingResampler<float, float> resampler;
+  zimtohrli::StreamingAnalyzer analyzer;
+};
+
+struct StreamingAnalyzerObject {
+  // clang-format off
+  PyObject_HEAD
+  void *state;
+  // clang-format on
+};
+
+// Arguments: sample_rate, and the keyword-only high_gamma_band and
+// perceptual_sample_rate, see ApplyPerceptualParameters.
+int StreamingAnalyzer_init(StreamingAnalyzerObject* self, PyObject* args,
+                           PyObject* kwds) {
+  static const char* keywords[] = {"sample_rate", kPerceptualKeywords[2],
+                                   kPerceptualKeywords[3], nullptr};
+  float sample_rate = zimtohrli::kSampleRate;
+  PyObject* perceptual[kNumPerceptualParameters] = {};
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|f$OO",
+                                   const_cast<char**>(keywords), &sample_rate,
+                                   &perceptual[2], &perceptual[3])) {
+    return -1;
+  }
+  if (!(sample_rate > 0)) {
+    PyErr_SetString(PyExc_ValueError, "sample_rate must be positive");
+    return -1;
+  }
+  zimtohrli::Zimtohrli zimtohrli;
+  if (!ApplyPerceptualParameters(perceptual, zimtohrli)) {
+    return -1;
+  }
+  try {
+    delete static_cast<StreamingState*>(self->state);
+    self->state = new StreamingState(sample_rate, zimtohrli);
+  } catch (const std::bad_alloc&) {
+    self->state = nullptr;
+    PyErr_SetNone(PyExc_MemoryError);
+    return -1;
+  }
+  return 0;
+}
+
+void StreamingAnalyzer_dealloc(StreamingAnalyzerObject* self) {
+  if (self) {
+    if (self->state) {
+      delete static_cast<StreamingState*>(self->state);
+      self->state = nullptr;
+    }
+    Py_TYPE(self)->tp_free((PyObject*)self);
+  }
+}
+
+PyObject* StreamingAnalyzer_push(StreamingAnalyzerObject* self,
+                                 PyObject* const* args, Py_ssize_t nargs) {
+  if (nargs != 1) {
+    return BadArgument("not exactly 1 argument provided");
+  }
+  StreamingState& state = *static_cast<StreamingState*>(self->state);
+  const std::optional<std::vector<float>> samples =
+      CopySignal(args[0], /*allow_empty=*/true);
+  if (!samples.has_value()) {
+    return nullptr;
+  }
+  std::optional<zimtohrli::Spectrogram> rows;
+  try {
+    GilRelease gil_release;
+    std::lock_guard<std::mutex> lock(state.mutex);
+    const std::vector<float> resampled = state.resampler.Push(
+        zimtohrli::Span<const float>(samples.value()));
+    rows = state.analyzer.Push(zimtohrli::Span<const float>(resampled));
+  } catch (const std::exception& e) {
+    return SetErrorFromException(e);
+  }
+  return NewSpectrogram(std::move(rows.value()));
+}
+
+PyObject* StreamingAnalyzer_finish(StreamingAnalyzerObject* self,
+                                   PyObject* const* args, Py_ssize_t nargs) {
+  if (nargs != 0) {
+    return BadArgument("not exactly 0 arguments provided");
+  }
+  StreamingState& state = *static_cast<StreamingState*>(self->state);
+  std::optional<zimtohrli::Spectrogram> rows;
+  try {
+    GilRelease gil_release;
+    std::lock_guard<std::mutex> lock(state.mutex);
+    const std::vector<float> resampled = state.resampler.Finish();
+    const zimtohrli::Spectrogram pushed =
+        state.analyzer.Push(zimtohrli::Span<const float>(resampled));
+    const zimtohrli::Spectrogram finished = state.analyzer.Finish();
+    rows.emplace(pushed.num_steps + finished.num_steps, pushed.num_dims);
+    std::copy(pushed.values.get(), pushed.values.get() + pushed.size(),
+              rows->values.get());
+    std::copy(finished.values.get(), finished.values.get() + finished.size(),
+              rows->values.get() + pushed.size());
+  } catch (const std::exception& e) {
+    return SetErrorFromException(e);
+  }
+  return NewSpectrogram(std::move(rows.value()));
+}
+
+PyObject* StreamingAnalyzer_reset(StreamingAnalyzerObject* self,
+                                  PyObject* const* args, Py_ssize_t nargs) {
+  if (nargs != 0) {
+    return BadArgument("not exactly 0 arguments provided");
+  }
+  StreamingState& state = *static_cast<StreamingState*>(self->state);
+  std::lock_guard<std::mutex> lock(state.mutex);
+  state.resampler.Reset();
+  state.analyzer.Reset();
+  Py_RETURN_NONE;
+}
+
+PyMethodDef StreamingAnalyzer_methods[] = {
+    {"push", (PyCFunction)StreamingAnalyzer_push, METH_FASTCALL,
+     "Adds a chunk of samples to the stream, and returns a Spectrogram of "
+     "the rows it completes, possibly with 0 steps."},
+    {"finish", (PyCFunction)StreamingAnalyzer_finish, METH_FASTCALL,
+     "Ends the stream, returns a Spectrogram of its remaining rows, and "
+     "resets the analyzer."},
+    {"reset", (PyCFunction)StreamingAnalyzer_reset, METH_FASTCALL,
+     "Discards the stream analyzed so far."},
+    {nullptr} /* Sentinel */
+};
+
+PyObject* StreamingAnalyzer_get_num_samples(StreamingAnalyzerObject* self,
+                                            void* closure) {
+  StreamingState& state = *static_cast<StreamingState*>(self->state);
+  std::lock_guard<std::mutex> lock(state.mutex);
+  return PyLong_FromSize_t(state.analyzer.num_samples());
+}
+
+PyObject* StreamingAnalyzer_get_num_steps(StreamingAnalyzerObject* self,
+                                          void* closure) {
+  StreamingState& state = *static_cast<StreamingState*>(self->state);
+  std::lock_guard<std::mutex> lock(state.mutex);
+  return PyLong_FromSize_t(state.analyzer.num_steps());
+}
+
+PyGetSetDef StreamingAnalyzer_getset[] = {
+    {"num_samples", (getter)StreamingAnalyzer_get_num_samples, nullptr,
+     "Number of 48 kHz samples analyzed since the stream started.", nullptr},
+    {"num_steps", (getter)StreamingAnalyzer_get_num_steps, nullptr,
+     "Number of spectrogram rows returned since the stream started.",
+     nullptr},
+    {nullptr} /* Sentinel */
+};
+
+PyTypeObject StreamingAnalyzerType = {
+    // clang-format off
+    .ob_base = PyVarObject_HEAD_INIT(nullptr, 0)
+    .tp_name = "pyohrli.StreamingAnalyzer",
+    // clang-format on
+    .tp_basicsize = sizeof(StreamingAnalyzerObject),
+    .tp_itemsize = 0,
+    .tp_dealloc = (destructor)StreamingAnalyzer_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = PyDoc_STR(
+        "Python wrapper around the C++ zimtohrli::StreamingAnalyzer type."),
+    .tp_methods = StreamingAnalyzer_methods,
+    .tp_getset = StreamingAnalyzer_getset,
+    .tp_init = (initproc)StreamingAnalyzer_init,
+    .tp_new = PyType_GenericNew,
+};
+
+// A zimtohrli::StreamingDistance, and the mutex that serializes the calls
+// from different Python threads while they run without the GIL.
+struct StreamingDistanceState {
+  StreamingDistanceState(const zimtohrli::Zimtohrli& zimtohrli,
+                         size_t report_steps, size_t window_steps)
+      : seconds_per_step(
+            static_cast<double>(zimtohrli.samples_per_perceptual_block) /
+            zimtohrli::kSampleRate),
+        distance(zimtohrli, report_steps, window_steps) {}
+
+  std::mutex mutex;
+  double seconds_per_step;
+  zimtohrli::StreamingDistance distance;
+};
+
+struct StreamingDistanceObject {
+  // clang-format off
+  PyObject_HEAD
+  void *state;
+  // clang-format on
+};
+
+// Arguments: report_seconds, window_seconds, max_drift_seconds, fast_math,
+// and the keyword-only perceptual parameters, see ApplyPerceptualParameters.
+int StreamingDistance_init(StreamingDistanceObject* self, PyObject* args,
+                           PyObject* kwds) {
+  static const char* keywords[] = {"report_seconds",
+                                   "window_seconds",
+                                   "max_drift_seconds",
+                                   "fast_math",
+                                   kPerceptualKeywords[0],
+                                   kPerceptualKeywords[1],
+                                   kPerceptualKeywords[2],
+                                   kPerceptualKeywords[3],
+                                   nullptr};
+  float report_seconds = 0;
+  float window_seconds = 0;
+  float max_drift_seconds = 0;
+  int fast_math = 0;
+  PyObject* perceptual[kNumPerceptualParameters] = {};
+  if (!PyArg_ParseTupleAndKeywords(
+          args, kwds, "fffp|$OOOO", const_cast<char**>(keywords),
+          &report_seconds, &window_seconds, &max_drift_seconds, &fast_math,
+          &perceptual[0], &perceptual[1], &perceptual[2], &perceptual[3])) {
+    return -1;
+  }
+  if (!(report_seconds > 0) || !(window_seconds > 0) ||
+      !(max_drift_seconds >= 0)) {
+    PyErr_SetString(PyExc_ValueError,
+                    "report_seconds and window_seconds must be positive, and "
+                    "max_drift_seconds non-negative");
+    return -1;
+  }
+  zimtohrli::Zimtohrli zimtohrli;
+  if (!ApplyPerceptualParameters(perceptual, zimtohrli)) {
+    return -1;
+  }
+  zimtohrli.dtw_max_drift_seconds = max_drift_seconds;
+  zimtohrli.fast_math = fast_math;
+  const auto to_steps = [&](float seconds) {
+    return std::max<size_t>(
+        1, std::lround(seconds * zimtohrli.perceptual_sample_rate));
+  };
+  try {
+    delete static_cast<StreamingDistanceState*>(self->state);
+    self->state = new StreamingDistanceState(
+        zimtohrli, to_steps(report_seconds), to_steps(window_seconds));
+  } catch (const std::bad_alloc&) {
+    self->state = nullptr;
+    PyErr_SetNone(PyExc_MemoryError);
+    return -1;
+  }
+  return 0;
+}
+
+void StreamingDistance_dealloc(StreamingDistanceObject* self) {
+  if (self) {
+    if (self->state) {
+      delete static_cast<StreamingDistanceState*>(self->state);
+      self->state = nullptr;
+    }
+    Py_TYPE(self)->tp_free((PyObject*)self);
+  }
+}
+
+// Returns a list of (start_seconds, end_seconds, distance, mos) tuples.
+PyObject* NewReportList(
+    const StreamingDistanceState& state,
+    const std::vector<zimtohrli::StreamingDistanceReport>& reports) {
+  PyObject* result = PyList_New(reports.size());
+  if (result == nullptr) {
+    return nullptr;
+  }
+  for (size_t index = 0; index < reports.size(); ++index) {
+    const zimtohrli::StreamingDistanceReport& report = reports[index];
+    PyObject* item = Py_BuildValue(
+        "(dddd)", report.begin_step * state.seconds_per_step,
+        report.end_step * state.seconds_per_step,
+        static_cast<double>(report.distance),
+        static_cast<double>(zimtohrli::MOSFromZimtohrli(report.distance)));
+    if (item == nullptr) {
+      Py_DECREF(result);
+      return nullptr;
+    }
+    PyList_SET_ITEM(result, index, item);
+  }
+  return result;
+}
+
+PyObject* StreamFinishedError() {
+  PyErr_SetString(PyExc_RuntimeError,
+                  "the streams are finished, call reset() first");
+  return nullptr;
+}
+
+PyObject* StreamingDistance_push(StreamingDistanceObject* self,
+                                 PyObject* const* args, Py_ssize_t nargs) {
+  if (nargs != 2) {
+    return BadArgument("not exactly 2 arguments provided");
+  }
+  StreamingDistanceState& state =
+      *static_cast<StreamingDistanceState*>(self->state);
+  const std::optional<std::vector<float>> samples_a =
+      CopySignal(args[0], /*allow_empty=*/true);
+  if (!samples_a.has_value()) {
+    return nullptr;
+  }
+  const std::optional<std::vector<float>> samples_b =
+      CopySignal(args[1], /*allow_empty=*/true);
+  if (!samples_b.has_value()) {
+    return nullptr;
+  }
+  std::vector<zimtohrli::StreamingDistanceReport> reports;
+  bool finished = false;
+  try {
+    GilRelease gil_release;
+    std::lock_guard<std::mutex> lock(state.mutex);
+    finished = state.distance.finished();
+    if (!finished) {
+      reports = state.distance.Push(
+          zimtohrli::Span<const float>(samples_a.value()),
+          zimtohrli::Span<const float>(samples_b.value()));
+    }
+  } catch (const std::exception& e) {
+    return SetErrorFromException(e);
+  }
+  if (finished) {
+    return StreamFinishedError();
+  }
+  return NewReportList(state, reports);
+}
+
+PyObject* StreamingDistance_finish(StreamingDistanceObject* self,
+                                   PyObject* const* args, Py_ssize_t nargs) {
+  if (nargs != 0) {
+    return BadArgument("not exactly 0 arguments provided");
+  }
+  StreamingDistanceState& state =
+      *static_cast<StreamingDistanceState*>(self->state);
+  std::vector<zimtohrli::StreamingDistanceReport> reports;
+  bool finished = false;
+  try {
+    GilRelease gil_release;
+    std::lock_guard<std::mutex> lock(state.mutex);
+    finished = state.distance.finished();
+    if (!finished) {
+      reports = state.distance.Finish();
+    }
+  } catch (const std::exception& e) {
+    return SetErrorFromException(e);
+  }
+  if (finished) {
+    return StreamFinishedError();
+  }
+  return NewReportList(state, reports);
+}
+
+PyObject* StreamingDistance_reset(StreamingDistanceObject* self,
+                                  PyObject* const* args, Py_ssize_t nargs) {
+  if (nargs != 0) {
+    return BadArgument("not exactly 0 arguments provided");
+  }
+  StreamingDistanceState& state =
+      *static_cast<StreamingDistanceState*>(self->state);
+  std::lock_guard<std::mutex> lock(state.mutex);
+  state.distance.Reset();
+  Py_RETURN_NONE;
+}
+
+PyMethodDef StreamingDistance_methods[] = {
+    {"push", (PyCFunction)StreamingDistance_push, METH_FASTCALL,
+     "Adds the next chunks of both streams, and returns a list of the "
+     "(start_seconds, end_seconds, distance, mos) reports they complete."},
+    {"finish", (PyCFunction)StreamingDistance_finish, METH_FASTCALL,
+     "Ends both streams, and returns a list of the remaining reports."},
+    {"reset", (PyCFunction)StreamingDistance_reset, METH_FASTCALL,
+     "Discards the streams compared so far."},
+    {nullptr} /* Sentinel */
+};
+
+PyObject* StreamingDistance_get_distance(StreamingDistanceObject* self,
+                                         void* closure) {
+  StreamingDistanceState& state =
+      *static_cast<StreamingDistanceState*>(self->state);
+  std::lock_guard<std::mutex> lock(state.mutex);
+  if (state.distance.num_pairs() == 0) {
+    Py_RETURN_NONE;
+  }
+  return PyFloat_FromDouble(state.distance.distance());
+}
+
+PyObject* StreamingDistance_get_num_pairs(StreamingDistanceObject* self,
+                                          void* closure) {
+  StreamingDistanceState& state =
+      *static_cast<StreamingDistanceState*>(self->state);
+  std::lock_guard<std::mutex> lock(state.mutex);
+  return PyLong_FromSize_t(state.distance.num_pairs());
+}
+
+PyObject* StreamingDistance_get_finished(StreamingDistanceObject* self,
+                                         void* closure) {
+  StreamingDistanceState& state =
+      *static_cast<StreamingDistanceState*>(self->state);
+  std::lock_guard<std::mutex> lock(state.mutex);
+  return PyBool_FromLong(state.distance.finished());
+}
+
+PyGetSetDef StreamingDistance_getset[] = {
+    {"distance", (getter)StreamingDistance_get_distance, nullptr,
+     "Distance over all aligned pairs of steps, or None before the first.",
+     nullptr},
+    {"num_pairs", (getter)StreamingDistance_get_num_pairs, nullptr,
+     "Number of aligned pairs of steps since the streams started.", nullptr},
+    {"finished", (getter)StreamingDistance_get_finished, nullptr,
+     "Whether finish() was called since the streams started.", nullptr},
+    {nullptr} /* Sentinel */
+};
+
+PyTypeObject StreamingDistanceType = {
+    // clang-format off
+    .ob_base = PyVarObject_HEAD_INIT(nullptr, 0)
+    .tp_name = "pyohrli.StreamingDistance",
+    // clang-format on
+    .tp_basicsize = sizeof(StreamingDistanceObject),
+    .tp_itemsize = 0,
+    .tp_dealloc = (destructor)StreamingDistance_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = PyDoc_STR(
+        "Python wrapper around the C++ zimtohrli::StreamingDistance type."),
+    .tp_methods = StreamingDistance_methods,
+    .tp_getset = StreamingDistance_getset,
+    .tp_init = (initproc)StreamingDistance_init,
     .tp_new = PyType_GenericNew,
 };
 
@@ -212,203 +2191,938 @@ PyObject* MOSFromZimtohrli(PyohrliObject* self, PyObject* const* args,
       zimtohrli::MOSFromZimtohrli(PyFloat_AsDouble(args[0])));
 }
 
-// Enhanced function that accepts numpy arrays with sample rates
-PyObject* CompareAudioArrays(PyObject* self, PyObject* const* args,
-                            Py_ssize_t nargs) {
-  if (nargs != 4) {
-    return BadArgument("Expected 4 arguments: audio_a, sample_rate_a, audio_b, sample_rate_b");
+// Returns the counters of zimtohrli::DistanceStats as a (num_time_warps,
+// num_identical) tuple, and resets them if the optional argument is true.
+PyObject* DistanceStats(PyObject* self, PyObject* const* args,
+                        Py_ssize_t nargs) {
+  if (nargs > 1) {
+    return BadArgument("more than 1 argument provided");
+  }
+  int reset = 0;
+  if (nargs == 1) {
+    reset = PyObject_IsTrue(args[0]);
+    if (reset < 0) {
+      return nullptr;
+    }
+  }
+  zimtohrli::DistanceStats& stats = zimtohrli::DistanceStats::Global();
+  const size_t num_time_warps =
+      reset ? stats.num_time_warps.exchange(0) : stats.num_time_warps.load();
+  const size_t num_identical =
+      reset ? stats.num_identical.exchange(0) : stats.num_identical.load();
+  return Py_BuildValue("(nn)", static_cast<Py_ssize_t>(num_time_warps),
+                       static_cast<Py_ssize_t>(num_identical));
+}
+
+// Measures the wall time of the comparisons that a Profile collects the
+// stages of.
+class ProfileClock {
+ public:
+  ProfileClock() : start_(std::chrono::steady_clock::now()) {}
+  double seconds() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start_)
+        .count();
+  }
+
+ private:
+  std::chrono::steady_clock::time_point start_;
+};
+
+// Returns a dict with the stages and counters of profile: the seconds and
+// number of calls of each stage as "<stage>_seconds" and "<stage>_calls",
+// each counter by its name, and the wall_seconds and num_comparisons they
+// were collected over.
+PyObject* NewProfileDict(const zimtohrli::Profile& profile,
+                         double wall_seconds, Py_ssize_t num_comparisons) {
+  PyObject* dict = PyDict_New();
+  if (dict == nullptr) {
+    return nullptr;
+  }
+  // Steals value.
+  const auto set = [&](const std::string& key, PyObject* value) {
+    if (value == nullptr) {
+      return false;
+    }
+    const int error = PyDict_SetItemString(dict, key.c_str(), value);
+    Py_DECREF(value);
+    return error == 0;
+  };
+  bool ok = set("wall_seconds", PyFloat_FromDouble(wall_seconds)) &&
+            set("num_comparisons", PyLong_FromSsize_t(num_comparisons));
+  for (size_t index = 0; ok && index < zimtohrli::kNumStages; ++index) {
+    const zimtohrli::Stage stage = static_cast<zimtohrli::Stage>(index);
+    const std::string name = zimtohrli::StageName(stage);
+    ok = set(name + "_seconds", PyFloat_FromDouble(profile.seconds(stage))) &&
+         set(name + "_calls",
+             PyLong_FromUnsignedLongLong(profile.num_calls(stage)));
+  }
+  for (size_t index = 0; ok && index < zimtohrli::kNumCounters; ++index) {
+    const zimtohrli::Counter counter = static_cast<zimtohrli::Counter>(index);
+    ok = set(zimtohrli::CounterName(counter),
+             PyLong_FromUnsignedLongLong(profile.count(counter)));
+  }
+  if (!ok) {
+    Py_DECREF(dict);
+    return nullptr;
+  }
+  return dict;
+}
+
+// Returns a (result, profile dict) tuple, see NewProfileDict. Steals result.
+PyObject* WithProfile(PyObject* result, const zimtohrli::Profile& profile,
+                      double wall_seconds, Py_ssize_t num_comparisons) {
+  if (result == nullptr) {
+    return nullptr;
+  }
+  PyObject* dict = NewProfileDict(profile, wall_seconds, num_comparisons);
+  if (dict == nullptr) {
+    Py_DECREF(result);
+    return nullptr;
+  }
+  return Py_BuildValue("(NN)", result, dict);
+}
+
+// Resamples the signals to kSampleRate if needed, and returns their Zimtohrli
+// distance. Signal is either a Span<const float> or a SignalView.
+//
+// Doesn't touch any Python objects and is safe to call without the GIL.
+template <typename Signal>
+float DistanceBetweenSignals(const zimtohrli::Zimtohrli& zimtohrli,
+                             const Signal& signal_a, float sample_rate_a,
+                             const Signal& signal_b, float sample_rate_b,
+                             const zimtohrli::ResampleOptions& resample) {
+  zimtohrli::Spectrogram spec_a =
+      AnalyzeSignal(zimtohrli, signal_a, sample_rate_a, resample);
+  zimtohrli::Spectrogram spec_b =
+      AnalyzeSignal(zimtohrli, signal_b, sample_rate_b, resample);
+  return zimtohrli.Distance(spec_a, spec_b);
+}
+
+// Returns the same distance as DistanceBetweenSignals without a workspace,
+// computed in the buffers of workspace.
+//
+// Doesn't touch any Python objects and is safe to call without the GIL, as
+// long as the buffers of the signals are held.
+float DistanceBetweenSignals(const zimtohrli::Zimtohrli& zimtohrli,
+                             const SignalView& signal_a, float sample_rate_a,
+                             const SignalView& signal_b, float sample_rate_b,
+                             const zimtohrli::ResampleOptions& resample,
+                             zimtohrli::Workspace& workspace) {
+  AnalyzeSignal(zimtohrli, signal_a, sample_rate_a, resample, workspace,
+                workspace.spectrogram_a);
+  AnalyzeSignal(zimtohrli, signal_b, sample_rate_b, resample, workspace,
+                workspace.spectrogram_b);
+  return zimtohrli.Distance(
+      workspace.spectrogram_a, workspace.spectrogram_a.max(),
+      workspace.spectrogram_b, workspace.spectrogram_b.max(), workspace);
+}
+
+// Parses a resample quality name and a number of soxr threads into options.
+// Returns false with a Python error set if either is invalid.
+bool ParseResampleOptions(PyObject* quality_obj, PyObject* num_threads_obj,
+                          zimtohrli::ResampleOptions& options) {
+  const char* quality = PyUnicode_AsUTF8(quality_obj);
+  if (quality == nullptr || !ParseResampleQuality(quality, options)) {
+    return false;
+  }
+  const long num_threads = PyLong_AsLong(num_threads_obj);
+  if (num_threads == -1 && PyErr_Occurred()) {
+    return false;
+  }
+  if (num_threads < 0) {
+    PyErr_SetString(PyExc_ValueError,
+                    "resample_num_threads must be non-negative");
+    return false;
+  }
+  options.num_threads = num_threads;
+  return true;
+}
+
+// Applies the keyword arguments kwnames of a METH_FASTCALL | METH_KEYWORDS
+// call, whose values follow the nargs positional args, to zimtohrli, see
+// ApplyPerceptualParameters. Returns false with a Python error set if one
+// isn't a perceptual parameter or is invalid.
+bool ApplyPerceptualKeywords(PyObject* const* args, Py_ssize_t nargs,
+                             PyObject* kwnames,
+                             zimtohrli::Zimtohrli& zimtohrli) {
+  PyObject* values[kNumPerceptualParameters] = {};
+  const Py_ssize_t num_keywords =
+      kwnames == nullptr ? 0 : PyTuple_GET_SIZE(kwnames);
+  for (Py_ssize_t keyword = 0; keyword < num_keywords; ++keyword) {
+    PyObject* const name = PyTuple_GET_ITEM(kwnames, keyword);
+    size_t index = 0;
+    while (index < kNumPerceptualParameters &&
+           PyUnicode_CompareWithASCIIString(name,
+                                            kPerceptualKeywords[index]) != 0) {
+      ++index;
+    }
+    if (index == kNumPerceptualParameters) {
+      PyErr_Format(PyExc_TypeError, "unexpected keyword argument '%U'", name);
+      return false;
+    }
+    values[index] = args[nargs + keyword];
+  }
+  return ApplyPerceptualParameters(values, zimtohrli);
+}
+
+// Shared implementation of compare_audio_arrays and
+// compare_audio_arrays_distance.
+//
+// The audio arrays are validated and copied while holding the GIL, after which
+// resampling, analysis and the distance computation run without it.
+PyObject* CompareAudioArraysImpl(PyObject* const* args, Py_ssize_t nargs,
+                                 PyObject* kwnames, bool return_mos) {
+  if (nargs != 4 && nargs != 6 && nargs != 7) {
+    return BadArgument(
+        "Expected 4, 6 or 7 arguments: audio_a, sample_rate_a, audio_b, "
+        "sample_rate_b[, resample_quality, resample_num_threads[, profile]]");
   }
-  
+
   // Parse arguments
   PyObject* audio_a = args[0];
   PyObject* sample_rate_a_obj = args[1];
   PyObject* audio_b = args[2];
   PyObject* sample_rate_b_obj = args[3];
-  
+
   // Extract sample rates
   double sample_rate_a = PyFloat_AsDouble(sample_rate_a_obj);
   if (PyErr_Occurred()) {
     return BadArgument("sample_rate_a must be a float");
   }
-  
+
   double sample_rate_b = PyFloat_AsDouble(sample_rate_b_obj);
   if (PyErr_Occurred()) {
     return BadArgument("sample_rate_b must be a float");
   }
-  
-  // Get buffer views for audio arrays
-  Py_buffer buffer_a, buffer_b;
-  if (PyObject_GetBuffer(audio_a, &buffer_a, PyBUF_C_CONTIGUOUS) != 0) {
-    return BadArgument("audio_a is not a valid buffer");
-  }
-  
-  if (PyObject_GetBuffer(audio_b, &buffer_b, PyBUF_C_CONTIGUOUS) != 0) {
-    PyBuffer_Release(&buffer_a);
-    return BadArgument("audio_b is not a valid buffer");
-  }
-  
-  // Validate buffer formats
-  if (buffer_a.itemsize != sizeof(float) || buffer_b.itemsize != sizeof(float)) {
-    PyBuffer_Release(&buffer_a);
-    PyBuffer_Release(&buffer_b);
-    return BadArgument("Audio arrays must contain float32 values");
-  }
-  
-  if (buffer_a.ndim != 1 || buffer_b.ndim != 1) {
-    PyBuffer_Release(&buffer_a);
-    PyBuffer_Release(&buffer_b);
-    return BadArgument("Audio arrays must be 1-dimensional");
-  }
-  
+
+  // Extract resampling options
+  zimtohrli::ResampleOptions resample;
+  if (nargs >= 6 && !ParseResampleOptions(args[4], args[5], resample)) {
+    return nullptr;
+  }
+  int profile = 0;
+  if (nargs == 7) {
+    profile = PyObject_IsTrue(args[6]);
+    if (profile < 0) {
+      return nullptr;
+    }
+  }
+  zimtohrli::Zimtohrli zimtohrli;
+  if (!ApplyPerceptualKeywords(args, nargs, kwnames, zimtohrli)) {
+    return nullptr;
+  }
+
+  // Copy the samples as float32 so that the buffers can be released before
+  // the GIL.
+  const std::optional<std::vector<float>> signal_a = CopySignal(audio_a);
+  if (!signal_a.has_value()) {
+    return nullptr;
+  }
+  const std::optional<std::vector<float>> signal_b = CopySignal(audio_b);
+  if (!signal_b.has_value()) {
+    return nullptr;
+  }
+
   try {
-    // Create spans from the buffer data
-    zimtohrli::Span<const float> span_a(
-        static_cast<const float*>(buffer_a.buf),
-        buffer_a.len / sizeof(float));
-    zimtohrli::Span<const float> span_b(
-        static_cast<const float*>(buffer_b.buf),
-        buffer_b.len / sizeof(float));
-    
-    // Resample to Zimtohrli's expected sample rate (48kHz) if needed
-    std::vector<float> resampled_a, resampled_b;
-    zimtohrli::Span<const float> final_span_a = span_a;
-    zimtohrli::Span<const float> final_span_b = span_b;
-    
-    if (sample_rate_a != zimtohrli::kSampleRate) {
-      resampled_a = zimtohrli::Resample<float>(span_a, sample_rate_a, zimtohrli::kSampleRate);
-      final_span_a = zimtohrli::Span<const float>(resampled_a);
-    }
-    
-    if (sample_rate_b != zimtohrli::kSampleRate) {
-      resampled_b = zimtohrli::Resample<float>(span_b, sample_rate_b, zimtohrli::kSampleRate);
-      final_span_b = zimtohrli::Span<const float>(resampled_b);
-    }
-    
-    // Create Zimtohrli instance and analyze
-    zimtohrli::Zimtohrli zimtohrli_instance;
-    zimtohrli::Spectrogram spec_a = zimtohrli_instance.Analyze(final_span_a);
-    zimtohrli::Spectrogram spec_b = zimtohrli_instance.Analyze(final_span_b);
-    
-    // Calculate distance and convert to MOS
-    float distance = zimtohrli_instance.Distance(spec_a, spec_b);
-    double mos = zimtohrli::MOSFromZimtohrli(distance);
-    
-    PyBuffer_Release(&buffer_a);
-    PyBuffer_Release(&buffer_b);
-    
-    return PyFloat_FromDouble(mos);
-    
+    float distance;
+    zimtohrli::Profile stats;
+    const ProfileClock clock;
+    {
+      GilRelease gil_release;
+      const zimtohrli::ProfileScope profile_scope(profile ? &stats : nullptr);
+      distance = DistanceBetweenSignals(
+          zimtohrli, zimtohrli::Span<const float>(*signal_a),
+          sample_rate_a, zimtohrli::Span<const float>(*signal_b),
+          sample_rate_b, resample);
+    }
+    const double wall_seconds = clock.seconds();
+
+    PyObject* result = PyFloat_FromDouble(
+        return_mos ? zimtohrli::MOSFromZimtohrli(distance) : distance);
+    if (profile) {
+      return WithProfile(result, stats, wall_seconds, 1);
+    }
+    return result;
+
   } catch (const std::exception& e) {
-    PyBuffer_Release(&buffer_a);
-    PyBuffer_Release(&buffer_b);
-    PyErr_SetString(PyExc_RuntimeError, e.what());
-    return nullptr;
+    return SetErrorFromException(e);
   }
 }
 
+// Enhanced function that accepts numpy arrays with sample rates
+PyObject* CompareAudioArrays(PyObject* self, PyObject* const* args,
+                            Py_ssize_t nargs, PyObject* kwnames) {
+  return CompareAudioArraysImpl(args, nargs, kwnames, /*return_mos=*/true);
+}
+
 // Function that returns the raw Zimtohrli distance instead of MOS
 PyObject* CompareAudioArraysDistance(PyObject* self, PyObject* const* args,
-                                    Py_ssize_t nargs) {
-  if (nargs != 4) {
-    return BadArgument("Expected 4 arguments: audio_a, sample_rate_a, audio_b, sample_rate_b");
+                                    Py_ssize_t nargs, PyObject* kwnames) {
+  return CompareAudioArraysImpl(args, nargs, kwnames, /*return_mos=*/false);
+}
+
+// Holds buffer views of a batch of Python objects and releases them when
+// destroyed.
+class BufferViews {
+ public:
+  explicit BufferViews(size_t capacity) { views_.reserve(capacity); }
+  ~BufferViews() {
+    for (Py_buffer& view : views_) {
+      PyBuffer_Release(&view);
+    }
   }
-  
-  // Parse arguments
-  PyObject* audio_a = args[0];
-  PyObject* sample_rate_a_obj = args[1];
-  PyObject* audio_b = args[2];
-  PyObject* sample_rate_b_obj = args[3];
-  
-  // Extract sample rates
-  double sample_rate_a = PyFloat_AsDouble(sample_rate_a_obj);
-  if (PyErr_Occurred()) {
-    return BadArgument("sample_rate_a must be a float");
+  BufferViews(const BufferViews&) = delete;
+  BufferViews& operator=(const BufferViews&) = delete;
+
+  // Acquires a view of a 1-dimensional int16, int32, float32 or float64
+  // buffer with any stride. Returns std::nullopt with a Python error set if
+  // object isn't one.
+  //
+  // name and index identify the object in error messages, index is omitted if
+  // negative.
+  std::optional<SignalView> Add(PyObject* object, const char* name,
+                                Py_ssize_t index = -1) {
+    Py_buffer view;
+    if (PyObject_GetBuffer(object, &view, kSignalBufferFlags) != 0) {
+      SetError(PyExc_TypeError, name, index, "is not a valid buffer");
+      return std::nullopt;
+    }
+    SignalView signal;
+    if (const char* problem = ParseSignalView(view, signal)) {
+      PyBuffer_Release(&view);
+      SetError(PyExc_TypeError, name, index, problem);
+      return std::nullopt;
+    }
+    if (signal.size == 0) {
+      PyBuffer_Release(&view);
+      SetError(PyExc_ValueError, name, index, "cannot be empty");
+      return std::nullopt;
+    }
+    views_.push_back(view);
+    return signal;
   }
-  
-  double sample_rate_b = PyFloat_AsDouble(sample_rate_b_obj);
-  if (PyErr_Occurred()) {
-    return BadArgument("sample_rate_b must be a float");
+
+ private:
+  static void SetError(PyObject* type, const char* name, Py_ssize_t index,
+                       const char* problem) {
+    PyErr_Clear();
+    if (index < 0) {
+      PyErr_Format(type, "%s %s", name, problem);
+    } else {
+      PyErr_Format(type, "%s[%zd] %s", name, index, problem);
+    }
+  }
+
+  std::vector<Py_buffer> views_;
+};
+
+// Fills sample_rates with one sample rate per pair from either a single
+// number or a sequence of num_pairs numbers. Returns false with a Python error
+// set on failure.
+bool ParseSampleRates(PyObject* sample_rates_obj, Py_ssize_t num_pairs,
+                      std::vector<float>& sample_rates) {
+  if (!PySequence_Check(sample_rates_obj)) {
+    const double sample_rate = PyFloat_AsDouble(sample_rates_obj);
+    if (PyErr_Occurred()) {
+      return false;
+    }
+    sample_rates.assign(num_pairs, sample_rate);
+  } else {
+    PyObject* sequence = PySequence_Fast(
+        sample_rates_obj, "sample_rates must be a number or a sequence");
+    if (sequence == nullptr) {
+      return false;
+    }
+    if (PySequence_Fast_GET_SIZE(sequence) != num_pairs) {
+      Py_DECREF(sequence);
+      PyErr_SetString(PyExc_ValueError,
+                      "sample_rates must have one entry per pair");
+      return false;
+    }
+    sample_rates.resize(num_pairs);
+    for (Py_ssize_t index = 0; index < num_pairs; ++index) {
+      sample_rates[index] =
+          PyFloat_AsDouble(PySequence_Fast_GET_ITEM(sequence, index));
+      if (PyErr_Occurred()) {
+        Py_DECREF(sequence);
+        return false;
+      }
+    }
+    Py_DECREF(sequence);
+  }
+  for (const float sample_rate : sample_rates) {
+    if (!(sample_rate > 0)) {
+      PyErr_SetString(PyExc_ValueError, "sample rates must be positive");
+      return false;
+    }
+  }
+  return true;
+}
+
+// Compares refs[i] to degs[i] for all i using a pool of worker threads.
+//
+// Valid buffer views of all arrays are held for the duration of the call, so
+// the signals are read in place without copies. The arrays mustn't be mutated
+// by other threads until the call returns.
+PyObject* CompareAudioBatch(PyObject* self, PyObject* args, PyObject* kwargs) {
+  static const char* keywords[] = {"refs",
+                                   "degs",
+                                   "sample_rates",
+                                   "num_threads",
+                                   "return_distance",
+                                   "resample_quality",
+                                   "resample_num_threads",
+                                   "profile",
+                                   kPerceptualKeywords[0],
+                                   kPerceptualKeywords[1],
+                                   kPerceptualKeywords[2],
+                                   kPerceptualKeywords[3],
+                                   nullptr};
+  PyObject* refs_obj;
+  PyObject* degs_obj;
+  PyObject* sample_rates_obj;
+  Py_ssize_t num_threads = 0;
+  int return_distance = 0;
+  const char* resample_quality = "very_high";
+  Py_ssize_t resample_num_threads = 1;
+  int profile = 0;
+  PyObject* perceptual[kNumPerceptualParameters] = {};
+  if (!PyArg_ParseTupleAndKeywords(
+          args, kwargs, "OOO|$npsnpOOOO", const_cast<char**>(keywords),
+          &refs_obj, &degs_obj, &sample_rates_obj, &num_threads,
+          &return_distance, &resample_quality, &resample_num_threads, &profile,
+          &perceptual[0], &perceptual[1], &perceptual[2], &perceptual[3])) {
+    return nullptr;
+  }
+  zimtohrli::Zimtohrli zimtohrli;
+  if (!ApplyPerceptualParameters(perceptual, zimtohrli)) {
+    return nullptr;
+  }
+  if (num_threads < 0) {
+    PyErr_SetString(PyExc_ValueError, "num_threads must be non-negative");
+    return nullptr;
+  }
+  if (resample_num_threads < 0) {
+    PyErr_SetString(PyExc_ValueError,
+                    "resample_num_threads must be non-negative");
+    return nullptr;
+  }
+  zimtohrli::ResampleOptions resample;
+  resample.num_threads = resample_num_threads;
+  if (!ParseResampleQuality(resample_quality, resample)) {
+    return nullptr;
+  }
+
+  PyObject* refs = PySequence_Fast(refs_obj, "refs must be a sequence");
+  if (refs == nullptr) {
+    return nullptr;
+  }
+  std::unique_ptr<PyObject, PyObjectDeleter> refs_deleter(refs);
+  PyObject* degs = PySequence_Fast(degs_obj, "degs must be a sequence");
+  if (degs == nullptr) {
+    return nullptr;
+  }
+  std::unique_ptr<PyObject, PyObjectDeleter> degs_deleter(degs);
+  const Py_ssize_t num_pairs = PySequence_Fast_GET_SIZE(refs);
+  if (PySequence_Fast_GET_SIZE(degs) != num_pairs) {
+    PyErr_SetString(PyExc_ValueError,
+                    "refs and degs must have the same length");
+    return nullptr;
+  }
+
+  try {
+    std::vector<float> sample_rates;
+    if (!ParseSampleRates(sample_rates_obj, num_pairs, sample_rates)) {
+      return nullptr;
+    }
+    BufferViews views(2 * num_pairs);
+    std::vector<SignalView> ref_signals, deg_signals;
+    ref_signals.reserve(num_pairs);
+    deg_signals.reserve(num_pairs);
+    for (Py_ssize_t index = 0; index < num_pairs; ++index) {
+      std::optional<SignalView> ref =
+          views.Add(PySequence_Fast_GET_ITEM(refs, index), "refs", index);
+      if (!ref.has_value()) {
+        return nullptr;
+      }
+      std::optional<SignalView> deg =
+          views.Add(PySequence_Fast_GET_ITEM(degs, index), "degs", index);
+      if (!deg.has_value()) {
+        return nullptr;
+      }
+      ref_signals.push_back(ref.value());
+      deg_signals.push_back(deg.value());
+    }
+
+    std::vector<float> results(num_pairs);
+    // All comparisons add to the same Profile.
+    zimtohrli::Profile stats;
+    zimtohrli::Profile* const current = profile ? &stats : nullptr;
+    const ProfileClock clock;
+    {
+      GilRelease gil_release;
+      zimtohrli::WorkspacePool workspaces;
+      zimtohrli::ThreadPool pool(num_threads);
+      pool.ParallelFor(num_pairs, [&](size_t index) {
+        const zimtohrli::ProfileScope profile_scope(current);
+        const zimtohrli::WorkspacePool::Lease workspace = workspaces.Acquire();
+        const float distance = DistanceBetweenSignals(
+            zimtohrli, ref_signals[index], sample_rates[index],
+            deg_signals[index], sample_rates[index], resample, *workspace);
+        results[index] =
+            return_distance ? distance : zimtohrli::MOSFromZimtohrli(distance);
+      });
+    }
+    const double wall_seconds = clock.seconds();
+    PyObject* array = NewArray(std::move(results), {num_pairs});
+    if (profile) {
+      return WithProfile(array, stats, wall_seconds, num_pairs);
+    }
+    return array;
+  } catch (const std::exception& e) {
+    return SetErrorFromException(e);
+  }
+}
+
+// Compares one reference signal with each of the degraded signals in degs.
+//
+// The reference is resampled and analyzed once, and its spectrogram is shared
+// read-only by all comparisons, which run on a pool of worker threads.
+PyObject* CompareAudioOneToMany(PyObject* self, PyObject* args,
+                                PyObject* kwargs) {
+  static const char* keywords[] = {"reference",
+                                   "sample_rate",
+                                   "degs",
+                                   "sample_rates",
+                                   "num_threads",
+                                   "return_distance",
+                                   "resample_quality",
+                                   "resample_num_threads",
+                                   "profile",
+                                   kPerceptualKeywords[0],
+                                   kPerceptualKeywords[1],
+                                   kPerceptualKeywords[2],
+                                   kPerceptualKeywords[3],
+                                   nullptr};
+  PyObject* reference_obj;
+  double reference_sample_rate;
+  PyObject* degs_obj;
+  PyObject* sample_rates_obj;
+  Py_ssize_t num_threads = 0;
+  int return_distance = 0;
+  const char* resample_quality = "very_high";
+  Py_ssize_t resample_num_threads = 1;
+  int profile = 0;
+  PyObject* perceptual[kNumPerceptualParameters] = {};
+  if (!PyArg_ParseTupleAndKeywords(
+          args, kwargs, "OdOO|$npsnpOOOO", const_cast<char**>(keywords),
+          &reference_obj, &reference_sample_rate, &degs_obj, &sample_rates_obj,
+          &num_threads, &return_distance, &resample_quality,
+          &resample_num_threads, &profile, &perceptual[0], &perceptual[1],
+          &perceptual[2], &perceptual[3])) {
+    return nullptr;
+  }
+  zimtohrli::Zimtohrli zimtohrli;
+  if (!ApplyPerceptualParameters(perceptual, zimtohrli)) {
+    return nullptr;
+  }
+  if (num_threads < 0) {
+    PyErr_SetString(PyExc_ValueError, "num_threads must be non-negative");
+    return nullptr;
+  }
+  if (resample_num_threads < 0) {
+    PyErr_SetString(PyExc_ValueError,
+                    "resample_num_threads must be non-negative");
+    return nullptr;
   }
-  
-  // Get buffer views for audio arrays
-  Py_buffer buffer_a, buffer_b;
-  if (PyObject_GetBuffer(audio_a, &buffer_a, PyBUF_C_CONTIGUOUS) != 0) {
-    return BadArgument("audio_a is not a valid buffer");
-  }
-  
-  if (PyObject_GetBuffer(audio_b, &buffer_b, PyBUF_C_CONTIGUOUS) != 0) {
-    PyBuffer_Release(&buffer_a);
-    return BadArgument("audio_b is not a valid buffer");
-  }
-  
-  // Validate buffer formats
-  if (buffer_a.itemsize != sizeof(float) || buffer_b.itemsize != sizeof(float)) {
-    PyBuffer_Release(&buffer_a);
-    PyBuffer_Release(&buffer_b);
-    return BadArgument("Audio arrays must contain float32 values");
-  }
-  
-  if (buffer_a.ndim != 1 || buffer_b.ndim != 1) {
-    PyBuffer_Release(&buffer_a);
-    PyBuffer_Release(&buffer_b);
-    return BadArgument("Audio arrays must be 1-dimensional");
-  }
-  
+  zimtohrli::ResampleOptions resample;
+  resample.num_threads = resample_num_threads;
+  if (!ParseResampleQuality(resample_quality, resample)) {
+    return nullptr;
+  }
+  if (!(reference_sample_rate > 0)) {
+    PyErr_SetString(PyExc_ValueError, "sample rates must be positive");
+    return nullptr;
+  }
+
+  PyObject* degs = PySequence_Fast(degs_obj, "degs must be a sequence");
+  if (degs == nullptr) {
+    return nullptr;
+  }
+  std::unique_ptr<PyObject, PyObjectDeleter> degs_deleter(degs);
+  const Py_ssize_t num_degs = PySequence_Fast_GET_SIZE(degs);
+
   try {
-    // Create spans from the buffer data
-    zimtohrli::Span<const float> span_a(
-        static_cast<const float*>(buffer_a.buf),
-        buffer_a.len / sizeof(float));
-    zimtohrli::Span<const float> span_b(
-        static_cast<const float*>(buffer_b.buf),
-        buffer_b.len / sizeof(float));
-    
-    // Resample to Zimtohrli's expected sample rate (48kHz) if needed
-    std::vector<float> resampled_a, resampled_b;
-    zimtohrli::Span<const float> final_span_a = span_a;
-    zimtohrli::Span<const float> final_span_b = span_b;
-    
-    if (sample_rate_a != zimtohrli::kSampleRate) {
-      resampled_a = zimtohrli::Resample<float>(span_a, sample_rate_a, zimtohrli::kSampleRate);
-      final_span_a = zimtohrli::Span<const float>(resampled_a);
-    }
-    
-    if (sample_rate_b != zimtohrli::kSampleRate) {
-      resampled_b = zimtohrli::Resample<float>(span_b, sample_rate_b, zimtohrli::kSampleRate);
-      final_span_b = zimtohrli::Span<const float>(resampled_b);
-    }
-    
-    // Create Zimtohrli instance and analyze
-    zimtohrli::Zimtohrli zimtohrli_instance;
-    zimtohrli::Spectrogram spec_a = zimtohrli_instance.Analyze(final_span_a);
-    zimtohrli::Spectrogram spec_b = zimtohrli_instance.Analyze(final_span_b);
-    
-    // Calculate distance
-    float distance = zimtohrli_instance.Distance(spec_a, spec_b);
-    
-    PyBuffer_Release(&buffer_a);
-    PyBuffer_Release(&buffer_b);
-    
-    return PyFloat_FromDouble(distance);
-    
+    std::vector<float> sample_rates;
+    if (!ParseSampleRates(sample_rates_obj, num_degs, sample_rates)) {
+      return nullptr;
+    }
+    BufferViews views(num_degs + 1);
+    const std::optional<SignalView> reference =
+        views.Add(reference_obj, "reference");
+    if (!reference.has_value()) {
+      return nullptr;
+    }
+    std::vector<SignalView> deg_signals;
+    deg_signals.reserve(num_degs);
+    for (Py_ssize_t index = 0; index < num_degs; ++index) {
+      std::optional<SignalView> deg =
+          views.Add(PySequence_Fast_GET_ITEM(degs, index), "degs", index);
+      if (!deg.has_value()) {
+        return nullptr;
+      }
+      deg_signals.push_back(deg.value());
+    }
+
+    std::vector<float> results(num_degs);
+    // The analysis of the reference and all comparisons add to the same
+    // Profile.
+    zimtohrli::Profile stats;
+    zimtohrli::Profile* const current = profile ? &stats : nullptr;
+    const ProfileClock clock;
+    {
+      GilRelease gil_release;
+      const zimtohrli::ProfileScope profile_scope(current);
+      const zimtohrli::Spectrogram reference_spec =
+          AnalyzeSignal(zimtohrli, reference.value(), reference_sample_rate,
+                        resample);
+      const float reference_max = reference_spec.max();
+      zimtohrli::WorkspacePool workspaces;
+      zimtohrli::ThreadPool pool(num_threads);
+      pool.ParallelFor(num_degs, [&](size_t index) {
+        const zimtohrli::ProfileScope task_profile_scope(current);
+        const zimtohrli::WorkspacePool::Lease workspace = workspaces.Acquire();
+        zimtohrli::Spectrogram& deg_spec = workspace->spectrogram_b;
+        AnalyzeSignal(zimtohrli, deg_signals[index], sample_rates[index],
+                      resample, *workspace, deg_spec);
+        const float distance =
+            zimtohrli.Distance(reference_spec, reference_max, deg_spec,
+                               deg_spec.max(), *workspace);
+        results[index] =
+            return_distance ? distance : zimtohrli::MOSFromZimtohrli(distance);
+      });
+    }
+    const double wall_seconds = clock.seconds();
+    PyObject* array = NewArray(std::move(results), {num_degs});
+    if (profile) {
+      return WithProfile(array, stats, wall_seconds, num_degs);
+    }
+    return array;
   } catch (const std::exception& e) {
-    PyBuffer_Release(&buffer_a);
-    PyBuffer_Release(&buffer_b);
-    PyErr_SetString(PyExc_RuntimeError, e.what());
+    return SetErrorFromException(e);
+  }
+}
+
+// The pool running the comparisons of compare_audio_async, with one worker
+// per core. It's never destroyed, so that no worker is joined while the
+// interpreter shuts down.
+zimtohrli::ThreadPool& AsyncPool() {
+  static zimtohrli::ThreadPool* const pool = new zimtohrli::ThreadPool();
+  return *pool;
+}
+
+// A comparison submitted by compare_audio_async, shared by its task on
+// AsyncPool and its AsyncComparison handle.
+struct AsyncComparisonState {
+  enum Status { kPending, kCancelled, kDone };
+
+  zimtohrli::Zimtohrli zimtohrli;
+  zimtohrli::ResampleOptions resample;
+  std::vector<float> signal_a;
+  float sample_rate_a;
+  std::vector<float> signal_b;
+  float sample_rate_b;
+  bool return_distance;
+  // Strong reference, released by the task while holding the GIL.
+  PyObject* callback;
+  zimtohrli::Cancellation cancellation;
+  // Whoever moves it from kPending decides whether the callback is called.
+  std::atomic<Status> status{kPending};
+};
+
+// Runs the comparison of state on a worker of AsyncPool, and calls its
+// callback with (result, None) or (None, exception) unless it was cancelled
+// first.
+void RunAsyncComparison(AsyncComparisonState& state) {
+  float result = 0;
+  bool out_of_memory = false;
+  std::optional<std::string> error;
+  try {
+    const zimtohrli::CancellationScope cancellation_scope(&state.cancellation);
+    const float distance = DistanceBetweenSignals(
+        state.zimtohrli, zimtohrli::Span<const float>(state.signal_a),
+        state.sample_rate_a, zimtohrli::Span<const float>(state.signal_b),
+        state.sample_rate_b, state.resample);
+    result =
+        state.return_distance ? distance : zimtohrli::MOSFromZimtohrli(distance);
+  } catch (const zimtohrli::CancelledError&) {
+    // Cancel already moved the status to kCancelled.
+  } catch (const std::bad_alloc&) {
+    out_of_memory = true;
+  } catch (const std::exception& e) {
+    error = e.what();
+  }
+  AsyncComparisonState::Status expected = AsyncComparisonState::kPending;
+  const bool call = state.status.compare_exchange_strong(
+      expected, AsyncComparisonState::kDone);
+
+  const PyGILState_STATE gil = PyGILState_Ensure();
+  if (call) {
+    PyObject* value = nullptr;
+    if (out_of_memory) {
+      value = PyObject_CallObject(PyExc_MemoryError, nullptr);
+    } else if (error.has_value()) {
+      value = PyObject_CallFunction(PyExc_RuntimeError, "s", error->c_str());
+    } else {
+      value = PyFloat_FromDouble(result);
+    }
+    PyObject* returned = nullptr;
+    if (value != nullptr) {
+      returned = out_of_memory || error.has_value()
+                     ? PyObject_CallFunctionObjArgs(state.callback, Py_None,
+                                                    value, nullptr)
+                     : PyObject_CallFunctionObjArgs(state.callback, value,
+                                                    Py_None, nullptr);
+      Py_DECREF(value);
+    }
+    if (returned == nullptr) {
+      PyErr_WriteUnraisable(state.callback);
+    }
+    Py_XDECREF(returned);
+  }
+  Py_CLEAR(state.callback);
+  PyGILState_Release(gil);
+}
+
+struct AsyncComparisonObject {
+  // clang-format off
+  PyObject_HEAD
+  void *state;
+  // clang-format on
+};
+
+void AsyncComparison_dealloc(AsyncComparisonObject* self) {
+  if (self) {
+    if (self->state) {
+      delete static_cast<std::shared_ptr<AsyncComparisonState>*>(self->state);
+      self->state = nullptr;
+    }
+    Py_TYPE(self)->tp_free((PyObject*)self);
+  }
+}
+
+AsyncComparisonState& AsyncComparison_get(AsyncComparisonObject* self) {
+  return **static_cast<std::shared_ptr<AsyncComparisonState>*>(self->state);
+}
+
+PyObject* AsyncComparison_cancel(AsyncComparisonObject* self,
+                                 PyObject* const* args, Py_ssize_t nargs) {
+  if (nargs != 0) {
+    return BadArgument("not exactly 0 arguments provided");
+  }
+  AsyncComparisonState& state = AsyncComparison_get(self);
+  AsyncComparisonState::Status expected = AsyncComparisonState::kPending;
+  if (!state.status.compare_exchange_strong(expected,
+                                            AsyncComparisonState::kCancelled)) {
+    return PyBool_FromLong(expected == AsyncComparisonState::kCancelled);
+  }
+  state.cancellation.Cancel();
+  Py_RETURN_TRUE;
+}
+
+PyObject* AsyncComparison_get_done(AsyncComparisonObject* self,
+                                   void* closure) {
+  return PyBool_FromLong(AsyncComparison_get(self).status.load() ==
+                         AsyncComparisonState::kDone);
+}
+
+PyObject* AsyncComparison_get_cancelled(AsyncComparisonObject* self,
+                                        void* closure) {
+  return PyBool_FromLong(AsyncComparison_get(self).status.load() ==
+                         AsyncComparisonState::kCancelled);
+}
+
+PyMethodDef AsyncComparison_methods[] = {
+    {"cancel", (PyCFunction)AsyncComparison_cancel, METH_FASTCALL,
+     "Stops the comparison, within one block of time warp rows if it's "
+     "running, and drops its callback. Returns whether the comparison is "
+     "cancelled, i.e. False if it already finished."},
+    {nullptr} /* Sentinel */
+};
+
+PyGetSetDef AsyncComparison_getset[] = {
+    {"done", (getter)AsyncComparison_get_done, nullptr,
+     "Whether the comparison finished and its callback is (being) called.",
+     nullptr},
+    {"cancelled", (getter)AsyncComparison_get_cancelled, nullptr,
+     "Whether cancel stopped the comparison before it finished.", nullptr},
+    {nullptr} /* Sentinel */
+};
+
+PyTypeObject AsyncComparisonType = {
+    // clang-format off
+    .ob_base = PyVarObject_HEAD_INIT(nullptr, 0)
+    .tp_name = "pyohrli.AsyncComparison",
+    // clang-format on
+    .tp_basicsize = sizeof(AsyncComparisonObject),
+    .tp_itemsize = 0,
+    .tp_dealloc = (destructor)AsyncComparison_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = PyDoc_STR(
+        "Handle of a comparison started by compare_audio_async."),
+    .tp_methods = AsyncComparison_methods,
+    .tp_getset = AsyncComparison_getset,
+};
+
+// Copies the signals, starts comparing them on AsyncPool and returns an
+// AsyncComparison handle without waiting for the result.
+//
+// The callback is called on a worker thread, holding the GIL, with
+// (score, None) or (None, exception). Exceptions it raises are reported with
+// sys.unraisablehook.
+PyObject* CompareAudioAsync(PyObject* self, PyObject* args, PyObject* kwargs) {
+  static const char* keywords[] = {"audio_a",
+                                   "sample_rate_a",
+                                   "audio_b",
+                                   "sample_rate_b",
+                                   "callback",
+                                   "return_distance",
+                                   "resample_quality",
+                                   "resample_num_threads",
+                                   kPerceptualKeywords[0],
+                                   kPerceptualKeywords[1],
+                                   kPerceptualKeywords[2],
+                                   kPerceptualKeywords[3],
+                                   nullptr};
+  PyObject* audio_a;
+  float sample_rate_a;
+  PyObject* audio_b;
+  float sample_rate_b;
+  PyObject* callback;
+  int return_distance = 0;
+  const char* resample_quality = "very_high";
+  Py_ssize_t resample_num_threads = 1;
+  PyObject* perceptual[kNumPerceptualParameters] = {};
+  if (!PyArg_ParseTupleAndKeywords(
+          args, kwargs, "OfOfO|$psnOOOO", const_cast<char**>(keywords),
+          &audio_a, &sample_rate_a, &audio_b, &sample_rate_b, &callback,
+          &return_distance, &resample_quality, &resample_num_threads,
+          &perceptual[0], &perceptual[1], &perceptual[2], &perceptual[3])) {
+    return nullptr;
+  }
+  if (!PyCallable_Check(callback)) {
+    return BadArgument("callback must be callable");
+  }
+  if (resample_num_threads < 0) {
+    PyErr_SetString(PyExc_ValueError,
+                    "resample_num_threads must be non-negative");
     return nullptr;
   }
+  try {
+    auto state = std::make_shared<AsyncComparisonState>();
+    if (!ApplyPerceptualParameters(perceptual, state->zimtohrli)) {
+      return nullptr;
+    }
+    state->resample.num_threads = resample_num_threads;
+    if (!ParseResampleQuality(resample_quality, state->resample)) {
+      return nullptr;
+    }
+    // Copy the samples, so that the buffers are free to change while the
+    // comparison runs.
+    std::optional<std::vector<float>> signal_a = CopySignal(audio_a);
+    if (!signal_a.has_value()) {
+      return nullptr;
+    }
+    std::optional<std::vector<float>> signal_b = CopySignal(audio_b);
+    if (!signal_b.has_value()) {
+      return nullptr;
+    }
+    state->signal_a = std::move(*signal_a);
+    state->sample_rate_a = sample_rate_a;
+    state->signal_b = std::move(*signal_b);
+    state->sample_rate_b = sample_rate_b;
+    state->return_distance = return_distance;
+
+    AsyncComparisonObject* handle =
+        PyObject_New(AsyncComparisonObject, &AsyncComparisonType);
+    if (handle == nullptr) {
+      return nullptr;
+    }
+    handle->state = nullptr;
+    std::unique_ptr<PyObject, PyObjectDeleter> handle_deleter(
+        (PyObject*)handle);
+    handle->state = new std::shared_ptr<AsyncComparisonState>(state);
+
+    Py_INCREF(callback);
+    state->callback = callback;
+    AsyncPool().Submit([state] { RunAsyncComparison(*state); });
+    return handle_deleter.release();
+  } catch (const std::exception& e) {
+    return SetErrorFromException(e);
+  }
 }
 
 static PyMethodDef PyohrliModuleMethods[] = {
     {"MOSFromZimtohrli", (PyCFunction)MOSFromZimtohrli, METH_FASTCALL,
      "Returns an approximate mean opinion score based on the provided "
      "Zimtohrli distance."},
-    {"compare_audio_arrays", (PyCFunction)CompareAudioArrays, METH_FASTCALL,
+    {"distance_stats", (PyCFunction)DistanceStats, METH_FASTCALL,
+     "Returns (num_time_warps, num_identical): how many time warps all "
+     "comparisons so far computed, and how many of them were between "
+     "identical spectrograms and skipped the DTW. "
+     "Args: reset (bool, optional), which resets both counters to 0"},
+    {"compare_audio_arrays", (PyCFunction)(void (*)(void))CompareAudioArrays,
+     METH_FASTCALL | METH_KEYWORDS,
      "Compare two audio arrays and return MOS score. "
-     "Args: audio_a (numpy array), sample_rate_a (float), audio_b (numpy array), sample_rate_b (float)"},
-    {"compare_audio_arrays_distance", (PyCFunction)CompareAudioArraysDistance, METH_FASTCALL,
+     "Args: audio_a (numpy array), sample_rate_a (float), audio_b (numpy array), sample_rate_b (float), "
+     "optionally followed by resample_quality (str) and resample_num_threads (int), "
+     "and profile (bool), which returns (score, profile dict) instead. "
+     "Keyword args: nsim_step_window, nsim_channel_window, high_gamma_band "
+     "and perceptual_sample_rate, see Pyohrli"},
+    {"compare_audio_arrays_distance",
+     (PyCFunction)(void (*)(void))CompareAudioArraysDistance,
+     METH_FASTCALL | METH_KEYWORDS,
      "Compare two audio arrays and return raw Zimtohrli distance. "
-     "Args: audio_a (numpy array), sample_rate_a (float), audio_b (numpy array), sample_rate_b (float)"},
+     "Args: audio_a (numpy array), sample_rate_a (float), audio_b (numpy array), sample_rate_b (float), "
+     "optionally followed by resample_quality (str) and resample_num_threads (int), "
+     "and profile (bool), which returns (distance, profile dict) instead. "
+     "Keyword args: nsim_step_window, nsim_channel_window, high_gamma_band "
+     "and perceptual_sample_rate, see Pyohrli"},
+    {"compare_audio_batch", (PyCFunction)(void (*)(void))CompareAudioBatch,
+     METH_VARARGS | METH_KEYWORDS,
+     "Compare refs[i] with degs[i] for all pairs using a pool of worker "
+     "threads, and return a float32 Array of MOS scores (or raw distances if "
+     "return_distance is true). "
+     "Args: refs (sequence of numpy arrays), degs (sequence of numpy arrays), "
+     "sample_rates (float or sequence of floats, one per pair), "
+     "num_threads (int, 0 means one per core), return_distance (bool), "
+     "resample_quality (str), resample_num_threads (int), profile (bool), "
+     "which returns (array, profile dict) with the stages of all pairs, and "
+     "the perceptual parameters of Pyohrli"},
+    {"compare_audio_one_to_many",
+     (PyCFunction)(void (*)(void))CompareAudioOneToMany,
+     METH_VARARGS | METH_KEYWORDS,
+     "Compare one reference signal with each of the degraded signals, "
+     "analyzing the reference only once, and return a float32 Array of MOS "
+     "scores (or raw distances if return_distance is true). "
+     "Args: reference (numpy array), sample_rate (float), degs (sequence of "
+     "numpy arrays), sample_rates (float or sequence of floats, one per "
+     "degraded signal), num_threads (int, 0 means one per core), "
+     "return_distance (bool), resample_quality (str), resample_num_threads "
+     "(int), profile (bool), which returns (array, profile dict) with the "
+     "stages of all comparisons, and the perceptual parameters of Pyohrli"},
+    {"compare_audio_async", (PyCFunction)(void (*)(void))CompareAudioAsync,
+     METH_VARARGS | METH_KEYWORDS,
+     "Start comparing two audio arrays on a shared pool of worker threads, "
+     "and return an AsyncComparison handle without waiting. The callback is "
+     "called on a worker thread with (MOS score, None), or (raw distance, "
+     "None) if return_distance is true, or (None, exception) if the "
+     "comparison failed, and not at all if it was cancelled. "
+     "Args: audio_a (numpy array), sample_rate_a (float), audio_b (numpy "
+     "array), sample_rate_b (float), callback (callable), return_distance "
+     "(bool), resample_quality (str), resample_num_threads (int), and the "
+     "perceptual parameters of Pyohrli"},
     {NULL, NULL, 0, NULL},
 };
 
@@ -434,6 +3148,15 @@ PyMODINIT_FUNC PyInit__zimtohrli(void) {
     return nullptr;
   }
 
+  if (PyType_Ready(&ArrayType) < 0) {
+    Py_DECREF(m);
+    return nullptr;
+  }
+  if (PyModule_AddObjectRef(m, "Array", (PyObject*)&ArrayType) < 0) {
+    Py_DECREF(m);
+    return nullptr;
+  }
+
   if (PyType_Ready(&PyohrliType) < 0) {
     Py_DECREF(m);
     return nullptr;
@@ -443,6 +3166,36 @@ PyMODINIT_FUNC PyInit__zimtohrli(void) {
     return nullptr;
   }
 
+  if (PyType_Ready(&StreamingAnalyzerType) < 0) {
+    Py_DECREF(m);
+    return nullptr;
+  }
+  if (PyModule_AddObjectRef(m, "StreamingAnalyzer",
+                            (PyObject*)&StreamingAnalyzerType) < 0) {
+    Py_DECREF(m);
+    return nullptr;
+  }
+
+  if (PyType_Ready(&StreamingDistanceType) < 0) {
+    Py_DECREF(m);
+    return nullptr;
+  }
+  if (PyModule_AddObjectRef(m, "StreamingDistance",
+                            (PyObject*)&StreamingDistanceType) < 0) {
+    Py_DECREF(m);
+    return nullptr;
+  }
+
+  if (PyType_Ready(&AsyncComparisonType) < 0) {
+    Py_DECREF(m);
+    return nullptr;
+  }
+  if (PyModule_AddObjectRef(m, "AsyncComparison",
+                            (PyObject*)&AsyncComparisonType) < 0) {
+    Py_DECREF(m);
+    return nullptr;
+  }
+
   return m;
 }
 
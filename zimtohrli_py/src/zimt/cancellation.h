@@ -0,0 +1,79 @@
+// Copyright 2025 The Zimtohrli Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CPP_ZIMT_CANCELLATION_H_
+#define CPP_ZIMT_CANCELLATION_H_
+
+#include <atomic>
+#include <stdexcept>
+
+namespace zimtohrli {
+
+// Thrown by CheckCancellation, i.e. by the analyses, time warps and NSIM
+// computations of a cancelled Cancellation.
+class CancelledError : public std::runtime_error {
+ public:
+  CancelledError() : std::runtime_error("the computation was cancelled") {}
+};
+
+// Stops the computations running under a CancellationScope of it, from any
+// thread. The computations check it with CheckCancellation before each
+// analysis (or segment of one), each NSIM and at least once per simd::kRows
+// rows of the time warp cost matrix, so that cancelling a long comparison stops
+// its time warp within a fraction of a millisecond. Resampling and a running
+// filterbank pass are not interrupted.
+class Cancellation {
+ public:
+  // The Cancellation the computations on this thread check, or null.
+  static Cancellation*& Current() {
+    static thread_local Cancellation* current = nullptr;
+    return current;
+  }
+
+  void Cancel() { cancelled_.store(true, std::memory_order_relaxed); }
+  bool cancelled() const { return cancelled_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<bool> cancelled_{false};
+};
+
+// Makes cancellation the Cancellation::Current() of this thread until
+// destruction, e.g. inside the tasks of a ThreadPool::ParallelFor.
+// cancellation may be null.
+class CancellationScope {
+ public:
+  explicit CancellationScope(Cancellation* cancellation)
+      : previous_(Cancellation::Current()) {
+    Cancellation::Current() = cancellation;
+  }
+  ~CancellationScope() { Cancellation::Current() = previous_; }
+  CancellationScope(const CancellationScope&) = delete;
+  CancellationScope& operator=(const CancellationScope&) = delete;
+
+ private:
+  Cancellation* previous_;
+};
+
+// Throws CancelledError if the Cancellation::Current() of this thread has
+// been cancelled.
+inline void CheckCancellation() {
+  const Cancellation* const cancellation = Cancellation::Current();
+  if (cancellation != nullptr && cancellation->cancelled()) {
+    throw CancelledError();
+  }
+}
+
+}  // namespace zimtohrli
+
+#endif  // CPP_ZIMT_CANCELLATION_H_
@@ -0,0 +1,175 @@
+// Copyright 2025 The Zimtohrli Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CPP_ZIMT_PROFILE_H_
+#define CPP_ZIMT_PROFILE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Building with ZIMT_PROFILE defined to 0 compiles the stage timers and
+// counters out, and every Profile stays zero.
+#ifndef ZIMT_PROFILE
+#define ZIMT_PROFILE 1
+#endif
+
+namespace zimtohrli {
+
+// The stages of a comparison that Profile times.
+enum class Stage {
+  // Resampling the signals to kSampleRate, see ResampleInterleaved.
+  kResample,
+  // Analyzing the signals into spectrograms, see Zimtohrli::Analyze.
+  kAnalyze,
+  // Time warping the spectrograms, see Zimtohrli::TimePairs.
+  kDTW,
+  // Scoring the aligned spectrograms, see NSIM.
+  kNSIM,
+};
+constexpr size_t kNumStages = 4;
+
+// The amounts of work that Profile counts.
+enum class Counter {
+  // Samples resampled, over all channels.
+  kResampledSamples,
+  // Samples analyzed into spectrograms.
+  kAnalyzedSamples,
+  // Cells of the time warp cost matrix evaluated.
+  kDTWCells,
+  // Bytes of cost matrix the time warps held, summed over the time warps.
+  kDTWCostBytes,
+  // Channel values of aligned steps scored, i.e. time pairs * channels.
+  kNSIMCells,
+  // Spectrogram buffers allocated.
+  kSpectrogramAllocations,
+  // Bytes of the allocated spectrogram buffers.
+  kSpectrogramAllocatedBytes,
+};
+constexpr size_t kNumCounters = 7;
+
+// The names of the stages and counters, e.g. as Python dict keys.
+inline const char* StageName(Stage stage) {
+  static const char* const kNames[kNumStages] = {"resample", "analyze", "dtw",
+                                                 "nsim"};
+  return kNames[static_cast<size_t>(stage)];
+}
+inline const char* CounterName(Counter counter) {
+  static const char* const kNames[kNumCounters] = {
+      "resampled_samples",       "analyzed_samples",
+      "dtw_cells",               "dtw_cost_bytes",
+      "nsim_cells",              "spectrogram_allocations",
+      "spectrogram_allocated_bytes"};
+  return kNames[static_cast<size_t>(counter)];
+}
+
+// The time spent in each Stage and the Counters of the work done while a
+// ProfileScope of it was active.
+//
+// The values are atomic, so one Profile can collect the work of several
+// threads, e.g. all comparisons of a batch. The times of stages running on
+// several threads at once add up, so they may exceed the wall time.
+struct Profile {
+  // The Profile the stages on this thread are recorded in, or null.
+  static Profile*& Current() {
+    static thread_local Profile* current = nullptr;
+    return current;
+  }
+
+  double seconds(Stage stage) const {
+    return nanoseconds[static_cast<size_t>(stage)].load(
+               std::memory_order_relaxed) *
+           1e-9;
+  }
+  uint64_t num_calls(Stage stage) const {
+    return calls[static_cast<size_t>(stage)].load(std::memory_order_relaxed);
+  }
+  uint64_t count(Counter counter) const {
+    return counts[static_cast<size_t>(counter)].load(
+        std::memory_order_relaxed);
+  }
+
+  std::atomic<uint64_t> nanoseconds[kNumStages] = {};
+  // The number of times each stage ran.
+  std::atomic<uint64_t> calls[kNumStages] = {};
+  std::atomic<uint64_t> counts[kNumCounters] = {};
+};
+
+// Makes profile the Profile::Current() of this thread until destruction,
+// e.g. inside the tasks of a ThreadPool::ParallelFor. profile may be null.
+class ProfileScope {
+ public:
+  explicit ProfileScope(Profile* profile) : previous_(Profile::Current()) {
+    Profile::Current() = profile;
+  }
+  ~ProfileScope() { Profile::Current() = previous_; }
+  ProfileScope(const ProfileScope&) = delete;
+  ProfileScope& operator=(const ProfileScope&) = delete;
+
+ private:
+  Profile* previous_;
+};
+
+// Adds amount to counter of Profile::Current(), if any.
+inline void CountProfile(Counter counter, uint64_t amount) {
+#if ZIMT_PROFILE
+  if (Profile* const profile = Profile::Current()) {
+    profile->counts[static_cast<size_t>(counter)].fetch_add(
+        amount, std::memory_order_relaxed);
+  }
+#endif
+}
+
+// Adds the time from construction to destruction to stage of the
+// Profile::Current() at construction, if any. Without a current Profile it
+// doesn't read the clock.
+class StageTimer {
+ public:
+#if ZIMT_PROFILE
+  explicit StageTimer(Stage stage)
+      : profile_(Profile::Current()), stage_(stage) {
+    if (profile_ != nullptr) {
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+  ~StageTimer() {
+    if (profile_ == nullptr) {
+      return;
+    }
+    const size_t index = static_cast<size_t>(stage_);
+    profile_->nanoseconds[index].fetch_add(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start_)
+            .count(),
+        std::memory_order_relaxed);
+    profile_->calls[index].fetch_add(1, std::memory_order_relaxed);
+  }
+#else
+  explicit StageTimer(Stage) {}
+#endif
+  StageTimer(const StageTimer&) = delete;
+  StageTimer& operator=(const StageTimer&) = delete;
+
+ private:
+#if ZIMT_PROFILE
+  Profile* profile_;
+  Stage stage_;
+  std::chrono::steady_clock::time_point start_;
+#endif
+};
+
+}  // namespace zimtohrli
+
+#endif  // CPP_ZIMT_PROFILE_H_
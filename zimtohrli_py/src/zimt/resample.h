@@ -16,15 +16,39 @@
 #define CPP_ZIMT_RESAMPLE_H_
 
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <tuple>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 #include "absl/log/check.h"
 #include "soxr.h"
+#include "zimt/profile.h"
 #include "zimt/zimtohrli.h"
 
 namespace zimtohrli {
 
+// The factor samples of type I are scaled by when converted to type O.
+//
+// Like soxr, treats integer samples as fixed point fractions of full scale,
+// so converting int16 or int32 samples to floating point divides them by
+// 2^15 or 2^31, which maps full scale PCM to [-1, 1).
+template <typename O, typename I>
+inline constexpr double SampleScale() {
+  if constexpr (std::is_floating_point_v<O> && std::is_integral_v<I>) {
+    return 1.0 / (static_cast<double>(std::numeric_limits<I>::max()) + 1.0);
+  } else {
+    return 1.0;
+  }
+}
+
 template <typename O, typename I>
 std::vector<O> Convert(Span<const I> input) {
   if constexpr (std::is_same<O, I>::value) {
@@ -32,9 +56,14 @@ std::vector<O> Convert(Span<const I> input) {
     memcpy(result.data(), input.data, input.size * sizeof(I));
     return result;
   }
+  constexpr double kScale = SampleScale<O, I>();
   std::vector<O> output(input.size);
   for (size_t sample_index = 0; sample_index < input.size; ++sample_index) {
-    output[sample_index] = static_cast<O>(input[sample_index]);
+    if constexpr (kScale == 1.0) {
+      output[sample_index] = static_cast<O>(input[sample_index]);
+    } else {
+      output[sample_index] = static_cast<O>(input[sample_index] * kScale);
+    }
   }
   return output;
 }
@@ -54,24 +83,271 @@ inline constexpr soxr_datatype_t SoxrType() {
   }
 }
 
+// How Resample and StreamingResampler configure soxr.
+struct ResampleOptions {
+  // The soxr quality recipe: SOXR_QQ, SOXR_LQ, SOXR_MQ, SOXR_HQ or SOXR_VHQ,
+  // combined with a phase response.
+  unsigned long quality_recipe = SOXR_VHQ | SOXR_LINEAR_PHASE;
+  // The num_threads of the soxr_runtime_spec, or 0 to let soxr decide. soxr
+  // distributes the channels of a signal over its threads, so more than one
+  // only pays off for multichannel signals.
+  unsigned num_threads = 1;
+};
+
+// The configuration of a soxr resampler for num_channels interleaved channels.
+struct ResamplerKey {
+  template <typename O, typename I>
+  static ResamplerKey For(double in_sample_rate, double out_sample_rate,
+                          const ResampleOptions& options,
+                          unsigned num_channels = 1) {
+    return {in_sample_rate,      out_sample_rate, options.quality_recipe,
+            options.num_threads, num_channels,    SoxrType<I>(),
+            SoxrType<O>()};
+  }
+
+  double in_sample_rate;
+  double out_sample_rate;
+  unsigned long quality_recipe;
+  unsigned num_threads;
+  unsigned num_channels;
+  soxr_datatype_t in_type;
+  soxr_datatype_t out_type;
+
+  bool operator<(const ResamplerKey& other) const {
+    return std::tie(in_sample_rate, out_sample_rate, quality_recipe,
+                    num_threads, num_channels, in_type, out_type) <
+           std::tie(other.in_sample_rate, other.out_sample_rate,
+                    other.quality_recipe, other.num_threads,
+                    other.num_channels, other.in_type, other.out_type);
+  }
+};
+
+// Keeps soxr resamplers for reuse, so that resampling many signals with the
+// same configuration doesn't create and configure a resampler for each.
+//
+// Each resampler is leased to one user at a time, and returned to the cache,
+// reset with soxr_clear, when the lease ends. The cache is safe to use from
+// multiple threads, and keeps as many idle resamplers per configuration as
+// were in use at once.
+class ResamplerCache {
+ public:
+  struct SoxrDeleter {
+    void operator()(soxr_t soxr) const { soxr_delete(soxr); }
+  };
+  using SoxrPtr = std::unique_ptr<std::remove_pointer_t<soxr_t>, SoxrDeleter>;
+
+  // A resampler in the state of a fresh soxr_create, returned to the cache on
+  // destruction.
+  class Lease {
+   public:
+    Lease(Lease&& other) = default;
+    Lease& operator=(Lease&& other) = delete;
+    ~Lease() {
+      if (soxr_ != nullptr) {
+        cache_->Release(key_, std::move(soxr_));
+      }
+    }
+
+    soxr_t get() const { return soxr_.get(); }
+
+   private:
+    friend class ResamplerCache;
+    Lease(ResamplerCache* cache, const ResamplerKey& key, SoxrPtr soxr)
+        : cache_(cache), key_(key), soxr_(std::move(soxr)) {}
+
+    ResamplerCache* cache_;
+    ResamplerKey key_;
+    SoxrPtr soxr_;
+  };
+
+  ResamplerCache() = default;
+  ResamplerCache(const ResamplerCache&) = delete;
+  ResamplerCache& operator=(const ResamplerCache&) = delete;
+
+  // Returns the cache Resample and StreamingResampler use.
+  static ResamplerCache& Global() {
+    // Never destroyed, so that leases can outlive static destruction.
+    static ResamplerCache* const cache = new ResamplerCache();
+    return *cache;
+  }
+
+  // Returns an idle resampler for key, or a new one if there is none.
+  Lease Acquire(const ResamplerKey& key) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      const auto idle = idle_.find(key);
+      if (idle != idle_.end() && !idle->second.empty()) {
+        SoxrPtr soxr = std::move(idle->second.back());
+        idle->second.pop_back();
+        return Lease(this, key, std::move(soxr));
+      }
+    }
+    const soxr_quality_spec_t quality = soxr_quality_spec(key.quality_recipe, 0);
+    const soxr_io_spec_t io_spec = soxr_io_spec(key.in_type, key.out_type);
+    const soxr_runtime_spec_t runtime = soxr_runtime_spec(key.num_threads);
+    soxr_error_t error = nullptr;
+    SoxrPtr soxr(soxr_create(key.in_sample_rate, key.out_sample_rate,
+                             key.num_channels,
+                             &error, &io_spec, &quality, &runtime));
+    assert(error == 0);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++num_created_;
+    }
+    return Lease(this, key, std::move(soxr));
+  }
+
+  // Deletes the idle resamplers.
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    idle_.clear();
+  }
+
+  // The number of resamplers the cache has created.
+  size_t num_created() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return num_created_;
+  }
+
+ private:
+  void Release(const ResamplerKey& key, SoxrPtr soxr) {
+    if (soxr_clear(soxr.get()) != 0) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    idle_[key].push_back(std::move(soxr));
+  }
+
+  mutable std::mutex mutex_;
+  std::map<ResamplerKey, std::vector<SoxrPtr>> idle_;
+  size_t num_created_ = 0;
+};
+
+// Resamples a signal of num_channels interleaved channels, i.e. with the
+// samples of all channels of one frame next to each other, and returns the
+// interleaved result. soxr spreads the channels over the
+// ResampleOptions::num_threads threads.
 template <typename O, typename I>
-std::vector<O> Resample(Span<const I> samples, float in_sample_rate,
-                        float out_sample_rate) {
+std::vector<O> ResampleInterleaved(
+    Span<const I> samples, size_t num_channels, float in_sample_rate,
+    float out_sample_rate, const ResampleOptions& options = ResampleOptions()) {
   if (in_sample_rate == out_sample_rate) {
     return Convert<O>(samples);
   }
 
+  const StageTimer timer(Stage::kResample);
+  CountProfile(Counter::kResampledSamples, samples.size);
+  const size_t num_frames = samples.size / num_channels;
   std::vector<O> result(
-      static_cast<size_t>(samples.size * out_sample_rate / in_sample_rate));
-  soxr_quality_spec_t quality = soxr_quality_spec(SOXR_VHQ, SOXR_LINEAR_PHASE);
-  soxr_io_spec_t io_spec = soxr_io_spec(SoxrType<I>(), SoxrType<O>());
-  const soxr_error_t error = soxr_oneshot(
-      in_sample_rate, out_sample_rate, 1, samples.data, samples.size, nullptr,
-      result.data(), result.size(), nullptr, &io_spec, &quality, nullptr);
+      static_cast<size_t>(num_frames * out_sample_rate / in_sample_rate) *
+      num_channels);
+  const ResamplerCache::Lease soxr =
+      ResamplerCache::Global().Acquire(ResamplerKey::For<O, I>(
+          in_sample_rate, out_sample_rate, options, num_channels));
+  // Like soxr_oneshot, passes the length inverted to end the input with it.
+  const soxr_error_t error =
+      soxr_process(soxr.get(), samples.data, ~num_frames, nullptr,
+                   result.data(), result.size() / num_channels, nullptr);
   assert(error == 0);
   return result;
 }
 
+template <typename O, typename I>
+std::vector<O> Resample(Span<const I> samples, float in_sample_rate,
+                        float out_sample_rate,
+                        const ResampleOptions& options = ResampleOptions()) {
+  return ResampleInterleaved<O>(samples, 1, in_sample_rate, out_sample_rate,
+                                options);
+}
+
+// Resamples a signal incrementally as it arrives, e.g. a live stream, with a
+// resampler leased from ResamplerCache::Global() for the lifetime of the
+// object.
+//
+// Push accepts chunks of any size and returns the samples soxr has completed,
+// which lag the input by the filter delay. Finish returns the rest, so that
+// the concatenated output matches Resample of the whole signal, apart from a
+// possible extra last sample, and resets the resampler for a new stream.
+template <typename O, typename I>
+class StreamingResampler {
+ public:
+  StreamingResampler(float in_sample_rate, float out_sample_rate,
+                     const ResampleOptions& options = ResampleOptions())
+      : ratio_(static_cast<double>(out_sample_rate) / in_sample_rate) {
+    if (in_sample_rate != out_sample_rate) {
+      soxr_.emplace(ResamplerCache::Global().Acquire(
+          ResamplerKey::For<O, I>(in_sample_rate, out_sample_rate, options)));
+    }
+  }
+
+  // Adds the samples to the stream, and returns the output they complete.
+  std::vector<O> Push(Span<const I> samples) {
+    if (!soxr_.has_value()) {
+      return Convert<O>(samples);
+    }
+    std::vector<O> result;
+    size_t consumed = 0;
+    while (true) {
+      // soxr only consumes as much input as fits the output, so this repeats
+      // until the input is consumed and the output not full.
+      const size_t offset = result.size();
+      const size_t capacity =
+          static_cast<size_t>((samples.size - consumed) * ratio_) + kSlack;
+      result.resize(offset + capacity);
+      size_t num_consumed = 0;
+      size_t num_produced = 0;
+      const soxr_error_t error = soxr_process(
+          soxr_->get(), samples.data + consumed, samples.size - consumed,
+          &num_consumed, result.data() + offset, capacity, &num_produced);
+      assert(error == 0);
+      consumed += num_consumed;
+      result.resize(offset + num_produced);
+      if (consumed == samples.size && num_produced < capacity) {
+        return result;
+      }
+    }
+  }
+
+  // Ends the stream and returns its remaining output, then resets the
+  // resampler.
+  std::vector<O> Finish() {
+    if (!soxr_.has_value()) {
+      return {};
+    }
+    std::vector<O> result;
+    while (true) {
+      const size_t offset = result.size();
+      result.resize(offset + kSlack);
+      size_t num_produced = 0;
+      const soxr_error_t error =
+          soxr_process(soxr_->get(), nullptr, 0, nullptr,
+                       result.data() + offset, kSlack, &num_produced);
+      assert(error == 0);
+      result.resize(offset + num_produced);
+      if (num_produced == 0) {
+        break;
+      }
+    }
+    Reset();
+    return result;
+  }
+
+  // Discards the stream resampled so far.
+  void Reset() {
+    if (soxr_.has_value()) {
+      soxr_clear(soxr_->get());
+    }
+  }
+
+ private:
+  // The output space beyond the expected output of each soxr_process.
+  static constexpr size_t kSlack = 1024;
+
+  double ratio_;
+  // Not set if the sample rates are equal.
+  std::optional<ResamplerCache::Lease> soxr_;
+};
+
 }  // namespace zimtohrli
 
 #endif  // CPP_ZIMT_RESAMPLE_H_
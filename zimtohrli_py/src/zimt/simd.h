@@ -0,0 +1,658 @@
+// Copyright 2025 The Zimtohrli Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CPP_ZIMT_SIMD_H_
+#define CPP_ZIMT_SIMD_H_
+
+// Explicitly vectorized kernels with runtime dispatch.
+//
+// The kernels in simd_kernels.h are written once over GCC/Clang vector
+// extension types, and compiled once per target inside a namespace with the
+// compiler target set to AVX2, AVX-512, or the baseline instruction set (SSE2
+// or NEON). This way the rest of the library can be compiled for the baseline
+// instruction set, while the kernels use the best instruction set the CPU
+// supports.
+//
+// Exact kernels perform the same float and double operations, in the same
+// order per output, as the scalar code they replace, so their results are
+// bit-identical on every target. Fast kernels accumulate in float, use FMA,
+// and replace std::pow with FastPow.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define ZIMT_SIMD_VECTOR_EXTENSIONS 1
+#define ZIMT_SIMD_INLINE inline __attribute__((always_inline))
+#else
+#define ZIMT_SIMD_VECTOR_EXTENSIONS 0
+#define ZIMT_SIMD_INLINE inline
+#endif
+
+#if ZIMT_SIMD_VECTOR_EXTENSIONS && defined(__x86_64__)
+#define ZIMT_SIMD_X86 1
+#include <immintrin.h>
+#else
+#define ZIMT_SIMD_X86 0
+#endif
+
+#if ZIMT_SIMD_VECTOR_EXTENSIONS && defined(__aarch64__)
+// NEON is part of the aarch64 baseline, so it needs neither a target
+// attribute nor runtime detection.
+#define ZIMT_SIMD_NEON 1
+#include <arm_neon.h>
+#else
+#define ZIMT_SIMD_NEON 0
+#endif
+
+// Values of ZIMT_SIMD_ISA, see simd_kernels.h.
+#define ZIMT_SIMD_ISA_GENERIC 0
+#define ZIMT_SIMD_ISA_SSE2 1
+#define ZIMT_SIMD_ISA_AVX2 2
+#define ZIMT_SIMD_ISA_AVX512 3
+#define ZIMT_SIMD_ISA_NEON 4
+
+// Passing vector types by value changes the ABI depending on the target, which
+// GCC warns about. All such functions are inlined.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+namespace zimtohrli {
+
+namespace simd {
+
+// The instruction sets kernels can be dispatched to.
+enum class Target { kScalar, kNEON, kAVX2, kAVX512 };
+
+inline const char* TargetName(Target target) {
+  switch (target) {
+    case Target::kScalar:
+      return "scalar";
+    case Target::kNEON:
+      return "neon";
+    case Target::kAVX2:
+      return "avx2";
+    case Target::kAVX512:
+      return "avx512";
+  }
+  return "unknown";
+}
+
+// Returns all targets supported by the current CPU, best last.
+inline std::vector<Target> SupportedTargets() {
+  std::vector<Target> result = {Target::kScalar};
+#if ZIMT_SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    result.push_back(Target::kAVX2);
+    if (__builtin_cpu_supports("avx512f")) {
+      result.push_back(Target::kAVX512);
+    }
+  }
+#elif ZIMT_SIMD_NEON
+  result.push_back(Target::kNEON);
+#endif
+  return result;
+}
+
+// Returns the best target supported by the current CPU.
+inline Target BestTarget() {
+  static const Target target = SupportedTargets().back();
+  return target;
+}
+
+// The number of rows of a the distance kernels process at once, which lets
+// them reuse every vector of columns loaded from memory kRows times.
+constexpr size_t kRows = 4;
+
+// The distance kernels read their columns from panels of kPanelWidth columns
+// each. The num_dims values of the columns of a panel are stored dims-major,
+// i.e. column k and dimension d of the matrix are stored at PanelIndex(k, d,
+// num_dims). This keeps the memory accesses of the kernels sequential.
+constexpr size_t kPanelWidth = 16;
+
+inline size_t PanelIndex(size_t k, size_t d, size_t num_dims) {
+  return (k / kPanelWidth) * kPanelWidth * num_dims + d * kPanelWidth +
+         k % kPanelWidth;
+}
+
+// The types the values of panels can be stored in.
+enum class PanelType {
+  kFloat32,
+  // IEEE 754 half precision: 11 significant bits, values up to 65504.
+  kFloat16,
+  // The upper half of a float: 8 significant bits, the range of float.
+  kBFloat16,
+};
+
+// Returns value rounded to the nearest IEEE 754 half precision value, with
+// ties to even.
+inline uint16_t FloatToHalf(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  const uint16_t sign = (bits >> 16) & 0x8000;
+  const uint32_t magnitude = bits & 0x7fffffff;
+  if (magnitude > 0x7f800000) {
+    return sign | 0x7e00;
+  }
+  // Values from 65520, halfway between the max half and 2^16, are infinite.
+  if (magnitude >= 0x477ff000) {
+    return sign | 0x7c00;
+  }
+  // Values below 2^-14 are subnormal halfs, multiples of 2^-24.
+  if (magnitude < 0x38800000) {
+    float subnormal;
+    std::memcpy(&subnormal, &magnitude, sizeof(subnormal));
+    return sign | static_cast<uint16_t>(std::nearbyint(subnormal * 0x1p24f));
+  }
+  // Rebiases the exponent from 127 to 15 and rounds away 13 mantissa bits,
+  // carrying into the exponent if needed.
+  uint32_t half = (magnitude - 0x38000000) >> 13;
+  const uint32_t rest = magnitude & 0x1fff;
+  if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+    ++half;
+  }
+  return sign | half;
+}
+
+// Returns the IEEE 754 half precision value half as a float, exactly.
+inline float HalfToFloat(uint16_t half) {
+  const uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+  const uint32_t exponent = (half >> 10) & 0x1f;
+  const uint32_t mantissa = half & 0x3ff;
+  if (exponent == 0) {
+    const float magnitude = mantissa * 0x1p-24f;
+    return sign ? -magnitude : magnitude;
+  }
+  const uint32_t bits =
+      sign | (exponent == 0x1f ? 0x7f800000 | (mantissa << 13)
+                               : ((exponent + 112) << 23) | (mantissa << 13));
+  float result;
+  std::memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+// Returns value rounded to the nearest bfloat16 value, with ties to even.
+inline uint16_t FloatToBFloat16(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  if ((bits & 0x7fffffff) > 0x7f800000) {
+    return (bits >> 16) | 0x40;
+  }
+  // Carries into the exponent if needed, which rounds the max float to
+  // infinity.
+  return (bits + 0x7fff + ((bits >> 16) & 1)) >> 16;
+}
+
+// Returns the bfloat16 value bfloat16 as a float, exactly.
+inline float BFloat16ToFloat(uint16_t bfloat16) {
+  const uint32_t bits = static_cast<uint32_t>(bfloat16) << 16;
+  float result;
+  std::memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+// Returns value rounded to panel_type, as a float.
+inline float RoundToPanelType(float value, PanelType panel_type) {
+  switch (panel_type) {
+    case PanelType::kFloat16:
+      return HalfToFloat(FloatToHalf(value));
+    case PanelType::kBFloat16:
+      return BFloat16ToFloat(FloatToBFloat16(value));
+    default:
+      return value;
+  }
+}
+
+// The constants of the NSIM score, see NSIMScoreSum.
+struct NSIMParams {
+  float c1;
+  float c3;
+  float c4;
+  float c5;
+  float c6;
+  float c7;
+  float c8;
+  float p0;
+  float p1;
+  float p2;
+};
+
+#if ZIMT_SIMD_VECTOR_EXTENSIONS
+
+// Kernels for the instruction set the rest of the library is compiled for,
+// i.e. SSE2 on x86-64, NEON on aarch64, and 4 lane generic vectors elsewhere.
+namespace baseline {
+#define ZIMT_SIMD_LANES 4
+#if ZIMT_SIMD_X86
+#define ZIMT_SIMD_ISA ZIMT_SIMD_ISA_SSE2
+#elif ZIMT_SIMD_NEON
+#define ZIMT_SIMD_ISA ZIMT_SIMD_ISA_NEON
+#else
+#define ZIMT_SIMD_ISA ZIMT_SIMD_ISA_GENERIC
+#endif
+#include "zimt/simd_kernels.h"
+#undef ZIMT_SIMD_ISA
+#undef ZIMT_SIMD_LANES
+}  // namespace baseline
+
+#if ZIMT_SIMD_X86
+
+// The distance and NSIM exact kernels never multiply and add in the same
+// precision, and the rotator kernels disable FMA contraction, so FMA can only
+// affect the fast kernels.
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2,fma"))), \
+                             apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#endif
+namespace avx2 {
+#define ZIMT_SIMD_LANES 8
+#define ZIMT_SIMD_ISA ZIMT_SIMD_ISA_AVX2
+#include "zimt/simd_kernels.h"
+#undef ZIMT_SIMD_ISA
+#undef ZIMT_SIMD_LANES
+}  // namespace avx2
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx512f,avx2,fma"))), \
+                             apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx2,fma")
+#endif
+namespace avx512 {
+#define ZIMT_SIMD_LANES 16
+#define ZIMT_SIMD_ISA ZIMT_SIMD_ISA_AVX512
+#include "zimt/simd_kernels.h"
+#undef ZIMT_SIMD_ISA
+#undef ZIMT_SIMD_LANES
+}  // namespace avx512
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#endif  // ZIMT_SIMD_X86
+
+#endif  // ZIMT_SIMD_VECTOR_EXTENSIONS
+
+// Returns an approximation of pow(x, exponent) for x >= 0, computed as
+// exp2(exponent * log2(x)) with polynomial approximations of log2 and exp2.
+//
+// The relative error is below 3e-6 for normal x and exponent * log2(x) in
+// [-126, 126], and about 3e-7 for x in [1e-4, 1e4] and exponent 0.355.
+// x == 0 returns 0, and denormal x returns values close to 0.
+inline float FastPow(float x, float exponent) {
+#if ZIMT_SIMD_VECTOR_EXTENSIONS
+  return baseline::FastPow(x, exponent);
+#else
+  return std::pow(x, exponent);
+#endif
+}
+
+// Scalar reference of SquaredDistances.
+inline void LoopSquaredDistances(const float* a, size_t a_stride,
+                                 size_t num_rows, const float* panels,
+                                 size_t num_dims, size_t num_panels,
+                                 double* out, size_t out_stride) {
+  for (size_t row = 0; row < num_rows; ++row) {
+    for (size_t k = 0; k < num_panels * kPanelWidth; ++k) {
+      double sum = 0;
+      for (size_t d = 0; d < num_dims; ++d) {
+        const float delta =
+            a[row * a_stride + d] - panels[PanelIndex(k, d, num_dims)];
+        sum += delta * delta;
+      }
+      out[row * out_stride + k] = sum;
+    }
+  }
+}
+
+// Computes the squared L2 distances between num_rows vectors of num_dims
+// values and the num_panels * kPanelWidth columns of a matrix stored in
+// panels, i.e.
+//
+// out[row * out_stride + k] = sum over d of
+//     (a[row * a_stride + d] - panels[PanelIndex(k, d, num_dims)])^2
+//
+// for row in [0, num_rows) and k in [0, num_panels * kPanelWidth).
+//
+// The squares are computed in float and summed in double in order of d, so the
+// result is bit-identical for all targets.
+inline void SquaredDistances(Target target, const float* a, size_t a_stride,
+                             size_t num_rows, const float* panels,
+                             size_t num_dims, size_t num_panels, double* out,
+                             size_t out_stride) {
+  switch (target) {
+#if ZIMT_SIMD_X86
+    case Target::kAVX512:
+      return avx512::SquaredDistances(a, a_stride, num_rows, panels, num_dims,
+                                      num_panels, out, out_stride);
+    case Target::kAVX2:
+      return avx2::SquaredDistances(a, a_stride, num_rows, panels, num_dims,
+                                    num_panels, out, out_stride);
+#endif
+#if ZIMT_SIMD_NEON
+    case Target::kNEON:
+      return baseline::SquaredDistances(a, a_stride, num_rows, panels,
+                                        num_dims, num_panels, out, out_stride);
+#endif
+    default:
+      return LoopSquaredDistances(a, a_stride, num_rows, panels, num_dims,
+                                  num_panels, out, out_stride);
+  }
+}
+
+// Like SquaredDistances followed by FastPow(out[...], exponent), but sums the
+// squares in float. Not bit-identical between targets.
+inline void FastPowSquaredDistances(Target target, const float* a,
+                                    size_t a_stride, size_t num_rows,
+                                    const float* panels, size_t num_dims,
+                                    size_t num_panels, float exponent,
+                                    double* out, size_t out_stride) {
+  switch (target) {
+#if ZIMT_SIMD_X86
+    case Target::kAVX512:
+      return avx512::FastPowSquaredDistances(a, a_stride, num_rows, panels,
+                                             num_dims, num_panels, exponent,
+                                             out, out_stride);
+    case Target::kAVX2:
+      return avx2::FastPowSquaredDistances(a, a_stride, num_rows, panels,
+                                           num_dims, num_panels, exponent, out,
+                                           out_stride);
+#endif
+    default:
+#if ZIMT_SIMD_VECTOR_EXTENSIONS
+      return baseline::FastPowSquaredDistances(a, a_stride, num_rows, panels,
+                                               num_dims, num_panels, exponent,
+                                               out, out_stride);
+#else
+      LoopSquaredDistances(a, a_stride, num_rows, panels, num_dims,
+                           num_panels, out, out_stride);
+      for (size_t row = 0; row < num_rows; ++row) {
+        for (size_t k = 0; k < num_panels * kPanelWidth; ++k) {
+          out[row * out_stride + k] =
+              std::pow(out[row * out_stride + k], exponent);
+        }
+      }
+      return;
+#endif
+  }
+}
+
+// Computes FastPowSquaredDistances with panels of kFloat16 or kBFloat16
+// values, which the kernels widen to float as they load them. This halves the
+// memory the panels take and the kernels read, while the result is as close
+// to SquaredDistances as that of FastPowSquaredDistances with the panels
+// rounded to panel_type. Not bit-identical between targets.
+inline void HalfPanelsSquaredDistances(Target target, const float* a,
+                                       size_t a_stride, size_t num_rows,
+                                       const uint16_t* panels,
+                                       PanelType panel_type, size_t num_dims,
+                                       size_t num_panels, float exponent,
+                                       double* out, size_t out_stride) {
+  switch (target) {
+#if ZIMT_SIMD_X86
+    case Target::kAVX512:
+      return avx512::HalfPanelsSquaredDistances(
+          a, a_stride, num_rows, panels, panel_type, num_dims, num_panels,
+          exponent, out, out_stride);
+    case Target::kAVX2:
+      return avx2::HalfPanelsSquaredDistances(a, a_stride, num_rows, panels,
+                                              panel_type, num_dims, num_panels,
+                                              exponent, out, out_stride);
+#endif
+    default:
+#if ZIMT_SIMD_VECTOR_EXTENSIONS
+      return baseline::HalfPanelsSquaredDistances(
+          a, a_stride, num_rows, panels, panel_type, num_dims, num_panels,
+          exponent, out, out_stride);
+#else
+      for (size_t row = 0; row < num_rows; ++row) {
+        for (size_t k = 0; k < num_panels * kPanelWidth; ++k) {
+          float sum = 0;
+          for (size_t d = 0; d < num_dims; ++d) {
+            const uint16_t value = panels[PanelIndex(k, d, num_dims)];
+            const float delta = a[row * a_stride + d] -
+                                (panel_type == PanelType::kBFloat16
+                                     ? BFloat16ToFloat(value)
+                                     : HalfToFloat(value));
+            sum += delta * delta;
+          }
+          out[row * out_stride + k] = std::pow(sum, exponent);
+        }
+      }
+      return;
+#endif
+  }
+}
+
+// Scalar reference of DualFIR.
+inline void LoopDualFIR(const float* in, size_t num_outputs,
+                        const float* kernel_a, const float* kernel_b,
+                        size_t kernel_size, float* out_a, float* out_b) {
+  for (size_t index = 0; index < num_outputs; ++index) {
+    float sum_a = 0;
+    float sum_b = 0;
+    for (size_t tap = 0; tap < kernel_size; ++tap) {
+      sum_a += in[index + tap] * kernel_a[tap];
+      sum_b += in[index + tap] * kernel_b[tap];
+    }
+    out_a[index] = sum_a;
+    out_b[index] = sum_b;
+  }
+}
+
+// Applies the two FIR filters kernel_a and kernel_b of kernel_size taps to in,
+// i.e.
+//
+// out_a[j] = sum over t of in[j + t] * kernel_a[t]
+// out_b[j] = sum over t of in[j + t] * kernel_b[t]
+//
+// for j in [0, num_outputs), which reads num_outputs + kernel_size - 1 values
+// of in.
+//
+// Each input vector is loaded once for both kernels. The products are summed
+// in float in order of t without FMA contraction, so the result is
+// bit-identical for all targets.
+inline void DualFIR(Target target, const float* in, size_t num_outputs,
+                    const float* kernel_a, const float* kernel_b,
+                    size_t kernel_size, float* out_a, float* out_b) {
+  switch (target) {
+#if ZIMT_SIMD_X86
+    case Target::kAVX512:
+      return avx512::DualFIR(in, num_outputs, kernel_a, kernel_b, kernel_size,
+                             out_a, out_b);
+    case Target::kAVX2:
+      return avx2::DualFIR(in, num_outputs, kernel_a, kernel_b, kernel_size,
+                           out_a, out_b);
+#endif
+    default:
+#if ZIMT_SIMD_VECTOR_EXTENSIONS
+      return baseline::DualFIR(in, num_outputs, kernel_a, kernel_b,
+                               kernel_size, out_a, out_b);
+#else
+      return LoopDualFIR(in, num_outputs, kernel_a, kernel_b, kernel_size,
+                         out_a, out_b);
+#endif
+  }
+}
+
+// Scalar reference of IncrementRotators.
+inline void LoopIncrementRotators(float* rot, float* accu, const float* window,
+                                  size_t num_rotators, const float* signal,
+                                  size_t num_samples, const float* weights,
+                                  float* current, float* next) {
+  float* phase0 = rot;
+  float* phase1 = rot + num_rotators;
+  float* phase2 = rot + 2 * num_rotators;
+  float* phase3 = rot + 3 * num_rotators;
+  for (size_t sample = 0; sample < num_samples; ++sample) {
+    for (size_t i = 0; i < num_rotators; ++i) {
+      const float w = window[i];
+      for (size_t k = 0; k < 6; ++k) accu[k * num_rotators + i] *= w;
+      // For an unknown reason this update order works best, i.e. 2, 3, 4, 5,
+      // and finally 0, 1.
+      accu[2 * num_rotators + i] += accu[i];
+      accu[3 * num_rotators + i] += accu[num_rotators + i];
+      accu[4 * num_rotators + i] += accu[2 * num_rotators + i];
+      accu[5 * num_rotators + i] += accu[3 * num_rotators + i];
+      accu[i] += phase2[i] * signal[sample];
+      accu[num_rotators + i] += phase3[i] * signal[sample];
+      const float a = phase2[i], b = phase3[i];
+      phase2[i] = phase0[i] * a - phase1[i] * b;
+      phase3[i] = phase0[i] * b + phase1[i] * a;
+    }
+    for (size_t i = 0; i < num_rotators; ++i) {
+      const float real = accu[4 * num_rotators + i];
+      const float imag = accu[5 * num_rotators + i];
+      const float energy = real * real + imag * imag;
+      if (next == nullptr) {
+        current[i] += energy;
+      } else {
+        next[i] += (1.0 - weights[sample]) * energy;
+        current[i] += weights[sample] * energy;
+      }
+    }
+  }
+}
+
+// Advances the rotating phasors of the filterbank in Rotators by num_samples
+// samples of signal, and accumulates the energies of the third leaking
+// accumulators into the output rows current and next.
+//
+// rot and accu are the 4 and 6 rows of num_rotators values of the Rotators
+// state, window the leak factors. The energy of sample s is added to current
+// with weight weights[s] and to next with weight 1 - weights[s], or to current
+// with weight 1 if next is nullptr. num_rotators must be a multiple of
+// kPanelWidth.
+//
+// Each vector of rotators is advanced through all samples before moving to the
+// next, so its state never leaves the registers. The kernels don't contract
+// multiplications and additions, and weight next in double like the scalar
+// code, so the result is bit-identical for all targets.
+inline void IncrementRotators(Target target, float* rot, float* accu,
+                              const float* window, size_t num_rotators,
+                              const float* signal, size_t num_samples,
+                              const float* weights, float* current,
+                              float* next) {
+  switch (target) {
+#if ZIMT_SIMD_X86
+    case Target::kAVX512:
+      return avx512::IncrementRotators(rot, accu, window, num_rotators, signal,
+                                       num_samples, weights, current, next);
+    case Target::kAVX2:
+      return avx2::IncrementRotators(rot, accu, window, num_rotators, signal,
+                                     num_samples, weights, current, next);
+#endif
+    default:
+#if ZIMT_SIMD_VECTOR_EXTENSIONS
+      return baseline::IncrementRotators(rot, accu, window, num_rotators,
+                                         signal, num_samples, weights, current,
+                                         next);
+#else
+      return LoopIncrementRotators(rot, accu, window, num_rotators, signal,
+                                   num_samples, weights, current, next);
+#endif
+  }
+}
+
+// Returns the sum of the NSIM scores
+//
+// pow((2 * sqrt(mean_a * mean_b) + c1) / (|mean_a| + |mean_b| + c1), p0) *
+// (pow(pow(max(c8, (cov + c3) / (sqrt(var_a) * sqrt(var_b) + c3)) + c4, p1) +
+//      c5, p2) + c6) +
+// c7 * |value_a - value_b|
+//
+// of num_cells cells, where mean_a[i], mean_b[i], ... are the statistics of
+// cell i. If scores is not null, the score of cell i is also written to
+// scores[i].
+//
+// The powers are computed with FastPow and summed per lane, so the result
+// isn't bit-identical to a scalar loop with std::pow. The relative error of
+// each score is below 1e-5 (about 3 times the FastPow bound, for the 3 chained
+// powers), and below 5e-7 for typical spectrogram statistics.
+inline float NSIMScoreSum(Target target, const NSIMParams& params,
+                          const float* mean_a, const float* mean_b,
+                          const float* var_a, const float* var_b,
+                          const float* cov, const float* value_a,
+                          const float* value_b, size_t num_cells,
+                          float* scores = nullptr) {
+  switch (target) {
+#if ZIMT_SIMD_X86
+    case Target::kAVX512:
+      return avx512::NSIMScoreSum(params, mean_a, mean_b, var_a, var_b, cov,
+                                  value_a, value_b, num_cells, scores);
+    case Target::kAVX2:
+      return avx2::NSIMScoreSum(params, mean_a, mean_b, var_a, var_b, cov,
+                                value_a, value_b, num_cells, scores);
+#endif
+    default:
+#if ZIMT_SIMD_VECTOR_EXTENSIONS
+      return baseline::NSIMScoreSum(params, mean_a, mean_b, var_a, var_b, cov,
+                                    value_a, value_b, num_cells, scores);
+#else
+      float result = 0;
+      for (size_t index = 0; index < num_cells; ++index) {
+        const float intensity = std::pow(
+            (2 * std::sqrt(mean_a[index] * mean_b[index]) + params.c1) /
+                (std::abs(mean_a[index]) + std::abs(mean_b[index]) +
+                 params.c1),
+            params.p0);
+        const float structure_base =
+            (cov[index] + params.c3) /
+            (std::sqrt(var_a[index]) * std::sqrt(var_b[index]) + params.c3);
+        const float structure =
+            std::pow(std::pow(std::max(params.c8, structure_base) + params.c4,
+                              params.p1) +
+                         params.c5,
+                     params.p2) +
+            params.c6;
+        const float score =
+            intensity * structure +
+            params.c7 * std::abs(value_a[index] - value_b[index]);
+        if (scores != nullptr) {
+          scores[index] = score;
+        }
+        result += score;
+      }
+      return result;
+#endif
+  }
+}
+
+}  // namespace simd
+
+}  // namespace zimtohrli
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif  // CPP_ZIMT_SIMD_H_
@@ -0,0 +1,633 @@
+// Copyright 2025 The Zimtohrli Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Kernels of simd.h, written once over GCC/Clang vector extension types.
+//
+// Deliberately without include guard: simd.h includes this file once per
+// target, inside a target specific namespace and with the compiler target set
+// to that instruction set. Before every inclusion ZIMT_SIMD_LANES must be
+// defined to the number of float lanes, and ZIMT_SIMD_ISA to one of the
+// ZIMT_SIMD_ISA_* values.
+
+constexpr size_t kLanes = ZIMT_SIMD_LANES;
+
+typedef float F __attribute__((vector_size(kLanes * sizeof(float))));
+typedef int32_t I __attribute__((vector_size(kLanes * sizeof(int32_t))));
+// Half as many double lanes, i.e. a vector of the same size as F.
+typedef double D __attribute__((vector_size(kLanes / 2 * sizeof(double))));
+// As many 16 bit lanes as F has, i.e. a vector of half the size of F.
+typedef uint16_t H __attribute__((vector_size(kLanes * sizeof(uint16_t))));
+typedef uint32_t U __attribute__((vector_size(kLanes * sizeof(uint32_t))));
+
+ZIMT_SIMD_INLINE F LoadU(const float* data) {
+  F result;
+  std::memcpy(&result, data, sizeof(F));
+  return result;
+}
+
+ZIMT_SIMD_INLINE void StoreU(F value, float* data) {
+  std::memcpy(data, &value, sizeof(F));
+}
+
+ZIMT_SIMD_INLINE void StoreU(D value, double* data) {
+  std::memcpy(data, &value, sizeof(D));
+}
+
+ZIMT_SIMD_INLINE F Set(float value) { return F{} + value; }
+
+// Returns mask ? yes : no for lane masks as returned by vector comparisons.
+ZIMT_SIMD_INLINE F IfThenElse(I mask, F yes, F no) {
+  return (F)(((I)yes & mask) | ((I)no & ~mask));
+}
+
+// Converts the lower and upper half of the lanes of value to double.
+ZIMT_SIMD_INLINE D LowerToDouble(F value) {
+#if ZIMT_SIMD_ISA == ZIMT_SIMD_ISA_AVX512
+  // The zero-masking variants avoid the -Wmaybe-uninitialized false positives
+  // GCC reports for the _mm512_undefined_* placeholders of the unmasked ones.
+  return (D)_mm512_maskz_cvtps_pd(
+      0xff, _mm256_castpd_ps(_mm512_maskz_extractf64x4_pd(
+                0xff, _mm512_castps_pd((__m512)value), 0)));
+#elif ZIMT_SIMD_ISA == ZIMT_SIMD_ISA_AVX2
+  return (D)_mm256_cvtps_pd(_mm256_castps256_ps128((__m256)value));
+#elif ZIMT_SIMD_ISA == ZIMT_SIMD_ISA_SSE2
+  return (D)_mm_cvtps_pd((__m128)value);
+#elif ZIMT_SIMD_ISA == ZIMT_SIMD_ISA_NEON
+  return (D)vcvt_f64_f32(vget_low_f32((float32x4_t)value));
+#else
+  D result;
+  for (size_t lane = 0; lane < kLanes / 2; ++lane) {
+    result[lane] = value[lane];
+  }
+  return result;
+#endif
+}
+
+ZIMT_SIMD_INLINE D UpperToDouble(F value) {
+#if ZIMT_SIMD_ISA == ZIMT_SIMD_ISA_AVX512
+  return (D)_mm512_maskz_cvtps_pd(
+      0xff, _mm256_castpd_ps(_mm512_maskz_extractf64x4_pd(
+                0xff, _mm512_castps_pd((__m512)value), 1)));
+#elif ZIMT_SIMD_ISA == ZIMT_SIMD_ISA_AVX2
+  return (D)_mm256_cvtps_pd(_mm256_extractf128_ps((__m256)value, 1));
+#elif ZIMT_SIMD_ISA == ZIMT_SIMD_ISA_SSE2
+  return (D)_mm_cvtps_pd(_mm_movehl_ps((__m128)value, (__m128)value));
+#elif ZIMT_SIMD_ISA == ZIMT_SIMD_ISA_NEON
+  return (D)vcvt_high_f64_f32((float32x4_t)value);
+#else
+  D result;
+  for (size_t lane = 0; lane < kLanes / 2; ++lane) {
+    result[lane] = value[kLanes / 2 + lane];
+  }
+  return result;
+#endif
+}
+
+// Rounds the lanes of lower and upper to float, i.e. the inverse of
+// LowerToDouble and UpperToDouble.
+ZIMT_SIMD_INLINE F DemoteToFloat(D lower, D upper) {
+#if ZIMT_SIMD_ISA == ZIMT_SIMD_ISA_AVX512
+  // See LowerToDouble for why the zero-masking variants are used.
+  const __m512d result = _mm512_maskz_insertf64x4(
+      0xff, _mm512_setzero_pd(),
+      _mm256_castps_pd(_mm512_maskz_cvtpd_ps(0xff, (__m512d)lower)), 0);
+  return (F)_mm512_castpd_ps(_mm512_maskz_insertf64x4(
+      0xff, result,
+      _mm256_castps_pd(_mm512_maskz_cvtpd_ps(0xff, (__m512d)upper)), 1));
+#elif ZIMT_SIMD_ISA == ZIMT_SIMD_ISA_AVX2
+  return (F)_mm256_insertf128_ps(
+      _mm256_castps128_ps256(_mm256_cvtpd_ps((__m256d)lower)),
+      _mm256_cvtpd_ps((__m256d)upper), 1);
+#elif ZIMT_SIMD_ISA == ZIMT_SIMD_ISA_SSE2
+  return (F)_mm_movelh_ps(_mm_cvtpd_ps((__m128d)lower),
+                          _mm_cvtpd_ps((__m128d)upper));
+#elif ZIMT_SIMD_ISA == ZIMT_SIMD_ISA_NEON
+  return (F)vcvt_high_f32_f64(vcvt_f32_f64((float64x2_t)lower),
+                              (float64x2_t)upper);
+#else
+  F result;
+  for (size_t lane = 0; lane < kLanes / 2; ++lane) {
+    result[lane] = lower[lane];
+    result[kLanes / 2 + lane] = upper[lane];
+  }
+  return result;
+#endif
+}
+
+ZIMT_SIMD_INLINE F Sqrt(F value) {
+#if ZIMT_SIMD_ISA == ZIMT_SIMD_ISA_AVX512
+  // See LowerToDouble for why the zero-masking variant is used.
+  return (F)_mm512_maskz_sqrt_ps(0xffff, (__m512)value);
+#elif ZIMT_SIMD_ISA == ZIMT_SIMD_ISA_AVX2
+  return (F)_mm256_sqrt_ps((__m256)value);
+#elif ZIMT_SIMD_ISA == ZIMT_SIMD_ISA_SSE2
+  return (F)_mm_sqrt_ps((__m128)value);
+#elif ZIMT_SIMD_ISA == ZIMT_SIMD_ISA_NEON
+  return (F)vsqrtq_f32((float32x4_t)value);
+#else
+  F result;
+  for (size_t lane = 0; lane < kLanes; ++lane) {
+    result[lane] = std::sqrt(value[lane]);
+  }
+  return result;
+#endif
+}
+
+ZIMT_SIMD_INLINE F Abs(F value) { return (F)((I)value & 0x7fffffff); }
+
+ZIMT_SIMD_INLINE F FastLog2(F x) {
+  const I bits = (I)x;
+  I exponent = ((bits >> 23) & 0xff) - 127;
+  F mantissa = (F)((bits & 0x7fffff) | 0x3f800000);
+  // Move the mantissa to [sqrt(0.5), sqrt(2)) to center the series below
+  // around 1.
+  const I large = mantissa > 1.41421356f;
+  mantissa = IfThenElse(large, mantissa * 0.5f, mantissa);
+  exponent -= large;
+  // ln(m) = 2 * atanh(t) with t = (m - 1) / (m + 1) and |t| < 0.172.
+  const F t = (mantissa - 1.0f) / (mantissa + 1.0f);
+  const F t2 = t * t;
+  const F series =
+      1.0f +
+      t2 * (1.0f / 3 + t2 * (1.0f / 5 + t2 * (1.0f / 7 + t2 * (1.0f / 9))));
+  return __builtin_convertvector(exponent, F) +
+         t * series * (2.0f / 0.6931471805599453f);
+}
+
+ZIMT_SIMD_INLINE F FastExp2(F x) {
+  x = IfThenElse(x < -126.0f, Set(-126.0f), x);
+  x = IfThenElse(x > 126.0f, Set(126.0f), x);
+  // Rounds to the nearest integer, and leaves the fraction in [-0.5, 0.5].
+  const F rounded = (x + 12582912.0f) - 12582912.0f;
+  const F fraction = x - rounded;
+  // Taylor series of exp(fraction * ln(2)).
+  constexpr float c1 = 0.6931471805599453f;
+  constexpr float c2 = c1 * c1 / 2;
+  constexpr float c3 = c2 * c1 / 3;
+  constexpr float c4 = c3 * c1 / 4;
+  constexpr float c5 = c4 * c1 / 5;
+  constexpr float c6 = c5 * c1 / 6;
+  F poly = c5 + fraction * c6;
+  poly = c4 + fraction * poly;
+  poly = c3 + fraction * poly;
+  poly = c2 + fraction * poly;
+  poly = c1 + fraction * poly;
+  poly = 1.0f + fraction * poly;
+  const F scale = (F)((__builtin_convertvector(rounded, I) + 127) << 23);
+  return poly * scale;
+}
+
+// See simd::FastPow.
+ZIMT_SIMD_INLINE F FastPow(F x, float exponent) {
+  const F result = FastExp2(FastLog2(x) * exponent);
+  return IfThenElse(x > 0.0f, result, F{});
+}
+
+inline float FastPow(float x, float exponent) {
+  return FastPow(Set(x), exponent)[0];
+}
+
+// The number of vectors in a panel of kPanelWidth columns.
+constexpr size_t kPanelVectors = kPanelWidth / kLanes;
+
+// Computes SquaredDistances for R rows of a and one panel at a time.
+template <size_t R>
+ZIMT_SIMD_INLINE void SquaredDistancesBlock(const float* a, size_t a_stride,
+                                            const float* panels,
+                                            size_t num_dims, size_t num_panels,
+                                            double* out, size_t out_stride) {
+  for (size_t panel = 0; panel < num_panels; ++panel) {
+    const float* columns = panels + panel * kPanelWidth * num_dims;
+    for (size_t vector = 0; vector < kPanelVectors; ++vector) {
+      D lower_sums[R] = {};
+      D upper_sums[R] = {};
+      for (size_t d = 0; d < num_dims; ++d) {
+        const F column = LoadU(columns + d * kPanelWidth + vector * kLanes);
+#pragma GCC unroll 4
+        for (size_t r = 0; r < R; ++r) {
+          const F delta = a[r * a_stride + d] - column;
+          const F square = delta * delta;
+          lower_sums[r] += LowerToDouble(square);
+          upper_sums[r] += UpperToDouble(square);
+        }
+      }
+      const size_t k = panel * kPanelWidth + vector * kLanes;
+      for (size_t r = 0; r < R; ++r) {
+        StoreU(lower_sums[r], out + r * out_stride + k);
+        StoreU(upper_sums[r], out + r * out_stride + k + kLanes / 2);
+      }
+    }
+  }
+}
+
+// See simd::SquaredDistances.
+inline void SquaredDistances(const float* a, size_t a_stride, size_t num_rows,
+                             const float* panels, size_t num_dims,
+                             size_t num_panels, double* out,
+                             size_t out_stride) {
+  size_t row = 0;
+  for (; row + kRows <= num_rows; row += kRows) {
+    SquaredDistancesBlock<kRows>(a + row * a_stride, a_stride, panels,
+                                 num_dims, num_panels, out + row * out_stride,
+                                 out_stride);
+  }
+  for (; row < num_rows; ++row) {
+    SquaredDistancesBlock<1>(a + row * a_stride, a_stride, panels, num_dims,
+                             num_panels, out + row * out_stride, out_stride);
+  }
+}
+
+// Computes FastPowSquaredDistances for R rows of a and one panel at a time.
+template <size_t R>
+ZIMT_SIMD_INLINE void FastPowSquaredDistancesBlock(
+    const float* a, size_t a_stride, const float* panels, size_t num_dims,
+    size_t num_panels, float exponent, double* out, size_t out_stride) {
+  for (size_t panel = 0; panel < num_panels; ++panel) {
+    const float* columns = panels + panel * kPanelWidth * num_dims;
+    for (size_t vector = 0; vector < kPanelVectors; ++vector) {
+      F sums[R] = {};
+      for (size_t d = 0; d < num_dims; ++d) {
+        const F column = LoadU(columns + d * kPanelWidth + vector * kLanes);
+#pragma GCC unroll 4
+        for (size_t r = 0; r < R; ++r) {
+          const F delta = a[r * a_stride + d] - column;
+          sums[r] += delta * delta;
+        }
+      }
+      const size_t k = panel * kPanelWidth + vector * kLanes;
+      for (size_t r = 0; r < R; ++r) {
+        const F result = FastPow(sums[r], exponent);
+        StoreU(LowerToDouble(result), out + r * out_stride + k);
+        StoreU(UpperToDouble(result), out + r * out_stride + k + kLanes / 2);
+      }
+    }
+  }
+}
+
+// See simd::FastPowSquaredDistances.
+inline void FastPowSquaredDistances(const float* a, size_t a_stride,
+                                    size_t num_rows, const float* panels,
+                                    size_t num_dims, size_t num_panels,
+                                    float exponent, double* out,
+                                    size_t out_stride) {
+  size_t row = 0;
+  for (; row + kRows <= num_rows; row += kRows) {
+    FastPowSquaredDistancesBlock<kRows>(a + row * a_stride, a_stride, panels,
+                                        num_dims, num_panels, exponent,
+                                        out + row * out_stride, out_stride);
+  }
+  for (; row < num_rows; ++row) {
+    FastPowSquaredDistancesBlock<1>(a + row * a_stride, a_stride, panels,
+                                    num_dims, num_panels, exponent,
+                                    out + row * out_stride, out_stride);
+  }
+}
+
+// Loads kLanes IEEE half precision values, or bfloat16 values if kBFloat16,
+// and widens them to float, exactly for finite values.
+template <bool kBFloat16>
+ZIMT_SIMD_INLINE F LoadWiden(const uint16_t* data) {
+  H narrow;
+  std::memcpy(&narrow, data, sizeof(H));
+  const U wide = __builtin_convertvector(narrow, U);
+  if (kBFloat16) {
+    return (F)(wide << 16);
+  }
+#if ZIMT_SIMD_ISA == ZIMT_SIMD_ISA_AVX512
+  // The masked conversion, like in LowerToDouble.
+  return (F)_mm512_maskz_cvtph_ps(0xffff, (__m256i)narrow);
+#endif
+  // Moves exponent and mantissa into place and rebiases the exponent from 15
+  // to 127, which also turns subnormal halfs into normal floats.
+  const F magnitude = (F)((wide & 0x7fff) << 13) * 0x1p112f;
+  return (F)((U)magnitude | ((wide & 0x8000) << 16));
+}
+
+// Computes HalfPanelsSquaredDistances for R rows of a and one panel at a
+// time.
+template <size_t R, bool kBFloat16>
+ZIMT_SIMD_INLINE void HalfPanelsSquaredDistancesBlock(
+    const float* a, size_t a_stride, const uint16_t* panels, size_t num_dims,
+    size_t num_panels, float exponent, double* out, size_t out_stride) {
+  for (size_t panel = 0; panel < num_panels; ++panel) {
+    const uint16_t* columns = panels + panel * kPanelWidth * num_dims;
+    for (size_t vector = 0; vector < kPanelVectors; ++vector) {
+      F sums[R] = {};
+      for (size_t d = 0; d < num_dims; ++d) {
+        const F column =
+            LoadWiden<kBFloat16>(columns + d * kPanelWidth + vector * kLanes);
+#pragma GCC unroll 4
+        for (size_t r = 0; r < R; ++r) {
+          const F delta = a[r * a_stride + d] - column;
+          sums[r] += delta * delta;
+        }
+      }
+      const size_t k = panel * kPanelWidth + vector * kLanes;
+      for (size_t r = 0; r < R; ++r) {
+        const F result = FastPow(sums[r], exponent);
+        StoreU(LowerToDouble(result), out + r * out_stride + k);
+        StoreU(UpperToDouble(result), out + r * out_stride + k + kLanes / 2);
+      }
+    }
+  }
+}
+
+template <bool kBFloat16>
+void HalfPanelsSquaredDistances(const float* a, size_t a_stride,
+                                size_t num_rows, const uint16_t* panels,
+                                size_t num_dims, size_t num_panels,
+                                float exponent, double* out,
+                                size_t out_stride) {
+  size_t row = 0;
+  for (; row + kRows <= num_rows; row += kRows) {
+    HalfPanelsSquaredDistancesBlock<kRows, kBFloat16>(
+        a + row * a_stride, a_stride, panels, num_dims, num_panels, exponent,
+        out + row * out_stride, out_stride);
+  }
+  for (; row < num_rows; ++row) {
+    HalfPanelsSquaredDistancesBlock<1, kBFloat16>(
+        a + row * a_stride, a_stride, panels, num_dims, num_panels, exponent,
+        out + row * out_stride, out_stride);
+  }
+}
+
+// See simd::HalfPanelsSquaredDistances.
+inline void HalfPanelsSquaredDistances(const float* a, size_t a_stride,
+                                       size_t num_rows, const uint16_t* panels,
+                                       PanelType panel_type, size_t num_dims,
+                                       size_t num_panels, float exponent,
+                                       double* out, size_t out_stride) {
+  if (panel_type == PanelType::kBFloat16) {
+    HalfPanelsSquaredDistances<true>(a, a_stride, num_rows, panels, num_dims,
+                                     num_panels, exponent, out, out_stride);
+  } else {
+    HalfPanelsSquaredDistances<false>(a, a_stride, num_rows, panels, num_dims,
+                                      num_panels, exponent, out, out_stride);
+  }
+}
+
+// The NSIM score of kLanes cells, see simd::NSIMScoreSum.
+ZIMT_SIMD_INLINE F NSIMScores(const NSIMParams& params, F mean_a, F mean_b,
+                              F var_a, F var_b, F cov, F value_a, F value_b) {
+  const F intensity =
+      FastPow((2.0f * Sqrt(mean_a * mean_b) + params.c1) /
+                  (Abs(mean_a) + Abs(mean_b) + params.c1),
+              params.p0);
+  const F structure_base =
+      (cov + params.c3) / (Sqrt(var_a) * Sqrt(var_b) + params.c3);
+  const F structure_clamped = IfThenElse(structure_base < params.c8,
+                                         Set(params.c8), structure_base);
+  const F structure =
+      FastPow(FastPow(structure_clamped + params.c4, params.p1) + params.c5,
+              params.p2) +
+      params.c6;
+  return intensity * structure + params.c7 * Abs(value_a - value_b);
+}
+
+// See simd::NSIMScoreSum.
+inline float NSIMScoreSum(const NSIMParams& params, const float* mean_a,
+                          const float* mean_b, const float* var_a,
+                          const float* var_b, const float* cov,
+                          const float* value_a, const float* value_b,
+                          size_t num_cells, float* scores) {
+  F sums = {};
+  size_t index = 0;
+  for (; index + kLanes <= num_cells; index += kLanes) {
+    const F cell_scores =
+        NSIMScores(params, LoadU(mean_a + index), LoadU(mean_b + index),
+                   LoadU(var_a + index), LoadU(var_b + index),
+                   LoadU(cov + index), LoadU(value_a + index),
+                   LoadU(value_b + index));
+    if (scores != nullptr) {
+      StoreU(cell_scores, scores + index);
+    }
+    sums += cell_scores;
+  }
+  float result = 0;
+  if (index < num_cells) {
+    // Pads the remaining cells with arbitrary finite values, and only sums
+    // the scores of the real cells.
+    float tail[7][kLanes];
+    for (size_t lane = 0; lane < kLanes; ++lane) {
+      const bool valid = index + lane < num_cells;
+      tail[0][lane] = valid ? mean_a[index + lane] : 1.0f;
+      tail[1][lane] = valid ? mean_b[index + lane] : 1.0f;
+      tail[2][lane] = valid ? var_a[index + lane] : 1.0f;
+      tail[3][lane] = valid ? var_b[index + lane] : 1.0f;
+      tail[4][lane] = valid ? cov[index + lane] : 1.0f;
+      tail[5][lane] = valid ? value_a[index + lane] : 0.0f;
+      tail[6][lane] = valid ? value_b[index + lane] : 0.0f;
+    }
+    const F tail_scores =
+        NSIMScores(params, LoadU(tail[0]), LoadU(tail[1]), LoadU(tail[2]),
+                   LoadU(tail[3]), LoadU(tail[4]), LoadU(tail[5]),
+                   LoadU(tail[6]));
+    for (size_t lane = 0; index + lane < num_cells; ++lane) {
+      if (scores != nullptr) {
+        scores[index + lane] = tail_scores[lane];
+      }
+      result += tail_scores[lane];
+    }
+  }
+  for (size_t lane = 0; lane < kLanes; ++lane) {
+    result += sums[lane];
+  }
+  return result;
+}
+
+// The filterbank kernels must round after every multiplication like the scalar
+// filterbank, so FMA contraction is disabled for them. Clang needs its pragma
+// inside every function body instead.
+#if !defined(__clang__)
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+// Computes DualFIR for kVectors * kLanes outputs starting at in.
+template <size_t kVectors>
+ZIMT_SIMD_INLINE void DualFIRBlock(const float* in, const float* kernel_a,
+                                   const float* kernel_b, size_t kernel_size,
+                                   float* out_a, float* out_b) {
+#if defined(__clang__)
+#pragma clang fp contract(off)
+#endif
+  F sums_a[kVectors] = {};
+  F sums_b[kVectors] = {};
+  for (size_t tap = 0; tap < kernel_size; ++tap) {
+#pragma GCC unroll 4
+    for (size_t v = 0; v < kVectors; ++v) {
+      const F x = LoadU(in + v * kLanes + tap);
+      sums_a[v] += x * kernel_a[tap];
+      sums_b[v] += x * kernel_b[tap];
+    }
+  }
+  for (size_t v = 0; v < kVectors; ++v) {
+    StoreU(sums_a[v], out_a + v * kLanes);
+    StoreU(sums_b[v], out_b + v * kLanes);
+  }
+}
+
+// See simd::DualFIR.
+inline void DualFIR(const float* in, size_t num_outputs, const float* kernel_a,
+                    const float* kernel_b, size_t kernel_size, float* out_a,
+                    float* out_b) {
+#if defined(__clang__)
+#pragma clang fp contract(off)
+#endif
+  constexpr size_t kVectors = 4;
+  size_t index = 0;
+  for (; index + kVectors * kLanes <= num_outputs; index += kVectors * kLanes) {
+    DualFIRBlock<kVectors>(in + index, kernel_a, kernel_b, kernel_size,
+                           out_a + index, out_b + index);
+  }
+  for (; index + kLanes <= num_outputs; index += kLanes) {
+    DualFIRBlock<1>(in + index, kernel_a, kernel_b, kernel_size,
+                    out_a + index, out_b + index);
+  }
+  for (; index < num_outputs; ++index) {
+    float sum_a = 0;
+    float sum_b = 0;
+    for (size_t tap = 0; tap < kernel_size; ++tap) {
+      sum_a += in[index + tap] * kernel_a[tap];
+      sum_b += in[index + tap] * kernel_b[tap];
+    }
+    out_a[index] = sum_a;
+    out_b[index] = sum_b;
+  }
+}
+
+// Computes IncrementRotators for the kGroups * kLanes rotators starting at
+// rotator i.
+//
+// The rotator state and the two output rows stay in registers for all
+// num_samples samples. Advancing several independent vectors at once hides the
+// latency of the recurrences.
+template <size_t kGroups, bool kSplit>
+ZIMT_SIMD_INLINE void IncrementRotatorGroups(
+    float* rot, float* accu, const float* window, size_t num_rotators,
+    size_t i, const float* signal, size_t num_samples, const float* weights,
+    float* current, float* next) {
+#if defined(__clang__)
+#pragma clang fp contract(off)
+#endif
+  F phase0[kGroups], phase1[kGroups], phase2[kGroups], phase3[kGroups];
+  F accu0[kGroups], accu1[kGroups], accu2[kGroups], accu3[kGroups],
+      accu4[kGroups], accu5[kGroups];
+  F w[kGroups], current_sum[kGroups], next_sum[kGroups];
+  for (size_t g = 0; g < kGroups; ++g) {
+    const size_t offset = i + g * kLanes;
+    phase0[g] = LoadU(rot + offset);
+    phase1[g] = LoadU(rot + num_rotators + offset);
+    phase2[g] = LoadU(rot + 2 * num_rotators + offset);
+    phase3[g] = LoadU(rot + 3 * num_rotators + offset);
+    accu0[g] = LoadU(accu + offset);
+    accu1[g] = LoadU(accu + num_rotators + offset);
+    accu2[g] = LoadU(accu + 2 * num_rotators + offset);
+    accu3[g] = LoadU(accu + 3 * num_rotators + offset);
+    accu4[g] = LoadU(accu + 4 * num_rotators + offset);
+    accu5[g] = LoadU(accu + 5 * num_rotators + offset);
+    w[g] = LoadU(window + offset);
+    current_sum[g] = LoadU(current + offset);
+    next_sum[g] = kSplit ? LoadU(next + offset) : F{};
+  }
+  for (size_t sample = 0; sample < num_samples; ++sample) {
+    // The scalar code weights the next output row in double.
+    const D next_weight = D{} + (1.0 - weights[sample]);
+#pragma GCC unroll 4
+    for (size_t g = 0; g < kGroups; ++g) {
+      accu0[g] *= w[g];
+      accu1[g] *= w[g];
+      accu2[g] *= w[g];
+      accu3[g] *= w[g];
+      accu4[g] *= w[g];
+      accu5[g] *= w[g];
+      accu2[g] += accu0[g];
+      accu3[g] += accu1[g];
+      accu4[g] += accu2[g];
+      accu5[g] += accu3[g];
+      accu0[g] += phase2[g] * signal[sample];
+      accu1[g] += phase3[g] * signal[sample];
+      const F a = phase2[g];
+      const F b = phase3[g];
+      phase2[g] = phase0[g] * a - phase1[g] * b;
+      phase3[g] = phase0[g] * b + phase1[g] * a;
+      const F energy = accu4[g] * accu4[g] + accu5[g] * accu5[g];
+      if (kSplit) {
+        next_sum[g] = DemoteToFloat(
+            LowerToDouble(next_sum[g]) + next_weight * LowerToDouble(energy),
+            UpperToDouble(next_sum[g]) + next_weight * UpperToDouble(energy));
+        current_sum[g] += weights[sample] * energy;
+      } else {
+        current_sum[g] += energy;
+      }
+    }
+  }
+  for (size_t g = 0; g < kGroups; ++g) {
+    const size_t offset = i + g * kLanes;
+    StoreU(phase2[g], rot + 2 * num_rotators + offset);
+    StoreU(phase3[g], rot + 3 * num_rotators + offset);
+    StoreU(accu0[g], accu + offset);
+    StoreU(accu1[g], accu + num_rotators + offset);
+    StoreU(accu2[g], accu + 2 * num_rotators + offset);
+    StoreU(accu3[g], accu + 3 * num_rotators + offset);
+    StoreU(accu4[g], accu + 4 * num_rotators + offset);
+    StoreU(accu5[g], accu + 5 * num_rotators + offset);
+    StoreU(current_sum[g], current + offset);
+    if (kSplit) {
+      StoreU(next_sum[g], next + offset);
+    }
+  }
+}
+
+// The number of vectors of rotators IncrementRotators advances at once.
+constexpr size_t kRotatorGroups = 2;
+
+// Dispatches IncrementRotatorGroups on whether there is a next output row.
+template <size_t kGroups>
+ZIMT_SIMD_INLINE void IncrementRotatorsBlock(
+    float* rot, float* accu, const float* window, size_t num_rotators,
+    size_t i, const float* signal, size_t num_samples, const float* weights,
+    float* current, float* next) {
+  if (next == nullptr) {
+    IncrementRotatorGroups<kGroups, false>(rot, accu, window, num_rotators, i,
+                                           signal, num_samples, weights,
+                                           current, next);
+  } else {
+    IncrementRotatorGroups<kGroups, true>(rot, accu, window, num_rotators, i,
+                                          signal, num_samples, weights,
+                                          current, next);
+  }
+}
+
+// See simd::IncrementRotators.
+inline void IncrementRotators(float* rot, float* accu, const float* window,
+                              size_t num_rotators, const float* signal,
+                              size_t num_samples, const float* weights,
+                              float* current, float* next) {
+  size_t i = 0;
+  for (; i + kRotatorGroups * kLanes <= num_rotators;
+       i += kRotatorGroups * kLanes) {
+    IncrementRotatorsBlock<kRotatorGroups>(rot, accu, window, num_rotators, i,
+                                           signal, num_samples, weights,
+                                           current, next);
+  }
+  for (; i < num_rotators; i += kLanes) {
+    IncrementRotatorsBlock<1>(rot, accu, window, num_rotators, i, signal,
+                              num_samples, weights, current, next);
+  }
+}
+
+#if !defined(__clang__)
+#pragma GCC pop_options
+#endif
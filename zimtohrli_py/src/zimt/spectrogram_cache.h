@@ -0,0 +1,384 @@
+// Copyright 2025 The Zimtohrli Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CPP_ZIMT_SPECTROGRAM_CACHE_H_
+#define CPP_ZIMT_SPECTROGRAM_CACHE_H_
+
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#if defined(_WIN32)
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "zimt/zimtohrli.h"
+
+namespace zimtohrli {
+
+namespace {
+
+// A 128 bit hash, e.g. of the content of a signal.
+struct Hash128 {
+  bool operator==(const Hash128& other) const {
+    return low == other.low && high == other.high;
+  }
+  // Returns the hash as 32 lower case hex digits.
+  std::string Hex() const {
+    char result[33];
+    std::snprintf(result, sizeof(result), "%016llx%016llx",
+                  static_cast<unsigned long long>(high),
+                  static_cast<unsigned long long>(low));
+    return result;
+  }
+  uint64_t low;
+  uint64_t high;
+};
+
+// The SplitMix64 finalizer, which mixes all bits of value into all bits of
+// the result.
+uint64_t MixBits(uint64_t value) {
+  value ^= value >> 30;
+  value *= 0xbf58476d1ce4e5b9;
+  value ^= value >> 27;
+  value *= 0x94d049bb133111eb;
+  return value ^ (value >> 31);
+}
+
+// Returns a 128 bit hash of size bytes at data. Not cryptographic, since
+// cache entries are trusted, but 128 bits make collisions among billions of
+// entries unlikely.
+//
+// The hash of the same bytes differs between platforms of different
+// endianness.
+Hash128 HashBytes(const void* data, size_t size, Hash128 seed = {0, 0}) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  // Two independent lanes, so that the multiplications of both overlap.
+  uint64_t low = seed.low ^ MixBits(size);
+  uint64_t high = seed.high ^ MixBits(size ^ 0x9e3779b97f4a7c15);
+  const auto add_word = [&](uint64_t word) {
+    low = MixBits(low ^ word);
+    high = MixBits(high + word + 0x9e3779b97f4a7c15);
+  };
+  for (; size >= sizeof(uint64_t);
+       bytes += sizeof(uint64_t), size -= sizeof(uint64_t)) {
+    uint64_t word;
+    std::memcpy(&word, bytes, sizeof(word));
+    add_word(word);
+  }
+  uint64_t word = 0;
+  std::memcpy(&word, bytes, size);
+  add_word(word);
+  return {MixBits(low ^ high), MixBits(high + low)};
+}
+
+// Returns a hash of the parameters of zimtohrli that Analyze depends on, to
+// tell spectrograms analyzed with different parameters apart.
+uint64_t AnalysisHash(const Zimtohrli& zimtohrli) {
+  uint32_t perceptual_sample_rate;
+  std::memcpy(&perceptual_sample_rate, &zimtohrli.perceptual_sample_rate,
+              sizeof(perceptual_sample_rate));
+  const uint64_t parameters[] = {
+      kNumRotators,
+      static_cast<uint64_t>(zimtohrli.samples_per_perceptual_block),
+      perceptual_sample_rate,
+      zimtohrli.SegmentSteps(),
+      zimtohrli.SegmentSteps() == 0 ? 0 : zimtohrli.SegmentOverlapSteps(),
+  };
+  return HashBytes(parameters, sizeof(parameters)).low;
+}
+
+// The encodings of the values in a spectrogram file.
+enum class SpectrogramEncoding : uint32_t {
+  // IEEE 754 single precision, mapped into memory without copying.
+  kFloat32 = 0,
+  // IEEE 754 half precision, half the size, widened to float32 on load. The
+  // relative rounding error is below 2^-11, i.e. below 0.05 for values of up
+  // to 100 dB.
+  kFloat16 = 1,
+  // bfloat16, half the size, widened to float32 on load. The relative
+  // rounding error is below 2^-9, i.e. below 0.2 for values of up to 100 dB.
+  kBFloat16 = 2,
+};
+
+// The header of a spectrogram file, kSpectrogramFileAlignment bytes long and
+// followed by the num_steps * num_dims values in encoding, row by row.
+//
+// The fields are in the byte order of the writing platform, which the magic
+// number tells apart.
+struct SpectrogramFileHeader {
+  uint32_t magic;
+  uint32_t version;
+  SpectrogramEncoding encoding;
+  uint32_t reserved;
+  // The AnalysisHash, or any other hash of the configuration, of the
+  // spectrogram.
+  uint64_t config_hash;
+  uint64_t num_steps;
+  uint64_t num_dims;
+  uint64_t padding[3];
+};
+
+// "ZSPC" in little endian byte order.
+constexpr uint32_t kSpectrogramFileMagic = 0x4350535a;
+// Changes whenever the layout, or the analysis of unchanged parameters,
+// changes, to invalidate old files.
+constexpr uint32_t kSpectrogramFileVersion = 1;
+// The size of SpectrogramFileHeader, so that the values of mapped files are
+// aligned for the SIMD kernels.
+constexpr size_t kSpectrogramFileAlignment = 64;
+static_assert(sizeof(SpectrogramFileHeader) == kSpectrogramFileAlignment);
+
+// Returns the size in bytes of one value in encoding.
+size_t EncodedValueSize(SpectrogramEncoding encoding) {
+  return encoding == SpectrogramEncoding::kFloat32 ? sizeof(float)
+                                                   : sizeof(uint16_t);
+}
+
+// Writes spectrogram to path in the spectrogram file format, first to a
+// temporary file in the same directory which then replaces path, so that
+// concurrent readers and writers of path never see a partial file.
+//
+// Returns false if the file couldn't be written.
+bool WriteSpectrogramFile(const std::string& path,
+                          const Spectrogram& spectrogram, uint64_t config_hash,
+                          SpectrogramEncoding encoding) {
+  SpectrogramFileHeader header = {};
+  header.magic = kSpectrogramFileMagic;
+  header.version = kSpectrogramFileVersion;
+  header.encoding = encoding;
+  header.config_hash = config_hash;
+  header.num_steps = spectrogram.num_steps;
+  header.num_dims = spectrogram.num_dims;
+  // Unique among the threads and processes writing concurrently.
+  const std::string temporary_path =
+      path + "." +
+#if defined(_WIN32)
+      std::to_string(_getpid()) +
+#else
+      std::to_string(getpid()) +
+#endif
+      "." + std::to_string(std::hash<std::thread::id>()(
+                std::this_thread::get_id())) +
+      ".tmp";
+  {
+    std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (encoding != SpectrogramEncoding::kFloat32) {
+      std::vector<uint16_t> row(spectrogram.num_dims);
+      for (size_t step = 0; step < spectrogram.num_steps; ++step) {
+        for (size_t dim = 0; dim < spectrogram.num_dims; ++dim) {
+          row[dim] = encoding == SpectrogramEncoding::kBFloat16
+                         ? simd::FloatToBFloat16(spectrogram[step][dim])
+                         : simd::FloatToHalf(spectrogram[step][dim]);
+        }
+        file.write(reinterpret_cast<const char*>(row.data()),
+                   row.size() * sizeof(uint16_t));
+      }
+    } else {
+      file.write(reinterpret_cast<const char*>(spectrogram.values.get()),
+                 spectrogram.size() * sizeof(float));
+    }
+    if (!file.good()) {
+      file.close();
+      std::remove(temporary_path.c_str());
+      return false;
+    }
+  }
+  std::error_code error;
+  std::filesystem::rename(temporary_path, path, error);
+  if (error) {
+    std::remove(temporary_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+// Returns the spectrogram in the spectrogram file at path, or std::nullopt if
+// there is none, or if it is malformed or has another config_hash.
+//
+// float32 files are memory mapped copy-on-write straight into the values of
+// the result, which keeps the mapping alive, so that only the pages that are
+// touched are read. float16 and bfloat16 files are widened into a new
+// spectrogram.
+std::optional<Spectrogram> ReadSpectrogramFile(const std::string& path,
+                                               uint64_t config_hash) {
+  std::error_code error;
+  const uintmax_t file_size = std::filesystem::file_size(path, error);
+  if (error || file_size < sizeof(SpectrogramFileHeader)) {
+    return std::nullopt;
+  }
+  SpectrogramFileHeader header;
+  std::ifstream file(path, std::ios::binary);
+  if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+      header.magic != kSpectrogramFileMagic ||
+      header.version != kSpectrogramFileVersion ||
+      header.config_hash != config_hash || header.num_steps == 0 ||
+      header.num_dims == 0 ||
+      (header.encoding != SpectrogramEncoding::kFloat32 &&
+       header.encoding != SpectrogramEncoding::kFloat16 &&
+       header.encoding != SpectrogramEncoding::kBFloat16)) {
+    return std::nullopt;
+  }
+  const size_t num_values = header.num_steps * header.num_dims;
+  if (num_values / header.num_steps != header.num_dims ||
+      file_size - sizeof(header) !=
+          num_values * EncodedValueSize(header.encoding)) {
+    return std::nullopt;
+  }
+  if (header.encoding != SpectrogramEncoding::kFloat32) {
+    std::vector<uint16_t> encoded(num_values);
+    if (!file.read(reinterpret_cast<char*>(encoded.data()),
+                   num_values * sizeof(uint16_t))) {
+      return std::nullopt;
+    }
+    Spectrogram result(header.num_steps, header.num_dims);
+    for (size_t index = 0; index < num_values; ++index) {
+      result.values[index] =
+          header.encoding == SpectrogramEncoding::kBFloat16
+              ? simd::BFloat16ToFloat(encoded[index])
+              : simd::HalfToFloat(encoded[index]);
+    }
+    return result;
+  }
+#if defined(_WIN32)
+  Spectrogram result(header.num_steps, header.num_dims);
+  if (!file.read(reinterpret_cast<char*>(result.values.get()),
+                 num_values * sizeof(float))) {
+    return std::nullopt;
+  }
+  return result;
+#else
+  const int descriptor = open(path.c_str(), O_RDONLY);
+  if (descriptor < 0) {
+    return std::nullopt;
+  }
+  // Writes, e.g. Spectrogram::rescale, go to private copies of the pages.
+  void* mapping = mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                       descriptor, 0);
+  close(descriptor);
+  if (mapping == MAP_FAILED) {
+    return std::nullopt;
+  }
+  // The file may have been replaced since its header was read.
+  if (std::memcmp(mapping, &header, sizeof(header)) != 0) {
+    munmap(mapping, file_size);
+    return std::nullopt;
+  }
+  std::shared_ptr<const void> owner(
+      mapping, [file_size](const void* mapping) {
+        munmap(const_cast<void*>(mapping), file_size);
+      });
+  return Spectrogram(
+      header.num_steps, header.num_dims,
+      reinterpret_cast<float*>(static_cast<char*>(mapping) + sizeof(header)),
+      std::move(owner));
+#endif
+}
+
+// A content addressed directory of spectrogram files, e.g. of a library of
+// reference signals that is compared against again and again.
+//
+// Entries are named by a Hash128 key of the analyzed signal and the
+// configuration (see Key), in 256 subdirectories named by their first two hex
+// digits. Load and Store are thread-safe, also across processes sharing the
+// directory, and treat unusable entries as missing, so that a damaged cache
+// only costs time.
+class SpectrogramCache {
+ public:
+  explicit SpectrogramCache(
+      std::string directory,
+      SpectrogramEncoding encoding = SpectrogramEncoding::kFloat32)
+      : directory_(std::move(directory)), encoding_(encoding) {}
+
+  // Returns the key of the spectrogram of signal at sample_rate, analyzed
+  // with the configuration config_hash, e.g. an AnalysisHash combined with
+  // how the signal is resampled.
+  static Hash128 Key(Span<const float> signal, float sample_rate,
+                     uint64_t config_hash) {
+    uint32_t sample_rate_bits;
+    std::memcpy(&sample_rate_bits, &sample_rate, sizeof(sample_rate_bits));
+    const uint64_t seed[] = {sample_rate_bits, config_hash};
+    return HashBytes(signal.data, signal.size * sizeof(float),
+                     HashBytes(seed, sizeof(seed)));
+  }
+
+  // Returns the path of the entry of key.
+  std::string Path(const Hash128& key) const {
+    const std::string name = key.Hex();
+    return (std::filesystem::path(directory_) / name.substr(0, 2) /
+            (name + ".zspec"))
+        .string();
+  }
+
+  // Returns the spectrogram stored for key, or std::nullopt if there is no
+  // usable entry for key and config_hash.
+  std::optional<Spectrogram> Load(const Hash128& key,
+                                  uint64_t config_hash) const {
+    std::optional<Spectrogram> result =
+        ReadSpectrogramFile(Path(key), config_hash);
+    (result.has_value() ? num_hits_ : num_misses_)
+        .fetch_add(1, std::memory_order_relaxed);
+    return result;
+  }
+
+  // Stores spectrogram as the entry of key, replacing any previous one.
+  // Returns false if it couldn't be written.
+  bool Store(const Hash128& key, const Spectrogram& spectrogram,
+             uint64_t config_hash) const {
+    const std::string path = Path(key);
+    std::error_code error;
+    std::filesystem::create_directories(
+        std::filesystem::path(path).parent_path(), error);
+    if (error) {
+      return false;
+    }
+    return WriteSpectrogramFile(path, spectrogram, config_hash, encoding_);
+  }
+
+  const std::string& directory() const { return directory_; }
+  SpectrogramEncoding encoding() const { return encoding_; }
+  // The number of Load calls that found an entry.
+  size_t num_hits() const { return num_hits_.load(); }
+  // The number of Load calls that found none.
+  size_t num_misses() const { return num_misses_.load(); }
+
+ private:
+  std::string directory_;
+  SpectrogramEncoding encoding_;
+  mutable std::atomic<size_t> num_hits_{0};
+  mutable std::atomic<size_t> num_misses_{0};
+};
+
+}  // namespace
+
+}  // namespace zimtohrli
+
+#endif  // CPP_ZIMT_SPECTROGRAM_CACHE_H_
@@ -0,0 +1,239 @@
+// Copyright 2025 The Zimtohrli Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CPP_ZIMT_THREAD_POOL_H_
+#define CPP_ZIMT_THREAD_POOL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace zimtohrli {
+
+// A fixed-size pool of worker threads with one task deque per worker.
+//
+// Submitted tasks are distributed round-robin over the worker deques. Workers
+// pop tasks from the front of their own deque and, when it runs dry, steal
+// from the back of the other deques. This keeps all cores busy even when task
+// costs vary a lot, e.g. when comparing clips of very different durations.
+//
+// Threads waiting in ParallelFor help executing queued tasks, so ParallelFor
+// can safely be called from inside a task running on the same pool.
+class ThreadPool {
+ public:
+  // Creates a pool with num_threads workers, or one worker per hardware
+  // thread if num_threads is 0.
+  explicit ThreadPool(size_t num_threads = 0) {
+    if (num_threads == 0) {
+      num_threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+    queues_.reserve(num_threads);
+    for (size_t index = 0; index < num_threads; ++index) {
+      queues_.push_back(std::make_unique<Queue>());
+    }
+    workers_.reserve(num_threads);
+    for (size_t index = 0; index < num_threads; ++index) {
+      workers_.emplace_back([this, index] { WorkerLoop(index); });
+    }
+  }
+
+  // Waits for all queued tasks to finish before joining the workers.
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(wake_mutex_);
+      stopping_ = true;
+    }
+    wake_cv_.notify_all();
+    for (std::thread& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  size_t num_threads() const { return workers_.size(); }
+
+  // Returns the pool with num_threads workers (one per hardware thread if
+  // num_threads is 0) shared by all callers asking for that many, which is
+  // created on first use. Several threads can run ParallelFor on it at once.
+  //
+  // The pools are never destroyed, so that no worker is joined while static
+  // objects are destroyed.
+  static ThreadPool& Shared(size_t num_threads) {
+    if (num_threads == 0) {
+      num_threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+    static std::mutex* const mutex = new std::mutex();
+    static auto* const pools = new std::map<size_t, ThreadPool*>();
+    std::lock_guard<std::mutex> lock(*mutex);
+    ThreadPool*& pool = (*pools)[num_threads];
+    if (pool == nullptr) {
+      pool = new ThreadPool(num_threads);
+    }
+    return *pool;
+  }
+
+  // Queues a task for execution by one of the workers.
+  //
+  // Tasks must not throw, use ParallelFor to propagate errors.
+  void Submit(std::function<void()> task) {
+    const size_t index =
+        next_queue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+    {
+      std::lock_guard<std::mutex> lock(wake_mutex_);
+      ++pending_;
+    }
+    {
+      std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+      queues_[index]->tasks.push_back(std::move(task));
+    }
+    wake_cv_.notify_one();
+  }
+
+  // Calls f(index) for every index in [0, num_items) using the pool, and
+  // blocks until all calls are done.
+  //
+  // The items are grouped into chunks small enough to be balanced by work
+  // stealing. If any call throws, the remaining chunks are skipped and the
+  // first exception is rethrown.
+  template <typename F>
+  void ParallelFor(size_t num_items, const F& f) {
+    if (num_items == 0) {
+      return;
+    }
+    const size_t chunk_size =
+        std::max<size_t>(1, num_items / (queues_.size() * kChunksPerThread));
+    const size_t num_chunks = (num_items + chunk_size - 1) / chunk_size;
+    struct State {
+      std::atomic<size_t> remaining;
+      std::atomic<bool> failed{false};
+      std::exception_ptr error;
+      std::mutex mutex;
+      std::condition_variable done_cv;
+    };
+    auto state = std::make_shared<State>();
+    state->remaining = num_chunks;
+    for (size_t chunk = 0; chunk < num_chunks; ++chunk) {
+      Submit([state, &f, chunk, chunk_size, num_items] {
+        if (!state->failed.load(std::memory_order_relaxed)) {
+          try {
+            const size_t end = std::min(num_items, (chunk + 1) * chunk_size);
+            for (size_t index = chunk * chunk_size; index < end; ++index) {
+              f(index);
+            }
+          } catch (...) {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (!state->failed.exchange(true)) {
+              state->error = std::current_exception();
+            }
+          }
+        }
+        if (state->remaining.fetch_sub(1) == 1) {
+          std::lock_guard<std::mutex> lock(state->mutex);
+          state->done_cv.notify_all();
+        }
+      });
+    }
+    // Help with the queued work instead of idling, which also avoids
+    // deadlocks when ParallelFor is called from a worker.
+    std::function<void()> task;
+    while (state->remaining.load() > 0) {
+      if (PopOrSteal(0, task)) {
+        task();
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(state->mutex);
+      state->done_cv.wait_for(lock, std::chrono::milliseconds(1), [&] {
+        return state->remaining.load() == 0;
+      });
+    }
+    if (state->error) {
+      std::rethrow_exception(state->error);
+    }
+  }
+
+ private:
+  // Number of chunks per worker that ParallelFor aims for.
+  static constexpr size_t kChunksPerThread = 16;
+
+  struct Queue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  // Pops a task from the front of queue `index`, or steals one from the back
+  // of another queue. Returns false if all queues are empty.
+  bool PopOrSteal(size_t index, std::function<void()>& task) {
+    for (size_t offset = 0; offset < queues_.size(); ++offset) {
+      Queue& queue = *queues_[(index + offset) % queues_.size()];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (queue.tasks.empty()) {
+        continue;
+      }
+      if (offset == 0) {
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+      } else {
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+      }
+      pending_.fetch_sub(1);
+      return true;
+    }
+    return false;
+  }
+
+  void WorkerLoop(size_t index) {
+    std::function<void()> task;
+    while (true) {
+      if (PopOrSteal(index, task)) {
+        task();
+        task = nullptr;
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(wake_mutex_);
+      wake_cv_.wait(lock, [this] { return stopping_ || pending_.load() > 0; });
+      if (stopping_ && pending_.load() == 0) {
+        return;
+      }
+    }
+  }
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> workers_;
+  std::atomic<size_t> next_queue_{0};
+  // Number of tasks queued but not yet popped. Incremented before the task is
+  // pushed, and only while holding wake_mutex_, so that sleeping workers never
+  // miss a wake up.
+  std::atomic<size_t> pending_{0};
+  std::mutex wake_mutex_;
+  std::condition_variable wake_cv_;
+  bool stopping_ = false;
+};
+
+}  // namespace zimtohrli
+
+#endif  // CPP_ZIMT_THREAD_POOL_H_
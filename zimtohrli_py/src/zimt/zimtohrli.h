@@ -16,17 +16,28 @@
 #define CPP_ZIMT_ZIMTOHRLI_H_
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cstdlib>
 #include <cstdint>
 #include <cstring>
+#include <deque>
 #include <memory>
 #include <iostream>
 #include <limits>
+#include <map>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
+#include "zimt/cancellation.h"
+#include "zimt/profile.h"
+#include "zimt/simd.h"
+#include "zimt/thread_pool.h"
+
 namespace zimtohrli {
 
 // Lightweight non-owning view of a contiguous array.
@@ -115,15 +126,6 @@ struct Resonator {
   }
 };
 
-// Computes dot product of two 32-element float arrays.
-// Optimized for SIMD vectorization with -ffast-math.
-inline float Dot32(const float* a, const float* b) {
-  // -ffast-math is helpful here, and clang can simdify this.
-  float sum = 0;
-  for (int i = 0; i < 32; ++i) sum += a[i] * b[i];
-  return sum;
-}
-
 // Returns the center frequency in Hz for filter bank channel i.
 // The 128 channels are spaced to match human auditory perception,
 // with finer resolution at lower frequencies.
@@ -157,6 +159,62 @@ double CalculateBandwidthInHz(int i) {
   return std::sqrt(Freq(i + 1) * Freq(i)) - std::sqrt(Freq(i - 1) * Freq(i));
 }
 
+// The coefficients of a Rotators filterbank for output steps of downsample
+// input samples, which only depend on downsample.
+//
+// The tables are computed once per downsample and shared read-only by all
+// Rotators, see Get.
+struct RotatorTables {
+  explicit RotatorTables(int downsample) : downsample_window(downsample) {
+    static const float kHzToRad = 2.0f * M_PI / kSampleRate;
+    static const double kWindow = 0.9996028710680265;
+    static const double kBandwidthMagic = 0.7328516996032982;
+    // A big value for normalization. Ideally 1.0, but this works better.
+    static const double kScale = 929900594411.23657;
+    const float gainer = sqrt(kScale / downsample);
+    for (int i = 0; i < kNumRotators; ++i) {
+      float bandwidth = CalculateBandwidthInHz(i);  // bandwidth per bucket.
+      window[i] = std::pow(kWindow, bandwidth * kBandwidthMagic);
+      float windowM1 = 1.0f - window[i];
+      const float f = Freq(i) * kHzToRad;
+      gain[i] = gainer * (windowM1 * windowM1 * windowM1) * Freq(i) / bandwidth;
+      rot[0][i] = float(std::cos(f));
+      rot[1][i] = float(-std::sin(f));
+    }
+    for (int i = 0; i < downsample; ++i) {
+      downsample_window[i] =
+          1.0 / (1.0 + exp(7.9446 * ((2.0 / downsample) * (i + 0.5) - 1)));
+    }
+  }
+
+  // Returns the tables for downsample, computing them on first use.
+  //
+  // Thread-safe. The tables of the default samples_per_perceptual_block are
+  // returned without locking, and all tables live until the program exits.
+  static const RotatorTables& Get(int downsample) {
+    static const RotatorTables* const kDefault =
+        new RotatorTables(kDefaultDownsample);
+    if (downsample == kDefaultDownsample) {
+      return *kDefault;
+    }
+    static std::mutex* const mutex = new std::mutex;
+    static auto* const tables = new std::map<int, RotatorTables>;
+    std::lock_guard<std::mutex> lock(*mutex);
+    return tables->try_emplace(downsample, downsample).first->second;
+  }
+
+  // The downsample of the default Zimtohrli::samples_per_perceptual_block.
+  static constexpr int kDefaultDownsample = int(kSampleRate / 84.0f);
+
+  // Real and imag of the rotation speed of each rotator.
+  float rot[2][kNumRotators];
+  float window[kNumRotators];
+  float gain[kNumRotators];
+  // The weights of the samples of a step in the current output row, the rest
+  // goes to the next.
+  std::vector<float> downsample_window;
+};
+
 // Core signal processing engine using rotating phasors (Goertzel-like algorithm)
 // for efficient frequency analysis. Implements the Tabuli filterbank.
 class Rotators {
@@ -169,12 +227,13 @@ class Rotators {
   // [2..3] is for real and imag of 2nd leaking accumulation
   // [4..5] is for real and imag of 3rd leaking accumulation
   float accu[6][kNumRotators] = {{0}};
-  float window[kNumRotators];
-  float gain[kNumRotators];
+  // The coefficients for the downsample passed to Init.
+  const RotatorTables* tables = nullptr;
 
   // Renormalizes the rotating phasors to prevent numerical drift.
   // Called periodically during signal processing.
   void OccasionallyRenormalize() {
+    const float* gain = tables->gain;
     for (int i = 0; i < kNumRotators; ++i) {
       float norm =
           gain[i] / sqrt(rot[2][i] * rot[2][i] + rot[3][i] * rot[3][i]);
@@ -182,25 +241,50 @@ class Rotators {
       rot[3][i] *= norm;
     }
   }
-  // Updates all rotators and accumulators with a new signal sample.
-  // Applies windowing, rotates phasors, and accumulates energy.
-  void IncrementAll(float signal) {
-    for (int i = 0; i < kNumRotators; i++) {  // clang simdifies this.
-      const float w = window[i];
-      for (int k = 0; k < 6; ++k) accu[k][i] *= w;
-      accu[2][i] += accu[0][i];  // For an unknown reason this
-      accu[3][i] += accu[1][i];  // update order works best.
-      accu[4][i] += accu[2][i];  // i.e., 2, 3, 4, 5, and finally 0, 1.
-      accu[5][i] += accu[3][i];
-      accu[0][i] += rot[2][i] * signal;
-      accu[1][i] += rot[3][i] * signal;
-      const float a = rot[2][i], b = rot[3][i];
-      rot[2][i] = rot[0][i] * a - rot[1][i] * b;
-      rot[3][i] = rot[0][i] * b + rot[1][i] * a;
+
+ public:
+  // The number of taps of the prefilters, i.e. the number of input samples
+  // each filtered sample depends on.
+  static constexpr size_t kKernelSize = 32;
+
+  // Resets the filterbank for output steps of downsample input samples.
+  void Init(int downsample) {
+    tables = &RotatorTables::Get(downsample);
+    std::memcpy(rot[0], tables->rot, sizeof(tables->rot));
+    std::memcpy(rot[2], tables->gain, sizeof(tables->gain));
+    std::fill(rot[3], rot[3] + kNumRotators, 0.0f);
+    std::fill(accu[0], accu[0] + 6 * kNumRotators, 0.0f);
+    resonator = Resonator();
+    reso_filtered.resize(downsample);
+    signal.resize(downsample);
+  }
+
+  // Filters the first step_size samples of an output step, and adds their
+  // energies to the output rows current and next.
+  //
+  // Reads step_size + kKernelSize - 1 samples of in, and step_size must not
+  // exceed the downsample passed to Init. next is nullptr if current is the
+  // last output row, which then gets the full energies.
+  void AddStep(const float* in, size_t step_size, float* current,
+               float* next) {
+    const simd::Target target = simd::BestTarget();
+    simd::DualFIR(target, in, step_size, kResoKernel, kLinearKernel,
+                  kKernelSize, reso_filtered.data(), signal.data());
+    for (size_t dix = 0; dix < step_size; ++dix) {
+      signal[dix] += resonator.Update(reso_filtered[dix]);
     }
+    simd::IncrementRotators(target, rot[0], accu[0], tables->window,
+                            kNumRotators, signal.data(), step_size,
+                            tables->downsample_window.data(), current, next);
+  }
+
+  // Converts the completed output row current to loudness, and prepares the
+  // rotators for the next step.
+  void FinishStep(float* current) {
+    LoudnessDb(current);
+    OccasionallyRenormalize();
   }
 
- public:
   // Main signal processing function that converts time-domain audio to a
   // perceptual spectrogram. Applies resonator filtering, frequency analysis
   // via rotating phasors, and downsampling.
@@ -213,82 +297,71 @@ class Rotators {
   void FilterAndDownsample(const float* in, size_t in_size, float* out,
                            size_t out_shape0, size_t out_stride,
                            int downsample) {
-    static const float kHzToRad = 2.0f * M_PI / kSampleRate;
-    static const double kWindow = 0.9996028710680265;
-    static const double kBandwidthMagic = 0.7328516996032982;
-    // A big value for normalization. Ideally 1.0, but this works better.
-    static const double kScale = 929900594411.23657;
-    const float gainer = sqrt(kScale / downsample);
-    for (int i = 0; i < kNumRotators; ++i) {
-      float bandwidth = CalculateBandwidthInHz(i);  // bandwidth per bucket.
-      window[i] = std::pow(kWindow, bandwidth * kBandwidthMagic);
-      float windowM1 = 1.0f - window[i];
-      const float f = Freq(i) * kHzToRad;
-      gain[i] = gainer * (windowM1 * windowM1 * windowM1) * Freq(i) / bandwidth;
-      rot[0][i] = float(std::cos(f));
-      rot[1][i] = float(-std::sin(f));
-      rot[2][i] = gain[i];
-      rot[3][i] = 0.0f;
-    }
+    Init(downsample);
     for (size_t zz = 0; zz < out_shape0; zz++) {
       for (int k = 0; k < kNumRotators; ++k) {
         out[zz * out_stride + k] = 0;
       }
     }
-    std::vector<float> downsample_window(downsample);
-    for (int i = 0; i < downsample; ++i) {
-      downsample_window[i] =
-          1.0 / (1.0 + exp(7.9446 * ((2.0 / downsample) * (i + 0.5) - 1)));
-    }
-    Resonator resonator;
+    // The signal is filtered and the rotators are advanced one output step at
+    // a time, so that the kernels can keep each vector of rotators in
+    // registers for the whole step.
+    const size_t num_samples = in_size > kKernelSize ? in_size - kKernelSize : 0;
     size_t out_ix = 0;
-    constexpr size_t kKernelSize = 32;
-    static const float reso_kernel[kKernelSize] = {
-      -0.0075642284403770708, 0.0041328270786934662, -7.6269851290751061e-06, 0.0061764514689768733,
-      -0.0028376753880472038, -1.1759452250705732e-05, -0.0065499115361845562, -0.0069727090984949783,
-      0.0034584201864033401, 0.003329316161974918, -0.0029971240720728575, 0.0034898641766847685,
-      0.0017717742743446263, -0.0015229487607625498, 0.0039309982613565655, 0.001278227701047937,
-      -0.0116877416785343, -0.00039070521292690666, -0.0015923522740827827, -0.0082269584153230185,
-      -0.0063814620315990021, -0.0008796390298788419, -0.0071855544224704287, 0.0034822736952680863,
-      -0.00041538926556568181, 0.0001753900488857857, -0.0011326124605282573, 0.00095353008231245965,
-      0.0073567454219722467, -0.0016601446765057634, -0.0069136302438569507, 0.010715105623693549,
-    };
-    static const float linear_kernel[kKernelSize] = {
-      -0.30960591444509439, -0.079455203026254709, -0.14108618014504098, 0.070751037303552131,
-      0.14104891038659864, -0.17036477880916376, 0.014288229833457814, 0.27147357420390988,
-      0.17978692186268302, 0.065653189749429991, 0.014169704877201516, 0.18257259370291729,
-      0.0021021318985668257, 0.065359875882277235, -0.015544998395038102, -0.049398120278478827,
-      -0.064034911106614606, -0.57876116795333099, 0.57561220696398696, 0.40135227167310927,
-      -0.33118848897270026, 0.17695279679195522, 1.0491938729586434, -0.58835602045486513,
-      -1.4541325309560014, 0.071462019783188307, 0.72056751090553661, 1.2265425406909325,
-      -0.72083484154250099, 0.84200784192262634, -0.10112736611558046, -0.44049413285605787,
-    };
-    for (size_t in_ix = 0, dix = 0; in_ix + kKernelSize < in_size; ++in_ix) {
-      const float weight = downsample_window[dix];
-      IncrementAll(resonator.Update(Dot32(&in[in_ix], &reso_kernel[0])) +
-                   Dot32(&in[in_ix], &linear_kernel[0]));
-      if (out_ix + 1 < out_shape0) {
-        for (int k = 0; k < kNumRotators; ++k) {
-          float energy = accu[4][k] * accu[4][k] + accu[5][k] * accu[5][k];
-          out[(out_ix + 1) * out_stride + k] += (1.0 - weight) * energy;
-          out[out_ix * out_stride + k] += weight * energy;
-        }
-      } else {
-        for (int k = 0; k < kNumRotators; ++k) {
-          float energy = accu[4][k] * accu[4][k] + accu[5][k] * accu[5][k];
-          out[out_ix * out_stride + k] += energy;
-        }
-      }
-      if (++dix == downsample || in_ix + kKernelSize + 1 == in_size) {
-        LoudnessDb(&out[out_stride * out_ix]);
-        if (++out_ix >= out_shape0) {
-          break;
-        }
-        dix = 0;
-        OccasionallyRenormalize();
-      }
+    for (size_t in_ix = 0; in_ix < num_samples && out_ix < out_shape0;
+         ++out_ix) {
+      const size_t step_size =
+          std::min<size_t>(downsample, num_samples - in_ix);
+      AddStep(&in[in_ix], step_size, &out[out_ix * out_stride],
+              out_ix + 1 < out_shape0 ? &out[(out_ix + 1) * out_stride]
+                                      : nullptr);
+      FinishStep(&out[out_ix * out_stride]);
+      in_ix += step_size;
     }
   }
+
+ private:
+  static constexpr float kResoKernel[kKernelSize] = {
+    -0.0075642284403770708, 0.0041328270786934662, -7.6269851290751061e-06, 0.0061764514689768733,
+    -0.0028376753880472038, -1.1759452250705732e-05, -0.0065499115361845562, -0.0069727090984949783,
+    0.0034584201864033401, 0.003329316161974918, -0.0029971240720728575, 0.0034898641766847685,
+    0.0017717742743446263, -0.0015229487607625498, 0.0039309982613565655, 0.001278227701047937,
+    -0.0116877416785343, -0.00039070521292690666, -0.0015923522740827827, -0.0082269584153230185,
+    -0.0063814620315990021, -0.0008796390298788419, -0.0071855544224704287, 0.0034822736952680863,
+    -0.00041538926556568181, 0.0001753900488857857, -0.0011326124605282573, 0.00095353008231245965,
+    0.0073567454219722467, -0.0016601446765057634, -0.0069136302438569507, 0.010715105623693549,
+  };
+  static constexpr float kLinearKernel[kKernelSize] = {
+    -0.30960591444509439, -0.079455203026254709, -0.14108618014504098, 0.070751037303552131,
+    0.14104891038659864, -0.17036477880916376, 0.014288229833457814, 0.27147357420390988,
+    0.17978692186268302, 0.065653189749429991, 0.014169704877201516, 0.18257259370291729,
+    0.0021021318985668257, 0.065359875882277235, -0.015544998395038102, -0.049398120278478827,
+    -0.064034911106614606, -0.57876116795333099, 0.57561220696398696, 0.40135227167310927,
+    -0.33118848897270026, 0.17695279679195522, 1.0491938729586434, -0.58835602045486513,
+    -1.4541325309560014, 0.071462019783188307, 0.72056751090553661, 1.2265425406909325,
+    -0.72083484154250099, 0.84200784192262634, -0.10112736611558046, -0.44049413285605787,
+  };
+
+  Resonator resonator;
+  // The prefiltered samples of the current step.
+  std::vector<float> reso_filtered;
+  std::vector<float> signal;
+};
+
+// Frees the values of a Spectrogram: with delete[] if the spectrogram owns
+// them, or by releasing owner if they belong to another object, e.g. a memory
+// mapped file.
+struct SpectrogramValuesDeleter {
+  SpectrogramValuesDeleter() = default;
+  SpectrogramValuesDeleter(std::default_delete<float[]>) {}
+  explicit SpectrogramValuesDeleter(std::shared_ptr<const void> owner)
+      : owner(std::move(owner)) {}
+  void operator()(float* values) const {
+    if (owner == nullptr) {
+      delete[] values;
+    }
+  }
+  std::shared_ptr<const void> owner;
 };
 
 // A simple buffer of float samples describing a spectrogram with a given number
@@ -308,22 +381,41 @@ struct Spectrogram {
   Spectrogram(size_t num_steps)
       : num_steps(num_steps),
         num_dims(kNumRotators),
-        values(std::make_unique<float[]>(num_steps * kNumRotators)) {}
+        capacity(num_steps * kNumRotators),
+        values(Allocate(num_steps * kNumRotators)) {}
   Spectrogram(size_t num_steps, size_t num_dims)
       : num_steps(num_steps),
         num_dims(num_dims),
-        values(std::make_unique<float[]>(num_steps * num_dims)) {}
+        capacity(num_steps * num_dims),
+        values(Allocate(num_steps * num_dims)) {}
   Spectrogram(size_t num_steps, size_t num_dims,
               std::unique_ptr<float[]> values)
-      : num_steps(num_steps), num_dims(num_dims), values(std::move(values)) {}
+      : num_steps(num_steps),
+        num_dims(num_dims),
+        capacity(num_steps * num_dims),
+        values(std::move(values)) {}
   Spectrogram(size_t num_steps, size_t num_dims, std::vector<float> data)
       : num_steps(num_steps),
         num_dims(num_dims),
-        values(std::make_unique<float[]>(data.size())) {
-    std::memcpy(values.get(), data.data(), data.size() * sizeof(float));
+        capacity(data.size()),
+        values(Allocate(data.size())) {
+    // data.data() may be null if data is empty, which memcpy doesn't allow.
+    if (!data.empty()) {
+      std::memcpy(values.get(), data.data(), data.size() * sizeof(float));
+    }
   }
   Spectrogram(size_t num_steps, size_t num_dims, float* data)
-      : num_steps(num_steps), num_dims(num_dims), values(data) {}
+      : num_steps(num_steps),
+        num_dims(num_dims),
+        capacity(num_steps * num_dims),
+        values(data) {}
+  // Borrows the values at data, which owner keeps alive.
+  Spectrogram(size_t num_steps, size_t num_dims, float* data,
+              std::shared_ptr<const void> owner)
+      : num_steps(num_steps),
+        num_dims(num_dims),
+        capacity(num_steps * num_dims),
+        values(data, SpectrogramValuesDeleter(std::move(owner))) {}
   Spectrogram& operator=(Spectrogram&& other) = default;
   Span<const float> operator[](size_t n) const {
     return Span<const float>(values.get() + n * num_dims, num_dims);
@@ -350,9 +442,27 @@ struct Spectrogram {
     }
   }
   size_t size() const { return num_steps * num_dims; }
+  // Sets the number of steps, and only reallocates values if they don't fit
+  // in capacity. The values are left undefined.
+  void Resize(size_t num_steps) {
+    if (num_steps * num_dims > capacity) {
+      capacity = num_steps * num_dims;
+      values = Allocate(capacity);
+    }
+    this->num_steps = num_steps;
+  }
+  // Allocates size values, counted in the Profile::Current() allocation
+  // counters.
+  static std::unique_ptr<float[]> Allocate(size_t size) {
+    CountProfile(Counter::kSpectrogramAllocations, 1);
+    CountProfile(Counter::kSpectrogramAllocatedBytes, size * sizeof(float));
+    return std::make_unique<float[]>(size);
+  }
   size_t num_steps;
   size_t num_dims;
-  std::unique_ptr<float[]> values;
+  // The number of floats values has room for.
+  size_t capacity;
+  std::unique_ptr<float[], SpectrogramValuesDeleter> values;
 };
 
 // Computes windowed mean values over a 2D spectrogram using efficient
@@ -451,90 +561,192 @@ Spectrogram WindowMean(size_t num_steps, size_t num_channels,
   return tmp_a;
 }
 
-// Returns a slightly nonstandard version of the NSIM neural structural
-// similarity metric between arrays a and b.
+// Computes the same windowed means as WindowMean, one step at a time.
 //
-// step_window and channel_window are the number of time steps and channels
-// in the array over which to window the mean, standard deviance, and
-// covariance measures in NSIM.
+// Only the prefix sums of the last step_window steps are kept, so memory is
+// O(step_window * num_channels) instead of O(num_steps * num_channels). The
+// sums are computed with the same float operations in the same order as
+// WindowMean, so the results are bit-identical.
 //
-// time_pairs is the dynamic time warp computed between spectrograms a and
-// b, i.e. pairs of time step indices where a and b are considered to match
-// each other in time.
+// Sum is the type of the prefix sums. The prefix sums grow with the number of
+// steps, so float loses precision on long inputs. Sum = double keeps them
+// accurate for streams of any practical length, at the cost of no longer
+// being bit-identical to WindowMean.
+template <typename Sum = float>
+class SlidingWindowMean {
+ public:
+  SlidingWindowMean(size_t num_channels, size_t step_window,
+                    size_t channel_window) {
+    Reset(num_channels, step_window, channel_window);
+  }
+
+  // Starts over with no steps added, reusing the memory of the buffers.
+  void Reset(size_t num_channels, size_t step_window, size_t channel_window) {
+    num_channels_ = num_channels;
+    step_window_ = step_window;
+    channel_window_ = channel_window;
+    reciprocal_ = 1.0 / (step_window * channel_window);
+    num_steps_ = 0;
+    prefix_sums_.assign((step_window + 1) * num_channels, 0);
+    channel_prefix_sums_.assign(num_channels, 0);
+  }
+
+  // Adds the num_channels values of the next step, and writes the windowed
+  // means ending at that step to result.
+  void Add(const float* values, float* result) {
+    Sum* prefix_sums = PrefixSums(num_steps_);
+    if (num_steps_ == 0) {
+      std::copy(values, values + num_channels_, prefix_sums);
+    } else {
+      const Sum* prev_prefix_sums = PrefixSums(num_steps_ - 1);
+      for (size_t channel_index = 0; channel_index < num_channels_;
+           ++channel_index) {
+        prefix_sums[channel_index] =
+            values[channel_index] + prev_prefix_sums[channel_index];
+      }
+    }
+    // Windowed sums across the step axis, and their prefix sums across the
+    // channel axis.
+    const Sum* window_start_sums =
+        num_steps_ >= step_window_ ? PrefixSums(num_steps_ - step_window_)
+                                   : nullptr;
+    for (size_t channel_index = 0; channel_index < num_channels_;
+         ++channel_index) {
+      const Sum window_sum =
+          window_start_sums == nullptr
+              ? prefix_sums[channel_index]
+              : prefix_sums[channel_index] - window_start_sums[channel_index];
+      channel_prefix_sums_[channel_index] =
+          channel_index == 0
+              ? window_sum
+              : channel_prefix_sums_[channel_index - 1] + window_sum;
+    }
+    // Windowed sums across both axes, divided to make them mean values.
+    for (size_t channel_index = 0; channel_index < num_channels_;
+         ++channel_index) {
+      const Sum window_sum =
+          channel_index < channel_window_
+              ? channel_prefix_sums_[channel_index]
+              : channel_prefix_sums_[channel_index] -
+                    channel_prefix_sums_[channel_index - channel_window_];
+      result[channel_index] = window_sum * reciprocal_;
+    }
+    ++num_steps_;
+  }
+
+ private:
+  // Returns the prefix sums of step_index across the step axis, stored in a
+  // ring buffer of step_window + 1 rows.
+  Sum* PrefixSums(size_t step_index) {
+    return prefix_sums_.data() +
+           (step_index % (step_window_ + 1)) * num_channels_;
+  }
+
+  size_t num_channels_;
+  size_t step_window_;
+  size_t channel_window_;
+  float reciprocal_;
+  size_t num_steps_ = 0;
+  std::vector<Sum> prefix_sums_;
+  std::vector<Sum> channel_prefix_sums_;
+};
+
+// The running state of the NSIM between two spectrograms, which adds one
+// pair of matching time steps at a time. See NSIM for the metric.
 //
-// See https://doi.org/10.1016/j.specom.2011.09.004 for details.
-float NSIM(const Spectrogram& a, const Spectrogram& b,
-           const std::vector<std::pair<size_t, size_t>>& time_pairs,
-           size_t step_window, size_t channel_window) {
-  assert_eq(a.num_dims, b.num_dims);
-  const size_t num_channels = a.num_dims;
-  const size_t num_steps = time_pairs.size();
-
-  const Spectrogram mean_a =
-      WindowMean(num_steps, num_channels, step_window, channel_window,
-                 [&](size_t step_index, size_t channel_index) {
-                   return a[time_pairs[step_index].first][channel_index];
-                 });
-  const Spectrogram mean_b =
-      WindowMean(num_steps, num_channels, step_window, channel_window,
-                 [&](size_t step_index, size_t channel_index) {
-                   return b[time_pairs[step_index].second][channel_index];
-                 });
-  // NB: This computes (value - mean) using the mean computed for the window
-  // at the same position as the value, so that each value gets a different mean
-  // subtracted.
-  const Spectrogram var_a = WindowMean(
-      num_steps, num_channels, step_window, channel_window,
-      [&](size_t step_index, size_t channel_index) {
-        const float delta = a[time_pairs[step_index].first][channel_index] -
-                            mean_a[step_index][channel_index];
-        return delta * delta;
-      });
-  const Spectrogram var_b = WindowMean(
-      num_steps, num_channels, step_window, channel_window,
-      [&](size_t step_index, size_t channel_index) {
-        const float delta = b[time_pairs[step_index].second][channel_index] -
-                            mean_b[step_index][channel_index];
-        return delta * delta;
-      });
-  const Spectrogram cov = WindowMean(
-      num_steps, num_channels, step_window, channel_window,
-      [&](size_t step_index, size_t channel_index) {
-        const float delta_a = a[time_pairs[step_index].first][channel_index] -
-                              mean_a[step_index][channel_index];
-        const float delta_b = b[time_pairs[step_index].second][channel_index] -
-                              mean_b[step_index][channel_index];
-        return delta_a * delta_b;
-      });
+// Sum is the type of the prefix sums of the windowed statistics, see
+// SlidingWindowMean.
+template <typename Sum = float>
+class NSIMState {
+ public:
+  NSIMState(size_t num_channels, size_t step_window, size_t channel_window,
+            bool fast_math = false)
+      : num_channels_(num_channels),
+        fast_math_(fast_math),
+        target_(simd::BestTarget()),
+        mean_a_window_(num_channels, step_window, channel_window),
+        mean_b_window_(num_channels, step_window, channel_window),
+        var_a_window_(num_channels, step_window, channel_window),
+        var_b_window_(num_channels, step_window, channel_window),
+        cov_window_(num_channels, step_window, channel_window),
+        rows_(10 * num_channels) {}
 
-  // nsim-inspired ad hoc aggregation
-  // main changes:
-  // The aggregation tries to be more L1 than L2
-  // Clamping of structure value
-  // Adding a small amount of a-b L1 diff
-  //
-  // These changes were measured to be small improvements on a multi-corpus
-  // test.
-  static const float C1 = 28.341082593304403;
-  static const float C3 = 1.6705576583956854;
-  static const float C4 = 5.5778917823818053e-05;
-  static const float C5 = 2.5568733818058373e-07;
-  static const float C6 = 3.510912492638396e-08;
-  static const float C7 = 2.4720299934548813e-07;
-  static const float C8 = 0.54045365472095119;
-  static const float P0 = 0.84013864788155035;
-  static const float P1 = 1.7336006370531516;
-  static const float P2 = 0.19488365206961764;
-
-  float nsim_sum = 0.0;
-  for (size_t step_index = 0; step_index < num_steps; ++step_index) {
-    for (size_t channel_index = 0; channel_index < num_channels;
+  // Creates a state for channels of kNumRotators values, to be Reset before
+  // use.
+  NSIMState() : NSIMState(kNumRotators, 1, 1) {}
+
+  // Starts over with no pairs added, reusing the memory of the buffers.
+  void Reset(size_t num_channels, size_t step_window, size_t channel_window,
+             bool fast_math = false) {
+    num_channels_ = num_channels;
+    fast_math_ = fast_math;
+    for (SlidingWindowMean<Sum>* window :
+         {&mean_a_window_, &mean_b_window_, &var_a_window_, &var_b_window_,
+          &cov_window_}) {
+      window->Reset(num_channels, step_window, channel_window);
+    }
+    rows_.resize(10 * num_channels);
+    num_steps_ = 0;
+    nsim_sum_ = 0.0;
+    fast_nsim_sum_ = 0.0;
+  }
+
+  // Adds the next pair of steps, where dims_a and dims_b are num_channels
+  // values each that are multiplied with scale_a and scale_b. Returns the sum
+  // of the scores of the pair over all channels, and writes the score of each
+  // channel to channel_scores if it's not null.
+  double Add(const float* dims_a, const float* dims_b, float scale_a = 1.0f,
+             float scale_b = 1.0f, float* channel_scores = nullptr) {
+    float* value_a = rows_.data();
+    float* value_b = value_a + num_channels_;
+    float* mean_a = value_b + num_channels_;
+    float* mean_b = mean_a + num_channels_;
+    float* delta_a_squared = mean_b + num_channels_;
+    float* delta_b_squared = delta_a_squared + num_channels_;
+    float* delta_product = delta_b_squared + num_channels_;
+    float* var_a = delta_product + num_channels_;
+    float* var_b = var_a + num_channels_;
+    float* cov = var_b + num_channels_;
+
+    ++num_steps_;
+    for (size_t channel_index = 0; channel_index < num_channels_;
+         ++channel_index) {
+      value_a[channel_index] = dims_a[channel_index] * scale_a;
+      value_b[channel_index] = dims_b[channel_index] * scale_b;
+    }
+    mean_a_window_.Add(value_a, mean_a);
+    mean_b_window_.Add(value_b, mean_b);
+    // NB: This computes (value - mean) using the mean computed for the window
+    // at the same position as the value, so that each value gets a different
+    // mean subtracted.
+    for (size_t channel_index = 0; channel_index < num_channels_;
          ++channel_index) {
-      const float mean_a_vec = mean_a[step_index][channel_index];
-      const float mean_b_vec = mean_b[step_index][channel_index];
-      const float std_a_vec = std::sqrt(var_a[step_index][channel_index]);
-      const float std_b_vec = std::sqrt(var_b[step_index][channel_index]);
-      const float cov_vec = cov[step_index][channel_index];
+      const float delta_a = value_a[channel_index] - mean_a[channel_index];
+      const float delta_b = value_b[channel_index] - mean_b[channel_index];
+      delta_a_squared[channel_index] = delta_a * delta_a;
+      delta_b_squared[channel_index] = delta_b * delta_b;
+      delta_product[channel_index] = delta_a * delta_b;
+    }
+    var_a_window_.Add(delta_a_squared, var_a);
+    var_b_window_.Add(delta_b_squared, var_b);
+    cov_window_.Add(delta_product, cov);
+
+    if (fast_math_) {
+      const double step_sum =
+          simd::NSIMScoreSum(target_, kParams, mean_a, mean_b, var_a, var_b,
+                             cov, value_a, value_b, num_channels_,
+                             channel_scores);
+      fast_nsim_sum_ += step_sum;
+      return step_sum;
+    }
+    double step_sum = 0.0;
+    for (size_t channel_index = 0; channel_index < num_channels_;
+         ++channel_index) {
+      const float mean_a_vec = mean_a[channel_index];
+      const float mean_b_vec = mean_b[channel_index];
+      const float std_a_vec = std::sqrt(var_a[channel_index]);
+      const float std_b_vec = std::sqrt(var_b[channel_index]);
+      const float cov_vec = cov[channel_index];
       const float intensity =
 	pow((2 * std::sqrt(mean_a_vec * mean_b_vec) + C1) /
 	    (std::abs(mean_a_vec) + std::abs(mean_b_vec) + C1), P0);
@@ -544,106 +756,1008 @@ float NSIM(const Spectrogram& a, const Spectrogram& b,
       const float structure =
 	std::pow(std::pow(structure_clamped + C4, P1) + C5, P2) + C6;
       const float nsim = intensity * structure;
-      const float aval = a[time_pairs[step_index].first][channel_index];
-      const float bval = b[time_pairs[step_index].second][channel_index];
+      const float aval = value_a[channel_index];
+      const float bval = value_b[channel_index];
       const float diff = aval - bval;
       const float sqrdiff = C7 * std::abs(diff);
       const float nsim2 = nsim + sqrdiff;
-      nsim_sum += nsim2;
+      nsim_sum_ += nsim2;
+      step_sum += nsim2;
+      if (channel_scores != nullptr) {
+        channel_scores[channel_index] = nsim2;
+      }
     }
+    return step_sum;
   }
-  return std::clamp<float>(
-      nsim_sum / static_cast<float>(num_steps * num_channels), 0.0, 1.0);
-}
 
-// A simple buffer of double cost values describing the time warp costs between
-// two spectrograms.
-struct CostMatrix {
-  double get(size_t step_a, size_t step_b) const {
-    return values[step_a * steps_b + step_b];
+  // Returns the NSIM of all pairs added so far.
+  float Score() const {
+    const float nsim_sum = fast_math_ ? fast_nsim_sum_ : nsim_sum_;
+    return std::clamp<float>(
+        nsim_sum / static_cast<float>(num_steps_ * num_channels_), 0.0, 1.0);
   }
-  void set(size_t step_a, size_t step_b, double value) {
-    values[step_a * steps_b + step_b] = value;
+
+  // The number of pairs added so far.
+  size_t num_steps() const { return num_steps_; }
+
+ private:
+  // nsim-inspired ad hoc aggregation
+  // main changes:
+  // The aggregation tries to be more L1 than L2
+  // Clamping of structure value
+  // Adding a small amount of a-b L1 diff
+  //
+  // These changes were measured to be small improvements on a multi-corpus
+  // test.
+  static constexpr float C1 = 28.341082593304403;
+  static constexpr float C3 = 1.6705576583956854;
+  static constexpr float C4 = 5.5778917823818053e-05;
+  static constexpr float C5 = 2.5568733818058373e-07;
+  static constexpr float C6 = 3.510912492638396e-08;
+  static constexpr float C7 = 2.4720299934548813e-07;
+  static constexpr float C8 = 0.54045365472095119;
+  static constexpr float P0 = 0.84013864788155035;
+  static constexpr float P1 = 1.7336006370531516;
+  static constexpr float P2 = 0.19488365206961764;
+  static constexpr simd::NSIMParams kParams = {C1, C3, C4, C5, C6, C7,
+                                               C8, P0, P1, P2};
+
+  size_t num_channels_;
+  bool fast_math_;
+  simd::Target target_;
+  SlidingWindowMean<Sum> mean_a_window_;
+  SlidingWindowMean<Sum> mean_b_window_;
+  SlidingWindowMean<Sum> var_a_window_;
+  SlidingWindowMean<Sum> var_b_window_;
+  SlidingWindowMean<Sum> cov_window_;
+  // One step of each statistic.
+  std::vector<float> rows_;
+  size_t num_steps_ = 0;
+  float nsim_sum_ = 0.0;
+  double fast_nsim_sum_ = 0.0;
+};
+
+// Returns a slightly nonstandard version of the NSIM neural structural
+// similarity metric between arrays a and b.
+//
+// step_window and channel_window are the number of time steps and channels
+// in the array over which to window the mean, standard deviance, and
+// covariance measures in NSIM.
+//
+// time_pairs is the dynamic time warp computed between spectrograms a and
+// b, i.e. pairs of time step indices where a and b are considered to match
+// each other in time.
+//
+// scale_a and scale_b are multiplied with the values of a and b, which
+// allows comparing rescaled spectrograms without modifying them.
+//
+// All windowed statistics are computed in a single pass over time_pairs with
+// NSIMState, so memory doesn't grow with the number of steps.
+//
+// fast_math computes the scores with simd::NSIMScoreSum, which approximates
+// the powers and isn't bit-identical, and sums them in double. The scores
+// have a relative error below 1e-5, but the result is typically closer to an
+// exact evaluation than the float sum of the reference path, whose rounding
+// error grows with the number of steps (to about 1e-3 for a minute of audio).
+//
+// scores, if not null, is set to the time_pairs.size() * num_dims scores that
+// the result is the clamped mean of, in row-major order, i.e. where each
+// aligned pair of steps and each channel contributes to it.
+//
+// See https://doi.org/10.1016/j.specom.2011.09.004 for details.
+//
+// state holds the buffers of the statistics, and is reset before use, which
+// lets repeated calls reuse its memory.
+float NSIM(const Spectrogram& a, const Spectrogram& b,
+           const std::vector<std::pair<size_t, size_t>>& time_pairs,
+           size_t step_window, size_t channel_window, float scale_a,
+           float scale_b, bool fast_math, std::vector<float>* scores,
+           NSIMState<>& state) {
+  assert_eq(a.num_dims, b.num_dims);
+  CheckCancellation();
+  const StageTimer timer(Stage::kNSIM);
+  CountProfile(Counter::kNSIMCells, time_pairs.size() * a.num_dims);
+  state.Reset(a.num_dims, step_window, channel_window, fast_math);
+  if (scores != nullptr) {
+    scores->resize(time_pairs.size() * a.num_dims);
   }
-  CostMatrix(size_t steps_a, size_t steps_b)
-      : steps_a(steps_a),
-        steps_b(steps_b),
-        values(std::vector<double>(steps_a * steps_b,
-                                   std::numeric_limits<double>::max())) {
-    set(0, 0, 0);
+  for (size_t pair_index = 0; pair_index < time_pairs.size(); ++pair_index) {
+    const auto& [step_a, step_b] = time_pairs[pair_index];
+    state.Add(a[step_a].data, b[step_b].data, scale_a, scale_b,
+              scores == nullptr ? nullptr
+                                : scores->data() + pair_index * a.num_dims);
+  }
+  return state.Score();
+}
+
+// Computes NSIM(a, b, time_pairs, ...) with a new NSIMState.
+float NSIM(const Spectrogram& a, const Spectrogram& b,
+           const std::vector<std::pair<size_t, size_t>>& time_pairs,
+           size_t step_window, size_t channel_window, float scale_a = 1.0f,
+           float scale_b = 1.0f, bool fast_math = false,
+           std::vector<float>* scores = nullptr) {
+  NSIMState<> state(a.num_dims, step_window, channel_window, fast_math);
+  return NSIM(a, b, time_pairs, step_window, channel_window, scale_a, scale_b,
+              fast_math, scores, state);
+}
+
+// Describes which cells of the steps_a * steps_b time warp cost matrix DTW
+// considers: all of them, or only those within a Sakoe-Chiba band around the
+// diagonal from (0, 0) to (steps_a - 1, steps_b - 1).
+//
+// The radius is widened to at least the slope of the diagonal, which keeps
+// every cell in the band reachable from (0, 0) and every cell of the forward
+// path connected to the next row.
+//
+// Alternatively, the band is given as the window of steps_b of each row, see
+// MultiresolutionDTW.
+struct DTWBand {
+  // band_radius 0 means all cells.
+  DTWBand(size_t steps_a, size_t steps_b, size_t band_radius)
+      : steps_b(steps_b),
+        slope(steps_a > 1 ? static_cast<double>(steps_b - 1) / (steps_a - 1)
+                          : 0),
+        radius(band_radius == 0
+                   ? std::max(steps_a, steps_b)
+                   : std::max({band_radius, size_t{1},
+                               static_cast<size_t>(std::ceil(slope))})) {}
+  // windows[step_a] is the [begin, end) of the band in row step_a. The first
+  // window must start at 0, the begins and ends must not decrease, and each
+  // window must begin no later than the previous one ends, and no later
+  // than 1 for row 1, which keeps the band connected like the radius does.
+  DTWBand(size_t steps_b, std::vector<std::pair<size_t, size_t>> windows)
+      : steps_b(steps_b), slope(0), radius(0), windows(std::move(windows)) {}
+  // The first step_b of the band in row step_a.
+  size_t begin(size_t step_a) const {
+    if (!windows.empty()) {
+      return windows[step_a].first;
+    }
+    const size_t floor_center = static_cast<size_t>(std::floor(step_a * slope));
+    return floor_center > radius ? floor_center - radius : 0;
+  }
+  // One past the last step_b of the band in row step_a.
+  size_t end(size_t step_a) const {
+    if (!windows.empty()) {
+      return std::min(steps_b, windows[step_a].second);
+    }
+    const size_t ceil_center = static_cast<size_t>(std::ceil(step_a * slope));
+    return std::min(steps_b, ceil_center + radius + 1);
   }
-  size_t steps_a;
   size_t steps_b;
+  double slope;
+  size_t radius;
+  // The windows of the rows, if not empty.
+  std::vector<std::pair<size_t, size_t>> windows;
+};
+
+// A row of double cost values describing the time warp costs between a step
+// of one spectrogram and the steps [begin, begin + values.size()) of another.
+// All other cells of the row have infinite
+// (std::numeric_limits<double>::max()) cost.
+struct CostRow {
+  double get(size_t step_b) const {
+    if (step_b < begin || step_b - begin >= values.size()) {
+      return std::numeric_limits<double>::max();
+    }
+    return values[step_b - begin];
+  }
+  void set(size_t step_b, double value) { values[step_b - begin] = value; }
+  // Makes the row cover [begin, end), with all costs infinite.
+  void Reset(size_t begin, size_t end) {
+    this->begin = begin;
+    values.assign(end - begin, std::numeric_limits<double>::max());
+  }
+  size_t begin = 0;
   std::vector<double> values;
 };
 
+// The power delta_norm raises the squared L2 norm to.
+constexpr float kDeltaNormPower = 0.35491343190704761;
+
+// The weight of the frame distance of a step of the time warp that advances
+// both spectrograms.
+constexpr double kSyncCostMul = 0.97775949394431627;
+
 // Computes the perceptual distance between two spectrogram frames.
 // Uses L2 norm with psychoacoustic weighting (power 0.233).
 // Used by DTW to compute frame-to-frame alignment costs.
-double delta_norm(const Spectrogram& a, const Spectrogram& b, size_t step_a,
-                  size_t step_b) {
-  Span<const float> dims_a = a[step_a];
-  Span<const float> dims_b = b[step_b];
+// scale_a and scale_b are multiplied with the values of dims_a and dims_b.
+double delta_norm(Span<const float> dims_a, Span<const float> dims_b,
+                  float scale_a = 1.0f, float scale_b = 1.0f) {
   assert_eq(dims_a.size, dims_b.size);
   double result = 0;
   for (size_t index = 0; index < dims_a.size; index++) {
-    float delta = dims_a[index] - dims_b[index];
+    float delta = dims_a[index] * scale_a - dims_b[index] * scale_b;
     result += delta * delta;
   }
-  static const float pp = 0.35491343190704761;
-  return std::pow(result, pp);
+  return std::pow(result, kDeltaNormPower);
 }
 
+// Computes delta_norm between a few steps of a spectrogram and many steps of
+// another at once, using simd::SquaredDistances.
+//
+// The second spectrogram is kept in the panel layout of simd::PanelIndex, so
+// that the kernels read it sequentially. Compute is const, so one DeltaNorms
+// can be used from multiple threads with one Block per thread.
+class DeltaNorms {
+ public:
+  // The frame distances of a few steps of a and a range of steps of b.
+  class Block {
+   public:
+    // Returns the distances of step first_step_a + row of a, where
+    // first_step_a is the one passed to Compute, indexed by step of b minus
+    // first_step_b().
+    const double* Row(size_t row) const {
+      return results_.data() + row * stride_;
+    }
+
+    // The step of b of the first distance of each Row, at most the begin_b
+    // passed to Compute.
+    size_t first_step_b() const { return first_step_b_; }
+
+   private:
+    friend class DeltaNorms;
+    std::vector<float> scaled_a_;
+    std::vector<double> results_;
+    size_t first_step_b_ = 0;
+    size_t stride_ = 0;
+  };
+
+  // scale_a and scale_b are multiplied with the values of a and b.
+  // If fast_math is true, simd::FastPowSquaredDistances is used, which is
+  // faster but not bit-identical to delta_norm.
+  // If panel_type isn't kFloat32, the scaled values of b are kept in
+  // panel_type, and simd::HalfPanelsSquaredDistances is used regardless of
+  // fast_math.
+  DeltaNorms(const Spectrogram& b, float scale_a, float scale_b,
+             bool fast_math,
+             simd::PanelType panel_type = simd::PanelType::kFloat32)
+      : target_(simd::BestTarget()) {
+    Reset(b, scale_a, scale_b, fast_math, panel_type);
+  }
+
+  // Creates empty DeltaNorms, to be Reset before use.
+  DeltaNorms() : target_(simd::BestTarget()) {}
+
+  // Replaces b and the scales, reusing the memory of the panels.
+  void Reset(const Spectrogram& b, float scale_a, float scale_b,
+             bool fast_math,
+             simd::PanelType panel_type = simd::PanelType::kFloat32) {
+    num_dims_ = b.num_dims;
+    num_panels_b_ =
+        (b.num_steps + simd::kPanelWidth - 1) / simd::kPanelWidth;
+    scale_a_ = scale_a;
+    fast_math_ = fast_math;
+    panel_type_ = panel_type;
+    const size_t num_values = num_panels_b_ * simd::kPanelWidth * num_dims_;
+    if (panel_type_ == simd::PanelType::kFloat32) {
+      panels_b_.assign(num_values, 0.0f);
+      half_panels_b_.clear();
+    } else {
+      // Zero is all zero bits in both half types.
+      half_panels_b_.assign(num_values, 0);
+      panels_b_.clear();
+    }
+    for (size_t step = 0; step < b.num_steps; ++step) {
+      Span<const float> dims = b[step];
+      for (size_t dim = 0; dim < num_dims_; ++dim) {
+        const size_t index = simd::PanelIndex(step, dim, num_dims_);
+        const float value = dims[dim] * scale_b;
+        switch (panel_type_) {
+          case simd::PanelType::kFloat16:
+            half_panels_b_[index] = simd::FloatToHalf(value);
+            break;
+          case simd::PanelType::kBFloat16:
+            half_panels_b_[index] = simd::FloatToBFloat16(value);
+            break;
+          default:
+            panels_b_[index] = value;
+        }
+      }
+    }
+  }
+
+  // Computes delta_norm(a[first_step_a + row], b[step_b], scale_a, scale_b)
+  // for row in [0, num_steps_a) and step_b in [begin_b, end_b) into block.
+  void Compute(const Spectrogram& a, size_t first_step_a, size_t num_steps_a,
+               size_t begin_b, size_t end_b, Block& block) const {
+    assert_eq(a.num_dims, num_dims_);
+    block.scaled_a_.resize(num_steps_a * num_dims_);
+    for (size_t row = 0; row < num_steps_a; ++row) {
+      Span<const float> dims_a = a[first_step_a + row];
+      for (size_t dim = 0; dim < num_dims_; ++dim) {
+        block.scaled_a_[row * num_dims_ + dim] = dims_a[dim] * scale_a_;
+      }
+    }
+    // The kernels work on whole panels, so a few steps outside [begin_b,
+    // end_b) are computed as well.
+    const size_t first_panel = begin_b / simd::kPanelWidth;
+    const size_t num_panels =
+        (end_b + simd::kPanelWidth - 1) / simd::kPanelWidth - first_panel;
+    block.first_step_b_ = first_panel * simd::kPanelWidth;
+    block.stride_ = num_panels * simd::kPanelWidth;
+    block.results_.resize(num_steps_a * block.stride_);
+    const size_t panels_offset = first_panel * simd::kPanelWidth * num_dims_;
+    if (panel_type_ != simd::PanelType::kFloat32) {
+      simd::HalfPanelsSquaredDistances(
+          target_, block.scaled_a_.data(), num_dims_, num_steps_a,
+          half_panels_b_.data() + panels_offset, panel_type_, num_dims_,
+          num_panels, kDeltaNormPower, block.results_.data(), block.stride_);
+      return;
+    }
+    const float* panels = panels_b_.data() + panels_offset;
+    if (fast_math_) {
+      simd::FastPowSquaredDistances(
+          target_, block.scaled_a_.data(), num_dims_, num_steps_a, panels,
+          num_dims_, num_panels, kDeltaNormPower, block.results_.data(),
+          block.stride_);
+      return;
+    }
+    simd::SquaredDistances(target_, block.scaled_a_.data(), num_dims_,
+                           num_steps_a, panels, num_dims_, num_panels,
+                           block.results_.data(), block.stride_);
+    for (double& result : block.results_) {
+      result = std::pow(result, kDeltaNormPower);
+    }
+  }
+
+ private:
+  size_t num_dims_ = 0;
+  size_t num_panels_b_ = 0;
+  float scale_a_ = 1.0f;
+  bool fast_math_ = false;
+  simd::PanelType panel_type_ = simd::PanelType::kFloat32;
+  simd::Target target_;
+  // The scaled values of b in the layout described by simd::PanelIndex,
+  // padded with zeros to whole panels. Only one of the two is used, depending
+  // on panel_type_.
+  std::vector<float> panels_b_;
+  std::vector<uint16_t> half_panels_b_;
+};
+
+// Fills the time warp cost matrix of DTW row by row, and tracks the cheapest
+// path through it.
+//
+// The cheapest path is tracked greedily forward from (0, 0), and each step of
+// it only looks at the current and the next row of the cost matrix. The path
+// is therefore advanced as soon as a row is complete, and only two rows of
+// costs are kept in memory.
+//
+// band.steps_b is read by every AddRow, so the owner of band may lower it
+// once the length of b is known, as long as no row added so far reaches
+// beyond it.
+class DTWPath {
+ public:
+  explicit DTWPath(const DTWBand& band) { Reset(band); }
+
+  // Creates an empty path, to be Reset before use.
+  DTWPath() = default;
+
+  // Starts a new path through band at (0, 0), reusing the memory of the rows
+  // and the path.
+  void Reset(const DTWBand& band) {
+    band_ = &band;
+    prev_row_.Reset(band.begin(0), band.end(0));
+    prev_row_.set(0, 0);
+    pos_ = {0, 0};
+    path_.clear();
+    path_.push_back(pos_);
+  }
+
+  // Computes row step_a of the cost matrix, where
+  // row_costs[step_b - first_step_b] is the frame distance between step_a and
+  // step_b for all step_b in the band, and advances the path through the
+  // previous row. Rows must be added in order,
+  // starting with row 1.
+  //
+  // Returns false when the path reached the last step of b, after which the
+  // remaining rows don't affect it.
+  bool AddRow(size_t step_a, const double* row_costs, size_t first_step_b) {
+    // Compute cost as cost as weighted sum of feature dimension norms to each
+    // cell.
+    row_.Reset(band_->begin(step_a), band_->end(step_a));
+    const size_t begin_b = std::max<size_t>(1, row_.begin);
+    const size_t end_b = row_.begin + row_.values.size();
+    for (size_t step_b = begin_b; step_b < end_b; ++step_b) {
+      const double cost_at_index = row_costs[step_b - first_step_b];
+      const double sync_cost = prev_row_.get(step_b - 1);
+      const double bwd_cost = prev_row_.get(step_b);
+      const double fwd_cost = row_.get(step_b - 1);
+      const double unsync_cost = std::min(bwd_cost, fwd_cost);
+      const double costmin = std::min(sync_cost + kSyncCostMul * cost_at_index,
+                                      unsync_cost + cost_at_index);
+      row_.set(step_b, costmin);
+    }
+
+    // Track the cheapest path through the previous row, now that the row
+    // after it is known.
+    while (pos_.first + 1 == step_a && pos_.second + 1 < band_->steps_b) {
+      double min_cost = std::numeric_limits<double>::max();
+      const std::pair<size_t, size_t> prev_pos = pos_;
+      for (const auto& [test_pos, cost] :
+           {std::pair{std::pair{prev_pos.first + 1, prev_pos.second + 1},
+                      row_.get(prev_pos.second + 1)},
+            std::pair{std::pair{prev_pos.first + 1, prev_pos.second},
+                      row_.get(prev_pos.second)},
+            std::pair{std::pair{prev_pos.first, prev_pos.second + 1},
+                      prev_row_.get(prev_pos.second + 1)}}) {
+        if (cost < min_cost) {
+          min_cost = cost;
+          pos_ = test_pos;
+        }
+      }
+      path_.push_back(pos_);
+    }
+    if (pos_.second + 1 == band_->steps_b) {
+      return false;
+    }
+    std::swap(prev_row_, row_);
+    return true;
+  }
+
+  std::vector<std::pair<size_t, size_t>>& path() { return path_; }
+
+ private:
+  const DTWBand* band_ = nullptr;
+  CostRow prev_row_;
+  CostRow row_;
+  std::pair<size_t, size_t> pos_ = {0, 0};
+  std::vector<std::pair<size_t, size_t>> path_;
+};
+
+// The memory DTW works in, which can be reused across calls.
+struct DTWBuffers {
+  DTWBand band{0, 0, 0};
+  DeltaNorms delta_norms;
+  DeltaNorms::Block block;
+  DTWPath path;
+};
+
 // Computes the DTW (https://en.wikipedia.org/wiki/Dynamic_time_warping)
 // between two arrays.
-std::vector<std::pair<size_t, size_t>> DTW(const Spectrogram& spec_a,
-                                           const Spectrogram& spec_b) {
+// scale_a and scale_b are multiplied with the values of spec_a and spec_b.
+// band_radius, if not 0, limits the warp to a band of that many steps around
+// the diagonal (see DTWBand), which makes time linear in the length of the
+// spectrograms. The result is the same as the unconstrained DTW as long as
+// the unconstrained path stays within the band.
+// fast_math computes the frame distances with simd::FastPowSquaredDistances,
+// and panel_type, if not kFloat32, keeps spec_b in that type and computes
+// them with simd::HalfPanelsSquaredDistances, see DeltaNorms.
+// pool, if not null, is used to compute the frame distances of upcoming rows
+// in parallel while the cost matrix is filled. The path is the same as
+// without pool.
+// buffers holds the memory of the computation, and the returned path is
+// buffers.path.path(), which lets repeated calls without pool reuse all
+// memory.
+std::vector<std::pair<size_t, size_t>>& DTW(
+    const Spectrogram& spec_a, const Spectrogram& spec_b, float scale_a,
+    float scale_b, size_t band_radius, bool fast_math, ThreadPool* pool,
+    DTWBuffers& buffers,
+    simd::PanelType panel_type = simd::PanelType::kFloat32);
+
+// Computes the DTW between two arrays like DTW(spec_a, spec_b, scale_a,
+// scale_b, band_radius, ...), but only within band, which must have
+// spec_b.num_steps steps_b and outlive buffers.path.
+std::vector<std::pair<size_t, size_t>>& DTW(
+    const Spectrogram& spec_a, const Spectrogram& spec_b, float scale_a,
+    float scale_b, const DTWBand& band, bool fast_math, ThreadPool* pool,
+    DTWBuffers& buffers,
+    simd::PanelType panel_type = simd::PanelType::kFloat32) {
   // Sanity check that both spectrograms have the same number of feature
   // dimensions.
   assert_eq(spec_a.num_dims, spec_b.num_dims);
-  CostMatrix cost_matrix(spec_a.num_steps, spec_b.num_steps);
-  // Compute cost as cost as weighted sum of feature dimension norms to each
-  // cell.
-  static const double kMul00 = 0.97775949394431627;
-  for (size_t spec_a_index = 1; spec_a_index < spec_a.num_steps;
-       ++spec_a_index) {
-    for (size_t spec_b_index = 1; spec_b_index < spec_b.num_steps;
-         ++spec_b_index) {
-      const double cost_at_index =
-          delta_norm(spec_a, spec_b, spec_a_index, spec_b_index);
-      const double sync_cost =
-          cost_matrix.get(spec_a_index - 1, spec_b_index - 1);
-      const double bwd_cost = cost_matrix.get(spec_a_index - 1, spec_b_index);
-      const double fwd_cost = cost_matrix.get(spec_a_index, spec_b_index - 1);
-      const double unsync_cost = std::min(bwd_cost, fwd_cost);
-      const double costmin = std::min(sync_cost + kMul00 * cost_at_index,
-                                      unsync_cost + cost_at_index);
-      cost_matrix.set(spec_a_index, spec_b_index, costmin);
+  DeltaNorms& delta_norms = buffers.delta_norms;
+  delta_norms.Reset(spec_b, scale_a, scale_b, fast_math, panel_type);
+  DTWPath& path = buffers.path;
+  path.Reset(band);
+  // The frame distances are computed in chunks of simd::kRows rows of spec_a,
+  // where chunk c covers the rows starting at 1 + c * simd::kRows.
+  const size_t num_chunks =
+      (spec_a.num_steps - 1 + simd::kRows - 1) / simd::kRows;
+  auto compute_chunk = [&](size_t chunk, DeltaNorms::Block& block) {
+    const size_t first_row = 1 + chunk * simd::kRows;
+    const size_t end_row = std::min(spec_a.num_steps, first_row + simd::kRows);
+    // The band only moves forward, so the union of the row windows spans
+    // from the begin of the first to the end of the last row.
+    delta_norms.Compute(spec_a, first_row, end_row - first_row,
+                        std::max<size_t>(1, band.begin(first_row)),
+                        band.end(end_row - 1), block);
+  };
+  // The cells of the rows added to path, and the widest of them, for the
+  // Profile::Current() counters.
+  size_t num_cells = 0;
+  size_t max_row_cells = 0;
+  // Adds the rows of chunk to path, returns false when the path is complete.
+  auto add_chunk = [&](size_t chunk, const DeltaNorms::Block& block) {
+    const size_t first_row = 1 + chunk * simd::kRows;
+    const size_t end_row = std::min(spec_a.num_steps, first_row + simd::kRows);
+    for (size_t row = first_row; row < end_row; ++row) {
+      const size_t row_cells = band.end(row) - band.begin(row);
+      num_cells += row_cells;
+      max_row_cells = std::max(max_row_cells, row_cells);
+      if (!path.AddRow(row, block.Row(row - first_row),
+                       block.first_step_b())) {
+        return false;
+      }
+    }
+    return true;
+  };
+  // DTWPath keeps two rows of the cost matrix.
+  auto count_cells = [&] {
+    CountProfile(Counter::kDTWCells, num_cells);
+    CountProfile(Counter::kDTWCostBytes, 2 * max_row_cells * sizeof(double));
+  };
+  if (pool == nullptr) {
+    for (size_t chunk = 0; chunk < num_chunks; ++chunk) {
+      CheckCancellation();
+      compute_chunk(chunk, buffers.block);
+      if (!add_chunk(chunk, buffers.block)) {
+        break;
+      }
     }
+    count_cells();
+    return path.path();
+  }
+  // Rounds of one chunk per thread. While one task adds the chunks of the
+  // previous round to the path, the others compute the chunks of the next.
+  const size_t chunks_per_round = pool->num_threads() + 1;
+  std::vector<DeltaNorms::Block> blocks(2 * chunks_per_round);
+  bool done = false;
+  for (size_t round_begin = 0;
+       !done && round_begin < num_chunks + chunks_per_round;
+       round_begin += chunks_per_round) {
+    CheckCancellation();
+    // Task 0 adds the chunks of the previous round to the path, the other
+    // tasks compute the chunks starting at round_begin.
+    const size_t add_begin =
+        round_begin > 0 ? round_begin - chunks_per_round : 0;
+    const size_t add_end = std::min(round_begin, num_chunks);
+    const size_t num_compute =
+        round_begin < num_chunks
+            ? std::min(chunks_per_round, num_chunks - round_begin)
+            : 0;
+    pool->ParallelFor(1 + num_compute, [&](size_t task) {
+      if (task > 0) {
+        const size_t chunk = round_begin + task - 1;
+        compute_chunk(chunk, blocks[chunk % blocks.size()]);
+        return;
+      }
+      for (size_t chunk = add_begin; chunk < add_end; ++chunk) {
+        if (!add_chunk(chunk, blocks[chunk % blocks.size()])) {
+          done = true;
+          return;
+        }
+      }
+    });
   }
+  count_cells();
+  return path.path();
+}
 
-  // Track the cheapest path through the cost matrix.
+std::vector<std::pair<size_t, size_t>>& DTW(
+    const Spectrogram& spec_a, const Spectrogram& spec_b, float scale_a,
+    float scale_b, size_t band_radius, bool fast_math, ThreadPool* pool,
+    DTWBuffers& buffers, simd::PanelType panel_type) {
+  // The path refers to the band until it's reset, so the band must outlive
+  // this call.
+  buffers.band = DTWBand(spec_a.num_steps, spec_b.num_steps, band_radius);
+  return DTW(spec_a, spec_b, scale_a, scale_b, buffers.band, fast_math, pool,
+             buffers, panel_type);
+}
+
+// Computes DTW(spec_a, spec_b, ...) with new buffers.
+std::vector<std::pair<size_t, size_t>> DTW(
+    const Spectrogram& spec_a, const Spectrogram& spec_b, float scale_a = 1.0f,
+    float scale_b = 1.0f, size_t band_radius = 0, bool fast_math = false,
+    ThreadPool* pool = nullptr,
+    simd::PanelType panel_type = simd::PanelType::kFloat32) {
+  DTWBuffers buffers;
+  return std::move(DTW(spec_a, spec_b, scale_a, scale_b, band_radius,
+                       fast_math, pool, buffers, panel_type));
+}
+
+// Approximates DTW(spec_a, spec_b, ...) for long spectrograms by aligning
+// segments of segment_steps steps of spec_a independently, in parallel on
+// pool if it's not null. Each DTW is limited to its segment, so memory and
+// time no longer grow quadratically with the length even without a band.
+//
+// Each segment is aligned together with overlap_steps steps of spec_a on both
+// sides, with the part of spec_b that the diagonal from (0, 0) to the ends of
+// both spectrograms maps them to. The segment ends of both signals are thus
+// forced to match, and the overlap gives the path room to find back to the
+// actual alignment before the pairs of the segment itself, which are the only
+// ones kept. The result is close to DTW as long as the signals don't drift
+// apart by more than overlap_steps from the diagonal. The paths of adjacent
+// segments are joined so that the steps of spec_b never decrease.
+//
+// band_radius, fast_math and panel_type apply to the DTW of each segment.
+std::vector<std::pair<size_t, size_t>> SegmentedDTW(
+    const Spectrogram& spec_a, const Spectrogram& spec_b, float scale_a,
+    float scale_b, size_t segment_steps, size_t overlap_steps,
+    size_t band_radius = 0, bool fast_math = false,
+    ThreadPool* pool = nullptr,
+    simd::PanelType panel_type = simd::PanelType::kFloat32) {
+  assert_eq(spec_a.num_dims, spec_b.num_dims);
+  if (segment_steps == 0 || spec_a.num_steps <= segment_steps ||
+      spec_b.num_steps == 0) {
+    return DTW(spec_a, spec_b, scale_a, scale_b, band_radius, fast_math,
+               nullptr, panel_type);
+  }
+  // The step of spec_b that the diagonal maps step_a of spec_a to.
+  const auto diagonal = [&](size_t step_a) {
+    return static_cast<size_t>(
+        (static_cast<double>(step_a) * spec_b.num_steps + spec_a.num_steps / 2) /
+        spec_a.num_steps);
+  };
+  const auto rows = [](const Spectrogram& spec, size_t begin, size_t end) {
+    Spectrogram result(end - begin, spec.num_dims);
+    std::memcpy(result.values.get(), spec[begin].data,
+                result.size() * sizeof(float));
+    return result;
+  };
+  const size_t num_segments =
+      (spec_a.num_steps + segment_steps - 1) / segment_steps;
+  std::vector<std::vector<std::pair<size_t, size_t>>> segment_pairs(
+      num_segments);
+  // The segments aligned on pool count in the Profile and stop with the
+  // Cancellation of the caller.
+  Profile* const profile = Profile::Current();
+  Cancellation* const cancellation = Cancellation::Current();
+  const auto align_segment = [&](size_t segment) {
+    const ProfileScope profile_scope(profile);
+    const CancellationScope cancellation_scope(cancellation);
+    const size_t begin = segment * segment_steps;
+    const size_t end = std::min(spec_a.num_steps, begin + segment_steps);
+    const size_t begin_a = begin - std::min(begin, overlap_steps);
+    const size_t end_a = std::min(spec_a.num_steps, end + overlap_steps);
+    const size_t end_b = end_a == spec_a.num_steps
+                             ? spec_b.num_steps
+                             : std::max<size_t>(1, diagonal(end_a));
+    const size_t begin_b = std::min(diagonal(begin_a), end_b - 1);
+    const std::vector<std::pair<size_t, size_t>> pairs =
+        DTW(rows(spec_a, begin_a, end_a), rows(spec_b, begin_b, end_b),
+            scale_a, scale_b, band_radius, fast_math, nullptr, panel_type);
+    for (const auto& [step_a, step_b] : pairs) {
+      if (begin_a + step_a >= begin && begin_a + step_a < end) {
+        segment_pairs[segment].push_back({begin_a + step_a, begin_b + step_b});
+      }
+    }
+  };
+  if (pool == nullptr) {
+    for (size_t segment = 0; segment < num_segments; ++segment) {
+      align_segment(segment);
+    }
+  } else {
+    pool->ParallelFor(num_segments, align_segment);
+  }
   std::vector<std::pair<size_t, size_t>> result;
-  std::pair<size_t, size_t> pos = {0, 0};
-  result.push_back(pos);
-  while (pos.first + 1 < spec_a.num_steps &&
-         pos.second + 1 < spec_b.num_steps) {
-    double min_cost = std::numeric_limits<double>::max();
-    for (const auto& test_pos :
-         {std::pair<size_t, size_t>{pos.first + 1, pos.second + 1},
-          std::pair<size_t, size_t>{pos.first + 1, pos.second},
-          std::pair<size_t, size_t>{pos.first, pos.second + 1}}) {
-      double cost = cost_matrix.get(test_pos.first, test_pos.second);
-      if (cost < min_cost) {
-        min_cost = cost;
-        pos = test_pos;
+  for (const std::vector<std::pair<size_t, size_t>>& pairs : segment_pairs) {
+    for (const auto& [step_a, step_b] : pairs) {
+      result.push_back(
+          {step_a, result.empty() ? step_b
+                                  : std::max(step_b, result.back().second)});
+    }
+  }
+  return result;
+}
+
+// Returns spec with each factor consecutive steps averaged into one step. The
+// last step averages the remaining steps if spec.num_steps isn't a multiple
+// of factor.
+Spectrogram PoolSteps(const Spectrogram& spec, size_t factor) {
+  Spectrogram result((spec.num_steps + factor - 1) / factor, spec.num_dims);
+  for (size_t step = 0; step < result.num_steps; ++step) {
+    const size_t begin = step * factor;
+    const size_t end = std::min(spec.num_steps, begin + factor);
+    Span<float> dims = result[step];
+    for (size_t dim = 0; dim < spec.num_dims; ++dim) {
+      float sum = 0;
+      for (size_t pooled = begin; pooled < end; ++pooled) {
+        sum += spec[pooled][dim];
       }
+      dims[dim] = sum / (end - begin);
     }
-    result.push_back(pos);
   }
   return result;
 }
 
+// Returns the band of the steps_a * steps_b cost matrix around coarse_path,
+// a time warp between spectrograms pooled by factor steps, see PoolSteps.
+//
+// Each pair of coarse_path covers factor * factor cells, and the band covers
+// all cells within radius steps of them along both axes. Rows after the end
+// of coarse_path, which ends once it reaches the last step of b, get the
+// rest of the row after the last covered cell.
+DTWBand ProjectPath(const std::vector<std::pair<size_t, size_t>>& coarse_path,
+                    size_t factor, size_t steps_a, size_t steps_b,
+                    size_t radius) {
+  // The cells that coarse_path covers in each row, as [begin, end).
+  std::vector<std::pair<size_t, size_t>> covered(steps_a, {steps_b, 0});
+  for (const auto& [coarse_a, coarse_b] : coarse_path) {
+    const size_t begin_b = std::min(steps_b, coarse_b * factor);
+    const size_t end_b = std::min(steps_b, (coarse_b + 1) * factor);
+    for (size_t step_a = coarse_a * factor;
+         step_a < std::min(steps_a, (coarse_a + 1) * factor); ++step_a) {
+      covered[step_a].first = std::min(covered[step_a].first, begin_b);
+      covered[step_a].second = std::max(covered[step_a].second, end_b);
+    }
+  }
+  for (size_t step_a = 1; step_a < steps_a; ++step_a) {
+    if (covered[step_a].first >= covered[step_a].second) {
+      covered[step_a] = {covered[step_a - 1].first, steps_b};
+    }
+  }
+  // The windows only move forward, so widening along a takes the begin of
+  // the first and the end of the last row within radius.
+  std::vector<std::pair<size_t, size_t>> windows(steps_a);
+  for (size_t step_a = 0; step_a < steps_a; ++step_a) {
+    const size_t begin = covered[step_a - std::min(step_a, radius)].first;
+    const size_t end =
+        covered[std::min(steps_a - 1, step_a + radius)].second;
+    windows[step_a] = {begin - std::min(begin, radius),
+                       std::min(steps_b, end + radius)};
+  }
+  return DTWBand(steps_b, std::move(windows));
+}
+
+// Returns the cheapest path from (0, 0) to (steps_a - 1, steps_b - 1)
+// through the cells of band of the DTW cost matrix of spec_a and spec_b.
+//
+// Unlike DTW, which tracks the path greedily forward, this remembers the
+// cheapest step into each cell of band and backtracks from the end, which
+// always finds the cheapest path, at the cost of a byte per cell. Cells of
+// the first row and column are reachable along them. band must contain
+// (steps_a - 1, steps_b - 1).
+std::vector<std::pair<size_t, size_t>> BacktrackedDTW(
+    const Spectrogram& spec_a, const Spectrogram& spec_b, float scale_a,
+    float scale_b, const DTWBand& band, bool fast_math = false,
+    simd::PanelType panel_type = simd::PanelType::kFloat32) {
+  assert_eq(spec_a.num_dims, spec_b.num_dims);
+  enum Step : uint8_t { kSync, kStepA, kStepB };
+  const size_t steps_a = spec_a.num_steps;
+  // The steps into the cells of row step_a start at steps[offsets[step_a]].
+  std::vector<size_t> offsets(steps_a + 1, 0);
+  for (size_t step_a = 0; step_a < steps_a; ++step_a) {
+    offsets[step_a + 1] =
+        offsets[step_a] + band.end(step_a) - band.begin(step_a);
+  }
+  std::vector<Step> steps(offsets.back());
+  size_t max_row_cells = 0;
+  for (size_t step_a = 0; step_a < steps_a; ++step_a) {
+    max_row_cells =
+        std::max(max_row_cells, offsets[step_a + 1] - offsets[step_a]);
+  }
+  // The steps of all cells, and two rows of costs.
+  CountProfile(Counter::kDTWCells, steps.size());
+  CountProfile(Counter::kDTWCostBytes,
+               steps.size() * sizeof(Step) +
+                   2 * max_row_cells * sizeof(double));
+  const DeltaNorms delta_norms(spec_b, scale_a, scale_b, fast_math,
+                               panel_type);
+  DeltaNorms::Block block;
+  CostRow prev_row;
+  CostRow row;
+  for (size_t step_a = 0; step_a < steps_a; ++step_a) {
+    if (step_a % simd::kRows == 0) {
+      CheckCancellation();
+      const size_t end_row = std::min(steps_a, step_a + simd::kRows);
+      delta_norms.Compute(spec_a, step_a, end_row - step_a,
+                          band.begin(step_a), band.end(end_row - 1), block);
+    }
+    const double* row_costs = block.Row(step_a % simd::kRows);
+    row.Reset(band.begin(step_a), band.end(step_a));
+    Step* row_steps = steps.data() + offsets[step_a];
+    for (size_t step_b = row.begin; step_b < band.end(step_a); ++step_b) {
+      if (step_a == 0 && step_b == 0) {
+        row.set(0, 0);
+        continue;
+      }
+      const double cost = row_costs[step_b - block.first_step_b()];
+      const double prev_costs[] = {
+          step_b > 0 ? prev_row.get(step_b - 1)
+                     : std::numeric_limits<double>::max(),
+          prev_row.get(step_b),
+          step_b > 0 ? row.get(step_b - 1)
+                     : std::numeric_limits<double>::max(),
+      };
+      double min_cost = std::numeric_limits<double>::max();
+      for (const Step step : {kSync, kStepA, kStepB}) {
+        if (prev_costs[step] == std::numeric_limits<double>::max()) {
+          continue;
+        }
+        const double total =
+            prev_costs[step] + (step == kSync ? kSyncCostMul * cost : cost);
+        if (total < min_cost) {
+          min_cost = total;
+          row_steps[step_b - row.begin] = step;
+        }
+      }
+      row.set(step_b, min_cost);
+    }
+    std::swap(prev_row, row);
+  }
+  std::vector<std::pair<size_t, size_t>> path;
+  std::pair<size_t, size_t> pos = {steps_a - 1, spec_b.num_steps - 1};
+  path.push_back(pos);
+  while (pos.first > 0 || pos.second > 0) {
+    const Step step =
+        steps[offsets[pos.first] + pos.second - band.begin(pos.first)];
+    if (step != kStepB) {
+      --pos.first;
+    }
+    if (step != kStepA) {
+      --pos.second;
+    }
+    path.push_back(pos);
+  }
+  std::reverse(path.begin(), path.end());
+  return path;
+}
+
+// The max number of steps of the shorter spectrogram that MultiresolutionDTW
+// aligns in one piece instead of refining a coarser alignment.
+constexpr size_t kMultiresolutionMinSteps = 64;
+
+// Approximates DTW(spec_a, spec_b, scale_a, scale_b) of long spectrograms in
+// time and memory linear in their length, like FastDTW
+// (https://doi.org/10.3233/IDA-2007-11508).
+//
+// The spectrograms are pooled to half as many steps (see PoolSteps) until the
+// shorter one has at most kMultiresolutionMinSteps steps. These are aligned
+// with BacktrackedDTW, and each finer level only within radius steps of the
+// projection of the coarser alignment (see ProjectPath), with BacktrackedDTW
+// and finally with DTW. Unlike a band around the diagonal, this follows
+// drifts of any size, and the result is close to DTW as long as the
+// alignment is a refinement of the coarser ones.
+//
+// fast_math and panel_type apply to all levels, and pool to the DTW of the
+// last one.
+std::vector<std::pair<size_t, size_t>> MultiresolutionDTW(
+    const Spectrogram& spec_a, const Spectrogram& spec_b, float scale_a,
+    float scale_b, size_t radius, bool fast_math = false,
+    ThreadPool* pool = nullptr,
+    simd::PanelType panel_type = simd::PanelType::kFloat32) {
+  assert_eq(spec_a.num_dims, spec_b.num_dims);
+  if (std::min(spec_a.num_steps, spec_b.num_steps) <=
+      kMultiresolutionMinSteps) {
+    return DTW(spec_a, spec_b, scale_a, scale_b, 0, fast_math, pool,
+               panel_type);
+  }
+  constexpr size_t kFactor = 2;
+  // The pooled spectrograms of each level, from fine to coarse.
+  std::vector<std::pair<Spectrogram, Spectrogram>> levels;
+  levels.emplace_back(PoolSteps(spec_a, kFactor), PoolSteps(spec_b, kFactor));
+  while (std::min(levels.back().first.num_steps,
+                  levels.back().second.num_steps) > kMultiresolutionMinSteps) {
+    levels.emplace_back(PoolSteps(levels.back().first, kFactor),
+                        PoolSteps(levels.back().second, kFactor));
+  }
+  std::vector<std::pair<size_t, size_t>> path;
+  for (size_t level = levels.size(); level-- > 0;) {
+    const auto& [level_a, level_b] = levels[level];
+    path = BacktrackedDTW(
+        level_a, level_b, scale_a, scale_b,
+        path.empty() ? DTWBand(level_a.num_steps, level_b.num_steps, 0)
+                     : ProjectPath(path, kFactor, level_a.num_steps,
+                                   level_b.num_steps, radius),
+        fast_math, panel_type);
+  }
+  DTWBuffers buffers;
+  buffers.band = ProjectPath(path, kFactor, spec_a.num_steps, spec_b.num_steps,
+                             radius);
+  return std::move(DTW(spec_a, spec_b, scale_a, scale_b, buffers.band,
+                       fast_math, pool, buffers, panel_type));
+}
+
+// Where a distance between two spectrograms comes from, see
+// Zimtohrli::DistanceWithMap.
+struct DistanceMap {
+  // The distance, as returned by Zimtohrli::Distance.
+  float distance;
+  // The pairs of time steps of the two spectrograms that the DTW aligned.
+  std::vector<std::pair<size_t, size_t>> time_pairs;
+  // The NSIM score of each channel in each aligned pair of steps,
+  // time_pairs.size() * kNumRotators values in row-major order. distance is
+  // 1 minus their mean clamped to [0, 1], up to the rounding error of the
+  // float sum NSIM computes it with.
+  std::vector<float> scores;
+};
+
+// Counts the time warps of Zimtohrli::TimePairs, which all distances are
+// computed with, across all instances and threads.
+struct DistanceStats {
+  // Returns the counters Zimtohrli updates.
+  static DistanceStats& Global() {
+    static DistanceStats* const stats = new DistanceStats();
+    return *stats;
+  }
+
+  // The number of time warps computed.
+  std::atomic<size_t> num_time_warps{0};
+  // The number of them between spectrograms that are identical after
+  // scaling, which skip the DTW, see Zimtohrli::TimePairs.
+  std::atomic<size_t> num_identical{0};
+};
+
+// The memory of Zimtohrli::Analyze and Zimtohrli::Distance, which can be
+// passed to them to reuse it across calls.
+//
+// Once its buffers have grown to the largest signals, analyzing into its
+// spectrograms and comparing them using a Workspace doesn't allocate, as long
+// as segment_seconds is 0 and dtw_num_threads is 1. A Workspace must not be
+// used by more than one thread at a time, see WorkspacePool.
+struct Workspace {
+  Rotators rotators;
+  DTWBuffers dtw;
+  NSIMState<> nsim;
+  // Spectrograms for the caller to Analyze signals into.
+  Spectrogram spectrogram_a{0};
+  Spectrogram spectrogram_b{0};
+};
+
+// Lends Workspaces to concurrent tasks, e.g. the items of a
+// ThreadPool::ParallelFor, and takes them back for reuse. There are never
+// more Workspaces than tasks that held one at the same time.
+class WorkspacePool {
+ public:
+  // A Workspace that is returned to the pool on destruction.
+  class Lease {
+   public:
+    Lease(Lease&& other) = default;
+    Lease& operator=(Lease&& other) = delete;
+    ~Lease() {
+      if (workspace_ != nullptr) {
+        pool_->Release(std::move(workspace_));
+      }
+    }
+
+    Workspace& operator*() const { return *workspace_; }
+    Workspace* operator->() const { return workspace_.get(); }
+
+   private:
+    friend class WorkspacePool;
+    Lease(WorkspacePool* pool, std::unique_ptr<Workspace> workspace)
+        : pool_(pool), workspace_(std::move(workspace)) {}
+
+    WorkspacePool* pool_;
+    std::unique_ptr<Workspace> workspace_;
+  };
+
+  WorkspacePool() = default;
+  WorkspacePool(const WorkspacePool&) = delete;
+  WorkspacePool& operator=(const WorkspacePool&) = delete;
+
+  // Returns an idle Workspace, or a new one if there is none.
+  Lease Acquire() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!idle_.empty()) {
+        std::unique_ptr<Workspace> workspace = std::move(idle_.back());
+        idle_.pop_back();
+        return Lease(this, std::move(workspace));
+      }
+      ++num_created_;
+    }
+    return Lease(this, std::make_unique<Workspace>());
+  }
+
+  // The number of Workspaces the pool has created.
+  size_t num_created() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return num_created_;
+  }
+
+ private:
+  void Release(std::unique_ptr<Workspace> workspace) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    idle_.push_back(std::move(workspace));
+  }
+
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<Workspace>> idle_;
+  size_t num_created_ = 0;
+};
+
 // Main class for psychoacoustic audio analysis.
 // Converts audio signals to perceptual spectrograms and computes
 // perceptual distance between audio signals using the Zimtohrli metric.
@@ -652,12 +1766,55 @@ struct Zimtohrli {
   // Analyzes an audio signal and fills the provided spectrogram.
   // signal: input audio samples at 48kHz, range [-1, 1]
   // spectrogram: pre-allocated output spectrogram to fill
+  // If SegmentSteps() is not 0, the signal is analyzed in segments, see
+  // segment_seconds.
   void Analyze(Span<const float> signal, Spectrogram& spectrogram) const {
     assert_eq(spectrogram.num_dims, kNumRotators);
-    Rotators rots;
-    rots.FilterAndDownsample(signal.data, signal.size, spectrogram.values.get(),
-                             spectrogram.num_steps, spectrogram.num_dims,
-                             signal.size / spectrogram.num_steps);
+    CheckCancellation();
+    const StageTimer timer(Stage::kAnalyze);
+    CountProfile(Counter::kAnalyzedSamples, signal.size);
+    const size_t downsample = signal.size / spectrogram.num_steps;
+    const size_t segment_steps = SegmentSteps();
+    if (segment_steps == 0 || spectrogram.num_steps <= segment_steps) {
+      Rotators rots;
+      rots.FilterAndDownsample(signal.data, signal.size,
+                               spectrogram.values.get(), spectrogram.num_steps,
+                               spectrogram.num_dims, downsample);
+      return;
+    }
+    // Each segment starts SegmentOverlapSteps() steps early for the
+    // filterbank to settle, and ends a step late so that its last row doesn't
+    // get the energies of the next.
+    const size_t warmup_steps = SegmentOverlapSteps();
+    const size_t num_segments =
+        (spectrogram.num_steps + segment_steps - 1) / segment_steps;
+    Cancellation* const cancellation = Cancellation::Current();
+    const auto analyze_segment = [&](size_t segment) {
+      const CancellationScope cancellation_scope(cancellation);
+      CheckCancellation();
+      const size_t begin = segment * segment_steps;
+      const size_t end = std::min(spectrogram.num_steps, begin + segment_steps);
+      const size_t first = begin - std::min(begin, warmup_steps);
+      const size_t last = std::min(spectrogram.num_steps, end + 1);
+      const size_t in_begin = first * downsample;
+      const size_t in_end =
+          std::min(signal.size, last * downsample + Rotators::kKernelSize);
+      std::vector<float> rows((last - first) * kNumRotators);
+      Rotators rots;
+      rots.FilterAndDownsample(signal.data + in_begin, in_end - in_begin,
+                               rows.data(), last - first, kNumRotators,
+                               downsample);
+      std::memcpy(spectrogram[begin].data, &rows[(begin - first) * kNumRotators],
+                  (end - begin) * kNumRotators * sizeof(float));
+    };
+    ThreadPool* const pool = SegmentThreadPool();
+    if (pool == nullptr) {
+      for (size_t segment = 0; segment < num_segments; ++segment) {
+        analyze_segment(segment);
+      }
+    } else {
+      pool->ParallelFor(num_segments, analyze_segment);
+    }
   }
 
   // Analyzes an audio signal and returns a new spectrogram.
@@ -669,6 +1826,77 @@ struct Zimtohrli {
     return spec;
   }
 
+  // Analyzes an audio signal into spectrogram, e.g. one of the spectrograms
+  // of workspace, after resizing it to SpectrogramSteps(signal.size) steps.
+  // The filterbank of workspace is used unless the signal is analyzed in
+  // segments, so that repeated calls don't allocate.
+  void Analyze(Span<const float> signal, Spectrogram& spectrogram,
+               Workspace& workspace) const {
+    assert_eq(spectrogram.num_dims, kNumRotators);
+    spectrogram.Resize(SpectrogramSteps(signal.size));
+    const size_t segment_steps = SegmentSteps();
+    if (segment_steps != 0 && spectrogram.num_steps > segment_steps) {
+      Analyze(signal, spectrogram);
+      return;
+    }
+    CheckCancellation();
+    const StageTimer timer(Stage::kAnalyze);
+    CountProfile(Counter::kAnalyzedSamples, signal.size);
+    workspace.rotators.FilterAndDownsample(
+        signal.data, signal.size, spectrogram.values.get(),
+        spectrogram.num_steps, spectrogram.num_dims,
+        signal.size / spectrogram.num_steps);
+  }
+
+  // Sets high_gamma_band, and samples_per_perceptual_block and
+  // perceptual_sample_rate from it like their defaults. A band outside
+  // [1, kSampleRate] sets samples_per_perceptual_block to 0, which
+  // CheckParameters reports.
+  void SetHighGammaBand(float band) {
+    high_gamma_band = band;
+    samples_per_perceptual_block =
+        band >= 1 && band <= kSampleRate ? int(kSampleRate / band) : 0;
+    perceptual_sample_rate =
+        samples_per_perceptual_block > 0
+            ? kSampleRate / samples_per_perceptual_block
+            : 0;
+  }
+
+  // Sets perceptual_sample_rate to the rate closest to rate with a whole
+  // number of samples_per_perceptual_block, and high_gamma_band to rate.
+  // Lower rates make fewer, longer time steps, which makes the DTW cheaper
+  // (its cost is quadratic in the steps unless it is banded). A rate outside
+  // [1, kSampleRate] sets samples_per_perceptual_block to 0, which
+  // CheckParameters reports.
+  void SetPerceptualSampleRate(float rate) {
+    high_gamma_band = rate;
+    samples_per_perceptual_block =
+        rate >= 1 && rate <= kSampleRate
+            ? std::max(1, static_cast<int>(std::lround(kSampleRate / rate)))
+            : 0;
+    perceptual_sample_rate =
+        samples_per_perceptual_block > 0
+            ? kSampleRate / samples_per_perceptual_block
+            : 0;
+  }
+
+  // Returns a description of the first invalid perceptual parameter, or null
+  // if the NSIM windows and the step length are valid.
+  const char* CheckParameters() const {
+    if (nsim_step_window < 1) {
+      return "nsim_step_window must be positive";
+    }
+    if (nsim_channel_window < 1 || nsim_channel_window > kNumRotators) {
+      return "nsim_channel_window must be between 1 and 128";
+    }
+    if (samples_per_perceptual_block < 1 || !(perceptual_sample_rate >= 1) ||
+        perceptual_sample_rate > kSampleRate) {
+      return "high_gamma_band and perceptual_sample_rate must be between 1 "
+             "and 48000";
+    }
+    return nullptr;
+  }
+
   // Calculates the number of time steps in the output spectrogram
   // based on the input signal length and perceptual sample rate.
   size_t SpectrogramSteps(size_t num_samples) const {
@@ -676,6 +1904,184 @@ struct Zimtohrli {
                                          perceptual_sample_rate / kSampleRate));
   }
 
+  // Returns the DTW band radius in time steps implied by dtw_band_radius and
+  // dtw_max_drift_seconds, or 0 if the DTW is unconstrained. If both are set
+  // the narrower band is used.
+  size_t DTWBandRadius() const {
+    size_t radius = dtw_band_radius;
+    if (dtw_max_drift_seconds > 0) {
+      const size_t drift_radius = static_cast<size_t>(
+          std::ceil(dtw_max_drift_seconds * perceptual_sample_rate));
+      radius = radius == 0 ? drift_radius : std::min(radius, drift_radius);
+    }
+    return radius;
+  }
+
+  // Returns the shared pool for the DTW as configured by dtw_num_threads
+  // (see ThreadPool::Shared), or null if the DTW runs serially.
+  ThreadPool* DTWThreadPool() const {
+    return SharedThreadPool(dtw_num_threads);
+  }
+
+  // Returns the segment length in time steps implied by segment_seconds, or 0
+  // if signals aren't segmented.
+  size_t SegmentSteps() const {
+    return segment_seconds > 0 ? std::max<size_t>(
+                                     1, std::lround(segment_seconds *
+                                                    perceptual_sample_rate))
+                               : 0;
+  }
+
+  // Returns the segment overlap in time steps implied by
+  // segment_overlap_seconds.
+  size_t SegmentOverlapSteps() const {
+    return static_cast<size_t>(
+        std::ceil(std::max(0.0f, segment_overlap_seconds) *
+                  perceptual_sample_rate));
+  }
+
+  // Returns the shared pool for the segments as configured by
+  // segment_num_threads (see ThreadPool::Shared), or null if they are
+  // processed serially.
+  ThreadPool* SegmentThreadPool() const {
+    return SharedThreadPool(segment_num_threads);
+  }
+
+  // Returns the shared pool that, together with the calling thread, runs
+  // num_threads threads, or one per hardware thread if num_threads is 0, or
+  // null for 1 thread.
+  static ThreadPool* SharedThreadPool(size_t num_threads) {
+    if (num_threads == 0) {
+      num_threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+    if (num_threads == 1) {
+      return nullptr;
+    }
+    // The calling thread takes part in the work.
+    return &ThreadPool::Shared(num_threads - 1);
+  }
+
+  // Returns true if spectrogram_a multiplied with scale_a has the same values
+  // as spectrogram_b multiplied with scale_b. Stops at the first difference,
+  // so it's cheap for spectrograms that differ.
+  static bool IdenticalAfterScaling(const Spectrogram& spectrogram_a,
+                                    float scale_a,
+                                    const Spectrogram& spectrogram_b,
+                                    float scale_b) {
+    if (spectrogram_a.num_steps != spectrogram_b.num_steps ||
+        spectrogram_a.num_dims != spectrogram_b.num_dims) {
+      return false;
+    }
+    const float* values_a = spectrogram_a.values.get();
+    const float* values_b = spectrogram_b.values.get();
+    if (scale_a == scale_b &&
+        (values_a == values_b ||
+         std::memcmp(values_a, values_b,
+                     spectrogram_a.size() * sizeof(float)) == 0)) {
+      return true;
+    }
+    for (size_t index = 0; index < spectrogram_a.size(); ++index) {
+      if (values_a[index] * scale_a != values_b[index] * scale_b) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Sets pairs to the diagonal, the time warp between num_steps steps of
+  // identical spectrograms.
+  static void DiagonalPairs(size_t num_steps,
+                            std::vector<std::pair<size_t, size_t>>& pairs) {
+    pairs.resize(num_steps);
+    for (size_t step = 0; step < num_steps; ++step) {
+      pairs[step] = {step, step};
+    }
+  }
+
+  // Returns the time warp between the spectrograms that Distance uses: DTW,
+  // or MultiresolutionDTW if dtw_multiresolution_radius is not 0, or
+  // SegmentedDTW if SegmentSteps() is not 0.
+  //
+  // If the spectrograms are identical after scaling, every frame distance
+  // on the diagonal is 0 and the DTW would return the diagonal, which is
+  // returned right away instead, counted in DistanceStats::num_identical.
+  std::vector<std::pair<size_t, size_t>> TimePairs(
+      const Spectrogram& spectrogram_a, const Spectrogram& spectrogram_b,
+      float scale_a, float scale_b) const {
+    const StageTimer timer(Stage::kDTW);
+    DistanceStats& stats = DistanceStats::Global();
+    stats.num_time_warps.fetch_add(1, std::memory_order_relaxed);
+    if (IdenticalAfterScaling(spectrogram_a, scale_a, spectrogram_b,
+                              scale_b)) {
+      stats.num_identical.fetch_add(1, std::memory_order_relaxed);
+      std::vector<std::pair<size_t, size_t>> pairs;
+      DiagonalPairs(spectrogram_a.num_steps, pairs);
+      return pairs;
+    }
+    const size_t segment_steps = SegmentSteps();
+    if (segment_steps == 0 || spectrogram_a.num_steps <= segment_steps) {
+      if (dtw_multiresolution_radius != 0) {
+        return MultiresolutionDTW(spectrogram_a, spectrogram_b, scale_a,
+                                  scale_b, dtw_multiresolution_radius,
+                                  fast_math, DTWThreadPool(),
+                                  dtw_panel_type);
+      }
+      return DTW(spectrogram_a, spectrogram_b, scale_a, scale_b,
+                 DTWBandRadius(), fast_math, DTWThreadPool(),
+                 dtw_panel_type);
+    }
+    return SegmentedDTW(spectrogram_a, spectrogram_b, scale_a, scale_b,
+                        segment_steps, SegmentOverlapSteps(), DTWBandRadius(),
+                        fast_math, SegmentThreadPool(), dtw_panel_type);
+  }
+
+  // Returns the same time warp as TimePairs(spectrogram_a, spectrogram_b,
+  // scale_a, scale_b), computed in the DTW buffers of workspace.
+  const std::vector<std::pair<size_t, size_t>>& TimePairs(
+      const Spectrogram& spectrogram_a, const Spectrogram& spectrogram_b,
+      float scale_a, float scale_b, Workspace& workspace) const {
+    std::vector<std::pair<size_t, size_t>>& pairs = workspace.dtw.path.path();
+    const size_t segment_steps = SegmentSteps();
+    if (segment_steps == 0 || spectrogram_a.num_steps <= segment_steps) {
+      const StageTimer timer(Stage::kDTW);
+      DistanceStats& stats = DistanceStats::Global();
+      stats.num_time_warps.fetch_add(1, std::memory_order_relaxed);
+      if (IdenticalAfterScaling(spectrogram_a, scale_a, spectrogram_b,
+                                scale_b)) {
+        stats.num_identical.fetch_add(1, std::memory_order_relaxed);
+        DiagonalPairs(spectrogram_a.num_steps, pairs);
+        return pairs;
+      }
+      if (dtw_multiresolution_radius != 0) {
+        pairs = MultiresolutionDTW(spectrogram_a, spectrogram_b, scale_a,
+                                   scale_b, dtw_multiresolution_radius,
+                                   fast_math, DTWThreadPool(),
+                                   dtw_panel_type);
+        return pairs;
+      }
+      return DTW(spectrogram_a, spectrogram_b, scale_a, scale_b,
+                 DTWBandRadius(), fast_math, DTWThreadPool(),
+                 workspace.dtw, dtw_panel_type);
+    }
+    pairs = TimePairs(spectrogram_a, spectrogram_b, scale_a, scale_b);
+    return pairs;
+  }
+
+  // Returns the factors {scale_a, scale_b} that Distance multiplies the
+  // spectrograms with to match their energy levels, given their max() values.
+  static std::pair<float, float> RescaleFactors(double max_a, double max_b) {
+    if (max_a == max_b) {
+      return {1.0f, 1.0f};
+    }
+    float cora = 0.48234235170721046;
+    float corb = 0.43404193485438936;
+    if (max_a > max_b) {
+      std::swap(cora, corb);
+    }
+    return {static_cast<float>(pow(max_b / max_a, corb)),
+            static_cast<float>(pow(max_a / max_b, cora))};
+  }
+
   // Computes perceptual distance between two spectrograms.
   // Uses DTW for time alignment and NSIM for similarity measurement.
   // Returns: distance in range [0, 1], where 0 = identical, 1 = maximally different
@@ -683,21 +2089,66 @@ struct Zimtohrli {
   float Distance(Spectrogram& spectrogram_a,
                  Spectrogram& spectrogram_b) const {
     assert_eq(spectrogram_a.num_dims, spectrogram_b.num_dims);
-    const double max_a = spectrogram_a.max();
-    const double max_b = spectrogram_b.max();
-    if (max_a != max_b) {
-      float cora = 0.48234235170721046;
-      float corb = 0.43404193485438936;
-      if (max_a > max_b) {
-	std::swap(cora, corb);
-      }
-      spectrogram_b.rescale(pow(max_a / max_b, cora));
-      spectrogram_a.rescale(pow(max_b / max_a, corb));
+    const auto [scale_a, scale_b] =
+        RescaleFactors(spectrogram_a.max(), spectrogram_b.max());
+    if (scale_a != 1.0f || scale_b != 1.0f) {
+      spectrogram_b.rescale(scale_b);
+      spectrogram_a.rescale(scale_a);
     }
-    std::vector<std::pair<size_t, size_t>> time_pairs;
-    time_pairs = DTW(spectrogram_a, spectrogram_b);
+    const std::vector<std::pair<size_t, size_t>> time_pairs =
+        TimePairs(spectrogram_a, spectrogram_b, 1.0f, 1.0f);
+    return 1 - NSIM(spectrogram_a, spectrogram_b, time_pairs, nsim_step_window,
+                    nsim_channel_window, 1.0f, 1.0f, fast_math);
+  }
+
+  // Computes the same distance as Distance(Spectrogram&, Spectrogram&), but
+  // applies the energy rescaling on the fly instead of modifying the
+  // spectrograms.
+  //
+  // max_a and max_b are spectrogram_a.max() and spectrogram_b.max(), which
+  // makes it cheap to compare one reference spectrogram with many others,
+  // also from multiple threads at once.
+  float Distance(const Spectrogram& spectrogram_a, float max_a,
+                 const Spectrogram& spectrogram_b, float max_b) const {
+    assert_eq(spectrogram_a.num_dims, spectrogram_b.num_dims);
+    const auto [scale_a, scale_b] = RescaleFactors(max_a, max_b);
+    const std::vector<std::pair<size_t, size_t>> time_pairs =
+        TimePairs(spectrogram_a, spectrogram_b, scale_a, scale_b);
+    return 1 - NSIM(spectrogram_a, spectrogram_b, time_pairs, nsim_step_window,
+                    nsim_channel_window, scale_a, scale_b, fast_math);
+  }
+
+  // Computes the same distance as Distance(spectrogram_a, max_a,
+  // spectrogram_b, max_b) in the memory of workspace, see Workspace.
+  float Distance(const Spectrogram& spectrogram_a, float max_a,
+                 const Spectrogram& spectrogram_b, float max_b,
+                 Workspace& workspace) const {
+    assert_eq(spectrogram_a.num_dims, spectrogram_b.num_dims);
+    const auto [scale_a, scale_b] = RescaleFactors(max_a, max_b);
+    const std::vector<std::pair<size_t, size_t>>& time_pairs =
+        TimePairs(spectrogram_a, spectrogram_b, scale_a, scale_b, workspace);
     return 1 - NSIM(spectrogram_a, spectrogram_b, time_pairs, nsim_step_window,
-                    nsim_channel_window);
+                    nsim_channel_window, scale_a, scale_b, fast_math, nullptr,
+                    workspace.nsim);
+  }
+
+  // Computes the same distance as Distance(spectrogram_a, max_a,
+  // spectrogram_b, max_b), and also returns the alignment and the scores it
+  // was computed from. This locates the differences in time and frequency in
+  // one pass, at the cost of 4 bytes of memory per score.
+  DistanceMap DistanceWithMap(const Spectrogram& spectrogram_a, float max_a,
+                              const Spectrogram& spectrogram_b,
+                              float max_b) const {
+    assert_eq(spectrogram_a.num_dims, spectrogram_b.num_dims);
+    const auto [scale_a, scale_b] = RescaleFactors(max_a, max_b);
+    DistanceMap result;
+    result.time_pairs =
+        TimePairs(spectrogram_a, spectrogram_b, scale_a, scale_b);
+    result.distance =
+        1 - NSIM(spectrogram_a, spectrogram_b, result.time_pairs,
+                 nsim_step_window, nsim_channel_window, scale_a, scale_b,
+                 fast_math, &result.scores);
+    return result;
   }
 
   // The window in perceptual_sample_rate time steps when compting the NSIM.
@@ -712,6 +2163,439 @@ struct Zimtohrli {
   float perceptual_sample_rate = kSampleRate / samples_per_perceptual_block;
   // The reference dB SPL of a sine signal of amplitude 1.
   float full_scale_sine_db = 78.3;
+  // If not 0, the max number of time steps the DTW may deviate from the
+  // diagonal. Limits DTW time to O(steps * dtw_band_radius), which makes it
+  // possible to compare long recordings.
+  size_t dtw_band_radius = 0;
+  // If greater than 0, the max alignment drift in seconds the DTW may find
+  // between the signals. Converted to a band radius using
+  // perceptual_sample_rate.
+  float dtw_max_drift_seconds = 0;
+  // If true, uses faster approximations that aren't bit-identical to the
+  // reference implementation: float accumulation and simd::FastPow in the DTW
+  // frame distances, and simd::NSIMScoreSum in the NSIM.
+  bool fast_math = false;
+  // The number of threads the DTW of a single Distance call uses, or 0 for
+  // one per hardware thread. The result is the same for any number of
+  // threads. All calls with the same number share the workers of one
+  // ThreadPool::Shared, so this is meant for latency sensitive comparisons of
+  // long signals, not for comparing many signals in parallel.
+  size_t dtw_num_threads = 1;
+  // If not 0, the DTW is computed with MultiresolutionDTW, refining each
+  // coarser alignment within this many time steps. Makes time and memory
+  // linear in the length of the signals while following drifts of any size,
+  // at the cost of a small deviation from the DTW. Takes precedence over
+  // dtw_band_radius and dtw_max_drift_seconds, and doesn't apply to the DTW
+  // of segments.
+  size_t dtw_multiresolution_radius = 0;
+  // If not kFloat32, the DTW keeps the second spectrogram in this type and
+  // computes the frame distances from it with the fast math kernels, see
+  // DeltaNorms. Halves the memory the DTW reads, for screening runs that
+  // accept a small deviation: in BM_CompactDistance, distances stay within
+  // 2e-6 and MOS within 1e-4 (kFloat16) or 3e-4 (kBFloat16) of the exact
+  // ones. NSIM is unaffected.
+  simd::PanelType dtw_panel_type = simd::PanelType::kFloat32;
+  // If greater than 0, long signals are processed in segments of this many
+  // seconds, in parallel on segment_num_threads threads: Analyze analyzes
+  // the segments separately, and Distance aligns them with SegmentedDTW
+  // before scoring the joined alignment with NSIM. This bounds the DTW
+  // memory of long recordings and uses more than one core, but the result
+  // deviates slightly from whole-signal processing.
+  float segment_seconds = 0;
+  // The context in seconds processed with each segment: the filterbank
+  // warm-up before each analyzed segment, and the overlap on both sides of
+  // each aligned segment. Should exceed the alignment drift between the
+  // signals.
+  float segment_overlap_seconds = 2;
+  // The number of threads the segments of a single call are processed on, or
+  // 0 for one per hardware thread. All calls with the same number share the
+  // workers of one ThreadPool::Shared. dtw_num_threads doesn't apply to the
+  // DTW of the segments.
+  size_t segment_num_threads = 1;
+};
+
+// Analyzes a signal incrementally as it arrives, e.g. a live stream, keeping
+// the filterbank state and the prefilter history between calls.
+//
+// Push accepts chunks of any size and returns the spectrogram rows they
+// complete. A row is complete once all samples_per_perceptual_block samples of
+// its step, plus the Rotators::kKernelSize samples the prefilters look ahead,
+// have arrived. Finish returns the remaining rows, so that the stream yields
+// one row per started step, and resets the analyzer for a new stream.
+//
+// If the length of the stream is a multiple of samples_per_perceptual_block,
+// the concatenated rows are bit-identical to Analyze of the whole signal.
+class StreamingAnalyzer {
+ public:
+  explicit StreamingAnalyzer(const Zimtohrli& zimtohrli = Zimtohrli())
+      : downsample_(zimtohrli.samples_per_perceptual_block) {
+    Reset();
+  }
+
+  // Adds the samples to the stream, and returns the rows they complete.
+  Spectrogram Push(Span<const float> samples) {
+    pending_.insert(pending_.end(), samples.data,
+                    samples.data + samples.size);
+    num_samples_ += samples.size;
+    std::vector<float> rows;
+    size_t offset = 0;
+    while (pending_.size() - offset >= downsample_ + Rotators::kKernelSize) {
+      rotators_.AddStep(&pending_[offset], downsample_, current_.data(),
+                        next_.data());
+      EmitRow(rows);
+      offset += downsample_;
+    }
+    pending_.erase(pending_.begin(), pending_.begin() + offset);
+    return RowsToSpectrogram(std::move(rows));
+  }
+
+  // Ends the stream and returns its remaining rows, including the partial
+  // last one, then resets the analyzer.
+  Spectrogram Finish() {
+    const size_t num_steps = (num_samples_ + downsample_ - 1) / downsample_;
+    std::vector<float> rows;
+    while (num_steps_ < num_steps) {
+      const size_t step_size =
+          pending_.size() > Rotators::kKernelSize
+              ? std::min(downsample_, pending_.size() - Rotators::kKernelSize)
+              : 0;
+      rotators_.AddStep(pending_.data(), step_size, current_.data(),
+                        num_steps_ + 1 < num_steps ? next_.data() : nullptr);
+      pending_.erase(pending_.begin(), pending_.begin() + step_size);
+      EmitRow(rows);
+    }
+    Reset();
+    return RowsToSpectrogram(std::move(rows));
+  }
+
+  // Discards the stream analyzed so far.
+  void Reset() {
+    rotators_.Init(downsample_);
+    pending_.clear();
+    current_.assign(kNumRotators, 0.0f);
+    next_.assign(kNumRotators, 0.0f);
+    num_samples_ = 0;
+    num_steps_ = 0;
+  }
+
+  // The number of samples pushed since the last Reset.
+  size_t num_samples() const { return num_samples_; }
+
+  // The number of rows returned since the last Reset.
+  size_t num_steps() const { return num_steps_; }
+
+ private:
+  static Spectrogram RowsToSpectrogram(std::vector<float> rows) {
+    const size_t num_rows = rows.size() / kNumRotators;
+    return Spectrogram(num_rows, kNumRotators, std::move(rows));
+  }
+
+  // Completes the current row, appends it to rows, and moves on to the next.
+  void EmitRow(std::vector<float>& rows) {
+    rotators_.FinishStep(current_.data());
+    rows.insert(rows.end(), current_.begin(), current_.end());
+    current_.swap(next_);
+    std::fill(next_.begin(), next_.end(), 0.0f);
+    ++num_steps_;
+  }
+
+  size_t downsample_;
+  Rotators rotators_;
+  // The samples that haven't been filtered yet, starting with the first
+  // sample of the current step.
+  std::vector<float> pending_;
+  // The current and next output rows, before the loudness conversion.
+  std::vector<float> current_;
+  std::vector<float> next_;
+  size_t num_samples_;
+  size_t num_steps_;
+};
+
+// The distance between two streams over a window of time, see
+// StreamingDistance.
+struct StreamingDistanceReport {
+  // The steps of the first stream that the window covers, [begin_step,
+  // end_step).
+  size_t begin_step;
+  size_t end_step;
+  // 1 - NSIM of the aligned pairs of steps in the window, in [0, 1].
+  float distance;
+};
+
+// Computes the distance between two live streams, e.g. the input and the
+// output of an encoder, while their samples arrive.
+//
+// Both streams are analyzed with StreamingAnalyzer, aligned with the DTW of
+// DTWPath, and each aligned pair of steps is scored with NSIMState as soon
+// as the alignment reaches it. The alignment is restricted to a band of
+// Zimtohrli::DTWBandRadius() steps around the diagonal, or of one second if
+// that is 0. Row i of the first stream is aligned once the second stream has
+// reached row i + radius, so latency and memory are bounded by the band
+// instead of growing with the streams.
+//
+// Each time the alignment passes a multiple of report_steps steps of the
+// first stream, a StreamingDistanceReport over the pairs of its last
+// window_steps steps is returned. distance() is the distance over all pairs
+// so far.
+//
+// The result differs from Distance of the whole signals in three ways:
+// - The lengths aren't known in advance, so the band follows the diagonal of
+//   slope 1. For streams with the same number of steps the alignment is the
+//   same as that of Distance with the same band.
+// - The energy levels of each pair of steps are matched with the max values
+//   of the streams up to those steps instead of the whole signals.
+// - The windowed statistics are summed in double, so that their precision
+//   doesn't degrade over hours of streaming.
+class StreamingDistance {
+ public:
+  StreamingDistance(const Zimtohrli& zimtohrli, size_t report_steps,
+                    size_t window_steps)
+      : report_steps_(std::max<size_t>(1, report_steps)),
+        window_steps_(std::max<size_t>(1, window_steps)),
+        nsim_step_window_(zimtohrli.nsim_step_window),
+        nsim_channel_window_(zimtohrli.nsim_channel_window),
+        fast_math_(zimtohrli.fast_math),
+        analyzer_a_(zimtohrli),
+        analyzer_b_(zimtohrli),
+        band_(kUnknownSteps, kUnknownSteps,
+              zimtohrli.DTWBandRadius() == 0
+                  ? static_cast<size_t>(
+                        std::ceil(zimtohrli.perceptual_sample_rate))
+                  : zimtohrli.DTWBandRadius()),
+        nsim_(kNumRotators, nsim_step_window_, nsim_channel_window_,
+              fast_math_) {
+    Reset();
+  }
+
+  // The DTW path refers to band_.
+  StreamingDistance(const StreamingDistance&) = delete;
+  StreamingDistance& operator=(const StreamingDistance&) = delete;
+
+  // Adds the next chunks of both streams, which may have different sizes
+  // including 0, and returns the reports they complete.
+  std::vector<StreamingDistanceReport> Push(Span<const float> samples_a,
+                                            Span<const float> samples_b) {
+    rows_a_.Append(analyzer_a_.Push(samples_a));
+    rows_b_.Append(analyzer_b_.Push(samples_b));
+    std::vector<StreamingDistanceReport> reports;
+    Align(reports);
+    return reports;
+  }
+
+  // Ends both streams and returns the remaining reports. The last one ends at
+  // the last aligned step, which may be less than report_steps after the
+  // previous report. Reset must be called before pushing new streams.
+  std::vector<StreamingDistanceReport> Finish() {
+    rows_a_.Append(analyzer_a_.Finish());
+    rows_b_.Append(analyzer_b_.Finish());
+    finished_ = true;
+    band_.steps_b = rows_b_.end_step();
+    std::vector<StreamingDistanceReport> reports;
+    if (rows_a_.end_step() == 0 || rows_b_.end_step() == 0) {
+      return reports;
+    }
+    Align(reports);
+    // A first stream of one step has no rows to align.
+    ConsumePairs(reports);
+    if (last_pair_.first + report_steps_ >= report_end_) {
+      AddReport(last_pair_.first + 1, reports);
+    }
+    return reports;
+  }
+
+  // Discards the streams compared so far.
+  void Reset() {
+    analyzer_a_.Reset();
+    analyzer_b_.Reset();
+    rows_a_ = StreamRows();
+    rows_b_ = StreamRows();
+    band_.steps_b = kUnknownSteps;
+    path_.emplace(band_);
+    nsim_ = NSIMState<double>(kNumRotators, nsim_step_window_,
+                              nsim_channel_window_, fast_math_);
+    window_.clear();
+    score_sum_ = 0.0;
+    next_step_a_ = 1;
+    last_pair_ = {0, 0};
+    report_end_ = report_steps_;
+    path_done_ = false;
+    finished_ = false;
+  }
+
+  // The distance over all pairs aligned since the last Reset, or NaN before
+  // the first pair.
+  float distance() const { return Distance(score_sum_, num_pairs()); }
+
+  // The number of pairs of steps aligned since the last Reset.
+  size_t num_pairs() const { return nsim_.num_steps(); }
+
+  // The number of steps analyzed of each stream since the last Reset.
+  size_t num_steps_a() const { return rows_a_.end_step(); }
+  size_t num_steps_b() const { return rows_b_.end_step(); }
+
+  // Whether Finish was called since the last Reset.
+  bool finished() const { return finished_; }
+
+  // The max number of steps the alignment may deviate from the diagonal.
+  size_t band_radius() const { return band_.radius; }
+
+ private:
+  // The steps_b of band_ while the length of the second stream is unknown.
+  static constexpr size_t kUnknownSteps = std::numeric_limits<size_t>::max();
+
+  // The rows of a stream from some step on, with the max absolute value of
+  // all rows up to each of them.
+  class StreamRows {
+   public:
+    void Append(const Spectrogram& rows) {
+      for (size_t step = 0; step < rows.num_steps; ++step) {
+        Span<const float> dims = rows[step];
+        float max = maxima_.empty() ? max_before_ : maxima_.back();
+        for (size_t dim = 0; dim < dims.size; ++dim) {
+          max = std::max(max, std::abs(dims[dim]));
+        }
+        values_.insert(values_.end(), dims.data, dims.data + dims.size);
+        maxima_.push_back(max);
+      }
+    }
+
+    Span<const float> operator[](size_t step) const {
+      return Span<const float>(
+          values_.data() + (step - first_step_) * kNumRotators, kNumRotators);
+    }
+
+    float max(size_t step) const { return maxima_[step - first_step_]; }
+
+    // Discards the rows before step. Rows are only erased once they are at
+    // least as many as those kept, so each row is moved O(1) times.
+    void Discard(size_t step) {
+      const size_t num_rows = step - first_step_;
+      if (num_rows == 0 || num_rows < maxima_.size() - num_rows) {
+        return;
+      }
+      max_before_ = maxima_[num_rows - 1];
+      values_.erase(values_.begin(), values_.begin() + num_rows * kNumRotators);
+      maxima_.erase(maxima_.begin(), maxima_.begin() + num_rows);
+      first_step_ = step;
+    }
+
+    // One past the last step appended.
+    size_t end_step() const { return first_step_ + maxima_.size(); }
+
+   private:
+    size_t first_step_ = 0;
+    float max_before_ = 0;
+    std::vector<float> values_;
+    std::vector<float> maxima_;
+  };
+
+  static float Distance(double score_sum, size_t num_pairs) {
+    return 1 - std::clamp<float>(score_sum / static_cast<double>(
+                                                 num_pairs * kNumRotators),
+                                 0.0, 1.0);
+  }
+
+  // The Zimtohrli::RescaleFactors of step_a and step_b, or none while one of
+  // the streams has been silent.
+  std::pair<float, float> Scales(size_t step_a, size_t step_b) const {
+    const float max_a = rows_a_.max(step_a);
+    const float max_b = rows_b_.max(step_b);
+    if (max_a == 0 || max_b == 0) {
+      return {1.0f, 1.0f};
+    }
+    return Zimtohrli::RescaleFactors(max_a, max_b);
+  }
+
+  // Adds the rows of the first stream whose band the second stream has
+  // reached to the path.
+  void Align(std::vector<StreamingDistanceReport>& reports) {
+    while (!path_done_ && next_step_a_ < rows_a_.end_step() &&
+           rows_b_.end_step() >= band_.end(next_step_a_)) {
+      const size_t begin_b = std::max<size_t>(1, band_.begin(next_step_a_));
+      const size_t end_b = band_.end(next_step_a_);
+      costs_.resize(end_b - begin_b);
+      for (size_t step_b = begin_b; step_b < end_b; ++step_b) {
+        const auto [scale_a, scale_b] = Scales(next_step_a_, step_b);
+        costs_[step_b - begin_b] = delta_norm(
+            rows_a_[next_step_a_], rows_b_[step_b], scale_a, scale_b);
+      }
+      path_done_ = !path_->AddRow(next_step_a_, costs_.data(), begin_b);
+      ConsumePairs(reports);
+      ++next_step_a_;
+      rows_a_.Discard(std::min(last_pair_.first, next_step_a_));
+      rows_b_.Discard(
+          std::min(last_pair_.second, band_.begin(next_step_a_)));
+    }
+  }
+
+  // Scores the pairs the path advanced through since the last call.
+  void ConsumePairs(std::vector<StreamingDistanceReport>& reports) {
+    std::vector<std::pair<size_t, size_t>>& pairs = path_->path();
+    for (const auto& [step_a, step_b] : pairs) {
+      // The path moves at most one step of a at a time, and all pairs before
+      // step_a are scored.
+      if (step_a == report_end_) {
+        AddReport(report_end_, reports);
+        report_end_ += report_steps_;
+      }
+      const auto [scale_a, scale_b] = Scales(step_a, step_b);
+      const double score_sum = nsim_.Add(rows_a_[step_a].data,
+                                         rows_b_[step_b].data, scale_a,
+                                         scale_b);
+      score_sum_ += score_sum;
+      window_.push_back({step_a, score_sum});
+      last_pair_ = {step_a, step_b};
+    }
+    pairs.clear();
+  }
+
+  // Reports on the pairs of the window_steps steps of the first stream before
+  // end_step, all of which have been scored.
+  void AddReport(size_t end_step,
+                 std::vector<StreamingDistanceReport>& reports) {
+    const size_t begin_step =
+        end_step > window_steps_ ? end_step - window_steps_ : 0;
+    while (window_.front().first < begin_step) {
+      window_.pop_front();
+    }
+    double window_sum = 0.0;
+    size_t num_pairs = 0;
+    for (const auto& [step_a, score_sum] : window_) {
+      if (step_a >= end_step) {
+        break;
+      }
+      window_sum += score_sum;
+      ++num_pairs;
+    }
+    reports.push_back(
+        {begin_step, end_step, Distance(window_sum, num_pairs)});
+  }
+
+  size_t report_steps_;
+  size_t window_steps_;
+  size_t nsim_step_window_;
+  size_t nsim_channel_window_;
+  bool fast_math_;
+  StreamingAnalyzer analyzer_a_;
+  StreamingAnalyzer analyzer_b_;
+  StreamRows rows_a_;
+  StreamRows rows_b_;
+  // steps_b is kUnknownSteps until the second stream is finished.
+  DTWBand band_;
+  std::optional<DTWPath> path_;
+  std::vector<double> costs_;
+  NSIMState<double> nsim_;
+  // The step of the first stream and the score sum of the pairs that the
+  // next reports cover.
+  std::deque<std::pair<size_t, double>> window_;
+  double score_sum_;
+  // The next row of the first stream to add to the path.
+  size_t next_step_a_;
+  std::pair<size_t, size_t> last_pair_;
+  // The end_step of the next report.
+  size_t report_end_;
+  bool path_done_;
+  bool finished_;
 };
 
 }  // namespace